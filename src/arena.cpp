@@ -0,0 +1,58 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+
+namespace file_binder {
+
+Arena::Arena(size_t chunk_size) :
+    chunk_size_(chunk_size), next_(nullptr), end_(nullptr), reserved_(0) {}
+
+Arena::~Arena() {}
+
+void* Arena::Allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(next_) + align - 1) &
+        ~(static_cast<uintptr_t>(align) - 1);
+    if (next_ == nullptr || p + size > reinterpret_cast<uintptr_t>(end_)) {
+        // Oversized requests get a chunk of their own.
+        const size_t chunk = std::max(chunk_size_, size + align - 1);
+        chunks_.emplace_back(new char[chunk]);
+        reserved_ += chunk;
+
+        next_ = chunks_.back().get();
+        end_ = next_ + chunk;
+        p = (reinterpret_cast<uintptr_t>(next_) + align - 1) &
+            ~(static_cast<uintptr_t>(align) - 1);
+    }
+
+    next_ = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+}
+
+const char* Arena::Copy(const char* data, size_t size) {
+    char* p = static_cast<char*>(Allocate(size));
+    memcpy(p, data, size);
+    return p;
+}
+
+}  // namespace file_binder
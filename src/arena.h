@@ -0,0 +1,56 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__ARENA_H__
+#define __FILE_BINDER__ARENA_H__
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace file_binder {
+
+// Arena is a bump allocator for long-lived, immutable data.  Memory is
+// released all at once, when the Arena is destroyed.
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 64 << 10);
+    ~Arena();
+
+    // Returns size bytes aligned to align, which must be a power of 2.
+    void* Allocate(size_t size, size_t align = 1);
+
+    // Copies size bytes of data into the arena.
+    const char* Copy(const char* data, size_t size);
+
+    // Bytes requested from the system for our chunks.
+    size_t MemoryUsage() const { return reserved_; }
+private:
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    const size_t chunk_size_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* next_;
+    char* end_;
+    size_t reserved_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__ARENA_H__
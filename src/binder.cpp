@@ -16,31 +16,464 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/types.h>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "kernel_features.h"
+#include "numa.h"
 #include "scanner.h"
+#include "self_protection.h"
+#include "shard_supervisor.h"
+
+namespace {
+
+file_binder::Scanner* scanner = nullptr;
+
+// The stack touched in advance by --self-protect.
+const size_t kStackReserve = 512 << 10;
+
+void Unthrottle(int) {
+    if (scanner != nullptr) {
+        scanner->throttle()->Unthrottle();
+    }
+}
+
+void ReloadIoLimits(int) {
+    if (scanner != nullptr) {
+        scanner->throttle()->RequestReload();
+    }
+}
+
+void Upgrade(int) {
+    if (scanner != nullptr) {
+        scanner->RequestUpgrade();
+    }
+}
+
+void Stop(int) {
+    if (scanner != nullptr) {
+        scanner->RequestStop();
+    }
+}
+
+// Forces the fallbacks for a comma-separated list of kernel features.  They
+// are passed through the environment to our helpers.
+bool ParseFallbacks(const char* s) {
+    std::string names(s);
+    size_t start = 0;
+    while (start <= names.size()) {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos) {
+            end = names.size();
+        }
+        file_binder::KernelFeature feature;
+        if (!file_binder::ParseKernelFeature(
+                names.substr(start, end - start), &feature)) {
+            return false;
+        }
+        start = end + 1;
+    }
+
+    const char* previous = getenv("FILE_BINDER_FALLBACK");
+    if (previous != nullptr && previous[0] != '\0') {
+        names = std::string(previous) + "," + names;
+    }
+    return setenv("FILE_BINDER_FALLBACK", names.c_str(), 1) == 0;
+}
+
+// Parses a count with an optional K, M or G (binary) suffix.
+bool ParseSize(const char* s, uint64_t* value) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno != 0 || end == s) {
+        return false;
+    }
+
+    static const char kSuffixes[] = "KMG";
+    const char* suffix = *end != '\0' ? strchr(kSuffixes, *end) : nullptr;
+    if (suffix != nullptr) {
+        v <<= 10 * (suffix - kSuffixes + 1);
+        end++;
+    }
+    *value = v;
+    return *end == '\0';
+}
+
+// Parses "idle", "best-effort[:<level>]" or "realtime[:<level>]".
+bool ParseIoPriority(const char* s, file_binder::IoPriority* priority) {
+    using file_binder::IoClass;
+
+    const char* colon = strchr(s, ':');
+    const std::string name(s, colon != nullptr ? colon - s : strlen(s));
+    if (name == "idle") {
+        priority->io_class = IoClass::kIdle;
+    } else if (name == "best-effort") {
+        priority->io_class = IoClass::kBestEffort;
+    } else if (name == "realtime") {
+        priority->io_class = IoClass::kRealtime;
+    } else {
+        return false;
+    }
+
+    priority->level = colon != nullptr ? atoi(colon + 1) : 7;
+    return priority->level >= 0 && priority->level <= 7;
+}
+
+}  // namespace
 
 int main(int argc, char **argv) {
-    if (argc <= 1) {
+    // Helpers holding a shard of our locks are started with this, see
+    // ShardSupervisor.
+    static const char kShardHelper[] = "--shard-helper=";
+    if (argc == 2 &&
+            strncmp(argv[1], kShardHelper, sizeof(kShardHelper) - 1) == 0) {
+        return file_binder::RunShardHelper(
+            atoi(argv[1] + sizeof(kShardHelper) - 1));
+    }
+
+    static const char kWarm[] = "--warm=";
+    static const char kRuntimeModules[] = "--runtime-modules";
+    static const char kIoRate[] = "--io-rate=";
+    static const char kDeviceIoRate[] = "--device-io-rate=";
+    static const char kOpenRate[] = "--open-rate=";
+    static const char kIoLimits[] = "--io-limits=";
+    static const char kIoPriority[] = "--ioprio=";
+    static const char kTrace[] = "--trace=";
+    static const char kHandoff[] = "--handoff=";
+    static const char kNuma[] = "--numa=";
+    static const char kGroup[] = "--group=";
+    static const char kPriority[] = "--priority=";
+    static const char kIoDeadline[] = "--io-deadline=";
+    static const char kQuarantineAfter[] = "--quarantine-after=";
+    static const char kFallback[] = "--fallback=";
+    static const char kCounters[] = "--counters";
+    static const char kShadow[] = "--shadow=";
+    static const char kShadowBind[] = "--shadow-bind";
+    static const char kWarmMetadata[] = "--warm-metadata";
+    static const char kSelfProtect[] = "--self-protect";
+
+    std::vector<std::string> paths;
+    std::vector<std::string> warm_paths;
+    bool runtime_modules = false;
+    file_binder::IoThrottle::Limits limits;
+    std::string io_limits;
+    file_binder::IoPriority priority = {file_binder::IoClass::kNone, 0};
+    std::string trace;
+    bool counters = false;
+    std::vector<std::pair<std::string, std::string>> shadows;
+    bool shadow_bind = false;
+    bool warm_metadata = false;
+    bool self_protect = false;
+    uint64_t heap_reserve = 64 << 20;
+    int handoff_fd = -1;
+    pid_t holder = -1;
+    std::vector<std::string> upgrade_args;
+    std::vector<std::pair<std::string, file_binder::NumaPolicy>> numa;
+    // Named pinned groups, in the order they were first given.
+    std::vector<std::pair<std::string, std::vector<std::string>>> groups;
+    std::vector<std::pair<std::string, int>> priorities;
+    uint64_t io_deadline_ms = 10000;
+    uint64_t quarantine_after = 3;
+    bool valid = true;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], kHandoff, sizeof(kHandoff) - 1) == 0) {
+            // Passed by the previous binary on a live upgrade.
+            valid &= sscanf(argv[i] + sizeof(kHandoff) - 1, "%d,%d",
+                &handoff_fd, &holder) == 2;
+            continue;
+        }
+        upgrade_args.emplace_back(argv[i]);
+
+        if (strcmp(argv[i], kRuntimeModules) == 0) {
+            runtime_modules = true;
+        } else if (strcmp(argv[i], kCounters) == 0) {
+            counters = true;
+        } else if (strcmp(argv[i], kShadowBind) == 0) {
+            shadow_bind = true;
+        } else if (strcmp(argv[i], kWarmMetadata) == 0) {
+            warm_metadata = true;
+        } else if (strcmp(argv[i], kSelfProtect) == 0) {
+            self_protect = true;
+        } else if (strncmp(argv[i], kSelfProtect,
+                sizeof(kSelfProtect) - 1) == 0 &&
+                argv[i][sizeof(kSelfProtect) - 1] == '=') {
+            self_protect = true;
+            valid &= ParseSize(argv[i] + sizeof(kSelfProtect), &heap_reserve);
+        } else if (strncmp(argv[i], kShadow, sizeof(kShadow) - 1) == 0) {
+            // <group>=<directory>
+            const char* spec = argv[i] + sizeof(kShadow) - 1;
+            const char* equals = strchr(spec, '=');
+            if (equals == nullptr || equals == spec || equals[1] == '\0') {
+                valid = false;
+            } else {
+                shadows.emplace_back(std::string(spec, equals), equals + 1);
+            }
+        } else if (strncmp(argv[i], kIoRate, sizeof(kIoRate) - 1) == 0) {
+            valid &= ParseSize(argv[i] + sizeof(kIoRate) - 1, &limits.bytes);
+        } else if (strncmp(argv[i], kDeviceIoRate,
+                sizeof(kDeviceIoRate) - 1) == 0) {
+            valid &= ParseSize(argv[i] + sizeof(kDeviceIoRate) - 1,
+                &limits.device_bytes);
+        } else if (strncmp(argv[i], kOpenRate, sizeof(kOpenRate) - 1) == 0) {
+            valid &= ParseSize(argv[i] + sizeof(kOpenRate) - 1, &limits.files);
+        } else if (strncmp(argv[i], kIoLimits, sizeof(kIoLimits) - 1) == 0) {
+            io_limits = argv[i] + sizeof(kIoLimits) - 1;
+            valid &= !io_limits.empty();
+        } else if (strncmp(argv[i], kIoPriority,
+                sizeof(kIoPriority) - 1) == 0) {
+            valid &= ParseIoPriority(argv[i] + sizeof(kIoPriority) - 1,
+                &priority);
+        } else if (strncmp(argv[i], kNuma, sizeof(kNuma) - 1) == 0) {
+            // <group>=<policy>
+            const char* spec = argv[i] + sizeof(kNuma) - 1;
+            const char* equals = strchr(spec, '=');
+            file_binder::NumaPolicy policy;
+            if (equals == nullptr ||
+                    !file_binder::ParseNumaPolicy(equals + 1, &policy)) {
+                valid = false;
+            } else {
+                numa.emplace_back(std::string(spec, equals), policy);
+            }
+        } else if (strncmp(argv[i], kGroup, sizeof(kGroup) - 1) == 0) {
+            // <group>=<path>
+            const char* spec = argv[i] + sizeof(kGroup) - 1;
+            const char* equals = strchr(spec, '=');
+            if (equals == nullptr || equals == spec || equals[1] == '\0') {
+                valid = false;
+                continue;
+            }
+            const std::string name(spec, equals);
+            if (name == "default" || name == "warm" ||
+                    name == "runtime-modules") {
+                valid = false;
+                continue;
+            }
+            auto it = std::find_if(groups.begin(), groups.end(),
+                [&name](const std::pair<std::string,
+                        std::vector<std::string>>& group) {
+                    return group.first == name;
+                });
+            if (it == groups.end()) {
+                groups.emplace_back(name, std::vector<std::string>());
+                it = groups.end() - 1;
+            }
+            it->second.emplace_back(equals + 1);
+        } else if (strncmp(argv[i], kPriority, sizeof(kPriority) - 1) == 0) {
+            // <group>=<priority>
+            const char* spec = argv[i] + sizeof(kPriority) - 1;
+            const char* equals = strchr(spec, '=');
+            char* end = nullptr;
+            long priority = 0;
+            if (equals != nullptr) {
+                priority = strtol(equals + 1, &end, 10);
+            }
+            if (equals == nullptr || end == equals + 1 || *end != '\0') {
+                valid = false;
+            } else {
+                priorities.emplace_back(std::string(spec, equals),
+                    static_cast<int>(priority));
+            }
+        } else if (strncmp(argv[i], kIoDeadline,
+                sizeof(kIoDeadline) - 1) == 0) {
+            valid &= ParseSize(argv[i] + sizeof(kIoDeadline) - 1,
+                &io_deadline_ms);
+        } else if (strncmp(argv[i], kQuarantineAfter,
+                sizeof(kQuarantineAfter) - 1) == 0) {
+            valid &= ParseSize(argv[i] + sizeof(kQuarantineAfter) - 1,
+                &quarantine_after);
+        } else if (strncmp(argv[i], kFallback, sizeof(kFallback) - 1) == 0) {
+            valid &= ParseFallbacks(argv[i] + sizeof(kFallback) - 1);
+        } else if (strncmp(argv[i], kTrace, sizeof(kTrace) - 1) == 0) {
+            trace = argv[i] + sizeof(kTrace) - 1;
+        } else if (strncmp(argv[i], kWarm, sizeof(kWarm) - 1) == 0) {
+            warm_paths.emplace_back(argv[i] + sizeof(kWarm) - 1);
+        } else {
+            paths.emplace_back(argv[i]);
+        }
+    }
+
+    if (!valid || (paths.empty() && groups.empty() && warm_paths.empty() &&
+            !runtime_modules)) {
         fprintf(stderr,
-            "Usage: %s <path-to-lock> [<path-to-lock> ...]\n\n"
-            "%s scans the paths specified for files to lock into memory.\n",
-            argv[0], argv[0]);
+            "Usage: %s [--runtime-modules] [--warm=<path>] "
+            "[--io-rate=<bytes>] [--device-io-rate=<bytes>]\n"
+            "    [--open-rate=<files>] [--io-limits=<file>] "
+            "[--ioprio=<class>[:<level>]]\n"
+            "    [--trace=<file>] [--counters] [--numa=<group>=<policy>]\n"
+            "    [--io-deadline=<ms>] [--quarantine-after=<count>]\n"
+            "    [--group=<group>=<path>] [--priority=<group>=<priority>]\n"
+            "    [--fallback=<feature>[,<feature>...]]\n"
+            "    [--shadow=<group>=<directory>] [--shadow-bind] "
+            "[--warm-metadata]\n"
+            "    [--self-protect[=<bytes>]]\n"
+            "    <path-to-lock> [<path-to-lock> ...]\n\n"
+            "%s scans the paths specified for files to lock into memory.\n"
+            "Paths passed with --warm are only prefetched and locked while\n"
+            "the system is under memory or I/O pressure.\n"
+            "--runtime-modules additionally locks the NSS, PAM and gconv\n"
+            "modules loaded at runtime according to the system's\n"
+            "configuration.\n\n"
+            "The initial scan may be limited to --io-rate bytes per second\n"
+            "(--device-io-rate per device) and --open-rate files per\n"
+            "second (K, M and G suffixes are accepted), and run at the\n"
+            "given --ioprio class (idle, best-effort or realtime).  Both\n"
+            "are lifted once the pinned paths are locked, or on SIGUSR1.\n"
+            "--io-limits reads the limits from a file of io-rate=,\n"
+            "device-io-rate= and open-rate= lines instead, and rereads it\n"
+            "on SIGHUP, re-arming the limits for any scan in progress or\n"
+            "to come.\n\n"
+            "--trace writes a Chrome trace of each stage of the scan to\n"
+            "the given file, for viewing with Perfetto.  --counters\n"
+            "reports the faults, context switches, CPU time and bytes\n"
+            "read of each stage, by group and for the files reading the\n"
+            "most.\n\n"
+            "--numa places the page cache of a group (default, warm,\n"
+            "runtime-modules or a --group) with a policy of\n"
+            "interleave[:<nodes>], bind:<nodes> or cpu:<nodes>, the last\n"
+            "populating from the CPUs of nodes.\n\n"
+            "--group adds a path to a named pinned group.  Pinned groups\n"
+            "are locked in order of --priority (0 by default, highest\n"
+            "first), each priority's files and their dependencies becoming\n"
+            "resident before the next is read.  Readiness is reported for\n"
+            "each priority, and to systemd with sd_notify.\n\n"
+            "Reading a file is given up on after --io-deadline ms (10000),\n"
+            "plus a second per MB, and its device is skipped once\n"
+            "--quarantine-after reads from it (3, 0 for never) have\n"
+            "timed out.\n\n"
+            "--fallback forces the fallback for kernel features which\n"
+            "would otherwise be used (statx, cachestat, populate-read),\n"
+            "for testing.\n\n"
+            "--shadow keeps copies of a group's locked files in a tmpfs\n"
+            "at directory (mounting one there if needed), mirroring their\n"
+            "paths, with a rescue.env setting PATH and LD_LIBRARY_PATH to\n"
+            "them.  --shadow-bind bind mounts the copies over the\n"
+            "originals, which cannot then be replaced until %s exits.\n\n"
+            "--warm-metadata periodically lists the directories and\n"
+            "looks up the path components leading to locked files, more\n"
+            "often under memory pressure, so that they stay cached.\n\n"
+            "--self-protect locks %s's own memory, reserving a heap of\n"
+            "the given size (64M) and touching its stack in advance, so it\n"
+            "does not fault or wait on the disk once running.\n\n"
+            "On SIGUSR2, %s re-executes its binary, as replaced on disk,\n"
+            "handing its locks over without releasing them.\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    // The default group, each --group, warm and runtime-modules.
+    const size_t group_count = 1 + groups.size() + !warm_paths.empty() +
+        runtime_modules;
+    if (group_count > file_binder::Scanner::kMaxGroups) {
+        fprintf(stderr, "Too many groups:  %zu given, at most %zu "
+            "(including default, warm and runtime-modules) are supported.\n",
+            group_count, file_binder::Scanner::kMaxGroups);
         return 1;
     }
 
     // TODO:  Support daemonization.
 
-    std::vector<std::string> paths;
-    for (int i = 1; i < argc; i++) {
-        paths.emplace_back(argv[i]);
+    if (self_protect) {
+        // Before any threads are started.
+        std::string error;
+        if (!file_binder::ProtectSelf({static_cast<size_t>(heap_reserve),
+                kStackReserve}, &error)) {
+            fprintf(stderr, "Unable to protect ourselves:  %s\n",
+                error.c_str());
+            return 1;
+        }
     }
 
     file_binder::Scanner s;
     s.SetPaths(std::move(paths));
+    for (auto& group : groups) {
+        s.AddGroup(group.first, file_binder::Scanner::Mode::kPinned,
+            std::move(group.second));
+    }
+    if (!warm_paths.empty()) {
+        s.AddGroup("warm", file_binder::Scanner::Mode::kWarm,
+            std::move(warm_paths));
+    }
+    if (runtime_modules) {
+        s.EnableRuntimeModules();
+    }
+    for (const auto& group : numa) {
+        if (!s.SetNumaPolicy(group.first, group.second)) {
+            fprintf(stderr, "Unknown group for --numa: %s\n",
+                group.first.c_str());
+            return 1;
+        }
+    }
+    for (const auto& group : priorities) {
+        if (!s.SetPriority(group.first, group.second)) {
+            fprintf(stderr, "Unknown group for --priority: %s\n",
+                group.first.c_str());
+            return 1;
+        }
+    }
+    if (!io_limits.empty()) {
+        std::string error;
+        if (!file_binder::ReadIoLimits(io_limits, &limits, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        s.SetIoLimitsFile(io_limits);
+    }
+    s.SetIoPolicy(limits, priority);
+    s.SetDeadlines(std::chrono::milliseconds(io_deadline_ms),
+        quarantine_after);
+    if (!trace.empty()) {
+        s.SetTraceOutput(std::move(trace));
+    }
+    if (counters) {
+        s.EnableResourceCounters();
+    }
+    if (warm_metadata) {
+        s.EnableMetadataWarming();
+    }
+    for (const auto& shadow : shadows) {
+        std::string error;
+        if (!s.SetShadow(shadow.first, shadow.second, shadow_bind, &error)) {
+            fprintf(stderr, "Unable to shadow group %s:  %s\n",
+                shadow.first.c_str(), error.c_str());
+            return 1;
+        }
+    }
+
+    s.SetUpgradeArguments(std::move(upgrade_args));
+    if (handoff_fd >= 0) {
+        s.SetHandoff(handoff_fd, holder);
+    }
+
+    scanner = &s;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Unthrottle;
+    sigaction(SIGUSR1, &action, nullptr);
+    action.sa_handler = Upgrade;
+    sigaction(SIGUSR2, &action, nullptr);
+    if (!io_limits.empty()) {
+        action.sa_handler = ReloadIoLimits;
+        sigaction(SIGHUP, &action, nullptr);
+    }
+    if (shadow_bind) {
+        // Our bind mounts would outlive us, so exit cleanly.
+        action.sa_handler = Stop;
+        sigaction(SIGTERM, &action, nullptr);
+        sigaction(SIGINT, &action, nullptr);
+    }
+
     s.Run();
 
     return 0;
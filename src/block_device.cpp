@@ -0,0 +1,145 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "block_device.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+// Files read at once from disks whose attributes are unknown.
+const size_t kDefaultDepth = 4;
+// The most files read at once from any one disk.
+const size_t kMaxDepth = 16;
+// Bounds the device-mapper stacks followed to their disk.
+const int kMaxStacking = 8;
+
+// Returns the first line of path, or an empty string.
+std::string ReadLine(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+uint32_t ReadNumber(const std::string& path) {
+    return static_cast<uint32_t>(
+        strtoul(ReadLine(path).c_str(), nullptr, 10));
+}
+
+std::string RealPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == nullptr) {
+        return std::string();
+    }
+    return resolved;
+}
+
+// Returns the entries of the directory at path.
+std::vector<std::string> List(const std::string& path) {
+    std::vector<std::string> entries;
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return entries;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            entries.push_back(name);
+        }
+    }
+    closedir(dir);
+    return entries;
+}
+
+bool Exists(const std::string& path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+}  // namespace
+
+BlockDevice DescribeBlockDevice(dev_t device, const std::string& sysfs) {
+    BlockDevice block;
+    block.disk = device;
+    block.rotational = false;
+    block.nr_requests = 0;
+    block.hw_queues = 0;
+    block.depth = kDefaultDepth;
+
+    char node[32];
+    snprintf(node, sizeof(node), "/dev/block/%u:%u",
+        major(device), minor(device));
+    std::string path = RealPath(sysfs + node);
+    for (int i = 0; !path.empty() && i < kMaxStacking; i++) {
+        // Partitions share the queue of the disk holding them.
+        if (Exists(path + "/partition")) {
+            path = path.substr(0, path.rfind('/'));
+        }
+
+        // Follow a device-mapper target to its disk, as long as there is
+        // only one.
+        const std::vector<std::string> slaves = List(path + "/slaves");
+        if (slaves.size() != 1) {
+            break;
+        }
+        path = RealPath(path + "/slaves/" + slaves[0]);
+    }
+    if (path.empty() || !Exists(path + "/queue")) {
+        return block;
+    }
+
+    unsigned disk_major, disk_minor;
+    if (sscanf(ReadLine(path + "/dev").c_str(), "%u:%u",
+            &disk_major, &disk_minor) == 2) {
+        block.disk = makedev(disk_major, disk_minor);
+    }
+    block.name = path.substr(path.rfind('/') + 1);
+    block.rotational = ReadNumber(path + "/queue/rotational") != 0;
+    block.nr_requests = ReadNumber(path + "/queue/nr_requests");
+    block.hw_queues = static_cast<uint32_t>(List(path + "/mq").size());
+    block.depth = QueueDepth(
+        block.rotational, block.nr_requests, block.hw_queues);
+    return block;
+}
+
+size_t QueueDepth(bool rotational, uint32_t nr_requests, uint32_t hw_queues) {
+    if (rotational) {
+        // Concurrent files would have the head seek between them.
+        return 1;
+    }
+
+    size_t depth = hw_queues > 0 ? 4 * hw_queues : kDefaultDepth;
+    if (nr_requests > 0) {
+        // Leave most of the queue to everyone else.
+        depth = std::min<size_t>(depth, nr_requests / 4);
+    }
+    return std::max<size_t>(2, std::min(depth, kMaxDepth));
+}
+
+}  // namespace file_binder
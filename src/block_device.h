@@ -0,0 +1,60 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__BLOCK_DEVICE_H__
+#define __FILE_BINDER__BLOCK_DEVICE_H__
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace file_binder {
+
+// The block device backing a filesystem, as described by /sys/dev/block.
+struct BlockDevice {
+    // The whole disk, which the device's partitions, and device-mapper
+    // targets stacked on a single disk, share.  Devices with no block device
+    // behind them (tmpfs, overlayfs, ...) are their own disk.
+    dev_t disk;
+    // The disk's name, e.g. "sda", or empty if it is unknown.
+    std::string name;
+    bool rotational;
+    // The depth of the disk's request queue, and its number of hardware
+    // (blk-mq) queues, or 0 if unknown.
+    uint32_t nr_requests;
+    uint32_t hw_queues;
+    // The number of files to read from the disk at once.
+    size_t depth;
+};
+
+// Describes the block device behind device (a st_dev), from the sysfs
+// mounted at sysfs.
+BlockDevice DescribeBlockDevice(
+    dev_t device, const std::string& sysfs = "/sys");
+
+// Returns the number of files to read at once from a disk with the given
+// queue attributes.  Rotational disks are read one file at a time, in
+// physical order, while solid state disks are kept busy in proportion to
+// their hardware queues.
+size_t QueueDepth(bool rotational, uint32_t nr_requests, uint32_t hw_queues);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__BLOCK_DEVICE_H__
@@ -0,0 +1,141 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "block_device.h"
+#include "temp_tree.h"
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <string>
+
+namespace file_binder {
+namespace {
+
+// Builds a fake sysfs, with a rotational disk with a partition, an NVMe disk
+// with a partition, and a device-mapper target on the latter.
+class BlockDeviceTest : public ::testing::Test {
+protected:
+    BlockDeviceTest() : tree_("block_device_test"), root_(tree_.root()) {}
+
+    void SetUp() override {
+        ASSERT_FALSE(root_.empty());
+
+        Directory("/dev");
+        Directory("/dev/block");
+        Directory("/devices");
+
+        Disk("sda", "8:0", true, 64, 1);
+        Directory("/devices/sda/sda1");
+        File("/devices/sda/sda1/partition", "1");
+        File("/devices/sda/sda1/dev", "8:1");
+        Link("/dev/block/8:1", "../../devices/sda/sda1");
+
+        Disk("nvme0n1", "259:0", false, 1023, 8);
+        Directory("/devices/nvme0n1/nvme0n1p2");
+        File("/devices/nvme0n1/nvme0n1p2/partition", "2");
+        Link("/dev/block/259:2", "../../devices/nvme0n1/nvme0n1p2");
+
+        Disk("dm-0", "253:0", false, 128, 0);
+        Directory("/devices/dm-0/slaves");
+        Link("/devices/dm-0/slaves/nvme0n1p2",
+            "../../nvme0n1/nvme0n1p2");
+    }
+
+    void Directory(const std::string& path) {
+        ASSERT_EQ(0, mkdir((root_ + path).c_str(), 0755));
+    }
+
+    void File(const std::string& path, const std::string& contents) {
+        ASSERT_TRUE(WriteFile(root_ + path, contents + "\n"));
+    }
+
+    void Link(const std::string& path, const std::string& target) {
+        ASSERT_EQ(0, symlink(target.c_str(), (root_ + path).c_str()));
+    }
+
+    void Disk(const std::string& name, const std::string& dev,
+            bool rotational, int nr_requests, int hw_queues) {
+        const std::string disk = "/devices/" + name;
+        Directory(disk);
+        File(disk + "/dev", dev);
+        Directory(disk + "/queue");
+        File(disk + "/queue/rotational", rotational ? "1" : "0");
+        File(disk + "/queue/nr_requests", std::to_string(nr_requests));
+        if (hw_queues > 0) {
+            Directory(disk + "/mq");
+            for (int i = 0; i < hw_queues; i++) {
+                Directory(disk + "/mq/" + std::to_string(i));
+            }
+        }
+        Link("/dev/block/" + dev, "../.." + disk);
+    }
+
+    TempTree tree_;
+    const std::string root_;
+};
+
+TEST_F(BlockDeviceTest, Partition) {
+    const BlockDevice block = DescribeBlockDevice(makedev(8, 1), root_);
+    EXPECT_EQ(makedev(8, 0), block.disk);
+    EXPECT_EQ("sda", block.name);
+    EXPECT_TRUE(block.rotational);
+    EXPECT_EQ(64, block.nr_requests);
+    EXPECT_EQ(1, block.hw_queues);
+    EXPECT_EQ(1, block.depth);
+}
+
+TEST_F(BlockDeviceTest, WholeDisk) {
+    const BlockDevice block = DescribeBlockDevice(makedev(259, 0), root_);
+    EXPECT_EQ(makedev(259, 0), block.disk);
+    EXPECT_EQ("nvme0n1", block.name);
+    EXPECT_FALSE(block.rotational);
+    EXPECT_EQ(8, block.hw_queues);
+    EXPECT_EQ(16, block.depth);
+}
+
+TEST_F(BlockDeviceTest, DeviceMapper) {
+    // The target shares the queue of the disk beneath it.
+    const BlockDevice block = DescribeBlockDevice(makedev(253, 0), root_);
+    EXPECT_EQ(makedev(259, 0), block.disk);
+    EXPECT_EQ("nvme0n1", block.name);
+    EXPECT_EQ(16, block.depth);
+}
+
+TEST_F(BlockDeviceTest, NoBlockDevice) {
+    // e.g. tmpfs.
+    const BlockDevice block = DescribeBlockDevice(makedev(0, 42), root_);
+    EXPECT_EQ(makedev(0, 42), block.disk);
+    EXPECT_TRUE(block.name.empty());
+    EXPECT_FALSE(block.rotational);
+    EXPECT_EQ(4, block.depth);
+}
+
+TEST(QueueDepth, ScalesWithQueues) {
+    EXPECT_EQ(1, QueueDepth(true, 128, 1));
+    EXPECT_EQ(4, QueueDepth(false, 64, 1));
+    EXPECT_EQ(16, QueueDepth(false, 1023, 32));
+    // Shallow queues are left room.
+    EXPECT_EQ(2, QueueDepth(false, 4, 1));
+    EXPECT_EQ(4, QueueDepth(false, 0, 0));
+}
+
+}  // namespace
+}  // namespace file_binder
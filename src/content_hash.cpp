@@ -0,0 +1,170 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "content_hash.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace file_binder {
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+// ContentHashFile reads this much at a time.
+const size_t kReadSize = 1 << 17;
+
+inline uint64_t Rotate(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// Unaligned, little-endian loads.
+inline uint64_t Load64(const unsigned char* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint32_t Load32(const unsigned char* p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = Rotate(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t Merge(uint64_t acc, uint64_t lane) {
+    acc ^= Round(0, lane);
+    return acc * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+uint64_t ContentHash(const void* data, size_t size) {
+    ContentHasher hasher;
+    hasher.Update(data, size);
+    return hasher.Digest();
+}
+
+ContentHasher::ContentHasher() :
+    v1_(kPrime1 + kPrime2), v2_(kPrime2), v3_(0), v4_(-kPrime1), total_(0),
+    buffered_(0) {}
+
+void ContentHasher::Update(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    total_ += size;
+
+    if (buffered_ > 0) {
+        const size_t fill = std::min(sizeof(buffer_) - buffered_, size);
+        memcpy(buffer_ + buffered_, p, fill);
+        buffered_ += fill;
+        p += fill;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        v1_ = Round(v1_, Load64(buffer_));
+        v2_ = Round(v2_, Load64(buffer_ + 8));
+        v3_ = Round(v3_, Load64(buffer_ + 16));
+        v4_ = Round(v4_, Load64(buffer_ + 24));
+        buffered_ = 0;
+    }
+
+    for (; end - p >= 32; p += 32) {
+        v1_ = Round(v1_, Load64(p));
+        v2_ = Round(v2_, Load64(p + 8));
+        v3_ = Round(v3_, Load64(p + 16));
+        v4_ = Round(v4_, Load64(p + 24));
+    }
+
+    memcpy(buffer_, p, end - p);
+    buffered_ = end - p;
+}
+
+uint64_t ContentHasher::Digest() const {
+    uint64_t hash;
+    if (total_ >= 32) {
+        hash = Rotate(v1_, 1) + Rotate(v2_, 7) + Rotate(v3_, 12) +
+            Rotate(v4_, 18);
+        hash = Merge(hash, v1_);
+        hash = Merge(hash, v2_);
+        hash = Merge(hash, v3_);
+        hash = Merge(hash, v4_);
+    } else {
+        hash = kPrime5;
+    }
+    hash += total_;
+
+    const unsigned char* p = buffer_;
+    const unsigned char* const end = p + buffered_;
+    for (; p + 8 <= end; p += 8) {
+        hash ^= Round(0, Load64(p));
+        hash = Rotate(hash, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        hash ^= static_cast<uint64_t>(Load32(p)) * kPrime1;
+        hash = Rotate(hash, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= (*p) * kPrime5;
+        hash = Rotate(hash, 11) * kPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+bool ContentHashFile(int fd, uint64_t size, uint64_t* hash) {
+    std::unique_ptr<unsigned char[]> buf(new unsigned char[kReadSize]);
+    ContentHasher hasher;
+    uint64_t offset = 0;
+    while (offset < size) {
+        const size_t want =
+            static_cast<size_t>(std::min<uint64_t>(size - offset, kReadSize));
+        const ssize_t ret = pread(fd, buf.get(), want,
+            static_cast<off_t>(offset));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return false;
+        }
+        hasher.Update(buf.get(), static_cast<size_t>(ret));
+        offset += static_cast<uint64_t>(ret);
+    }
+    *hash = hasher.Digest();
+    return true;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,56 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__CONTENT_HASH_H__
+#define __FILE_BINDER__CONTENT_HASH_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace file_binder {
+
+// Returns the XXH64 hash (seed 0) of size bytes at data.  Its four
+// independent lanes hash resident memory at several GB/s, so files can be
+// hashed as they are locked.
+uint64_t ContentHash(const void* data, size_t size);
+
+// Computes ContentHash over data supplied in pieces.
+class ContentHasher {
+public:
+    ContentHasher();
+
+    void Update(const void* data, size_t size);
+
+    // Returns the hash of everything passed to Update.
+    uint64_t Digest() const;
+private:
+    uint64_t v1_, v2_, v3_, v4_;
+    uint64_t total_;
+    // Input not yet consumed as a whole 32 byte stripe.
+    unsigned char buffer_[32];
+    size_t buffered_;
+};
+
+// Hashes the first size bytes of the file at fd with pread, rather than
+// through a mapping, so a file truncated meanwhile fails rather than raising
+// SIGBUS.  It returns false if fewer than size bytes could be read.
+bool ContentHashFile(int fd, uint64_t size, uint64_t* hash);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__CONTENT_HASH_H__
@@ -0,0 +1,97 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "content_hash.h"
+#include "temp_tree.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+uint64_t Hash(const std::string& s) {
+    return ContentHash(s.data(), s.size());
+}
+
+TEST(ContentHash, KnownValues) {
+    EXPECT_EQ(0xEF46DB3751D8E999ULL, Hash(""));
+    EXPECT_EQ(0x44BC2CF5AD770999ULL, Hash("abc"));
+    EXPECT_EQ(0xFBCEA83C8A378BF1ULL,
+        Hash("Nobody inspects the spammish repetition"));
+}
+
+TEST(ContentHash, Unaligned) {
+    std::vector<char> buf(4096 + 1);
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = static_cast<char>(i * 131);
+    }
+    const std::string aligned(buf.data() + 1, buf.size() - 1);
+    EXPECT_EQ(Hash(aligned), ContentHash(buf.data() + 1, buf.size() - 1));
+
+    // Every tail length takes a different path through the final rounds.
+    for (size_t size = 0; size < 64; size++) {
+        std::string changed = aligned.substr(0, size + 1);
+        changed[size] ^= 1;
+        EXPECT_NE(Hash(aligned.substr(0, size + 1)), Hash(changed)) << size;
+    }
+}
+
+TEST(ContentHash, Pieces) {
+    std::string data(1000, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>(i * 131);
+    }
+
+    // Pieces which straddle, fill and skip over the 32 byte stripes.
+    for (size_t piece : {1, 7, 31, 32, 33, 100, 999}) {
+        ContentHasher hasher;
+        for (size_t offset = 0; offset < data.size(); offset += piece) {
+            hasher.Update(data.data() + offset,
+                std::min(piece, data.size() - offset));
+        }
+        EXPECT_EQ(Hash(data), hasher.Digest()) << piece;
+    }
+    EXPECT_EQ(Hash(""), ContentHasher().Digest());
+}
+
+TEST(ContentHash, File) {
+    TempTree tree("content_hash_test");
+    ASSERT_FALSE(tree.root().empty());
+    const std::string data(300000, 'x');
+    ASSERT_TRUE(tree.Write("file", data));
+
+    const int fd = open(tree.Path("file").c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    uint64_t hash = 0;
+    EXPECT_TRUE(ContentHashFile(fd, data.size(), &hash));
+    EXPECT_EQ(Hash(data), hash);
+
+    // A file truncated from under us fails rather than faulting.
+    ASSERT_EQ(0, truncate(tree.Path("file").c_str(), 1000));
+    EXPECT_FALSE(ContentHashFile(fd, data.size(), &hash));
+    close(fd);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,432 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "deadline_executor.h"
+
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "io_throttle.h"
+#include "kernel_features.h"
+#include "numa.h"
+
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
+
+namespace file_binder {
+namespace {
+
+// From linux/mman.h, which older headers lack.
+struct CachestatRange {
+    uint64_t off;
+    uint64_t len;
+};
+
+struct Cachestat {
+    uint64_t nr_cache;
+    uint64_t nr_dirty;
+    uint64_t nr_writeback;
+    uint64_t nr_evicted;
+    uint64_t nr_recently_evicted;
+};
+
+// Checks residency with mincore, a window at a time.  Mapping the file
+// does not touch the disk.
+bool IsCachedByMincore(int fd, uint64_t offset, uint64_t length) {
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t kWindow = 64 << 20;
+
+    uint64_t start = offset / page * page;
+    const uint64_t end = offset + length;
+    std::vector<unsigned char> residency;
+    while (start < end) {
+        const size_t size = static_cast<size_t>(
+            std::min(end - start, kWindow));
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd,
+            static_cast<off_t>(start));
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+
+        residency.resize((size + page - 1) / page);
+        const bool ok = mincore(addr, size, residency.data()) == 0;
+        munmap(addr, size);
+        if (!ok) {
+            return false;
+        }
+        for (unsigned char resident : residency) {
+            if ((resident & 1) == 0) {
+                return false;
+            }
+        }
+        start += size;
+    }
+    return true;
+}
+
+// The per-thread state which governs how a task's reads are scheduled and
+// where the pages it brings in are placed.
+struct Context {
+    IoPriority priority;
+    ThreadPlacement placement;
+
+    static Context Current() {
+        return {GetIoPriority(), GetThreadPlacement()};
+    }
+
+    bool operator!=(const Context& rhs) const {
+        return priority.io_class != rhs.priority.io_class ||
+            priority.level != rhs.priority.level ||
+            placement != rhs.placement;
+    }
+};
+
+}  // namespace
+
+struct DeadlineExecutor::Worker {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::function<void()> task;
+    // The caller's context, which the task runs under.
+    Context context;
+    // A task has been handed over but not yet picked up.
+    bool pending = false;
+    // The last task handed over has completed.
+    bool done = false;
+    // The worker should exit once idle.
+    bool stop = false;
+};
+
+struct DeadlineExecutor::Queues {
+    enum class State {
+        kQueued,
+        kRunning,
+        kDone,
+        // The task missed its deadline, and its worker with it.
+        kAbandoned,
+    };
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<Task> tasks;
+    std::vector<State> states;
+    std::vector<Clock::time_point> deadlines;
+    // Tasks yet to start, by queue.
+    std::unordered_map<dev_t, std::deque<size_t>> pending;
+    // Running tasks, by deadline.
+    std::set<std::pair<Clock::time_point, size_t>> running;
+    // Workers by queue, not counting abandoned ones.
+    std::unordered_map<dev_t, size_t> workers;
+    // Tasks which are queued or running.
+    size_t remaining = 0;
+};
+
+DeadlineExecutor::DeadlineExecutor(size_t quarantine_after) :
+    quarantine_after_(quarantine_after), timeouts_(0) {}
+
+DeadlineExecutor::~DeadlineExecutor() {
+    if (worker_) {
+        std::lock_guard<std::mutex> lock(worker_->mu);
+        worker_->stop = true;
+        worker_->cv.notify_all();
+    }
+}
+
+DeadlineExecutor::Status DeadlineExecutor::Run(
+        dev_t device, Clock::duration timeout, std::function<void()> task) {
+    if (IsQuarantined(device)) {
+        return Status::kQuarantined;
+    }
+    if (!worker_ && !Start()) {
+        // Without a worker, the best we can do is run task ourselves.
+        task();
+        return Status::kOk;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(worker_->mu);
+        worker_->task = std::move(task);
+        worker_->context = Context::Current();
+        worker_->pending = true;
+        worker_->done = false;
+        worker_->cv.notify_all();
+
+        Worker* worker = worker_.get();
+        if (worker_->cv.wait_for(lock, timeout,
+                [worker] { return worker->done; })) {
+            return Status::kOk;
+        }
+
+        // The worker exits if it ever finishes the task.
+        worker_->stop = true;
+    }
+    worker_.reset();
+
+    TimedOut(device);
+    return Status::kTimedOut;
+}
+
+std::vector<DeadlineExecutor::Status> DeadlineExecutor::RunQueues(
+        std::vector<Task> tasks, const std::function<size_t(dev_t)>& depth) {
+    typedef Queues::State State;
+
+    std::vector<Status> statuses(tasks.size(), Status::kOk);
+    std::shared_ptr<Queues> queues(new Queues());
+    std::vector<dev_t> order;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (IsQuarantined(tasks[i].device)) {
+            statuses[i] = Status::kQuarantined;
+            continue;
+        }
+        auto& pending = queues->pending[tasks[i].queue];
+        if (pending.empty()) {
+            order.push_back(tasks[i].queue);
+        }
+        pending.push_back(i);
+        queues->remaining++;
+    }
+    queues->tasks = std::move(tasks);
+    queues->states.assign(queues->tasks.size(), State::kQueued);
+    queues->deadlines.resize(queues->tasks.size());
+
+    auto start = [&queues](dev_t queue) {
+        try {
+            std::thread(RunQueueWorker, queues, queue).detach();
+        } catch (std::system_error& ex) {
+            return false;
+        }
+        queues->workers[queue]++;
+        return true;
+    };
+
+    std::unique_lock<std::mutex> lock(queues->mu);
+    for (dev_t queue : order) {
+        auto& pending = queues->pending[queue];
+        const size_t workers = std::max<size_t>(1,
+            std::min(depth(queue), pending.size()));
+        for (size_t i = 0; i < workers && start(queue); i++) {}
+        if (queues->workers[queue] > 0) {
+            continue;
+        }
+
+        // Without a worker, the best we can do is run the tasks ourselves.
+        while (!pending.empty()) {
+            const size_t i = pending.front();
+            pending.pop_front();
+            queues->states[i] = State::kDone;
+            queues->remaining--;
+            std::function<void()> run;
+            run.swap(queues->tasks[i].run);
+            lock.unlock();
+            run();
+            lock.lock();
+        }
+    }
+
+    while (queues->remaining > 0) {
+        if (queues->running.empty()) {
+            queues->cv.wait(lock);
+            continue;
+        }
+        // Copied, as a worker may erase it while we wait.
+        const Clock::time_point deadline = queues->running.begin()->first;
+        queues->cv.wait_until(lock, deadline);
+
+        const Clock::time_point now = Clock::now();
+        while (!queues->running.empty() &&
+                queues->running.begin()->first <= now) {
+            const size_t i = queues->running.begin()->second;
+            queues->running.erase(queues->running.begin());
+            queues->states[i] = State::kAbandoned;
+            queues->remaining--;
+            statuses[i] = Status::kTimedOut;
+
+            const Task& task = queues->tasks[i];
+            queues->workers[task.queue]--;
+            TimedOut(task.device);
+            if (IsQuarantined(task.device)) {
+                for (auto& queue : queues->pending) {
+                    auto& pending = queue.second;
+                    for (auto it = pending.begin(); it != pending.end();) {
+                        if (queues->tasks[*it].device != task.device) {
+                            ++it;
+                            continue;
+                        }
+                        statuses[*it] = Status::kQuarantined;
+                        queues->remaining--;
+                        it = pending.erase(it);
+                    }
+                }
+            }
+
+            auto& pending = queues->pending[task.queue];
+            if (pending.empty() || start(task.queue) ||
+                    queues->workers[task.queue] > 0) {
+                continue;
+            }
+            // The queue has no workers left to run its tasks.
+            for (size_t j : pending) {
+                statuses[j] = Status::kTimedOut;
+                queues->remaining--;
+            }
+            pending.clear();
+        }
+    }
+    return statuses;
+}
+
+bool DeadlineExecutor::IsQuarantined(dev_t device) const {
+    if (device == kNoDevice || quarantine_after_ == 0) {
+        return false;
+    }
+
+    auto it = device_timeouts_.find(device);
+    return it != device_timeouts_.end() && it->second >= quarantine_after_;
+}
+
+void DeadlineExecutor::TimedOut(dev_t device) {
+    timeouts_++;
+    if (device != kNoDevice && quarantine_after_ > 0 &&
+            ++device_timeouts_[device] == quarantine_after_) {
+        quarantined_.push_back(device);
+    }
+}
+
+bool DeadlineExecutor::Start() {
+    std::shared_ptr<Worker> worker(new Worker());
+    try {
+        std::thread(RunWorker, worker).detach();
+    } catch (std::system_error& ex) {
+        return false;
+    }
+    worker_.swap(worker);
+    return true;
+}
+
+void DeadlineExecutor::RunWorker(std::shared_ptr<Worker> worker) {
+    // We outlive whatever scoped state our creator had applied, such as the
+    // idle I/O priority of the initial scan or a group's NUMA policy, so
+    // each task runs under its caller's instead.
+    Context applied = Context::Current();
+    std::unique_lock<std::mutex> lock(worker->mu);
+    while (true) {
+        worker->cv.wait(lock, [&worker] {
+            return worker->pending || worker->stop;
+        });
+        if (!worker->pending) {
+            return;
+        }
+
+        std::function<void()> task;
+        task.swap(worker->task);
+        const Context context = worker->context;
+        worker->pending = false;
+        lock.unlock();
+
+        if (context != applied) {
+            SetIoPriority(context.priority);
+            SetThreadPlacement(context.placement);
+            applied = context;
+        }
+        task();
+        // Release the task's state before we report back, in case it is
+        // abandoned.
+        task = nullptr;
+
+        lock.lock();
+        worker->done = true;
+        worker->cv.notify_all();
+    }
+}
+
+void DeadlineExecutor::RunQueueWorker(
+        std::shared_ptr<Queues> queues, dev_t queue) {
+    typedef Queues::State State;
+
+    std::unique_lock<std::mutex> lock(queues->mu);
+    while (true) {
+        auto& pending = queues->pending[queue];
+        if (pending.empty()) {
+            queues->workers[queue]--;
+            return;
+        }
+        const size_t i = pending.front();
+        pending.pop_front();
+
+        const Clock::time_point deadline =
+            Clock::now() + queues->tasks[i].timeout;
+        queues->states[i] = State::kRunning;
+        queues->deadlines[i] = deadline;
+        const auto running = queues->running.emplace(deadline, i).first;
+        if (running == queues->running.begin()) {
+            // The caller waits for the earliest deadline.
+            queues->cv.notify_all();
+        }
+
+        std::function<void()> run;
+        run.swap(queues->tasks[i].run);
+        lock.unlock();
+        run();
+        // As for RunWorker, release the task's state before reporting back.
+        run = nullptr;
+        lock.lock();
+
+        if (queues->states[i] == State::kAbandoned) {
+            // We have already been replaced.
+            return;
+        }
+        queues->states[i] = State::kDone;
+        queues->running.erase(std::make_pair(deadline, i));
+        if (--queues->remaining == 0) {
+            queues->cv.notify_all();
+        }
+    }
+}
+
+bool IsCached(int fd, uint64_t offset, uint64_t length) {
+    if (length == 0) {
+        return true;
+    } else if (!HasKernelFeature(KernelFeature::kCachestat)) {
+        return IsCachedByMincore(fd, offset, length);
+    }
+
+    CachestatRange range = {offset, length};
+    Cachestat stat;
+    if (syscall(__NR_cachestat, fd, &range, &stat, 0) != 0) {
+        return false;
+    }
+
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t pages =
+        (offset + length + page - 1) / page - offset / page;
+    return stat.nr_cache >= pages;
+}
+
+}  // namespace file_binder
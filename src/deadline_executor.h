@@ -0,0 +1,124 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__DEADLINE_EXECUTOR_H__
+#define __FILE_BINDER__DEADLINE_EXECUTOR_H__
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace file_binder {
+
+// DeadlineExecutor runs I/O which may block indefinitely, such as reads from
+// a failing disk, on a worker thread, so the caller can give up on it.  A
+// thread stuck in the kernel cannot be cancelled, so a worker which misses
+// its deadline is abandoned to finish in its own time and a fresh one takes
+// its place.  Devices which repeatedly miss deadlines are quarantined.
+class DeadlineExecutor {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Status {
+        kOk,
+        kTimedOut,
+        // The device was quarantined beforehand, so the task was not run.
+        kQuarantined,
+    };
+
+    // Passed as the device of tasks which should not count against one.
+    static constexpr dev_t kNoDevice = static_cast<dev_t>(-1);
+
+    // Devices are quarantined after quarantine_after timeouts, or never if
+    // it is 0.
+    explicit DeadlineExecutor(size_t quarantine_after = 3);
+    ~DeadlineExecutor();
+
+    // Runs task on a worker, waiting up to timeout for it to complete.  The
+    // task runs under the caller's I/O priority, memory policy and CPU
+    // affinity.  An abandoned task continues to run after Run returns, so it
+    // must own the state it touches, e.g. through a shared_ptr.
+    Status Run(dev_t device, Clock::duration timeout,
+        std::function<void()> task);
+
+    struct Task {
+        // The device the task reads from, as for Run.
+        dev_t device;
+        // Tasks sharing a queue, e.g. reading from the same disk, run in
+        // order, at most depth at a time.
+        dev_t queue;
+        // Measured from when the task starts.
+        Clock::duration timeout;
+        std::function<void()> run;
+    };
+
+    // Runs tasks, each queue on its own workers, so that queues proceed in
+    // parallel with each other.  depth returns the number of workers for a
+    // queue.  A worker which misses its deadline is abandoned and replaced,
+    // and once a device is quarantined, its queued tasks are skipped.  It
+    // returns the status of each task.
+    std::vector<Status> RunQueues(std::vector<Task> tasks,
+        const std::function<size_t(dev_t)>& depth);
+
+    bool IsQuarantined(dev_t device) const;
+
+    // The quarantined devices, in the order they were quarantined.
+    const std::vector<dev_t>& quarantined() const { return quarantined_; }
+
+    // The number of tasks which missed their deadline.
+    size_t timeouts() const { return timeouts_; }
+private:
+    struct Worker;
+    struct Queues;
+
+    // Starts worker_, returning false on failure.
+    bool Start();
+
+    // Runs the tasks handed to worker until it is stopped.
+    static void RunWorker(std::shared_ptr<Worker> worker);
+
+    // Runs the tasks of queue until it is empty, or the task it is running
+    // is abandoned.
+    static void RunQueueWorker(std::shared_ptr<Queues> queues, dev_t queue);
+
+    // Records a missed deadline against device.
+    void TimedOut(dev_t device);
+
+    const size_t quarantine_after_;
+    std::shared_ptr<Worker> worker_;
+
+    // Timeouts by device.
+    std::unordered_map<dev_t, size_t> device_timeouts_;
+    std::vector<dev_t> quarantined_;
+    size_t timeouts_;
+};
+
+// Returns true if length bytes of the file at fd, from offset, are in the
+// page cache, so reading them cannot block on the disk.  It returns false if
+// this is unknown.
+bool IsCached(int fd, uint64_t offset, uint64_t length);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__DEADLINE_EXECUTOR_H__
@@ -0,0 +1,214 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "deadline_executor.h"
+#include "io_throttle.h"
+#include "numa.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+namespace file_binder {
+namespace {
+
+typedef DeadlineExecutor::Status Status;
+
+// A task which blocks, as on a hung disk, until released.
+std::function<void()> Hang(std::shared_ptr<std::atomic<bool>> release) {
+    return [release] {
+        while (!release->load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+}
+
+TEST(DeadlineExecutor, RunsTasks) {
+    DeadlineExecutor executor;
+    int value = 0;
+    EXPECT_EQ(Status::kOk, executor.Run(1, std::chrono::seconds(10),
+        [&value] { value = 1; }));
+    EXPECT_EQ(1, value);
+    EXPECT_EQ(Status::kOk, executor.Run(1, std::chrono::seconds(10),
+        [&value] { value = 2; }));
+    EXPECT_EQ(2, value);
+    EXPECT_EQ(0, executor.timeouts());
+}
+
+TEST(DeadlineExecutor, RunsUnderCallersContext) {
+    DeadlineExecutor executor;
+    IoPriority priority;
+    auto run = [&executor, &priority] {
+        EXPECT_EQ(Status::kOk, executor.Run(1, std::chrono::seconds(10),
+            [&priority] { priority = GetIoPriority(); }));
+    };
+
+    // The worker is started while the caller is idle, but does not stay so.
+    const IoPriority original = GetIoPriority();
+    ASSERT_TRUE(SetIoPriority({IoClass::kIdle, 0}));
+    run();
+    EXPECT_EQ(IoClass::kIdle, priority.io_class);
+    ASSERT_TRUE(SetIoPriority(original));
+    run();
+    EXPECT_EQ(original.io_class, priority.io_class);
+    EXPECT_EQ(original.level, priority.level);
+
+    // Likewise for CPU affinity.
+    const ThreadPlacement placement = GetThreadPlacement();
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(sched_getcpu(), &one);
+    ASSERT_EQ(0, sched_setaffinity(0, sizeof(one), &one));
+    ThreadPlacement task_placement;
+    EXPECT_EQ(Status::kOk, executor.Run(1, std::chrono::seconds(10),
+        [&task_placement] { task_placement = GetThreadPlacement(); }));
+    EXPECT_TRUE(task_placement == GetThreadPlacement());
+    ASSERT_TRUE(SetThreadPlacement(placement));
+    EXPECT_EQ(Status::kOk, executor.Run(1, std::chrono::seconds(10),
+        [&task_placement] { task_placement = GetThreadPlacement(); }));
+    EXPECT_TRUE(task_placement == placement);
+}
+
+TEST(DeadlineExecutor, AbandonsAndQuarantines) {
+    std::shared_ptr<std::atomic<bool>> release(new std::atomic<bool>(false));
+    const auto timeout = std::chrono::milliseconds(20);
+
+    DeadlineExecutor executor(2);
+    EXPECT_EQ(Status::kTimedOut, executor.Run(1, timeout, Hang(release)));
+    EXPECT_FALSE(executor.IsQuarantined(1));
+
+    // A fresh worker takes over from the hung one.
+    bool ran = false;
+    EXPECT_EQ(Status::kOk, executor.Run(2, timeout * 50,
+        [&ran] { ran = true; }));
+    EXPECT_TRUE(ran);
+
+    EXPECT_EQ(Status::kTimedOut, executor.Run(1, timeout, Hang(release)));
+    EXPECT_TRUE(executor.IsQuarantined(1));
+    EXPECT_EQ(std::vector<dev_t>{1}, executor.quarantined());
+    EXPECT_EQ(2, executor.timeouts());
+
+    ran = false;
+    EXPECT_EQ(Status::kQuarantined, executor.Run(1, timeout,
+        [&ran] { ran = true; }));
+    EXPECT_FALSE(ran);
+
+    // Other devices, and tasks attributed to none, are unaffected.
+    EXPECT_EQ(Status::kOk, executor.Run(2, timeout * 50, [] {}));
+    EXPECT_EQ(Status::kTimedOut, executor.Run(
+        DeadlineExecutor::kNoDevice, timeout, Hang(release)));
+    EXPECT_EQ(Status::kOk, executor.Run(
+        DeadlineExecutor::kNoDevice, timeout * 50, [] {}));
+
+    release->store(true);
+}
+
+TEST(DeadlineExecutor, RunsQueuesInParallel) {
+    typedef DeadlineExecutor::Task Task;
+    const auto timeout = std::chrono::seconds(10);
+
+    // The task on queue 1 can only finish once the task on queue 2 runs.
+    std::shared_ptr<std::atomic<bool>> released(new std::atomic<bool>(false));
+    std::vector<Task> tasks;
+    tasks.push_back({1, 1, timeout, Hang(released)});
+    tasks.push_back({2, 2, timeout, [released] { released->store(true); }});
+
+    // Queue 3 runs at most two tasks at a time.
+    std::shared_ptr<std::atomic<int>> running(new std::atomic<int>(0));
+    std::shared_ptr<std::atomic<int>> most(new std::atomic<int>(0));
+    for (int i = 0; i < 6; i++) {
+        tasks.push_back({3, 3, timeout, [running, most] {
+            const int now = ++*running;
+            int seen = most->load();
+            while (now > seen && !most->compare_exchange_weak(seen, now)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --*running;
+        }});
+    }
+
+    DeadlineExecutor executor;
+    const std::vector<Status> statuses = executor.RunQueues(std::move(tasks),
+        [](dev_t queue) -> size_t { return queue == 3 ? 2 : 1; });
+    EXPECT_EQ(std::vector<Status>(8, Status::kOk), statuses);
+    EXPECT_TRUE(released->load());
+    EXPECT_LE(most->load(), 2);
+    EXPECT_EQ(0, executor.timeouts());
+}
+
+TEST(DeadlineExecutor, QueuesAbandonAndQuarantine) {
+    typedef DeadlineExecutor::Task Task;
+    std::shared_ptr<std::atomic<bool>> release(new std::atomic<bool>(false));
+    const auto timeout = std::chrono::milliseconds(20);
+
+    // Two devices share queue 1.
+    std::shared_ptr<std::atomic<int>> ran(new std::atomic<int>(0));
+    auto count = [ran] { ++*ran; };
+    std::vector<Task> tasks;
+    tasks.push_back({1, 1, timeout, Hang(release)});
+    tasks.push_back({1, 1, timeout, Hang(release)});
+    tasks.push_back({1, 1, timeout, count});
+    tasks.push_back({2, 1, timeout * 50, count});
+    tasks.push_back({3, 3, timeout * 50, count});
+
+    DeadlineExecutor executor(2);
+    const std::vector<Status> statuses = executor.RunQueues(std::move(tasks),
+        [](dev_t) -> size_t { return 1; });
+    EXPECT_EQ((std::vector<Status>{Status::kTimedOut, Status::kTimedOut,
+        Status::kQuarantined, Status::kOk, Status::kOk}), statuses);
+    EXPECT_EQ(2, ran->load());
+    EXPECT_TRUE(executor.IsQuarantined(1));
+    EXPECT_EQ(2, executor.timeouts());
+
+    // Tasks on quarantined devices are skipped up front.
+    tasks.clear();
+    tasks.push_back({1, 1, timeout, count});
+    EXPECT_EQ(std::vector<Status>{Status::kQuarantined}, executor.RunQueues(
+        std::move(tasks), [](dev_t) -> size_t { return 1; }));
+    EXPECT_EQ(2, ran->load());
+
+    release->store(true);
+}
+
+TEST(DeadlineExecutor, IsCached) {
+    char name[] = "/tmp/deadline_executor_test.XXXXXX";
+    const int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    unlink(name);
+
+    const std::string contents(1 << 16, 'x');
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+        write(fd, contents.data(), contents.size()));
+
+    // Freshly written pages are resident.
+    const bool supported = syscall(451, fd, nullptr, nullptr, 0) >= 0 ||
+        errno != ENOSYS;
+    EXPECT_EQ(supported, IsCached(fd, 0, contents.size()));
+    EXPECT_TRUE(IsCached(fd, 0, 0));
+    close(fd);
+}
+
+}  // namespace
+}  // namespace file_binder
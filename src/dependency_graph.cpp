@@ -0,0 +1,227 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dependency_graph.h"
+
+namespace file_binder {
+
+DependencyGraph::Identity DependencyGraph::Identity::Of(
+        const struct stat& buf) {
+    Identity identity;
+    identity.device = buf.st_dev;
+    identity.inode = buf.st_ino;
+    identity.size = buf.st_size;
+    identity.mtime = buf.st_mtim;
+    return identity;
+}
+
+bool DependencyGraph::Identity::operator==(const Identity& other) const {
+    return device == other.device && inode == other.inode &&
+        size == other.size && mtime.tv_sec == other.mtime.tv_sec &&
+        mtime.tv_nsec == other.mtime.tv_nsec;
+}
+
+DependencyGraph::DependencyGraph() {}
+
+DependencyGraph::~DependencyGraph() {}
+
+void DependencyGraph::Set(
+        PathId file, const Identity& identity, std::vector<Edge> edges,
+        PathId directory) {
+    Remove(file);
+
+    Index(file, edges);
+    if (directory != PathTable::kInvalid) {
+        directories_[directory].insert(file);
+    }
+    Node& node = nodes_[file];
+    node.identity = identity;
+    node.hash = 0;
+    node.directory = directory;
+    node.edges = std::move(edges);
+}
+
+void DependencyGraph::Remove(PathId file) {
+    auto it = nodes_.find(file);
+    if (it == nodes_.end()) {
+        return;
+    }
+
+    Unindex(file, it->second.edges);
+    auto directory = directories_.find(it->second.directory);
+    if (directory != directories_.end()) {
+        directory->second.erase(file);
+        if (directory->second.empty()) {
+            directories_.erase(directory);
+        }
+    }
+    nodes_.erase(it);
+}
+
+std::vector<PathId> DependencyGraph::Retarget(
+        const std::string& soname, bool is_64bit, PathId target) {
+    std::vector<PathId> changed;
+    auto it = sonames_.find(SonameKey(soname, is_64bit));
+    if (it == sonames_.end()) {
+        return changed;
+    }
+
+    // Files recorded at different times may disagree on the target, so each
+    // edge is checked.
+    it->second.target = target;
+    for (PathId file : it->second.files) {
+        Node& node = nodes_.at(file);
+        std::vector<PathId> old_targets;
+        for (auto& edge : node.edges) {
+            if (edge.soname == soname && edge.is_64bit == is_64bit &&
+                    edge.target != target) {
+                old_targets.push_back(edge.target);
+                edge.target = target;
+            }
+        }
+        if (old_targets.empty()) {
+            continue;
+        }
+
+        // file may reach an old target through other edges as well.
+        for (PathId old_target : old_targets) {
+            bool still_depends = false;
+            for (const auto& edge : node.edges) {
+                still_depends |= edge.target == old_target;
+            }
+            auto dependents = dependents_.find(old_target);
+            if (!still_depends && dependents != dependents_.end()) {
+                dependents->second.erase(file);
+                if (dependents->second.empty()) {
+                    dependents_.erase(dependents);
+                }
+            }
+        }
+        if (target != PathTable::kInvalid) {
+            dependents_[target].insert(file);
+        }
+        changed.push_back(file);
+    }
+    return changed;
+}
+
+std::vector<PathId> DependencyGraph::Dependents(PathId target) const {
+    std::vector<PathId> files;
+    auto it = dependents_.find(target);
+    if (it != dependents_.end()) {
+        files.assign(it->second.begin(), it->second.end());
+    }
+    return files;
+}
+
+std::vector<PathId> DependencyGraph::Closure(
+        const std::vector<PathId>& roots) const {
+    std::unordered_set<PathId> seen;
+    std::vector<PathId> closure;
+    std::vector<PathId> stack(roots.rbegin(), roots.rend());
+    while (!stack.empty()) {
+        const PathId file = stack.back();
+        stack.pop_back();
+
+        auto it = nodes_.find(file);
+        if (it == nodes_.end() || !seen.insert(file).second) {
+            continue;
+        }
+        closure.push_back(file);
+
+        for (const auto& edge : it->second.edges) {
+            if (edge.target != PathTable::kInvalid) {
+                stack.push_back(edge.target);
+            }
+        }
+    }
+    return closure;
+}
+
+size_t DependencyGraph::MemoryUsage() const {
+    size_t bytes = nodes_.size() * (sizeof(PathId) + sizeof(Node) +
+        2 * sizeof(void*));
+    for (const auto& node : nodes_) {
+        bytes += node.second.edges.capacity() * sizeof(Edge);
+    }
+    for (const auto& dependents : dependents_) {
+        bytes += sizeof(dependents) + 2 * sizeof(void*) +
+            dependents.second.size() * (sizeof(PathId) + 2 * sizeof(void*));
+    }
+    for (const auto& directory : directories_) {
+        bytes += sizeof(directory) + 2 * sizeof(void*) +
+            directory.second.size() * (sizeof(PathId) + 2 * sizeof(void*));
+    }
+    for (const auto& soname : sonames_) {
+        bytes += sizeof(soname) + 2 * sizeof(void*) +
+            soname.second.files.size() * (sizeof(PathId) + 2 * sizeof(void*));
+    }
+    return bytes;
+}
+
+std::string DependencyGraph::SonameKey(
+        const std::string& soname, bool is_64bit) {
+    return (is_64bit ? "64:" : "32:") + soname;
+}
+
+void DependencyGraph::Index(PathId file, const std::vector<Edge>& edges) {
+    for (const auto& edge : edges) {
+        if (edge.target != PathTable::kInvalid) {
+            dependents_[edge.target].insert(file);
+        }
+        if (edge.soname.empty()) {
+            continue;
+        }
+
+        auto inserted = sonames_.emplace(
+            SonameKey(edge.soname, edge.is_64bit), Soname());
+        Soname& soname = inserted.first->second;
+        if (inserted.second) {
+            soname.soname = edge.soname;
+            soname.is_64bit = edge.is_64bit;
+        }
+        // The latest resolution wins.
+        soname.target = edge.target;
+        soname.files.insert(file);
+    }
+}
+
+void DependencyGraph::Unindex(PathId file, const std::vector<Edge>& edges) {
+    for (const auto& edge : edges) {
+        auto dependents = dependents_.find(edge.target);
+        if (dependents != dependents_.end()) {
+            dependents->second.erase(file);
+            if (dependents->second.empty()) {
+                dependents_.erase(dependents);
+            }
+        }
+        if (edge.soname.empty()) {
+            continue;
+        }
+
+        auto soname = sonames_.find(SonameKey(edge.soname, edge.is_64bit));
+        if (soname != sonames_.end()) {
+            soname->second.files.erase(file);
+            if (soname->second.files.empty()) {
+                sonames_.erase(soname);
+            }
+        }
+    }
+}
+
+}  // namespace file_binder
@@ -0,0 +1,177 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__DEPENDENCY_GRAPH_H__
+#define __FILE_BINDER__DEPENDENCY_GRAPH_H__
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "path_table.h"
+
+namespace file_binder {
+
+// DependencyGraph records the runtime dependencies between the files we have
+// scanned:  The interpreters and DT_NEEDED sonames of ELF files, and the
+// interpreters of scripts.  Reverse indices by target and by soname trace a
+// change to one library, or to the library search path, back to the files
+// which depend on it, so closures can be recomputed without rescanning.
+class DependencyGraph {
+public:
+    // Identifies the contents of a file, so that replacing or modifying it
+    // is noticed.
+    struct Identity {
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+
+        static Identity Of(const struct stat& buf);
+        bool operator==(const Identity& other) const;
+        bool operator!=(const Identity& other) const {
+            return !(*this == other);
+        }
+    };
+
+    struct Edge {
+        // The soname needed, or empty for a dependency by path, such as an
+        // interpreter.
+        std::string soname;
+        bool is_64bit;
+        // The file the dependency resolved to, or PathTable::kInvalid.
+        PathId target;
+    };
+
+    DependencyGraph();
+    ~DependencyGraph();
+
+    // Records file with its identity and dependencies, replacing any
+    // previous record of it.  It is indexed under directory, the directory
+    // containing it, for ForEachFileIn.
+    void Set(PathId file, const Identity& identity, std::vector<Edge> edges,
+        PathId directory = PathTable::kInvalid);
+
+    // Updates the identity of file, which must be recorded, after a change
+    // which left its contents as they were.
+    void SetIdentity(PathId file, const Identity& identity) {
+        nodes_.at(file).identity = identity;
+    }
+
+    // Records the ContentHash of file, which must be recorded.  It is
+    // forgotten when file is Set again.
+    void SetHash(PathId file, uint64_t hash) {
+        nodes_.at(file).hash = hash;
+    }
+
+    // Forgets file.  The edges of files depending on it are kept, so it is
+    // picked up again if it reappears.
+    void Remove(PathId file);
+
+    bool Contains(PathId file) const { return nodes_.count(file) > 0; }
+
+    // The identity of file, which must be recorded.
+    const Identity& identity(PathId file) const {
+        return nodes_.at(file).identity;
+    }
+
+    // The ContentHash of file, which must be recorded, or 0 if unknown.
+    uint64_t hash(PathId file) const { return nodes_.at(file).hash; }
+
+    // The dependencies of file, which must be recorded.
+    const std::vector<Edge>& edges(PathId file) const {
+        return nodes_.at(file).edges;
+    }
+
+    // Points the edges needing soname at target, returning the files whose
+    // dependencies changed.
+    std::vector<PathId> Retarget(
+        const std::string& soname, bool is_64bit, PathId target);
+
+    // Calls f(soname, is_64bit, target) for each soname needed by a recorded
+    // file.
+    template<typename F>
+    void ForEachSoname(F f) const {
+        for (const auto& entry : sonames_) {
+            f(entry.second.soname, entry.second.is_64bit,
+                entry.second.target);
+        }
+    }
+
+    // Calls f(file) for each recorded file in directory.
+    template<typename F>
+    void ForEachFileIn(PathId directory, F f) const {
+        auto it = directories_.find(directory);
+        if (it == directories_.end()) {
+            return;
+        }
+        for (PathId file : it->second) {
+            f(file);
+        }
+    }
+
+    // The recorded files with an edge to target.
+    std::vector<PathId> Dependents(PathId target) const;
+
+    // Returns the recorded files reachable from roots, including those of
+    // roots which are recorded.
+    std::vector<PathId> Closure(const std::vector<PathId>& roots) const;
+
+    size_t size() const { return nodes_.size(); }
+
+    // Approximate bytes used by the graph.
+    size_t MemoryUsage() const;
+private:
+    DependencyGraph(const DependencyGraph&) = delete;
+    DependencyGraph& operator=(const DependencyGraph&) = delete;
+
+    struct Node {
+        Identity identity;
+        uint64_t hash;
+        PathId directory;
+        std::vector<Edge> edges;
+    };
+
+    struct Soname {
+        std::string soname;
+        bool is_64bit;
+        PathId target;
+        std::unordered_set<PathId> files;
+    };
+
+    static std::string SonameKey(const std::string& soname, bool is_64bit);
+
+    // Adds or removes the reverse index entries of file's edges.
+    void Index(PathId file, const std::vector<Edge>& edges);
+    void Unindex(PathId file, const std::vector<Edge>& edges);
+
+    std::unordered_map<PathId, Node> nodes_;
+    std::unordered_map<PathId, std::unordered_set<PathId>> dependents_;
+    std::unordered_map<PathId, std::unordered_set<PathId>> directories_;
+    std::unordered_map<std::string, Soname> sonames_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__DEPENDENCY_GRAPH_H__
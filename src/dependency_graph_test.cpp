@@ -0,0 +1,197 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dependency_graph.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "path_table.h"
+
+namespace file_binder {
+namespace {
+
+typedef DependencyGraph::Edge Edge;
+typedef DependencyGraph::Identity Identity;
+
+const PathId kBin = 0;
+const PathId kTool = 1;
+const PathId kLibA = 2;
+const PathId kLibB = 3;
+const PathId kLoader = 4;
+const PathId kLibB2 = 5;
+
+Identity MakeIdentity(ino_t inode) {
+    struct stat buf = {};
+    buf.st_dev = 1;
+    buf.st_ino = inode;
+    buf.st_size = 4096;
+    return Identity::Of(buf);
+}
+
+Edge Needs(const std::string& soname, PathId target) {
+    return Edge{soname, true, target};
+}
+
+std::vector<PathId> Sorted(std::vector<PathId> files) {
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// bin needs libA, which needs libB; tool needs libB.
+class DependencyGraphTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        graph_.Set(kBin, MakeIdentity(1), {
+            Edge{"", true, kLoader}, Needs("libA.so", kLibA)});
+        graph_.Set(kTool, MakeIdentity(2), {Needs("libB.so", kLibB)});
+        graph_.Set(kLibA, MakeIdentity(3), {Needs("libB.so", kLibB)});
+        graph_.Set(kLibB, MakeIdentity(4), {});
+        graph_.Set(kLoader, MakeIdentity(5), {});
+    }
+
+    DependencyGraph graph_;
+};
+
+TEST_F(DependencyGraphTest, Closure) {
+    EXPECT_EQ(5u, graph_.size());
+    EXPECT_EQ(Sorted({kBin, kLibA, kLibB, kLoader}),
+        Sorted(graph_.Closure({kBin})));
+    EXPECT_EQ(Sorted({kTool, kLibB}), Sorted(graph_.Closure({kTool})));
+    EXPECT_EQ(Sorted({kBin, kTool, kLibA, kLibB, kLoader}),
+        Sorted(graph_.Closure({kBin, kTool})));
+}
+
+TEST_F(DependencyGraphTest, Dependents) {
+    EXPECT_EQ(Sorted({kLibA, kTool}), Sorted(graph_.Dependents(kLibB)));
+    EXPECT_EQ(std::vector<PathId>{kBin}, graph_.Dependents(kLoader));
+    EXPECT_TRUE(graph_.Dependents(kBin).empty());
+}
+
+TEST_F(DependencyGraphTest, ForEachFileIn) {
+    const PathId kUsrBin = 10;
+    const PathId kUsrLib = 11;
+    auto files = [this](PathId directory) {
+        std::vector<PathId> ret;
+        graph_.ForEachFileIn(directory, [&ret](PathId file) {
+            ret.push_back(file);
+        });
+        return Sorted(ret);
+    };
+
+    graph_.Set(kBin, MakeIdentity(1), {}, kUsrBin);
+    graph_.Set(kLibA, MakeIdentity(3), {}, kUsrLib);
+    graph_.Set(kLibB, MakeIdentity(4), {}, kUsrLib);
+    EXPECT_EQ(std::vector<PathId>{kBin}, files(kUsrBin));
+    EXPECT_EQ(Sorted({kLibA, kLibB}), files(kUsrLib));
+
+    // Moving or removing a file unindexes it.
+    graph_.Set(kLibA, MakeIdentity(3), {}, kUsrBin);
+    graph_.Remove(kLibB);
+    EXPECT_EQ(Sorted({kBin, kLibA}), files(kUsrBin));
+    EXPECT_TRUE(files(kUsrLib).empty());
+}
+
+TEST_F(DependencyGraphTest, Identity) {
+    EXPECT_TRUE(graph_.identity(kBin) == MakeIdentity(1));
+    EXPECT_TRUE(graph_.identity(kBin) != MakeIdentity(6));
+
+    struct stat buf = {};
+    buf.st_dev = 1;
+    buf.st_ino = 1;
+    buf.st_size = 4096;
+    buf.st_mtim.tv_sec = 1;
+    EXPECT_TRUE(graph_.identity(kBin) != Identity::Of(buf));
+}
+
+TEST_F(DependencyGraphTest, Hash) {
+    EXPECT_EQ(0u, graph_.hash(kLibA));
+    graph_.SetHash(kLibA, 42);
+    graph_.SetIdentity(kLibA, MakeIdentity(7));
+    EXPECT_EQ(42u, graph_.hash(kLibA));
+    EXPECT_TRUE(graph_.identity(kLibA) == MakeIdentity(7));
+    EXPECT_EQ(1u, graph_.edges(kLibA).size());
+
+    // Reparsing the file forgets its hash.
+    graph_.Set(kLibA, MakeIdentity(8), {});
+    EXPECT_EQ(0u, graph_.hash(kLibA));
+    EXPECT_TRUE(graph_.edges(kLibA).empty());
+}
+
+TEST_F(DependencyGraphTest, Remove) {
+    graph_.Remove(kLibB);
+    EXPECT_FALSE(graph_.Contains(kLibB));
+    // The edges to it are kept, so it is picked up again if it reappears.
+    EXPECT_EQ(Sorted({kTool}), Sorted(graph_.Closure({kTool})));
+    graph_.Set(kLibB, MakeIdentity(4), {});
+    EXPECT_EQ(Sorted({kTool, kLibB}), Sorted(graph_.Closure({kTool})));
+
+    graph_.Remove(kLibA);
+    EXPECT_EQ(Sorted({kTool}), Sorted(graph_.Dependents(kLibB)));
+}
+
+TEST_F(DependencyGraphTest, Retarget) {
+    EXPECT_EQ(Sorted({kLibA, kTool}),
+        Sorted(graph_.Retarget("libB.so", true, kLibB2)));
+    graph_.Set(kLibB2, MakeIdentity(6), {});
+
+    EXPECT_EQ(Sorted({kBin, kLibA, kLibB2, kLoader}),
+        Sorted(graph_.Closure({kBin})));
+    EXPECT_TRUE(graph_.Dependents(kLibB).empty());
+    EXPECT_EQ(Sorted({kLibA, kTool}), Sorted(graph_.Dependents(kLibB2)));
+
+    // Nothing changes the second time, nor for the other word size.
+    EXPECT_TRUE(graph_.Retarget("libB.so", true, kLibB2).empty());
+    EXPECT_TRUE(graph_.Retarget("libB.so", false, kLibB).empty());
+
+    // An unresolvable soname drops out of the closure.
+    EXPECT_EQ(Sorted({kLibA, kTool}),
+        Sorted(graph_.Retarget("libB.so", true, PathTable::kInvalid)));
+    EXPECT_EQ(Sorted({kTool}), Sorted(graph_.Closure({kTool})));
+}
+
+TEST_F(DependencyGraphTest, RetargetStaleEdges) {
+    // A file recorded after the search path changed resolves differently
+    // from those recorded before.
+    graph_.Set(kLibB2, MakeIdentity(6), {});
+    graph_.Set(kTool, MakeIdentity(2), {Needs("libB.so", kLibB2)});
+
+    EXPECT_EQ(std::vector<PathId>{kLibA},
+        graph_.Retarget("libB.so", true, kLibB2));
+    EXPECT_TRUE(graph_.Dependents(kLibB).empty());
+}
+
+TEST_F(DependencyGraphTest, ForEachSoname) {
+    std::vector<std::string> sonames;
+    graph_.ForEachSoname([&sonames](const std::string& soname, bool is_64bit,
+            PathId target) {
+        EXPECT_TRUE(is_64bit);
+        sonames.push_back(soname);
+        EXPECT_EQ(soname == "libA.so" ? kLibA : kLibB, target);
+    });
+    std::sort(sonames.begin(), sonames.end());
+    EXPECT_EQ((std::vector<std::string>{"libA.so", "libB.so"}), sonames);
+    EXPECT_GT(graph_.MemoryUsage(), 0u);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,253 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "directory_poller.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace file_binder {
+namespace {
+
+// Directories modified within this long of being read may change again
+// without their mtime visibly changing.
+const int64_t kRacyNs = 2000000000;
+
+// A poll may take up to 1/kMaxOverhead of the time between polls.
+const int kMaxOverhead = 20;
+
+int64_t Nanoseconds(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int64_t WallNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return Nanoseconds(ts);
+}
+
+// FNV-1a.
+uint64_t Hash(const char* s) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *s != '\0'; s++) {
+        hash ^= static_cast<unsigned char>(*s);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}  // namespace
+
+DirectoryPoller::DirectoryPoller(
+        Clock::duration min_interval, Clock::duration max_interval) :
+    min_interval_(min_interval), max_interval_(max_interval),
+    interval_(min_interval), next_poll_(Clock::now() + min_interval) {}
+
+bool DirectoryPoller::Add(const std::string& directory) {
+    if (index_.count(directory) > 0) {
+        return true;
+    }
+
+    struct Added {
+        Directory directory;
+        bool ok = false;
+    };
+    std::shared_ptr<Added> added(new Added());
+    Directory& d = added->directory;
+    d.path = directory;
+    d.device = 0;
+    d.inode = 0;
+    d.mtime = 0;
+    d.racy = false;
+    if (!Run(kUnknownDevice, [added] { added->ok = Read(&added->directory); })
+            || !added->ok) {
+        return false;
+    }
+
+    index_.emplace(directory, directories_.size());
+    directories_.push_back(std::move(d));
+    return true;
+}
+
+std::vector<std::string> DirectoryPoller::Poll(Clock::time_point now) {
+    enum class State {
+        kRemoved,
+        kUnchanged,
+        kUnreadable,
+        kRead,
+    };
+    // The poll of one directory, which works on a copy of its snapshot, less
+    // its entries, in case it is abandoned.
+    struct Probe {
+        State state = State::kRemoved;
+        Directory directory;
+    };
+
+    std::vector<std::string> changed;
+    for (auto& directory : directories_) {
+        std::shared_ptr<Probe> probe(new Probe());
+        Directory& fresh = probe->directory;
+        fresh.path = directory.path;
+        fresh.device = directory.device;
+        fresh.inode = directory.inode;
+        fresh.mtime = directory.mtime;
+        fresh.racy = directory.racy;
+        if (!Run(directory.device, [probe] {
+                    Directory* d = &probe->directory;
+                    struct stat buf;
+                    if (stat(d->path.c_str(), &buf) != 0) {
+                        probe->state = State::kRemoved;
+                    } else if (!d->racy && buf.st_dev == d->device &&
+                            buf.st_ino == d->inode &&
+                            Nanoseconds(buf.st_mtim) == d->mtime) {
+                        probe->state = State::kUnchanged;
+                    } else {
+                        probe->state =
+                            Read(d) ? State::kRead : State::kUnreadable;
+                    }
+                })) {
+            // Try again next time.
+            continue;
+        }
+
+        switch (probe->state) {
+            case State::kRemoved:
+                // Report it once.
+                if (directory.inode != 0) {
+                    directory.inode = 0;
+                    directory.entries.clear();
+                    changed.push_back(directory.path);
+                }
+                break;
+            case State::kUnchanged:
+                break;
+            case State::kUnreadable:
+                directory.entries.clear();
+                changed.push_back(directory.path);
+                break;
+            case State::kRead:
+                if (fresh.inode != directory.inode ||
+                        fresh.entries != directory.entries) {
+                    changed.push_back(directory.path);
+                }
+                directory = std::move(fresh);
+                break;
+        }
+    }
+
+    // Back off while nothing changes, but never spend more than a fraction of
+    // our time polling.
+    if (changed.empty()) {
+        interval_ = std::min(interval_ * 2, max_interval_);
+    } else {
+        interval_ = min_interval_;
+    }
+    const Clock::time_point done = Clock::now();
+    interval_ = std::max(interval_, (done - now) * kMaxOverhead);
+    next_poll_ = done + interval_;
+
+    return changed;
+}
+
+size_t DirectoryPoller::MemoryUsage() const {
+    size_t usage = directories_.capacity() * sizeof(Directory);
+    for (const auto& directory : directories_) {
+        usage += directory.entries.capacity() * sizeof(Entry);
+        usage += directory.path.capacity();
+    }
+    // Approximately, for the index's nodes and buckets.
+    usage += index_.size() * (sizeof(std::string) + 2 * sizeof(void*)) +
+        index_.bucket_count() * sizeof(void*);
+    return usage;
+}
+
+bool DirectoryPoller::Run(dev_t device, std::function<void()> task) const {
+    if (!runner_) {
+        task();
+        return true;
+    }
+    return runner_(device, std::move(task));
+}
+
+bool DirectoryPoller::Read(Directory* directory) {
+    int fd;
+    do {
+        fd = open(directory->path.c_str(),
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return false;
+    }
+
+    // The mtime is taken before reading, so changes made while we read are
+    // seen by the next poll.
+    struct stat buf;
+    if (fstat(fd, &buf) != 0) {
+        close(fd);
+        return false;
+    }
+    directory->device = buf.st_dev;
+    directory->inode = buf.st_ino;
+    directory->mtime = Nanoseconds(buf.st_mtim);
+    directory->racy = WallNow() - directory->mtime < kRacyNs;
+
+    DIR* dir = fdopendir(fd);
+    if (dir == nullptr) {
+        close(fd);
+        return false;
+    }
+
+    directory->entries.clear();
+    while (struct dirent* ent = readdir(dir)) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        Entry entry;
+        entry.name = Hash(ent->d_name);
+        entry.inode = ent->d_ino;
+        entry.mtime = 0;
+        entry.size = 0;
+        struct stat child;
+        if (fstatat(dirfd(dir), ent->d_name, &child,
+                AT_SYMLINK_NOFOLLOW) == 0) {
+            // Subdirectories are polled in their own right, so only their
+            // identity matters here.
+            if (!S_ISDIR(child.st_mode)) {
+                entry.mtime = Nanoseconds(child.st_mtim);
+                entry.size = child.st_size;
+            }
+        }
+        directory->entries.push_back(entry);
+    }
+    closedir(dir);
+
+    std::sort(directory->entries.begin(), directory->entries.end());
+    directory->entries.shrink_to_fit();
+    return true;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,126 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__DIRECTORY_POLLER_H__
+#define __FILE_BINDER__DIRECTORY_POLLER_H__
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace file_binder {
+
+// DirectoryPoller detects changes to directories without inotify, for when
+// fs.inotify.max_user_watches is exhausted or the filesystem does not deliver
+// events (e.g. network filesystems).
+//
+// It keeps a compact snapshot of each directory's mtime and the identity of
+// its entries.  Each poll re-stats only the directories themselves, and
+// rereads only those whose mtime has changed, so a poll costs one stat per
+// directory plus work proportional to the changes.  Like Watcher, it relies
+// on files being replaced by renaming, which updates the directory's mtime.
+class DirectoryPoller {
+public:
+    typedef std::chrono::steady_clock Clock;
+    // Runs a task which reads from device, returning false if it did not
+    // complete, e.g. as it missed a deadline.  An unfinished task keeps
+    // running, and owns the state it touches.
+    typedef std::function<bool(dev_t, std::function<void()>)> Runner;
+    // Passed to the runner before the device is known.
+    static constexpr dev_t kUnknownDevice = static_cast<dev_t>(-1);
+
+    // Polls are spaced between min_interval and max_interval apart:  The
+    // interval is reset to min_interval when a change is found and doubles
+    // while nothing changes.
+    DirectoryPoller(
+        Clock::duration min_interval, Clock::duration max_interval);
+
+    // Stats and reads directories through runner, rather than on the calling
+    // thread.  A directory whose poll does not complete is polled again next
+    // time.
+    void SetRunner(Runner runner) { runner_ = std::move(runner); }
+
+    // Adds directory to the snapshot.  It returns false if it is unreadable.
+    bool Add(const std::string& directory);
+
+    // Returns the directories whose entries have changed since the last poll
+    // and schedules the next poll.
+    std::vector<std::string> Poll(Clock::time_point now);
+
+    Clock::time_point next_poll() const { return next_poll_; }
+    Clock::duration interval() const { return interval_; }
+
+    // The number of directories polled.
+    size_t size() const { return directories_.size(); }
+
+    // The memory used by the snapshot.
+    size_t MemoryUsage() const;
+private:
+    // The identity of a directory entry.  Names are stored as hashes, which
+    // is sufficient to notice entries being added, removed or replaced.
+    struct Entry {
+        uint64_t name;
+        uint64_t inode;
+        int64_t mtime;
+        uint64_t size;
+
+        bool operator<(const Entry& rhs) const { return name < rhs.name; }
+        bool operator==(const Entry& rhs) const {
+            return name == rhs.name && inode == rhs.inode &&
+                mtime == rhs.mtime && size == rhs.size;
+        }
+    };
+
+    struct Directory {
+        std::string path;
+        dev_t device;
+        ino_t inode;
+        int64_t mtime;
+        // True if the mtime is too recent to rely on, as the directory may
+        // change again within the timestamp's granularity.
+        bool racy;
+        // Sorted by name.
+        std::vector<Entry> entries;
+    };
+
+    // Rereads directory's entries, returning false if it is unreadable.
+    static bool Read(Directory* directory);
+
+    // Runs task through runner_, if any.
+    bool Run(dev_t device, std::function<void()> task) const;
+
+    const Clock::duration min_interval_;
+    const Clock::duration max_interval_;
+    Clock::duration interval_;
+    Clock::time_point next_poll_;
+
+    std::vector<Directory> directories_;
+    std::unordered_map<std::string, size_t> index_;
+
+    Runner runner_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__DIRECTORY_POLLER_H__
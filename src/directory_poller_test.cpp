@@ -0,0 +1,124 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "directory_poller.h"
+#include "temp_tree.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+typedef DirectoryPoller::Clock Clock;
+
+class DirectoryPollerTest : public ::testing::Test {
+protected:
+    DirectoryPollerTest()
+        : tree_("directory_poller_test"), root_(tree_.root()),
+          sub_(tree_.Path("sub")) {}
+
+    void SetUp() override {
+        ASSERT_FALSE(root_.empty());
+        ASSERT_TRUE(tree_.MakeDirectory("sub"));
+        ASSERT_TRUE(WriteFile(sub_ + "/a", "a"));
+    }
+
+    TempTree tree_;
+    const std::string root_;
+    const std::string sub_;
+};
+
+TEST_F(DirectoryPollerTest, DetectsChanges) {
+    DirectoryPoller poller(std::chrono::seconds(1), std::chrono::seconds(8));
+    ASSERT_TRUE(poller.Add(root_));
+    ASSERT_TRUE(poller.Add(sub_));
+    EXPECT_FALSE(poller.Add(root_ + "/missing"));
+    EXPECT_EQ(2, poller.size());
+
+    EXPECT_TRUE(poller.Poll(Clock::now()).empty());
+
+    // A new file.
+    ASSERT_TRUE(WriteFile(sub_ + "/b", "b"));
+    EXPECT_EQ(std::vector<std::string>{sub_}, poller.Poll(Clock::now()));
+    EXPECT_TRUE(poller.Poll(Clock::now()).empty());
+
+    // A file replaced by renaming.
+    ASSERT_TRUE(WriteFile(sub_ + "/c", "replacement"));
+    ASSERT_EQ(0, rename((sub_ + "/c").c_str(), (sub_ + "/a").c_str()));
+    EXPECT_EQ(std::vector<std::string>{sub_}, poller.Poll(Clock::now()));
+
+    // A removed file.
+    unlink((sub_ + "/b").c_str());
+    EXPECT_EQ(std::vector<std::string>{sub_}, poller.Poll(Clock::now()));
+}
+
+TEST_F(DirectoryPollerTest, AdaptiveInterval) {
+    DirectoryPoller poller(std::chrono::seconds(1), std::chrono::seconds(8));
+    ASSERT_TRUE(poller.Add(sub_));
+    EXPECT_EQ(std::chrono::seconds(1), poller.interval());
+
+    // The interval doubles while nothing changes, up to the maximum.
+    const Clock::duration expected[] = {
+        std::chrono::seconds(2), std::chrono::seconds(4),
+        std::chrono::seconds(8), std::chrono::seconds(8),
+    };
+    for (const auto& interval : expected) {
+        poller.Poll(Clock::now());
+        EXPECT_EQ(interval, poller.interval());
+    }
+    EXPECT_GE(poller.next_poll(), Clock::now() + std::chrono::seconds(7));
+
+    // A change resets it.
+    ASSERT_TRUE(WriteFile(sub_ + "/b", "b"));
+    EXPECT_FALSE(poller.Poll(Clock::now()).empty());
+    EXPECT_EQ(std::chrono::seconds(1), poller.interval());
+}
+
+TEST_F(DirectoryPollerTest, RetriesUnfinishedPolls) {
+    DirectoryPoller poller(std::chrono::seconds(1), std::chrono::seconds(8));
+    bool complete = true;
+    poller.SetRunner([&complete](dev_t, std::function<void()> task) {
+        if (!complete) {
+            return false;
+        }
+        task();
+        return true;
+    });
+    ASSERT_TRUE(poller.Add(sub_));
+
+    ASSERT_TRUE(WriteFile(sub_ + "/b", "b"));
+    complete = false;
+    EXPECT_TRUE(poller.Poll(Clock::now()).empty());
+
+    // The change is found once polls complete again.
+    complete = true;
+    EXPECT_EQ(std::vector<std::string>{sub_}, poller.Poll(Clock::now()));
+
+    complete = false;
+    EXPECT_FALSE(poller.Add(root_));
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -19,6 +19,7 @@
 #include "elf_parser.h"
 
 #include <cassert>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -26,443 +27,515 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <type_traits>
 #include <unordered_set>
 
 namespace file_binder {
 namespace {
 
-// Reads at most size bytes into buf.  Returns the number of bytes successfully
-// read.
-size_t TryReadBytesAtOffset(int fd, size_t offset, uint8_t* buf, size_t size) {
-    int ret = lseek(fd, offset, SEEK_SET);
-    if (ret < 0) {
-        throw ElfError("Unable to seek");
-    }
+// Upper bound on the size of the program header table and dynamic section we
+// are willing to read into memory.  Well-formed files are far smaller.
+const size_t kMaxTableSize = 1 << 20;
 
+// Reads at most size bytes into buf, storing the number of bytes read in
+// read.
+ElfStatus TryReadBytesAtOffset(
+        int fd, size_t offset, uint8_t* buf, size_t size, size_t* read) {
     ssize_t chunk;
     do {
-        chunk = read(fd, buf, size);
+        chunk = pread(fd, buf, size, offset);
     } while (chunk < 0 && errno == EINTR);
 
     if (chunk < 0) {
-        throw ElfError("Unable to read");
+        return ElfStatus::kReadError;
     }
 
-    return static_cast<size_t>(chunk);
+    *read = static_cast<size_t>(chunk);
+    return ElfStatus::kOk;
 }
 
-// Reads exactly size bytes into buf.  It throws an ElfError on failure.
-void ReadBytesAtOffset(int fd, size_t offset, uint8_t* buf, size_t size) {
-    int ret = lseek(fd, offset, SEEK_SET);
-    if (ret < 0) {
-        throw ElfError("Unable to seek");
-    }
-
+// Reads exactly size bytes into buf.
+ElfStatus ReadBytesAtOffset(int fd, size_t offset, uint8_t* buf, size_t size) {
     size_t consumed = 0;
     while (consumed < size) {
-        ssize_t chunk = read(fd, buf + consumed, size - consumed);
+        ssize_t chunk = pread(fd, buf + consumed, size - consumed,
+            offset + consumed);
         if (chunk < 0) {
             if (errno == EINTR) {
                 continue;
             }
 
-            throw ElfError("Unable to read");
+            return ElfStatus::kReadError;
         } else if (chunk == 0) {
-            throw ElfError("Premature EOF");
+            return ElfStatus::kTruncated;
         }
 
         consumed += static_cast<size_t>(chunk);
     }
+    return ElfStatus::kOk;
 }
 
-bool IsLittleEndian() {
-    const uint16_t x = 1;
-    return *reinterpret_cast<const uint8_t*>(&x) == 1;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+constexpr int kHostByteOrder = ELFDATA2LSB;
+#else
+constexpr int kHostByteOrder = ELFDATA2MSB;
+#endif
+
+inline uint16_t ByteSwap(uint16_t t) { return __builtin_bswap16(t); }
+inline uint32_t ByteSwap(uint32_t t) { return __builtin_bswap32(t); }
+inline uint64_t ByteSwap(uint64_t t) { return __builtin_bswap64(t); }
+inline int32_t ByteSwap(int32_t t) {
+    return static_cast<int32_t>(__builtin_bswap32(static_cast<uint32_t>(t)));
 }
-
-template<typename T>
-T ByteSwap(T t) {
-    static_assert(sizeof(t) == 0, "Not implemented");
+inline int64_t ByteSwap(int64_t t) {
+    return static_cast<int64_t>(__builtin_bswap64(static_cast<uint64_t>(t)));
 }
 
-template<>
-uint16_t ByteSwap(uint16_t t) {
-    return
-        ((t & 0x00FF) << 8) |
-        ((t & 0xFF00) >> 8);
-}
+// Decodes fields stored in the byte order Data.  For the host's byte order,
+// Load is the identity, so fields compile down to direct loads.
+template<int Data>
+struct ByteOrder {
+    static constexpr bool kSwap = Data != kHostByteOrder;
 
-template<>
-uint32_t ByteSwap(uint32_t t) {
-    return
-        ((t & 0x000000FF) << 24) |
-        ((t & 0x0000FF00) <<  8) |
-        ((t & 0x00FF0000) >>  8) |
-        ((t & 0xFF000000) >> 24);
-}
+    template<typename T>
+    static T Load(T t) {
+        return kSwap ? ByteSwap(t) : t;
+    }
+};
 
-template<>
-int32_t ByteSwap(int32_t t) {
-    return static_cast<int32_t>(ByteSwap(static_cast<uint32_t>(t)));
-}
+// The on-disk structures for each ELF class.
+template<int Class>
+struct ElfTypes;
 
 template<>
-uint64_t ByteSwap(uint64_t t) {
-    return
-        ((t & 0x00000000000000FFULL) << 56) |
-        ((t & 0x000000000000FF00ULL) << 40) |
-        ((t & 0x0000000000FF0000ULL) << 24) |
-        ((t & 0x00000000FF000000ULL) <<  8) |
-        ((t & 0x000000FF00000000ULL) >>  8) |
-        ((t & 0x0000FF0000000000ULL) >> 24) |
-        ((t & 0x00FF000000000000ULL) >> 40) |
-        ((t & 0xFF00000000000000ULL) >> 56);
-}
+struct ElfTypes<ELFCLASS32> {
+    typedef Elf32_Ehdr Ehdr;
+    typedef Elf32_Phdr Phdr;
+    typedef Elf32_Dyn  Dyn;
+};
 
 template<>
-int64_t ByteSwap(int64_t t) {
-    return static_cast<int64_t>(ByteSwap(static_cast<uint64_t>(t)));
-}
-
-// Swap the byte order of an ELF header.
-template<typename T>
-void SwapHeader(T& hdr) {
-    static_assert(
-        std::is_same<T, Elf32_Ehdr>::value ||
-        std::is_same<T, Elf64_Ehdr>::value,
-        "Not an Ehdr");
-
-    hdr.e_type      = ByteSwap(hdr.e_type);
-    hdr.e_machine   = ByteSwap(hdr.e_machine);
-    hdr.e_version   = ByteSwap(hdr.e_version);
-    hdr.e_entry     = ByteSwap(hdr.e_entry);
-    hdr.e_phoff     = ByteSwap(hdr.e_phoff);
-    hdr.e_shoff     = ByteSwap(hdr.e_shoff);
-    hdr.e_flags     = ByteSwap(hdr.e_flags);
-    hdr.e_ehsize    = ByteSwap(hdr.e_ehsize);
-    hdr.e_phentsize = ByteSwap(hdr.e_phentsize);
-    hdr.e_phnum     = ByteSwap(hdr.e_phnum);
-    hdr.e_shentsize = ByteSwap(hdr.e_shentsize);
-    hdr.e_shnum     = ByteSwap(hdr.e_shnum);
-    hdr.e_shstrndx  = ByteSwap(hdr.e_shstrndx);
-}
-
+struct ElfTypes<ELFCLASS64> {
+    typedef Elf64_Ehdr Ehdr;
+    typedef Elf64_Phdr Phdr;
+    typedef Elf64_Dyn  Dyn;
+};
+
+// The subset of a program header that we use, in native byte order and
+// zero-extended to 64 bits.
+struct ProgramHeader {
+    uint32_t type;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t filesz;
+    uint64_t memsz;
+};
+
+// Copies a T out of possibly unaligned storage.
 template<typename T>
-void SwapPHeader(T& hdr) {
-    static_assert(
-        std::is_same<T, Elf32_Phdr>::value ||
-        std::is_same<T, Elf64_Phdr>::value,
-        "Not an Phdr");
-
-    hdr.p_type   = ByteSwap(hdr.p_type);
-    hdr.p_flags  = ByteSwap(hdr.p_flags);
-    hdr.p_offset = ByteSwap(hdr.p_offset);
-    hdr.p_vaddr  = ByteSwap(hdr.p_vaddr);
-    hdr.p_paddr  = ByteSwap(hdr.p_paddr);
-    hdr.p_filesz = ByteSwap(hdr.p_filesz);
-    hdr.p_memsz  = ByteSwap(hdr.p_memsz);
-    hdr.p_align  = ByteSwap(hdr.p_align);
+T Copy(const uint8_t* bytes) {
+    static_assert(std::is_trivially_copyable<T>::value, "Not POD");
+    T t;
+    memcpy(&t, bytes, sizeof(t));
+    return t;
 }
 
-template<typename T>
-void SwapDHeader(T& hdr) {
-    static_assert(
-        std::is_same<T, Elf32_Dyn>::value ||
-        std::is_same<T, Elf64_Dyn>::value,
-        "Not an Phdr");
-
-    hdr.d_tag      = ByteSwap(hdr.d_tag);
-    hdr.d_un.d_val = ByteSwap(hdr.d_un.d_val);
-
-    static_assert(sizeof(hdr.d_un.d_val) == sizeof(hdr.d_un.d_ptr),
-        "Union field size mismatch.");
-}
+}  // namespace
 
-Elf64_Phdr Widen(const Elf32_Phdr& t) {
-    Elf64_Phdr ret;
-    ret.p_type   = t.p_type;
-    ret.p_offset = t.p_offset;
-    ret.p_vaddr  = t.p_vaddr;
-    ret.p_paddr  = t.p_paddr;
-    ret.p_filesz = t.p_filesz;
-    ret.p_memsz  = t.p_memsz;
-    ret.p_flags  = t.p_flags;
-    ret.p_align  = t.p_align;
-    return ret;
+const char* ElfStatusMessage(ElfStatus status) {
+    switch (status) {
+        case ElfStatus::kOk:
+            return "OK";
+        case ElfStatus::kNotElf:
+            return "Not an ELF file";
+        case ElfStatus::kTruncated:
+            return "Premature EOF";
+        case ElfStatus::kMalformed:
+            return "Malformed ELF file";
+        case ElfStatus::kReadError:
+            return "Unable to read";
+    }
+    return "Unknown error";
 }
 
-Elf64_Dyn Widen(const Elf32_Dyn& t) {
-    Elf64_Dyn ret;
-    ret.d_tag = t.d_tag;
-    ret.d_un.d_val = t.d_un.d_val;
-    static_assert(sizeof(t.d_un.d_val) == sizeof(t.d_un.d_ptr),
-        "Union field size mismatch.");
-    return ret;
+FileKind ClassifyFile(const uint8_t* prefix, size_t size) {
+    if (size >= SELFMAG && memcmp(prefix, ELFMAG, SELFMAG) == 0) {
+        return FileKind::kElf;
+    } else if (size >= 2 && prefix[0] == '#' && prefix[1] == '!') {
+        return FileKind::kScript;
+    }
+    return FileKind::kOther;
 }
 
-}  // namespace
-
 ElfError::ElfError(const std::string& what) : std::runtime_error(what) {}
 ElfError::~ElfError() {}
 
-ElfParser::ElfParser(int fd) : fd_(fd) {
-    union u_t {
-        Elf32_Ehdr x86;
-        Elf64_Ehdr x64;
-        uint8_t bytes[sizeof(x64)];
-    } u;
+class ElfParser::Impl {
+public:
+    virtual ~Impl() {}
+
+    // Reads the program header table, given the file header.
+    virtual ElfStatus Load(const uint8_t* header) = 0;
+    // Stores whether there is an interpreter in found, and if so, the
+    // interpreter.
+    virtual ElfStatus GetInterpreter(std::string* interpreter, bool* found) = 0;
+    virtual ElfStatus GetLibraryDependencies(
+        std::vector<std::string>* libraries) = 0;
+    virtual bool Is64Bit() const = 0;
+
+    // Returns an implementation for the ELF file open at fd, whose first size
+    // bytes are header, storing the outcome in status.
+    static std::unique_ptr<Impl> Open(
+        int fd, const uint8_t* header, size_t size, ElfStatus* status);
+};
 
-    static_assert(sizeof(u) == sizeof(u.x64), "Additional padding found");
-    static_assert(offsetof(u_t, x86) == offsetof(u_t, x64), "Invalid offsets");
+namespace {
 
-    // Verify the file is ELF and determine 32/64-bit.
-    ReadBytesAtOffset(fd_, 0, u.bytes, EI_CLASS + 1);
+template<int Class, int Data>
+class ElfImpl : public ElfParser::Impl {
+public:
+    typedef typename ElfTypes<Class>::Ehdr Ehdr;
+    typedef typename ElfTypes<Class>::Phdr Phdr;
+    typedef typename ElfTypes<Class>::Dyn  Dyn;
+    typedef ByteOrder<Data> Order;
+
+    explicit ElfImpl(int fd) : fd_(fd) {}
+
+    // header holds the first sizeof(Ehdr) bytes of the file.
+    ElfStatus Load(const uint8_t* header) override {
+        const Ehdr ehdr = Copy<Ehdr>(header);
+
+        const uint64_t phoff = Order::Load(ehdr.e_phoff);
+        const size_t phentsize = Order::Load(ehdr.e_phentsize);
+        const size_t phnum = Order::Load(ehdr.e_phnum);
+        if (phnum == 0) {
+            return ElfStatus::kOk;
+        } else if (phentsize != sizeof(Phdr)) {
+            // Unexpected program header size.
+            return ElfStatus::kMalformed;
+        } else if (phnum * phentsize > kMaxTableSize) {
+            // Program header table too large.
+            return ElfStatus::kMalformed;
+        }
 
-    if (memcmp(u.bytes, ELFMAG, SELFMAG) != 0) {
-        throw ElfError("Not an ELF file");
-    }
+        // Read the entire program header table at once, rather than issuing
+        // a read per entry.
+        std::vector<uint8_t> table(phnum * phentsize);
+        const ElfStatus status =
+            ReadBytesAtOffset(fd_, phoff, table.data(), table.size());
+        if (status != ElfStatus::kOk) {
+            return status;
+        }
 
-    const uint8_t c = u.bytes[EI_CLASS];
-    if (c == ELFCLASSNONE || c >= ELFCLASSNUM) {
-        throw ElfError("Unknown class");
+        phdrs_.reserve(phnum);
+        for (size_t i = 0; i < phnum; i++) {
+            const Phdr phdr = Copy<Phdr>(&table[i * sizeof(Phdr)]);
+
+            ProgramHeader hdr;
+            hdr.type   = Order::Load(phdr.p_type);
+            hdr.offset = Order::Load(phdr.p_offset);
+            hdr.vaddr  = Order::Load(phdr.p_vaddr);
+            hdr.filesz = Order::Load(phdr.p_filesz);
+            hdr.memsz  = Order::Load(phdr.p_memsz);
+            phdrs_.push_back(hdr);
+        }
+        return ElfStatus::kOk;
     }
-    x64_ = c == ELFCLASS64;
 
-    // Read the rest of the header.
-    ReadBytesAtOffset(fd_, EI_CLASS + 1, u.bytes + EI_CLASS + 1,
-        (x64_ ? sizeof(u.x64) : sizeof(u.x86)) - (EI_CLASS + 1));
+    ElfStatus GetInterpreter(std::string* interpreter, bool* found) override {
+        *found = false;
+        for (const auto& hdr : phdrs_) {
+            if (hdr.type != PT_INTERP) {
+                continue;
+            } else if (hdr.filesz < 1 || hdr.filesz > kMaxTableSize) {
+                // Empty or implausibly long.
+                return ElfStatus::kMalformed;
+            }
 
-    const uint8_t byte_order = u.bytes[EI_DATA];
-    if (byte_order == ELFDATANONE || byte_order >= ELFDATANUM) {
-        throw ElfError("Unknown byte order");
-    }
-    le_ = byte_order == ELFDATA2LSB;
+            interpreter->resize(hdr.filesz);
+            const ElfStatus status = ReadBytesAtOffset(
+                fd_, hdr.offset,
+                reinterpret_cast<uint8_t*>(&(*interpreter)[0]), hdr.filesz);
+            if (status != ElfStatus::kOk) {
+                return status;
+            }
 
-    if (le_ != IsLittleEndian()) {
-        if (x64_) {
-            SwapHeader(u.x64);
-        } else {
-            SwapHeader(u.x86);
+            if ((*interpreter)[hdr.filesz - 1] != '\0') {
+                // Not null terminated.
+                return ElfStatus::kMalformed;
+            }
+            interpreter->resize(hdr.filesz - 1);
+            *found = true;
+            return ElfStatus::kOk;
         }
-    }
 
-    // Copy relevant fields.
-    if (x64_) {
-        phoff_      = u.x64.e_phoff;
-        phentsize_  = u.x64.e_phentsize;
-        phnum_      = u.x64.e_phnum;
-        shoff_      = u.x64.e_shoff;
-        shentsize_  = u.x64.e_shentsize;
-        shnum_      = u.x64.e_shnum;
-        shstrndx_   = u.x64.e_shstrndx;
-    } else {
-        phoff_      = u.x86.e_phoff;
-        phentsize_  = u.x86.e_phentsize;
-        phnum_      = u.x86.e_phnum;
-        shoff_      = u.x86.e_shoff;
-        shentsize_  = u.x86.e_shentsize;
-        shnum_      = u.x86.e_shnum;
-        shstrndx_   = u.x86.e_shstrndx;
+        return ElfStatus::kOk;
     }
-}
 
-ElfParser::~ElfParser() {}
+    ElfStatus GetLibraryDependencies(
+            std::vector<std::string>* libraries) override {
+        std::vector<const ProgramHeader*> loads;
+        std::vector<uint64_t> needed_offsets;
+        bool dynsym_found = false;
+        uint64_t dynsym = 0;
 
-void ElfParser::ReadPHeader(size_t offset, Elf64_Phdr* hdr) {
-    union u_t {
-        Elf32_Phdr x86;
-        Elf64_Phdr x64;
-        uint8_t bytes[sizeof(x64)];
-    } u;
+        for (const auto& hdr : phdrs_) {
+            if (hdr.type == PT_LOAD) {
+                loads.push_back(&hdr);
+                continue;
+            }
 
-    static_assert(offsetof(u_t, x64) == offsetof(u_t, x86),
-        "Invalid offsets");
-    static_assert(sizeof(u) == sizeof(u.x64), "Invalid padding");
+            if (hdr.type != PT_DYNAMIC) {
+                continue;
+            }
 
-    const size_t size   = x64_ ? sizeof(u.x64) : sizeof(u.x86);
-    assert(size == phentsize_);
+            const size_t size = std::min(
+                static_cast<size_t>(hdr.filesz), kMaxTableSize) /
+                sizeof(Dyn) * sizeof(Dyn);
+            std::vector<uint8_t> dynamic(size);
+            const ElfStatus status =
+                ReadBytesAtOffset(fd_, hdr.offset, dynamic.data(), size);
+            if (status != ElfStatus::kOk) {
+                return status;
+            }
 
-    ReadBytesAtOffset(fd_, offset, u.bytes, size);
+            for (size_t d = 0; d < size; d += sizeof(Dyn)) {
+                const Dyn dyn = Copy<Dyn>(&dynamic[d]);
+                const int64_t tag = Order::Load(dyn.d_tag);
+                if (tag == DT_NULL) {
+                    break;
+                }
 
-    if (le_ != IsLittleEndian()) {
-        if (x64_) {
-            SwapPHeader(u.x64);
-        } else {
-            SwapPHeader(u.x86);
+                switch (tag) {
+                    case DT_NEEDED:
+                        needed_offsets.push_back(Order::Load(dyn.d_un.d_val));
+                        break;
+                    case DT_STRTAB:
+                        dynsym_found = true;
+                        dynsym = Order::Load(dyn.d_un.d_ptr);
+                        break;
+                    default:
+                        break;
+                }
+            }
         }
-    }
-
-    if (x64_) {
-        *hdr = u.x64;
-    } else {
-        *hdr = Widen(u.x86);
-    }
-}
 
-void ElfParser::ReadDHeader(size_t offset, Elf64_Dyn* hdr) {
-    union u_t {
-        Elf32_Dyn x86;
-        Elf64_Dyn x64;
-        uint8_t bytes[sizeof(x64)];
-    } u;
+        std::unordered_set<std::string> libs;
 
-    static_assert(offsetof(u_t, x64) == offsetof(u_t, x86),
-        "Invalid offsets");
-    static_assert(sizeof(u) == sizeof(u.x64), "Invalid padding");
+        if (!needed_offsets.empty() && !dynsym_found) {
+            // DT_NEEDED entries without a string table.
+            return ElfStatus::kMalformed;
+        }
+        if (dynsym_found) {
+            size_t load_idx;
+            for (load_idx = 0; load_idx < loads.size(); load_idx++) {
+                const auto& phdr = *loads[load_idx];
+                if (phdr.vaddr <= dynsym &&
+                        dynsym <= phdr.vaddr + phdr.memsz) {
+                    // Found a load that covers DT_STRTAB.
+                    break;
+                }
+            }
 
-    const size_t size   = x64_ ? sizeof(u.x64) : sizeof(u.x86);
-    ReadBytesAtOffset(fd_, offset, u.bytes, size);
+            if (load_idx == loads.size()) {
+                // No LOAD covers DT_STRTAB.
+                return ElfStatus::kMalformed;
+            }
+            const auto& load = *loads[load_idx];
+            assert(dynsym >= load.vaddr);
+            const size_t strtab_offset = dynsym - load.vaddr + load.offset;
+            // This is a coarse upperbound, but we should not cross into
+            // another load boundary while reading the strtab section.
+            const size_t strtab_limit  = load.memsz - (dynsym - load.vaddr);
+
+            for (const auto& needed_offset : needed_offsets) {
+                size_t offset = strtab_offset + needed_offset;
+                if (needed_offset > strtab_limit) {
+                    return ElfStatus::kMalformed;
+                }
+                size_t limit  = strtab_limit  - needed_offset;
+
+                // The string is null-terminated, so we read 64 byte pieces at
+                // a time until we find a null (or until we hit the limit).
+                std::string sym;
+                size_t nullpos = std::string::npos;
+                do {
+                    const size_t old_size = sym.size();
+                    size_t to_read = std::min(limit, size_t(64));
+                    sym.append(to_read, '\0');
+
+                    size_t bytes_read = 0;
+                    const ElfStatus status = TryReadBytesAtOffset(
+                        fd_, offset,
+                        reinterpret_cast<uint8_t*>(&sym[old_size]), to_read,
+                        &bytes_read);
+                    if (status != ElfStatus::kOk) {
+                        return status;
+                    } else if (bytes_read == 0) {
+                        nullpos = old_size;
+                        break;
+                    }
+
+                    offset += bytes_read;
+                    assert(limit >= bytes_read);
+                    limit  -= bytes_read;
+
+                    sym.resize(old_size + bytes_read);
+                } while ((nullpos = sym.find('\0')) == std::string::npos);
+
+                if (nullpos != std::string::npos) {
+                    sym.resize(nullpos);
+                }
 
-    if (le_ != IsLittleEndian()) {
-        if (x64_) {
-            SwapDHeader(u.x64);
-        } else {
-            SwapDHeader(u.x86);
+                if (!sym.empty()) {
+                    libs.insert(sym);
+                }
+            }
         }
+
+        libraries->assign(libs.begin(), libs.end());
+        return ElfStatus::kOk;
     }
 
-    if (x64_) {
-        *hdr = u.x64;
-    } else {
-        *hdr = Widen(u.x86);
+    bool Is64Bit() const override {
+        return Class == ELFCLASS64;
     }
-}
+private:
+    int fd_;
+    std::vector<ProgramHeader> phdrs_;
+};
 
-bool ElfParser::GetInterpreter(std::string* interpreter) {
-    for (unsigned i = 0; i < phnum_; i++) {
-        const size_t offset = phoff_ + i * phentsize_;
-        Elf64_Phdr hdr;
-        ReadPHeader(offset, &hdr);
-
-        if (hdr.p_type != PT_INTERP) {
-            continue;
-        } else if (hdr.p_filesz < 1) {
-            throw ElfError("Interpeter size 0 bytes");
-        }
+}  // namespace
 
-        interpreter->resize(hdr.p_filesz);
-        ReadBytesAtOffset(
-            fd_, hdr.p_offset, reinterpret_cast<uint8_t*>(&(*interpreter)[0]),
-            hdr.p_filesz);
+std::unique_ptr<ElfParser::Impl> ElfParser::Impl::Open(
+        int fd, const uint8_t* header, size_t size, ElfStatus* status) {
+    std::unique_ptr<Impl> impl;
+    if (size < SELFMAG || memcmp(header, ELFMAG, SELFMAG) != 0) {
+        *status = ElfStatus::kNotElf;
+        return impl;
+    } else if (size < EI_NIDENT) {
+        *status = ElfStatus::kTruncated;
+        return impl;
+    }
 
-        if ((*interpreter)[hdr.p_filesz - 1] != '\0') {
-            throw ElfError("Interpreter not null terminated");
-        }
-        interpreter->resize(hdr.p_filesz - 1);
-        return true;
+    const uint8_t c = header[EI_CLASS];
+    if (c == ELFCLASSNONE || c >= ELFCLASSNUM) {
+        // Unknown class.
+        *status = ElfStatus::kMalformed;
+        return impl;
     }
+    const bool x64 = c == ELFCLASS64;
 
-    return false;
-}
+    if (size < (x64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr))) {
+        *status = ElfStatus::kTruncated;
+        return impl;
+    }
 
-std::vector<std::string> ElfParser::GetLibraryDependencies() {
-    std::vector<Elf64_Phdr> loads;
-    std::vector<Elf64_Xword> needed_offsets;
-    bool dynsym_found = false;
-    Elf64_Addr dynsym = 0;
-
-    for (unsigned i = 0; i < phnum_; i++) {
-        const size_t offset = phoff_ + i * phentsize_;
-        Elf64_Phdr hdr;
-        ReadPHeader(offset, &hdr);
-
-        if (hdr.p_type == PT_LOAD) {
-            loads.push_back(hdr);
-            continue;
-        }
+    const uint8_t byte_order = header[EI_DATA];
+    if (byte_order == ELFDATANONE || byte_order >= ELFDATANUM) {
+        // Unknown byte order.
+        *status = ElfStatus::kMalformed;
+        return impl;
+    }
+    const bool le = byte_order == ELFDATA2LSB;
 
-        if (hdr.p_type != PT_DYNAMIC) {
-            continue;
+    // This is the only point at which we branch on the class and byte order.
+    if (x64) {
+        if (le) {
+            impl.reset(new ElfImpl<ELFCLASS64, ELFDATA2LSB>(fd));
+        } else {
+            impl.reset(new ElfImpl<ELFCLASS64, ELFDATA2MSB>(fd));
         }
+    } else {
+        if (le) {
+            impl.reset(new ElfImpl<ELFCLASS32, ELFDATA2LSB>(fd));
+        } else {
+            impl.reset(new ElfImpl<ELFCLASS32, ELFDATA2MSB>(fd));
+        }
+    }
 
-        const size_t dentsize = x64_ ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
-        for (size_t d = 0; d + dentsize <= hdr.p_filesz; d += dentsize) {
-            Elf64_Dyn dyn;
-            ReadDHeader(hdr.p_offset + d, &dyn);
+    *status = impl->Load(header);
+    if (*status != ElfStatus::kOk) {
+        impl.reset();
+    }
+    return impl;
+}
 
-            switch (dyn.d_tag) {
-                case DT_NEEDED:
-                    needed_offsets.push_back(dyn.d_un.d_val);
-                    break;
-                case DT_STRTAB:
-                    dynsym_found = true;
-                    dynsym = dyn.d_un.d_ptr;
-                    break;
-                default:
-                    break;
-            }
+ElfResult<ElfDependencies> ParseElfDependencies(
+        int fd, const uint8_t* prefix, size_t size) {
+    // The header of either class fits in the prefix of a well-formed file,
+    // but we may have been handed less.
+    uint8_t header[sizeof(Elf64_Ehdr)];
+    static_assert(sizeof(Elf64_Ehdr) >= sizeof(Elf32_Ehdr), "Header sizes");
+    if (size < sizeof(header)) {
+        const ElfStatus status =
+            TryReadBytesAtOffset(fd, 0, header, sizeof(header), &size);
+        if (status != ElfStatus::kOk) {
+            return status;
         }
+        prefix = header;
     }
 
-    std::unordered_set<std::string> libs;
-
-    // TODO:  replace this assertion as it is dependent on the contents of the
-    // ELF file being correctly formed.
-    assert(needed_offsets.empty() || dynsym_found);
-    if (dynsym_found) {
-        size_t load_idx;
-        for (load_idx = 0; load_idx < loads.size(); load_idx++) {
-            const auto& phdr = loads[load_idx];
-            if (phdr.p_vaddr <= dynsym &&
-                    dynsym <= phdr.p_vaddr + phdr.p_memsz) {
-                // Found a load that covers DT_STRTAB.
-                break;
-            }
-        }
+    ElfStatus status;
+    std::unique_ptr<ElfParser::Impl> impl =
+        ElfParser::Impl::Open(fd, prefix, size, &status);
+    if (!impl) {
+        return status;
+    }
 
-        if (load_idx == loads.size()) {
-            throw ElfError("Unable to find appropriate LOAD");
-        }
-        const auto& load = loads[load_idx];
-        assert(dynsym >= load.p_vaddr);
-        const size_t strtab_offset = dynsym - load.p_vaddr + load.p_offset;
-        // This is a coarse upperbound, but we should not cross into another
-        // load boundary while reading the strtab section.
-        const size_t strtab_limit  = load.p_memsz - (dynsym - load.p_vaddr);
-
-        for (const auto& needed_offset : needed_offsets) {
-            size_t offset = strtab_offset + needed_offset;
-            // This is dependent on the ELF file being correctly formatted.
-            assert(strtab_limit >= needed_offset);
-            size_t limit  = strtab_limit  - needed_offset;
-
-            // The string is null-terminated, so we read 64 byte pieces at a
-            // time until we find a null (or until we hit the limit).
-            std::string sym;
-            size_t nullpos = std::string::npos;
-            do {
-                const size_t old_size = sym.size();
-                size_t to_read = std::min(limit, size_t(64));
-                sym.append(to_read, '\0');
-
-                size_t bytes_read = TryReadBytesAtOffset(
-                    fd_, offset, reinterpret_cast<uint8_t*>(&sym[old_size]),
-                    to_read);
-                if (bytes_read == 0) {
-                    nullpos = old_size;
-                    break;
-                }
+    ElfDependencies deps;
+    deps.is_64bit = impl->Is64Bit();
+    status = impl->GetInterpreter(&deps.interpreter, &deps.has_interpreter);
+    if (status != ElfStatus::kOk) {
+        return status;
+    }
+    status = impl->GetLibraryDependencies(&deps.libraries);
+    if (status != ElfStatus::kOk) {
+        return status;
+    }
+    return ElfResult<ElfDependencies>(std::move(deps));
+}
 
-                offset += bytes_read;
-                assert(limit >= bytes_read);
-                limit  -= bytes_read;
+ElfParser::ElfParser(int fd) {
+    // Read enough for either class of header.  Shorter reads are diagnosed
+    // once we know which header to expect.
+    uint8_t header[sizeof(Elf64_Ehdr)];
+    static_assert(sizeof(Elf64_Ehdr) >= sizeof(Elf32_Ehdr), "Header sizes");
+
+    size_t size = 0;
+    ElfStatus status =
+        TryReadBytesAtOffset(fd, 0, header, sizeof(header), &size);
+    if (status == ElfStatus::kOk) {
+        impl_ = Impl::Open(fd, header, size, &status);
+    }
+    if (status != ElfStatus::kOk) {
+        throw ElfError(ElfStatusMessage(status));
+    }
+}
 
-                sym.resize(old_size + bytes_read);
-            } while ((nullpos = sym.find('\0')) == std::string::npos);
+ElfParser::~ElfParser() {}
 
-            if (nullpos != std::string::npos) {
-                sym.resize(nullpos);
-            }
+bool ElfParser::GetInterpreter(std::string* interpreter) {
+    bool found;
+    const ElfStatus status = impl_->GetInterpreter(interpreter, &found);
+    if (status != ElfStatus::kOk) {
+        throw ElfError(ElfStatusMessage(status));
+    }
+    return found;
+}
 
-            if (!sym.empty()) {
-                libs.insert(sym);
-            }
-        }
+std::vector<std::string> ElfParser::GetLibraryDependencies() {
+    std::vector<std::string> libraries;
+    const ElfStatus status = impl_->GetLibraryDependencies(&libraries);
+    if (status != ElfStatus::kOk) {
+        throw ElfError(ElfStatusMessage(status));
     }
+    return libraries;
+}
 
-    std::vector<std::string> ret;
-    ret.insert(ret.begin(), libs.begin(), libs.end());
-    return ret;
+bool ElfParser::Is64Bit() const {
+    return impl_->Is64Bit();
 }
 
 }  // namespace file_binder
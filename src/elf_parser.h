@@ -20,12 +20,74 @@
 #define __FILE_BINDER__ELF_PARSER_H_
 
 #include <elf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace file_binder {
 
+// The outcome of a parse, for callers which would rather not pay for an
+// exception per unparseable file.
+enum class ElfStatus {
+    kOk,
+    kNotElf,
+    kTruncated,
+    kMalformed,
+    kReadError,
+};
+
+// Returns a description of status.
+const char* ElfStatusMessage(ElfStatus status);
+
+// ElfResult holds either a value or the status explaining its absence, in
+// the manner of std::expected.
+template<typename T>
+class ElfResult {
+public:
+    ElfResult(T value) : status_(ElfStatus::kOk), value_(std::move(value)) {}
+    ElfResult(ElfStatus status) : status_(status), value_() {}
+
+    bool ok() const { return status_ == ElfStatus::kOk; }
+    ElfStatus status() const { return status_; }
+
+    // Only meaningful if ok().
+    T& value() { return value_; }
+    const T& value() const { return value_; }
+private:
+    ElfStatus status_;
+    T value_;
+};
+
+// The runtime dependencies of an ELF file.
+struct ElfDependencies {
+    bool is_64bit = false;
+    bool has_interpreter = false;
+    std::string interpreter;
+    std::vector<std::string> libraries;
+};
+
+// Parses the dependencies of the ELF file open at fd, whose first size bytes
+// have already been read into prefix, e.g. by ClassifyFile.  It does not
+// throw.
+ElfResult<ElfDependencies> ParseElfDependencies(
+    int fd, const uint8_t* prefix, size_t size);
+
+// The kinds of file that ClassifyFile distinguishes.
+enum class FileKind {
+    kElf,
+    kScript,
+    kOther,
+};
+
+// Classifies a file from its first size bytes, so that files which are
+// neither ELF nor scripts need not be read any further.
+FileKind ClassifyFile(const uint8_t* prefix, size_t size);
+
 class ElfError : public std::runtime_error {
 public:
     ElfError(const std::string& what);
@@ -35,8 +97,9 @@ public:
 class ElfParser {
 public:
     // ElfParser parses the contents of the ELF file.  It throws ElfError on
-    // failure at any point of the parse.  The file descriptor must remain
-    // valid for the lifetime of this class.
+    // failure at any point of the parse; see ParseElfDependencies for a
+    // non-throwing alternative.  The file descriptor must remain valid for
+    // the lifetime of this class.
     explicit ElfParser(int fd);
     ~ElfParser();
 
@@ -46,29 +109,19 @@ public:
 
     // Enumerates all of the dynamic library dependencies of this ELF file.
     std::vector<std::string> GetLibraryDependencies();
+
+    // Returns true if this is a 64-bit (ELFCLASS64) file.
+    bool Is64Bit() const;
+
+    // The parsing core, specialized for each ELF class and byte order.  The
+    // class and byte order are examined once per file, when constructing the
+    // implementation, rather than for each field decoded.
+    class Impl;
 private:
-    // Reads the program header at offset, widening as needed to an Elf64
-    // formatted version.
-    void ReadPHeader(size_t offset, Elf64_Phdr* hdr);
-
-    // Reads the dynamic header at offset, widening as needed to an Elf64
-    // formatted version.
-    void ReadDHeader(size_t offset, Elf64_Dyn* hdr);
-
-    int fd_;
-    bool x64_;
-    bool le_;
-
-    // These values are in native byte order and have been zero-extended to the
-    // 64-bit varieties.
-    Elf64_Off phoff_;
-    Elf64_Half phentsize_;
-    Elf64_Half phnum_;
-
-    Elf64_Off shoff_;
-    Elf64_Half shentsize_;
-    Elf64_Half shnum_;
-    Elf64_Half shstrndx_;
+    ElfParser(const ElfParser&) = delete;
+    ElfParser& operator=(const ElfParser&) = delete;
+
+    std::unique_ptr<Impl> impl_;
 };
 
 }  // namespace file_binder
@@ -0,0 +1,129 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the cost of parsing the interpreter and library dependencies of
+// the test binaries.  Usage:  elf_parser_benchmark [iterations]
+
+#include "elf_parser.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    const long iterations = argc > 1 ? atol(argv[1]) : 100000;
+
+    const char* base_ptr = getenv("TEST_SRCDIR");
+    const char* work_ptr = getenv("TEST_WORKSPACE");
+
+    std::string base;
+    if (base_ptr != nullptr) {
+        base += base_ptr;
+        base += "/";
+    }
+    if (work_ptr != nullptr) {
+        base += work_ptr;
+        base += "/";
+    }
+
+    const std::vector<std::string> binaries{
+        base + "src/testdata/hello_x64_dyn",
+        base + "src/testdata/hello_x64_static",
+        base + "src/testdata/hello_x86_dyn",
+        base + "src/testdata/hello_x86_static",
+    };
+
+    for (const auto& binary : binaries) {
+        int fd;
+        do {
+            fd = open(binary.c_str(), O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0) {
+            fprintf(stderr, "Unable to open %s\n", binary.c_str());
+            return 1;
+        }
+
+        size_t deps = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; i++) {
+            file_binder::ElfParser parser(fd);
+
+            std::string interpreter;
+            parser.GetInterpreter(&interpreter);
+            deps += parser.GetLibraryDependencies().size();
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        const double ns = std::chrono::duration<double, std::nano>(
+            elapsed).count();
+        printf("%-40s %10.1f ns/parse (%zu deps)\n",
+            binary.substr(base.size()).c_str(), ns / iterations,
+            deps / iterations);
+
+        close(fd);
+    }
+
+    // Files which are not ELF at all, such as this benchmark's source, are
+    // the common case when scanning data-heavy trees.
+    const std::string text = base + "src/elf_parser_benchmark.cc";
+    int fd;
+    do {
+        fd = open(text.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s\n", text.c_str());
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        try {
+            file_binder::ElfParser parser(fd);
+        } catch (file_binder::ElfError& ex) {
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%-40s %10.1f ns/parse\n", "non-ELF, ElfParser", ns / iterations);
+
+    size_t other = 0;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        uint8_t prefix[256];
+        const ssize_t size = pread(fd, prefix, sizeof(prefix), 0);
+        if (size > 0 && file_binder::ClassifyFile(prefix, size) ==
+                file_binder::FileKind::kOther) {
+            other++;
+        }
+    }
+    ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%-40s %10.1f ns/parse (%zu skipped)\n", "non-ELF, ClassifyFile",
+        ns / iterations, other / iterations);
+
+    close(fd);
+    return 0;
+}
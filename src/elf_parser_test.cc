@@ -18,10 +18,14 @@
 
 #include "elf_parser.h"
 
+#include <cstring>
+#include <elf.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <vector>
 #include <string>
@@ -96,5 +100,150 @@ TEST(ElfParser, Dependencies) {
     }
 }
 
+// Appends the big-endian encoding of value to out.
+template<typename T>
+void AppendBigEndian(T value, std::vector<uint8_t>* out) {
+    for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8) {
+        out->push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+TEST(ElfParser, BigEndian) {
+    // Construct a minimal big-endian ELF64 file with a single PT_INTERP
+    // program header.
+    const char interp[] = "/lib/ld64.so.1";
+    const size_t phoff = sizeof(Elf64_Ehdr);
+    const size_t interp_offset = phoff + sizeof(Elf64_Phdr);
+
+    std::vector<uint8_t> file = {
+        ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2MSB,
+        EV_CURRENT};
+    file.resize(EI_NIDENT);
+    AppendBigEndian<uint16_t>(ET_EXEC, &file);              // e_type
+    AppendBigEndian<uint16_t>(EM_PPC64, &file);             // e_machine
+    AppendBigEndian<uint32_t>(EV_CURRENT, &file);           // e_version
+    AppendBigEndian<uint64_t>(0, &file);                    // e_entry
+    AppendBigEndian<uint64_t>(phoff, &file);                // e_phoff
+    AppendBigEndian<uint64_t>(0, &file);                    // e_shoff
+    AppendBigEndian<uint32_t>(0, &file);                    // e_flags
+    AppendBigEndian<uint16_t>(sizeof(Elf64_Ehdr), &file);   // e_ehsize
+    AppendBigEndian<uint16_t>(sizeof(Elf64_Phdr), &file);   // e_phentsize
+    AppendBigEndian<uint16_t>(1, &file);                    // e_phnum
+    AppendBigEndian<uint16_t>(0, &file);                    // e_shentsize
+    AppendBigEndian<uint16_t>(0, &file);                    // e_shnum
+    AppendBigEndian<uint16_t>(0, &file);                    // e_shstrndx
+    ASSERT_EQ(phoff, file.size());
+
+    AppendBigEndian<uint32_t>(PT_INTERP, &file);            // p_type
+    AppendBigEndian<uint32_t>(PF_R, &file);                 // p_flags
+    AppendBigEndian<uint64_t>(interp_offset, &file);        // p_offset
+    AppendBigEndian<uint64_t>(0, &file);                    // p_vaddr
+    AppendBigEndian<uint64_t>(0, &file);                    // p_paddr
+    AppendBigEndian<uint64_t>(sizeof(interp), &file);       // p_filesz
+    AppendBigEndian<uint64_t>(sizeof(interp), &file);       // p_memsz
+    AppendBigEndian<uint64_t>(1, &file);                    // p_align
+    ASSERT_EQ(interp_offset, file.size());
+    file.insert(file.end(), interp, interp + sizeof(interp));
+
+    char name[] = "/tmp/elf_parser.XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(static_cast<ssize_t>(file.size()),
+        write(fd, file.data(), file.size()));
+
+    ElfParser parser(fd);
+    EXPECT_TRUE(parser.Is64Bit());
+
+    std::string interpreter;
+    EXPECT_TRUE(parser.GetInterpreter(&interpreter));
+    EXPECT_EQ(interp, interpreter);
+    EXPECT_EQ(0, parser.GetLibraryDependencies().size());
+
+    ::unlink(name);
+    ::close(fd);
+}
+
+TEST(ElfParser, NotElf) {
+    char name[] = "/tmp/elf_parser.XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    const char contents[] = "#!/bin/sh\n";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(contents)),
+        write(fd, contents, sizeof(contents)));
+
+    EXPECT_THROW(ElfParser parser(fd), ElfError);
+
+    const uint8_t* prefix = reinterpret_cast<const uint8_t*>(contents);
+    EXPECT_EQ(FileKind::kScript, ClassifyFile(prefix, sizeof(contents)));
+    EXPECT_EQ(ElfStatus::kNotElf,
+        ParseElfDependencies(fd, prefix, sizeof(contents)).status());
+
+    ::unlink(name);
+    ::close(fd);
+}
+
+TEST(ElfParser, NonThrowing) {
+    const char* base_ptr = getenv("TEST_SRCDIR");
+    const char* work_ptr = getenv("TEST_WORKSPACE");
+
+    std::string binary;
+    if (base_ptr != nullptr) {
+        binary += base_ptr;
+        binary += "/";
+    }
+    if (work_ptr != nullptr) {
+        binary += work_ptr;
+        binary += "/";
+    }
+    binary += "src/testdata/hello_x64_dyn";
+
+    int fd = open(binary.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "opening " << binary << " failed " << errno;
+
+    uint8_t prefix[256];
+    const ssize_t size = pread(fd, prefix, sizeof(prefix), 0);
+    ASSERT_GT(size, 0);
+    EXPECT_EQ(FileKind::kElf, ClassifyFile(prefix, size));
+
+    ElfResult<ElfDependencies> result = ParseElfDependencies(fd, prefix, size);
+    ASSERT_TRUE(result.ok()) << ElfStatusMessage(result.status());
+
+    ElfParser parser(fd);
+    std::string interpreter;
+    EXPECT_EQ(parser.GetInterpreter(&interpreter),
+        result.value().has_interpreter);
+    EXPECT_EQ(interpreter, result.value().interpreter);
+    EXPECT_EQ(parser.Is64Bit(), result.value().is_64bit);
+    std::vector<std::string> expected = parser.GetLibraryDependencies();
+    std::vector<std::string> actual = result.value().libraries;
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    EXPECT_EQ(expected, actual);
+
+    // A short prefix is topped up from the file.
+    EXPECT_TRUE(ParseElfDependencies(fd, prefix, 4).ok());
+
+    // Malformed and truncated files are reported rather than thrown.
+    uint8_t bad[sizeof(Elf64_Ehdr)];
+    memcpy(bad, prefix, sizeof(bad));
+    bad[EI_CLASS] = ELFCLASSNUM;
+    EXPECT_EQ(ElfStatus::kMalformed,
+        ParseElfDependencies(fd, bad, sizeof(bad)).status());
+
+    char name[] = "/tmp/elf_parser.XXXXXX";
+    int short_fd = mkstemp(name);
+    ASSERT_GE(short_fd, 0);
+    ASSERT_EQ(EI_NIDENT, write(short_fd, prefix, EI_NIDENT));
+    EXPECT_EQ(ElfStatus::kTruncated,
+        ParseElfDependencies(short_fd, prefix, EI_NIDENT).status());
+    ::unlink(name);
+    ::close(short_fd);
+
+    const uint8_t text[] = "plain text";
+    EXPECT_EQ(FileKind::kOther, ClassifyFile(text, sizeof(text)));
+
+    close(fd);
+}
+
 }  // namespace
 }  // namespace file_binder
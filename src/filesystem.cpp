@@ -18,28 +18,110 @@
 
 #include "filesystem.h"
 
-#include <ftw.h>
-#include <sys/types.h>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
 #include <unistd.h>
 
-#include <mutex>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "kernel_features.h"
+
+#ifndef __NR_statx
+#define __NR_statx 332
+#endif
 
 namespace file_binder {
 namespace {
 
-// callback_mx protects callback
-std::mutex callback_mx;
-std::function<void(const std::string&, const struct stat&)> callback_;
+// Stats name, relative to dirfd.  statx is asked for only the fields our
+// callers use, which spares network filesystems from fetching the rest; the
+// others are left zeroed.
+bool Stat(int dirfd, const char* name, bool follow, struct stat* buf) {
+    const int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (!HasKernelFeature(KernelFeature::kStatx)) {
+        return fstatat(dirfd, name, buf, flags) == 0;
+    }
 
-int walker(const char *fpath, const struct stat *sb, int typeflag,
-           struct FTW *ftwbuf) {
-    (void) typeflag;
-    (void) ftwbuf;
+    struct statx stx;
+    if (syscall(__NR_statx, dirfd, name, flags | AT_STATX_SYNC_AS_STAT,
+            STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_BLOCKS |
+            STATX_MTIME, &stx) != 0) {
+        return false;
+    }
 
-    std::string path(fpath);
-    callback_(path, *sb);
-    return 0;
+    memset(buf, 0, sizeof(*buf));
+    buf->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    buf->st_ino = stx.stx_ino;
+    buf->st_mode = stx.stx_mode;
+    buf->st_size = static_cast<off_t>(stx.stx_size);
+    buf->st_blksize = stx.stx_blksize;
+    buf->st_blocks = static_cast<blkcnt_t>(stx.stx_blocks);
+    buf->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+    buf->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    return true;
+}
+
+// Lists the entries of the directory at path, which must still be the one
+// described by expected, with their stats.  Symbolic links among the entries
+// are reported, not followed; path itself is followed only if follow is set.
+// It returns false, with *error set, if the directory cannot be read.
+bool ListDirectory(const std::string& path, const struct stat& expected,
+        bool follow, std::vector<Filesystem::Entry>* entries, int* error) {
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (!follow) {
+        flags |= O_NOFOLLOW;
+    }
+    int fd;
+    do {
+        fd = open(path.c_str(), flags);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        *error = errno;
+        return false;
+    }
+
+    // The directory is reopened by path, so it may have been replaced (even
+    // by a symbolic link in a parent) since it was listed.
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || buf.st_dev != expected.st_dev ||
+            buf.st_ino != expected.st_ino) {
+        close(fd);
+        *error = ESTALE;
+        return false;
+    }
+
+    DIR* dir = fdopendir(fd);
+    if (dir == nullptr) {
+        *error = errno;
+        close(fd);
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+                strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        Filesystem::Entry listed;
+        if (Stat(dirfd(dir), entry->d_name, false, &listed.buf)) {
+            listed.name = entry->d_name;
+            entries->push_back(std::move(listed));
+        }
+    }
+    closedir(dir);
+    return true;
 }
 
 }  // namespace
@@ -47,28 +129,89 @@ int walker(const char *fpath, const struct stat *sb, int typeflag,
 Filesystem::Filesystem() {}
 Filesystem::~Filesystem() {}
 
-void Filesystem::Walk(
-        const std::string& path,
-        std::function<void(const std::string&, const struct ::stat&)> callback) {
-    struct stat buf;
-    int ret = stat(path.c_str(), &buf);
-    if (ret < 0) {
-        // TODO:  Handle this error.
+bool Filesystem::Run(dev_t device, std::function<void()> task) const {
+    if (!runner_) {
+        task();
+        return true;
+    }
+    return runner_(device, std::move(task));
+}
+
+void Filesystem::Walk(const std::string& path, const Callback& callback,
+        const Skipped& skipped) {
+    struct Listing {
+        bool ok = false;
+        int error = 0;
+        struct stat buf;
+        std::vector<Entry> entries;
+    };
+    auto report = [&skipped](const std::string& directory, int error) {
+        if (skipped) {
+            skipped(directory, error);
+        }
+    };
+
+    std::shared_ptr<Listing> root(new Listing());
+    if (!Run(kUnknownDevice, [root, path] {
+                root->ok = Stat(AT_FDCWD, path.c_str(), true, &root->buf);
+                root->error = errno;
+            })) {
+        report(path, ETIMEDOUT);
+        return;
+    } else if (!root->ok) {
+        report(path, root->error);
         return;
     }
+    const struct stat buf = root->buf;
 
+    callback(path, buf);
     if (!S_ISDIR(buf.st_mode)) {
-        // Execute callback directly.
-        callback(path, buf);
         return;
     }
 
-    // TODO:  Replace nftw with a more reentrant implementation.  As we have to
-    // interact with global state for nftw, we hold callback_mx while nftw is
-    // running.
-    std::unique_lock<std::mutex> l(callback_mx);
-    callback_ = callback;
-    nftw(path.c_str(), walker, 16, FTW_PHYS);
+    // Directories are listed one at a time, each closed before its children
+    // are visited, so deep trees cannot exhaust our descriptors.  Children
+    // are visited depth first, in the order they were listed.
+    std::vector<std::pair<std::string, struct stat>> pending;
+    pending.emplace_back(path, buf);
+    bool first = true;
+    for (; !pending.empty(); first = false) {
+        const std::pair<std::string, struct stat> directory =
+            std::move(pending.back());
+        pending.pop_back();
+
+        // A fresh listing each time, as an unfinished one is still being
+        // written to.  Only the starting path may be a symbolic link.
+        std::shared_ptr<Listing> listing(new Listing());
+        if (!Run(directory.second.st_dev, [listing, directory, first] {
+                    listing->ok = ListDirectory(directory.first,
+                        directory.second, first, &listing->entries,
+                        &listing->error);
+                })) {
+            report(directory.first, ETIMEDOUT);
+            continue;
+        } else if (!listing->ok) {
+            report(directory.first, listing->error);
+            continue;
+        }
+        const std::vector<Entry>& entries = listing->entries;
+
+        const size_t children = pending.size();
+        std::string child = directory.first;
+        if (child.empty() || child.back() != '/') {
+            child.push_back('/');
+        }
+        const size_t length = child.size();
+        for (const auto& entry : entries) {
+            child.resize(length);
+            child.append(entry.name);
+            callback(child, entry.buf);
+            if (S_ISDIR(entry.buf.st_mode)) {
+                pending.emplace_back(child, entry.buf);
+            }
+        }
+        std::reverse(pending.begin() + children, pending.end());
+    }
 }
 
 }  // namespace file_binder
@@ -23,19 +23,51 @@
 #include <sys/stat.h>
 
 #include <functional>
+#include <string>
+#include <utility>
 
 namespace file_binder {
 
 class Filesystem {
 public:
+    typedef std::function<void(const std::string&, const struct stat&)>
+        Callback;
+    // Called with the path and error of each directory which could not be
+    // read, whose subtree is skipped.
+    typedef std::function<void(const std::string&, int)> Skipped;
+
+    // Runs a task which reads from device, returning false if it did not
+    // complete, e.g. as it missed a deadline.  An unfinished task keeps
+    // running, and owns the state it touches.
+    typedef std::function<bool(dev_t, std::function<void()>)> Runner;
+    // Passed to the runner before the device is known.
+    static constexpr dev_t kUnknownDevice = static_cast<dev_t>(-1);
+
+    // An entry of a directory, as listed.
+    struct Entry {
+        std::string name;
+        struct stat buf;
+    };
+
     Filesystem();
     virtual ~Filesystem();
 
+    // Stats and lists directories through runner, rather than on the calling
+    // thread.  Directories whose listing does not complete are skipped, with
+    // ETIMEDOUT.
+    void SetRunner(Runner runner) { runner_ = std::move(runner); }
+
     // Walks the filesystem tree at and below path, calling the callback for
-    // each file/directory found.
-    virtual void Walk(
-        const std::string& path,
-        std::function<void(const std::string&, const struct stat&)> callback);
+    // each file/directory found, parents before their children.  Symbolic
+    // links below path are reported rather than followed.  Only one
+    // directory is held open at a time, however deep the tree.
+    virtual void Walk(const std::string& path, const Callback& callback,
+        const Skipped& skipped = Skipped());
+private:
+    // Runs task through runner_, if any.
+    bool Run(dev_t device, std::function<void()> task) const;
+
+    Runner runner_;
 };
 
 }  // namespace file_binder
@@ -0,0 +1,159 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "filesystem.h"
+#include "temp_tree.h"
+
+#include <cerrno>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <functional>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+// Walks path, returning the paths reported, in order, and the directories
+// skipped with their errors.
+std::vector<std::string> Walk(const std::string& path,
+        std::map<std::string, int>* skipped = nullptr) {
+    std::vector<std::string> walked;
+    Filesystem().Walk(path,
+        [&walked](const std::string& p, const struct stat&) {
+            walked.push_back(p);
+        },
+        [skipped](const std::string& p, int error) {
+            if (skipped) {
+                (*skipped)[p] = error;
+            }
+        });
+    return walked;
+}
+
+TEST(Filesystem, WalksParentsFirst) {
+    TempTree tree("filesystem_test");
+    ASSERT_FALSE(tree.root().empty());
+    ASSERT_TRUE(tree.MakeDirectory("a"));
+    ASSERT_TRUE(tree.MakeDirectory("a/b"));
+    ASSERT_TRUE(tree.Write("a/b/file", "file"));
+    ASSERT_EQ(0, symlink("a", tree.Path("link").c_str()));
+
+    const std::string& root = tree.root();
+    const std::vector<std::string> walked = Walk(root);
+    ASSERT_EQ(5u, walked.size());
+    EXPECT_EQ(root, walked[0]);
+    auto position = [&walked](const std::string& path) {
+        for (size_t i = 0; i < walked.size(); i++) {
+            if (walked[i] == path) {
+                return i;
+            }
+        }
+        return walked.size();
+    };
+    EXPECT_LT(position(root + "/a"), position(root + "/a/b"));
+    EXPECT_LT(position(root + "/a/b"), position(root + "/a/b/file"));
+    // Symbolic links below the root are reported, not followed.
+    EXPECT_LT(position(root + "/link"), walked.size());
+
+    // The root itself may be a link.
+    const std::vector<std::string> linked = Walk(tree.Path("link"));
+    EXPECT_EQ(std::vector<std::string>({
+        tree.Path("link"), tree.Path("link/b"), tree.Path("link/b/file")}),
+        linked);
+}
+
+TEST(Filesystem, WalksDeepTrees) {
+    TempTree tree("filesystem_test");
+    ASSERT_FALSE(tree.root().empty());
+    const int kDepth = 200;
+    std::string relative = "d";
+    for (int i = 0; i < kDepth; i++) {
+        ASSERT_TRUE(tree.MakeDirectory(relative));
+        relative += "/d";
+    }
+    ASSERT_TRUE(tree.Write(relative, "leaf"));
+
+    // Far fewer descriptors than the tree is deep.
+    struct rlimit saved;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &saved));
+    struct rlimit lowered = saved;
+    lowered.rlim_cur = 32;
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &lowered));
+    std::map<std::string, int> skipped;
+    const std::vector<std::string> walked = Walk(tree.root(), &skipped);
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &saved));
+
+    EXPECT_TRUE(skipped.empty());
+    ASSERT_EQ(kDepth + 2u, walked.size());
+    EXPECT_EQ(tree.Path(relative), walked.back());
+}
+
+TEST(Filesystem, ReportsSkipped) {
+    TempTree tree("filesystem_test");
+    ASSERT_FALSE(tree.root().empty());
+
+    std::map<std::string, int> skipped;
+    EXPECT_TRUE(Walk(tree.Path("missing"), &skipped).empty());
+    EXPECT_EQ((std::map<std::string, int>{{tree.Path("missing"), ENOENT}}),
+        skipped);
+}
+
+TEST(Filesystem, SkipsUnfinishedListings) {
+    TempTree tree("filesystem_test");
+    ASSERT_FALSE(tree.root().empty());
+    ASSERT_TRUE(tree.MakeDirectory("a"));
+    ASSERT_TRUE(tree.Write("a/file", "file"));
+
+    // Everything but the root's listing completes.
+    Filesystem filesystem;
+    const std::string root = tree.root();
+    std::vector<dev_t> devices;
+    filesystem.SetRunner([&devices](dev_t device, std::function<void()> task) {
+        devices.push_back(device);
+        if (devices.size() == 2) {
+            return false;
+        }
+        task();
+        return true;
+    });
+
+    std::vector<std::string> walked;
+    std::map<std::string, int> skipped;
+    filesystem.Walk(root,
+        [&walked](const std::string& path, const struct stat&) {
+            walked.push_back(path);
+        },
+        [&skipped](const std::string& path, int error) {
+            skipped[path] = error;
+        });
+    EXPECT_EQ(std::vector<std::string>{root}, walked);
+    EXPECT_EQ((std::map<std::string, int>{{root, ETIMEDOUT}}), skipped);
+
+    // The root is stated before its device is known.
+    struct stat buf;
+    ASSERT_EQ(0, stat(root.c_str(), &buf));
+    EXPECT_EQ(std::vector<dev_t>({Filesystem::kUnknownDevice, buf.st_dev}),
+        devices);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,300 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "handoff.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace file_binder {
+namespace {
+
+enum Type : uint32_t {
+    // Holder to binder:  The holder has locked its regions.
+    kReady = 1,
+    // Holder to binder:  A shard helper, in pid.
+    kHelper = 2,
+    // Holder to binder:  A HandoffRecord, followed by its group and path.
+    kRecord = 3,
+    // Holder to binder:  The end of the inventory.
+    kEnd = 4,
+    // Binder to holder:  Exit.
+    kRelease = 5,
+    // Holder to binder:  The pressure level applied by the previous binary,
+    // in size.
+    kPressure = 6,
+};
+
+struct Message {
+    uint32_t type;
+    int32_t pid;
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    uint32_t group_length;
+    uint32_t path_length;
+};
+
+bool Send(int fd, const void* buf, size_t size) {
+    ssize_t ret;
+    do {
+        ret = ::send(fd, buf, size, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    return ret == static_cast<ssize_t>(size);
+}
+
+bool SendMessage(int fd, uint32_t type) {
+    Message message;
+    memset(&message, 0, sizeof(message));
+    message.type = type;
+    return Send(fd, &message, sizeof(message));
+}
+
+ssize_t Receive(int fd, void* buf, size_t size) {
+    ssize_t ret;
+    do {
+        ret = ::recv(fd, buf, size, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+void Wait(pid_t pid) {
+    int status;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+}
+
+// The body of the holder process.
+int RunHolder(
+        int fd,
+        const std::vector<LockedRegion>& regions,
+        const std::vector<pid_t>& helpers,
+        const std::vector<HandoffRecord>& records,
+        int pressure_level) {
+    // Memory locks are not inherited across fork, but the mappings are, and
+    // their pages are resident, so relocking them does no I/O.
+    for (const auto& region : regions) {
+        ::mlock(region.addr, region.size);
+    }
+
+    if (!SendMessage(fd, kReady)) {
+        return 1;
+    }
+
+    for (pid_t helper : helpers) {
+        Message message;
+        memset(&message, 0, sizeof(message));
+        message.type = kHelper;
+        message.pid = helper;
+        if (!Send(fd, &message, sizeof(message))) {
+            return 1;
+        }
+    }
+
+    // Sends block until the new binary reads the inventory.
+    std::string buf;
+    for (const auto& record : records) {
+        Message message;
+        memset(&message, 0, sizeof(message));
+        message.type = kRecord;
+        message.device = record.device;
+        message.inode = record.inode;
+        message.size = record.size;
+        message.group_length = static_cast<uint32_t>(record.group.size());
+        message.path_length = static_cast<uint32_t>(record.path.size());
+
+        buf.assign(reinterpret_cast<const char*>(&message), sizeof(message));
+        buf += record.group;
+        buf += record.path;
+        if (!Send(fd, buf.data(), buf.size())) {
+            return 1;
+        }
+    }
+
+    Message pressure;
+    memset(&pressure, 0, sizeof(pressure));
+    pressure.type = kPressure;
+    pressure.size = static_cast<uint64_t>(pressure_level);
+    if (!Send(fd, &pressure, sizeof(pressure)) || !SendMessage(fd, kEnd)) {
+        return 1;
+    }
+
+    // Hold our locks until we are released, or the new binary goes away.
+    Message message;
+    while (Receive(fd, &message, sizeof(message)) > 0 &&
+            message.type != kRelease) {}
+    return 0;
+}
+
+}  // namespace
+
+std::vector<MappedFile> ReadMappedFiles() {
+    std::vector<MappedFile> files;
+
+    std::ifstream in("/proc/self/maps");
+    std::string line;
+    while (std::getline(in, line)) {
+        // start-end perms offset major:minor inode [path]
+        uintptr_t start, end;
+        uint64_t offset;
+        unsigned major, minor;
+        uint64_t inode;
+        char perms[8];
+        if (sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " %7s %" SCNx64
+                " %x:%x %" SCNu64, &start, &end, perms, &offset, &major,
+                &minor, &inode) != 7 || inode == 0) {
+            continue;
+        }
+
+        MappedFile file;
+        file.start = start;
+        file.device = makedev(major, minor);
+        file.inode = inode;
+        files.push_back(file);
+    }
+
+    std::sort(files.begin(), files.end(),
+        [](const MappedFile& a, const MappedFile& b) {
+            return a.start < b.start;
+        });
+    return files;
+}
+
+bool StartHandoffHolder(
+        const std::vector<LockedRegion>& regions,
+        const std::vector<pid_t>& helpers,
+        const std::vector<HandoffRecord>& records,
+        int pressure_level,
+        int* fd, pid_t* holder) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        return false;
+    }
+
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        ::close(fds[0]);
+        _exit(RunHolder(fds[1], regions, helpers, records, pressure_level));
+    }
+
+    ::close(fds[1]);
+
+    Message message;
+    if (Receive(fds[0], &message, sizeof(message)) != sizeof(message) ||
+            message.type != kReady) {
+        ::close(fds[0]);
+        Wait(pid);
+        return false;
+    }
+
+    // The socket is passed to the new binary across exec.
+    ::fcntl(fds[0], F_SETFD, 0);
+    *fd = fds[0];
+    *holder = pid;
+    return true;
+}
+
+bool ReceiveHandoff(int fd, pid_t holder, Handoff* handoff) {
+    handoff->fd = fd;
+    handoff->holder = holder;
+    handoff->helpers.clear();
+    handoff->records.clear();
+    handoff->pressure_level = 0;
+
+    // Our own children must not inherit the socket, or the holder would not
+    // notice our exit.
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    std::vector<char> buf(sizeof(Message) + 2 * PATH_MAX);
+    while (true) {
+        const ssize_t size = Receive(fd, buf.data(), buf.size());
+        if (size < static_cast<ssize_t>(sizeof(Message))) {
+            return false;
+        }
+
+        Message message;
+        memcpy(&message, buf.data(), sizeof(message));
+        switch (message.type) {
+            case kReady:
+                break;
+            case kHelper:
+                handoff->helpers.push_back(message.pid);
+                break;
+            case kRecord: {
+                if (sizeof(Message) + message.group_length +
+                        message.path_length > static_cast<size_t>(size)) {
+                    return false;
+                }
+
+                const char* data = buf.data() + sizeof(Message);
+                HandoffRecord record;
+                record.group.assign(data, message.group_length);
+                record.path.assign(
+                    data + message.group_length, message.path_length);
+                record.device = static_cast<dev_t>(message.device);
+                record.inode = static_cast<ino_t>(message.inode);
+                record.size = message.size;
+                handoff->records.push_back(std::move(record));
+                break;
+            }
+            case kPressure:
+                handoff->pressure_level = static_cast<int>(message.size);
+                break;
+            case kEnd:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+void ReleaseHandoff(Handoff* handoff) {
+    if (handoff->fd < 0) {
+        return;
+    }
+
+    SendMessage(handoff->fd, kRelease);
+    ::close(handoff->fd);
+    handoff->fd = -1;
+
+    Wait(handoff->holder);
+    // The helpers exit once the holder's end of their sockets is closed.
+    for (pid_t helper : handoff->helpers) {
+        Wait(helper);
+    }
+    handoff->helpers.clear();
+}
+
+}  // namespace file_binder
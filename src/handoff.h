@@ -0,0 +1,101 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__HANDOFF_H__
+#define __FILE_BINDER__HANDOFF_H__
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// A live upgrade hands our locks over to a new binary without a window in
+// which they are released:
+//
+// 1. The running binder forks a holder, which locks the mappings it inherits
+//    and keeps our shard helpers' sockets open.
+// 2. Once the holder is ready, binder execs the new binary, passing it the
+//    socket to the holder.
+// 3. The new binary receives the inventory of what was locked, locks its own
+//    set against the (still resident) page cache, then releases the holder.
+
+// A file locked by the previous binary.
+struct HandoffRecord {
+    std::string group;
+    std::string path;
+    // The identity of the file when it was locked.
+    dev_t device;
+    ino_t inode;
+    uint64_t size;
+};
+
+struct Handoff {
+    // The socket to the holder.
+    int fd;
+    // The holder, and the shard helpers it kept alive.  Each is our child.
+    pid_t holder;
+    std::vector<pid_t> helpers;
+    std::vector<HandoffRecord> records;
+    // The PressureMonitor::Level the previous binary had applied to its warm
+    // groups, as their locks are part of what it handed over.
+    int pressure_level = 0;
+};
+
+// A locked region of our address space.
+struct LockedRegion {
+    void* addr;
+    size_t size;
+};
+
+// A file mapped into our address space.
+struct MappedFile {
+    uintptr_t start;
+    dev_t device;
+    ino_t inode;
+};
+
+// Returns the file mappings of this process, sorted by start address.
+std::vector<MappedFile> ReadMappedFiles();
+
+// Forks a holder which locks regions and holds the shard helpers' sockets
+// (which it inherits) until released.  records and pressure_level are passed
+// on to the new binary.  It returns once the holder has locked
+// regions, setting *fd to our end of its socket, which is not close-on-exec,
+// or returns false on failure.
+bool StartHandoffHolder(
+    const std::vector<LockedRegion>& regions,
+    const std::vector<pid_t>& helpers,
+    const std::vector<HandoffRecord>& records,
+    int pressure_level,
+    int* fd, pid_t* holder);
+
+// Receives the inventory from the holder at fd.  It returns false if the
+// holder has gone away.
+bool ReceiveHandoff(int fd, pid_t holder, Handoff* handoff);
+
+// Instructs the holder to exit, releasing its locks and, by closing their
+// sockets, its shard helpers.  It waits for all of them to exit.
+void ReleaseHandoff(Handoff* handoff);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__HANDOFF_H__
@@ -0,0 +1,128 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "handoff.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "mlocker.h"
+
+namespace file_binder {
+namespace {
+
+// Returns the locked memory of pid, in kB.
+size_t LockedKb(pid_t pid) {
+    std::ifstream in("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "VmLck:") == 0) {
+            return strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+class HandoffTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char name[] = "/tmp/handoff_test.XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+
+        const std::string contents(1 << 20, 'x');
+        ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+            write(fd, contents.data(), contents.size()));
+        ASSERT_EQ(0, fstat(fd, &buf_));
+        close(fd);
+
+        path_ = name;
+        mapping_ = mlocker_.LockMapping(path_);
+    }
+
+    void TearDown() override {
+        mlocker_.Unlock(mapping_);
+        unlink(path_.c_str());
+    }
+
+    MLocker mlocker_;
+    std::string path_;
+    struct stat buf_;
+    MLocker::Mapping mapping_;
+};
+
+TEST_F(HandoffTest, ReadMappedFiles) {
+    bool found = false;
+    for (const auto& file : ReadMappedFiles()) {
+        if (file.start == reinterpret_cast<uintptr_t>(mapping_.addr)) {
+            EXPECT_EQ(buf_.st_dev, file.device);
+            EXPECT_EQ(buf_.st_ino, file.inode);
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found);
+}
+
+TEST_F(HandoffTest, HoldAndRelease) {
+    LockedRegion region;
+    region.addr = mapping_.addr;
+    region.size = mapping_.size;
+
+    HandoffRecord record;
+    record.group = "default";
+    record.path = path_;
+    record.device = buf_.st_dev;
+    record.inode = buf_.st_ino;
+    record.size = mapping_.size;
+
+    int fd;
+    pid_t holder;
+    ASSERT_TRUE(
+        StartHandoffHolder({region}, {}, {record}, 2, &fd, &holder));
+
+    // The holder has its own lock on the file.
+    EXPECT_GE(LockedKb(holder), mapping_.size / 1024);
+
+    Handoff handoff;
+    ASSERT_TRUE(ReceiveHandoff(fd, holder, &handoff));
+    EXPECT_TRUE(handoff.helpers.empty());
+    ASSERT_EQ(1, handoff.records.size());
+    EXPECT_EQ("default", handoff.records[0].group);
+    EXPECT_EQ(path_, handoff.records[0].path);
+    EXPECT_EQ(buf_.st_dev, handoff.records[0].device);
+    EXPECT_EQ(buf_.st_ino, handoff.records[0].inode);
+    EXPECT_EQ(mapping_.size, handoff.records[0].size);
+    EXPECT_EQ(2, handoff.pressure_level);
+
+    ReleaseHandoff(&handoff);
+    EXPECT_EQ(-1, handoff.fd);
+    // The holder has exited and been reaped.
+    EXPECT_EQ(-1, kill(holder, 0));
+    EXPECT_EQ(ESRCH, errno);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,235 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "io_throttle.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace file_binder {
+namespace {
+
+// From include/uapi/linux/ioprio.h, which older kernel headers lack.
+const int kIoprioWhoProcess = 1;
+const int kIoprioClassShift = 13;
+const int kIoprioLevelMask = (1 << kIoprioClassShift) - 1;
+
+// The longest we sleep before checking whether we have been unthrottled.
+const std::chrono::milliseconds kMaxSleep(100);
+
+// Parses a count, with an optional K, M or G suffix.
+bool ParseSize(const std::string& s, uint64_t* value) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(s.c_str(), &end, 10);
+    if (errno != 0 || end == s.c_str()) {
+        return false;
+    }
+
+    static const char kSuffixes[] = "KMG";
+    const char* suffix = *end != '\0' ? strchr(kSuffixes, *end) : nullptr;
+    if (suffix != nullptr) {
+        v <<= 10 * (suffix - kSuffixes + 1);
+        end++;
+    }
+    *value = v;
+    return *end == '\0';
+}
+
+}  // namespace
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst) :
+    rate_(rate), burst_(burst), tokens_(burst), last_(Clock::now()) {}
+
+void TokenBucket::SetRate(uint64_t rate, uint64_t burst) {
+    rate_ = rate;
+    burst_ = burst;
+    tokens_ = std::min(tokens_, static_cast<double>(burst_));
+}
+
+TokenBucket::Clock::duration TokenBucket::Take(
+        uint64_t n, Clock::time_point now) {
+    if (rate_ == 0) {
+        return Clock::duration::zero();
+    }
+
+    if (now > last_) {
+        const double elapsed =
+            std::chrono::duration<double>(now - last_).count();
+        tokens_ = std::min(
+            tokens_ + elapsed * rate_, static_cast<double>(burst_));
+        last_ = now;
+    }
+
+    tokens_ -= n;
+    if (tokens_ >= 0) {
+        return Clock::duration::zero();
+    }
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(-tokens_ / rate_));
+}
+
+IoThrottle::IoThrottle() : unthrottled_(false), reload_requested_(false) {}
+
+void IoThrottle::SetLimits(const Limits& limits) {
+    limits_ = limits;
+    // Allow a second's worth of each in a burst.
+    bytes_.SetRate(limits.bytes, limits.bytes);
+    files_.SetRate(limits.files, limits.files);
+    for (auto& device : devices_) {
+        device.second.SetRate(limits.device_bytes, limits.device_bytes);
+    }
+    unthrottled_.store(false, std::memory_order_relaxed);
+}
+
+void IoThrottle::Unthrottle() {
+    unthrottled_.store(true, std::memory_order_relaxed);
+}
+
+void IoThrottle::RequestReload() {
+    reload_requested_.store(true, std::memory_order_relaxed);
+}
+
+bool IoThrottle::TakeReloadRequest() {
+    return reload_requested_.exchange(false, std::memory_order_relaxed);
+}
+
+bool IoThrottle::throttled() const {
+    if (unthrottled_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return limits_.bytes != 0 || limits_.device_bytes != 0 ||
+        limits_.files != 0;
+}
+
+void IoThrottle::Open() {
+    if (!throttled()) {
+        return;
+    }
+    Wait(files_.Take(1, Clock::now()));
+}
+
+void IoThrottle::Read(dev_t device, uint64_t bytes) {
+    if (!throttled()) {
+        return;
+    }
+
+    const Clock::time_point now = Clock::now();
+    Clock::duration wait = bytes_.Take(bytes, now);
+    if (limits_.device_bytes != 0) {
+        auto it = devices_.find(device);
+        if (it == devices_.end()) {
+            it = devices_.emplace(device, TokenBucket(
+                limits_.device_bytes, limits_.device_bytes)).first;
+        }
+        wait = std::max(wait, it->second.Take(bytes, now));
+    }
+    Wait(wait);
+}
+
+void IoThrottle::Wait(Clock::duration wait) {
+    const Clock::time_point deadline = Clock::now() + wait;
+    while (!unthrottled_.load(std::memory_order_relaxed) &&
+            !reload_requested_.load(std::memory_order_relaxed)) {
+        const Clock::time_point now = Clock::now();
+        if (now >= deadline) {
+            return;
+        }
+
+        const auto slice = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::min<Clock::duration>(deadline - now, kMaxSleep));
+        struct timespec ts;
+        ts.tv_sec = slice.count() / 1000000000;
+        ts.tv_nsec = slice.count() % 1000000000;
+        // A signal interrupts the sleep, so Unthrottle and RequestReload take
+        // effect promptly when called from a handler.
+        nanosleep(&ts, nullptr);
+    }
+}
+
+bool ReadIoLimits(
+        const std::string& path, IoThrottle::Limits* limits,
+        std::string* error) {
+    std::ifstream in(path);
+    if (!in) {
+        *error = "Unable to open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    IoThrottle::Limits read;
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++) {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+        line.erase(std::remove_if(line.begin(), line.end(),
+            [](unsigned char c) { return isspace(c) != 0; }), line.end());
+        if (line.empty()) {
+            continue;
+        }
+
+        const size_t equals = line.find('=');
+        const std::string key = line.substr(0, equals);
+        uint64_t* value = nullptr;
+        if (key == "io-rate") {
+            value = &read.bytes;
+        } else if (key == "device-io-rate") {
+            value = &read.device_bytes;
+        } else if (key == "open-rate") {
+            value = &read.files;
+        }
+        if (value == nullptr || equals == std::string::npos ||
+                !ParseSize(line.substr(equals + 1), value)) {
+            *error = path + ":" + std::to_string(number) + ": Unable to "
+                "parse \"" + line + "\"";
+            return false;
+        }
+    }
+
+    *limits = read;
+    return true;
+}
+
+IoPriority GetIoPriority() {
+    IoPriority priority = {IoClass::kNone, 0};
+    long ret = syscall(SYS_ioprio_get, kIoprioWhoProcess, 0);
+    if (ret >= 0) {
+        priority.io_class = static_cast<IoClass>(ret >> kIoprioClassShift);
+        priority.level = static_cast<int>(ret & kIoprioLevelMask);
+    }
+    return priority;
+}
+
+bool SetIoPriority(const IoPriority& priority) {
+    const int value =
+        (static_cast<int>(priority.io_class) << kIoprioClassShift) |
+        (priority.level & kIoprioLevelMask);
+    // With a "who" of 0, IOPRIO_WHO_PROCESS applies to the calling thread.
+    return syscall(SYS_ioprio_set, kIoprioWhoProcess, 0, value) == 0;
+}
+
+}  // namespace file_binder
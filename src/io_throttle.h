@@ -0,0 +1,141 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__IO_THROTTLE_H__
+#define __FILE_BINDER__IO_THROTTLE_H__
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace file_binder {
+
+// TokenBucket admits up to rate units per second, in bursts of up to burst
+// units.
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // A rate of zero is unlimited.
+    TokenBucket(uint64_t rate = 0, uint64_t burst = 0);
+
+    void SetRate(uint64_t rate, uint64_t burst);
+
+    // Takes n units at now, returning how long the caller must wait before
+    // using them.  Requests larger than the bucket are admitted by going into
+    // debt, which later requests wait out.
+    Clock::duration Take(uint64_t n, Clock::time_point now);
+private:
+    uint64_t rate_;
+    uint64_t burst_;
+    // May be negative while in debt.
+    double tokens_;
+    Clock::time_point last_;
+};
+
+// IoThrottle limits the bytes we read, in total and per device, and the files
+// we open, so that populating a large lock set does not starve the I/O of the
+// rest of the system.
+class IoThrottle {
+public:
+    typedef TokenBucket::Clock Clock;
+
+    // Each limit is per second, zero being unlimited.
+    struct Limits {
+        uint64_t bytes = 0;
+        uint64_t device_bytes = 0;
+        uint64_t files = 0;
+    };
+
+    IoThrottle();
+
+    // Replaces the current limits, and re-arms a throttle lifted by
+    // Unthrottle.
+    void SetLimits(const Limits& limits);
+    const Limits& limits() const { return limits_; }
+
+    // Lifts all limits, waking any caller blocked in Open or Read.  It is
+    // async-signal-safe, so it may be called from a signal handler.
+    void Unthrottle();
+
+    // Asks for the limits to be reloaded, waking any caller blocked in Open or
+    // Read.  Like Unthrottle, it is async-signal-safe.
+    void RequestReload();
+    // Returns true, once, after each RequestReload.
+    bool TakeReloadRequest();
+
+    // Returns true if any limit is in effect.
+    bool throttled() const;
+
+    // Blocks until we may open another file.
+    void Open();
+
+    // Blocks until we may read bytes from device.
+    void Read(dev_t device, uint64_t bytes);
+private:
+    IoThrottle(const IoThrottle&) = delete;
+    IoThrottle& operator=(const IoThrottle&) = delete;
+
+    // Sleeps for up to wait, returning early if we are unthrottled or a
+    // reload is requested.
+    void Wait(Clock::duration wait);
+
+    Limits limits_;
+    std::atomic<bool> unthrottled_;
+    std::atomic<bool> reload_requested_;
+
+    TokenBucket bytes_;
+    TokenBucket files_;
+    std::unordered_map<dev_t, TokenBucket> devices_;
+};
+
+// Reads limits from path, which holds lines of the form "io-rate=<bytes>",
+// "device-io-rate=<bytes>" or "open-rate=<files>", with K, M and G suffixes
+// accepted, and "#" comments.  Limits not given are unlimited.  On failure,
+// it returns false and describes the problem in *error.
+bool ReadIoLimits(
+    const std::string& path, IoThrottle::Limits* limits, std::string* error);
+
+// I/O scheduling classes, see ioprio_set(2).
+enum class IoClass {
+    kNone = 0,
+    kRealtime = 1,
+    kBestEffort = 2,
+    kIdle = 3,
+};
+
+struct IoPriority {
+    IoClass io_class;
+    // 0 (highest) to 7 (lowest), for kRealtime and kBestEffort.
+    int level;
+};
+
+// Returns the I/O priority of the calling thread.
+IoPriority GetIoPriority();
+
+// Sets the I/O priority of the calling thread, returning false on failure.
+// kNone reverts to a priority derived from the thread's CPU nice value.
+bool SetIoPriority(const IoPriority& priority);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__IO_THROTTLE_H__
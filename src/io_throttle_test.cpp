@@ -0,0 +1,144 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "io_throttle.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "temp_tree.h"
+
+namespace file_binder {
+namespace {
+
+typedef TokenBucket::Clock Clock;
+
+TEST(TokenBucket, Unlimited) {
+    TokenBucket bucket;
+    const Clock::time_point now = Clock::now();
+    EXPECT_EQ(Clock::duration::zero(), bucket.Take(1 << 30, now));
+    EXPECT_EQ(Clock::duration::zero(), bucket.Take(1 << 30, now));
+}
+
+TEST(TokenBucket, Rate) {
+    const Clock::time_point start = Clock::now();
+    TokenBucket bucket(1000, 1000);
+
+    // The initial burst is admitted immediately.
+    EXPECT_EQ(Clock::duration::zero(), bucket.Take(1000, start));
+
+    // Further units must wait for the bucket to refill.
+    auto wait = bucket.Take(500, start);
+    EXPECT_NEAR(0.5, std::chrono::duration<double>(wait).count(), 0.01);
+
+    // Large requests go into debt, which is waited out by later requests.
+    const Clock::time_point later = start + std::chrono::seconds(1);
+    wait = bucket.Take(2000, later);
+    EXPECT_NEAR(1.5, std::chrono::duration<double>(wait).count(), 0.01);
+
+    // The bucket never fills beyond its burst.
+    const Clock::time_point idle = later + std::chrono::seconds(60);
+    EXPECT_EQ(Clock::duration::zero(), bucket.Take(1000, idle));
+    EXPECT_GT(bucket.Take(1000, idle), Clock::duration::zero());
+}
+
+TEST(IoThrottle, Unthrottle) {
+    IoThrottle throttle;
+    EXPECT_FALSE(throttle.throttled());
+
+    IoThrottle::Limits limits;
+    limits.bytes = 1;
+    limits.files = 1;
+    throttle.SetLimits(limits);
+    EXPECT_TRUE(throttle.throttled());
+
+    throttle.Unthrottle();
+    EXPECT_FALSE(throttle.throttled());
+
+    // These would otherwise take hours.
+    const Clock::time_point start = Clock::now();
+    throttle.Read(0, 1 << 20);
+    for (int i = 0; i < 10; i++) {
+        throttle.Open();
+    }
+    EXPECT_LT(Clock::now() - start, std::chrono::seconds(1));
+
+    // Setting new limits re-arms the throttle.
+    throttle.SetLimits(limits);
+    EXPECT_TRUE(throttle.throttled());
+}
+
+TEST(IoThrottle, RequestReload) {
+    IoThrottle throttle;
+    EXPECT_FALSE(throttle.TakeReloadRequest());
+
+    IoThrottle::Limits limits;
+    limits.bytes = 1;
+    throttle.SetLimits(limits);
+    throttle.RequestReload();
+
+    // A pending reload cuts waits short, so new limits apply promptly.
+    const Clock::time_point start = Clock::now();
+    throttle.Read(0, 1 << 20);
+    EXPECT_LT(Clock::now() - start, std::chrono::seconds(1));
+
+    EXPECT_TRUE(throttle.TakeReloadRequest());
+    EXPECT_FALSE(throttle.TakeReloadRequest());
+}
+
+TEST(IoThrottle, ReadIoLimits) {
+    TempTree tree("io_throttle_test");
+    ASSERT_TRUE(tree.Write("limits",
+        "# Throttle the initial scan.\n"
+        "io-rate = 4M\n"
+        "\n"
+        "open-rate=100  # files\n"));
+
+    IoThrottle::Limits limits;
+    limits.device_bytes = 1;
+    std::string error;
+    ASSERT_TRUE(ReadIoLimits(tree.Path("limits"), &limits, &error)) << error;
+    EXPECT_EQ(4 << 20, limits.bytes);
+    EXPECT_EQ(0, limits.device_bytes);
+    EXPECT_EQ(100, limits.files);
+
+    ASSERT_TRUE(tree.Write("bad", "io-rate=4M\nio-rate=fast\n"));
+    EXPECT_FALSE(ReadIoLimits(tree.Path("bad"), &limits, &error));
+    EXPECT_NE(std::string::npos, error.find(":2:")) << error;
+    EXPECT_EQ(4 << 20, limits.bytes);
+
+    ASSERT_TRUE(tree.Write("unknown", "read-rate=1\n"));
+    EXPECT_FALSE(ReadIoLimits(tree.Path("unknown"), &limits, &error));
+    EXPECT_FALSE(ReadIoLimits(tree.Path("missing"), &limits, &error));
+}
+
+TEST(IoPriority, SetAndRestore) {
+    const IoPriority original = GetIoPriority();
+
+    IoPriority idle = {IoClass::kIdle, 7};
+    ASSERT_TRUE(SetIoPriority(idle));
+    EXPECT_EQ(IoClass::kIdle, GetIoPriority().io_class);
+
+    // Leaving the idle class may require privileges, so restoring is not
+    // checked.
+    SetIoPriority(original);
+}
+
+}  // namespace
+}  // namespace file_binder
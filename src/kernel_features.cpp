@@ -0,0 +1,170 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel_features.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+#ifndef __NR_statx
+#define __NR_statx 332
+#endif
+
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+namespace file_binder {
+namespace {
+
+const KernelFeature kFeatures[] = {
+    KernelFeature::kStatx,
+    KernelFeature::kCachestat,
+    KernelFeature::kPopulateRead,
+};
+const size_t kFeatureCount = sizeof(kFeatures) / sizeof(kFeatures[0]);
+
+std::once_flag probe_once;
+std::atomic<bool> available[kFeatureCount];
+std::atomic<bool> disabled[kFeatureCount];
+
+bool ProbeStatx() {
+    struct statx buf;
+    return syscall(__NR_statx, AT_FDCWD, "/", AT_SYMLINK_NOFOLLOW,
+        STATX_TYPE, &buf) == 0;
+}
+
+bool ProbeCachestat() {
+    struct {
+        uint64_t offset;
+        uint64_t length;
+    } range = {0, 0};
+    uint64_t stat[5];
+
+    int fd;
+    do {
+        fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool ok = syscall(__NR_cachestat, fd, &range, stat, 0) == 0;
+    close(fd);
+    return ok;
+}
+
+bool ProbePopulateRead() {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* addr = mmap(nullptr, page, PROT_READ,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    // Kernels without it reject the advice with EINVAL.
+    const bool ok = madvise(addr, page, MADV_POPULATE_READ) == 0;
+    munmap(addr, page);
+    return ok;
+}
+
+void Probe() {
+    available[static_cast<size_t>(KernelFeature::kStatx)] = ProbeStatx();
+    available[static_cast<size_t>(KernelFeature::kCachestat)] =
+        ProbeCachestat();
+    available[static_cast<size_t>(KernelFeature::kPopulateRead)] =
+        ProbePopulateRead();
+
+    const char* fallback = getenv("FILE_BINDER_FALLBACK");
+    if (fallback == nullptr) {
+        return;
+    }
+    std::istringstream names(fallback);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        KernelFeature feature;
+        if (ParseKernelFeature(name, &feature)) {
+            disabled[static_cast<size_t>(feature)] = true;
+        }
+    }
+}
+
+}  // namespace
+
+bool HasKernelFeature(KernelFeature feature) {
+    std::call_once(probe_once, Probe);
+    const size_t i = static_cast<size_t>(feature);
+    return available[i].load(std::memory_order_relaxed) &&
+        !disabled[i].load(std::memory_order_relaxed);
+}
+
+void DisableKernelFeature(KernelFeature feature) {
+    std::call_once(probe_once, Probe);
+    disabled[static_cast<size_t>(feature)] = true;
+}
+
+const char* KernelFeatureName(KernelFeature feature) {
+    switch (feature) {
+        case KernelFeature::kStatx:
+            return "statx";
+        case KernelFeature::kCachestat:
+            return "cachestat";
+        case KernelFeature::kPopulateRead:
+            return "populate-read";
+    }
+    return "unknown";
+}
+
+bool ParseKernelFeature(const std::string& name, KernelFeature* feature) {
+    for (KernelFeature candidate : kFeatures) {
+        if (name == KernelFeatureName(candidate)) {
+            *feature = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PrintKernelFeatures(FILE* out) {
+    std::call_once(probe_once, Probe);
+    fprintf(out, "Kernel features:");
+    for (size_t i = 0; i < kFeatureCount; i++) {
+        fprintf(out, "%s %s %s", i > 0 ? ";" : "",
+            KernelFeatureName(kFeatures[i]),
+            disabled[i] ? "disabled" :
+            available[i] ? "in use" : "unavailable");
+    }
+    fprintf(out, "\n");
+}
+
+}  // namespace file_binder
@@ -0,0 +1,62 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__KERNEL_FEATURES_H__
+#define __FILE_BINDER__KERNEL_FEATURES_H__
+
+#include <cstdio>
+#include <string>
+
+namespace file_binder {
+
+// Optional kernel interfaces with faster or more informative paths than
+// their fallbacks.  The running kernel is probed for all of them once, on
+// first use.
+enum class KernelFeature {
+    // statx(2), 4.11:  Filesystem stats only the fields we use.  Falls back
+    // to fstatat.
+    kStatx,
+    // cachestat(2), 6.5:  IsCached asks for page cache residency without a
+    // mapping.  Falls back to mmap and mincore.
+    kCachestat,
+    // MADV_POPULATE_READ, 5.14:  MLocker populates mappings with madvise,
+    // which reports I/O errors that MAP_POPULATE ignores.  Falls back to
+    // MAP_POPULATE.
+    kPopulateRead,
+};
+
+// Returns true if feature is available and not disabled.
+bool HasKernelFeature(KernelFeature feature);
+
+// Forces the fallback for feature, as if the kernel lacked it.  Features
+// named in $FILE_BINDER_FALLBACK (comma-separated) are disabled when the
+// kernel is probed, so the setting is inherited by helper processes.
+void DisableKernelFeature(KernelFeature feature);
+
+// The name of feature, as used by $FILE_BINDER_FALLBACK.
+const char* KernelFeatureName(KernelFeature feature);
+
+// Parses a feature name, returning false if it is unknown.
+bool ParseKernelFeature(const std::string& name, KernelFeature* feature);
+
+// Reports the implementation selected for each feature.
+void PrintKernelFeatures(FILE* out);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__KERNEL_FEATURES_H__
@@ -0,0 +1,72 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel_features.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+#include <string>
+
+namespace file_binder {
+namespace {
+
+std::string Report() {
+    char* buf = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&buf, &size);
+    PrintKernelFeatures(out);
+    fclose(out);
+    const std::string report(buf, size);
+    free(buf);
+    return report;
+}
+
+TEST(KernelFeatures, Names) {
+    const KernelFeature features[] = {
+        KernelFeature::kStatx,
+        KernelFeature::kCachestat,
+        KernelFeature::kPopulateRead,
+    };
+    for (KernelFeature feature : features) {
+        KernelFeature parsed;
+        ASSERT_TRUE(ParseKernelFeature(KernelFeatureName(feature), &parsed));
+        EXPECT_EQ(feature, parsed);
+    }
+
+    KernelFeature parsed;
+    EXPECT_FALSE(ParseKernelFeature("io_uring", &parsed));
+    EXPECT_FALSE(ParseKernelFeature("", &parsed));
+}
+
+TEST(KernelFeatures, Fallback) {
+    // Set before the kernel is first probed.
+    setenv("FILE_BINDER_FALLBACK", "cachestat,bogus", 1);
+    EXPECT_FALSE(HasKernelFeature(KernelFeature::kCachestat));
+    EXPECT_NE(std::string::npos, Report().find("cachestat disabled"));
+
+    // statx dates from 4.11, older than any kernel we build against.
+    EXPECT_TRUE(HasKernelFeature(KernelFeature::kStatx));
+    DisableKernelFeature(KernelFeature::kStatx);
+    EXPECT_FALSE(HasKernelFeature(KernelFeature::kStatx));
+    EXPECT_NE(std::string::npos, Report().find("statx disabled"));
+}
+
+}  // namespace
+}  // namespace file_binder
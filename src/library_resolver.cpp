@@ -0,0 +1,199 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "library_resolver.h"
+
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+namespace file_binder {
+namespace {
+
+// Limits the depth of nested include directives.
+const int kMaxIncludeDepth = 8;
+
+// The trusted directories, searched after those configured.
+const char* const kSystemDirectories[] = {
+    "/lib64",
+    "/usr/lib64",
+    "/lib",
+    "/usr/lib",
+};
+
+// Returns the ELF class of the file at path, or ELFCLASSNONE if it is not an
+// ELF file.
+int ElfClass(const std::string& path) {
+    int fd;
+    do {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0) {
+        return ELFCLASSNONE;
+    }
+
+    unsigned char ident[EI_CLASS + 1];
+    ssize_t ret;
+    do {
+        ret = ::pread(fd, ident, sizeof(ident), 0);
+    } while (ret < 0 && errno == EINTR);
+    ::close(fd);
+
+    if (ret != sizeof(ident) || memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        return ELFCLASSNONE;
+    }
+    return ident[EI_CLASS];
+}
+
+}  // namespace
+
+LibraryResolver::LibraryResolver(const std::string& config) :
+        config_(config) {
+    Reload();
+}
+
+LibraryResolver::~LibraryResolver() {}
+
+void LibraryResolver::Reload() {
+    directories_.clear();
+    cache_.clear();
+
+    ParseConfig(config_, 0);
+    for (const char* dir : kSystemDirectories) {
+        if (std::find(directories_.begin(), directories_.end(), dir) ==
+                directories_.end()) {
+            directories_.push_back(dir);
+        }
+    }
+}
+
+std::vector<std::string> LibraryResolver::ConfigPaths() const {
+    return {config_, config_ + ".d"};
+}
+
+void LibraryResolver::ParseConfig(const std::string& path, int depth) {
+    if (depth > kMaxIncludeDepth) {
+        return;
+    }
+
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+
+        std::istringstream words(line);
+        std::string word;
+        if (!(words >> word)) {
+            continue;
+        }
+
+        if (word == "include") {
+            std::string pattern;
+            while (words >> pattern) {
+                if (pattern[0] != '/') {
+                    // Relative includes are relative to the including file.
+                    const size_t slash = path.rfind('/');
+                    if (slash != std::string::npos) {
+                        pattern = path.substr(0, slash + 1) + pattern;
+                    }
+                }
+
+                glob_t g;
+                if (glob(pattern.c_str(), 0, nullptr, &g) == 0) {
+                    for (size_t i = 0; i < g.gl_pathc; i++) {
+                        ParseConfig(g.gl_pathv[i], depth + 1);
+                    }
+                }
+                globfree(&g);
+            }
+        } else if (word == "hwcap") {
+            // Obsolete.
+            continue;
+        } else {
+            // Directories may be separated by whitespace, colons or commas.
+            do {
+                std::replace(word.begin(), word.end(), ',', ':');
+                std::istringstream dirs(word);
+                std::string dir;
+                while (std::getline(dirs, dir, ':')) {
+                    if (!dir.empty() &&
+                            std::find(directories_.begin(), directories_.end(),
+                                dir) == directories_.end()) {
+                        directories_.push_back(dir);
+                    }
+                }
+            } while (words >> word);
+        }
+    }
+}
+
+bool LibraryResolver::Resolve(
+        const std::string& soname, bool x64, std::string* path) {
+    if (soname.find('/') != std::string::npos) {
+        // The dynamic linker uses names containing a slash as paths.
+        *path = soname;
+        return true;
+    }
+
+    const std::string key = soname + (x64 ? "/64" : "/32");
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+        *path = it->second;
+        return !path->empty();
+    }
+
+    // Probing opens each candidate, which may block on a failing disk, so
+    // the probe owns copies of everything it needs.
+    std::shared_ptr<std::string> found(new std::string());
+    const int want = x64 ? ELFCLASS64 : ELFCLASS32;
+    const std::vector<std::string>& directories = directories_;
+    std::function<void()> probe = [found, want, soname, directories] {
+        for (const auto& dir : directories) {
+            std::string candidate = dir + "/" + soname;
+            if (ElfClass(candidate) == want) {
+                *found = std::move(candidate);
+                break;
+            }
+        }
+    };
+    if (!runner_) {
+        probe();
+    } else if (!runner_(std::move(probe))) {
+        path->clear();
+        return false;
+    }
+
+    const std::string resolved = *found;
+    cache_.emplace(key, resolved);
+    *path = resolved;
+    return !resolved.empty();
+}
+
+}  // namespace file_binder
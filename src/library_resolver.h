@@ -0,0 +1,78 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__LIBRARY_RESOLVER_H__
+#define __FILE_BINDER__LIBRARY_RESOLVER_H__
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace file_binder {
+
+// LibraryResolver maps the sonames found in DT_NEEDED entries to paths, using
+// the same search directories as the dynamic linker:  Those configured by
+// /etc/ld.so.conf, followed by the trusted system directories.
+class LibraryResolver {
+public:
+    // Runs a task which probes the filesystem, returning false if it did not
+    // complete, e.g. as it missed a deadline.  An unfinished task keeps
+    // running, and owns the state it touches.
+    typedef std::function<bool(std::function<void()>)> Runner;
+
+    // Loads the search directories from config.
+    explicit LibraryResolver(const std::string& config = "/etc/ld.so.conf");
+    virtual ~LibraryResolver();
+
+    // Rereads the configuration and discards cached results.
+    void Reload();
+
+    // The configuration files and directories which determine our search
+    // path.
+    std::vector<std::string> ConfigPaths() const;
+
+    const std::vector<std::string>& directories() const {
+        return directories_;
+    }
+
+    // Resolves soname to a path, considering only libraries of the same ELF
+    // class (32/64-bit) as the object which depends on it.  It returns false
+    // if no matching library was found.
+    virtual bool Resolve(
+        const std::string& soname, bool x64, std::string* path);
+
+    // Probes candidates through runner, rather than on the calling thread.
+    // Resolutions whose probes do not complete fail, and are not cached.
+    void SetRunner(Runner runner) { runner_ = std::move(runner); }
+private:
+    void ParseConfig(const std::string& path, int depth);
+
+    const std::string config_;
+    std::vector<std::string> directories_;
+
+    // Cache of resolutions (including failures), keyed by soname and class.
+    std::unordered_map<std::string, std::string> cache_;
+
+    Runner runner_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__LIBRARY_RESOLVER_H__
@@ -0,0 +1,156 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lock_table.h"
+
+namespace file_binder {
+namespace {
+
+size_t Hash(PathId path) {
+    // Ids are dense, so scramble them to spread neighbours apart.
+    return static_cast<size_t>(path * 0x9E3779B97F4A7C15ULL >> 32);
+}
+
+}  // namespace
+
+constexpr PathId LockTable::kEmpty;
+constexpr PathId LockTable::kTombstone;
+
+LockTable::LockTable() : size_(0), used_(0) {}
+LockTable::~LockTable() {}
+
+LockTable::LockTable(LockTable&& rhs) :
+        slots_(std::move(rhs.slots_)), size_(rhs.size_), used_(rhs.used_) {
+    rhs.slots_.clear();
+    rhs.size_ = 0;
+    rhs.used_ = 0;
+}
+
+LockTable& LockTable::operator=(LockTable&& rhs) {
+    using std::swap;
+
+    swap(slots_, rhs.slots_);
+    swap(size_, rhs.size_);
+    swap(used_, rhs.used_);
+
+    return *this;
+}
+
+size_t LockTable::Probe(PathId path, bool* found) const {
+    const size_t mask = slots_.size() - 1;
+    size_t slot = Hash(path) & mask;
+    size_t free = slots_.size();
+    while (true) {
+        const PathId p = slots_[slot].path;
+        if (p == path) {
+            *found = true;
+            return slot;
+        } else if (p == kEmpty) {
+            *found = false;
+            return free != slots_.size() ? free : slot;
+        } else if (p == kTombstone && free == slots_.size()) {
+            free = slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+LockRecord* LockTable::Find(PathId path) {
+    return const_cast<LockRecord*>(
+        static_cast<const LockTable*>(this)->Find(path));
+}
+
+const LockRecord* LockTable::Find(PathId path) const {
+    if (size_ == 0) {
+        return nullptr;
+    }
+
+    bool found;
+    const size_t slot = Probe(path, &found);
+    return found ? &slots_[slot] : nullptr;
+}
+
+bool LockTable::Insert(const LockRecord& record) {
+    // Keep the load factor, counting tombstones, below 3/4.
+    if ((used_ + 1) * 4 > slots_.size() * 3) {
+        Rehash(size_ * 2 < 16 ? 16 : size_ * 2);
+    }
+
+    bool found;
+    const size_t slot = Probe(record.path, &found);
+    if (found) {
+        return false;
+    }
+
+    if (slots_[slot].path == kEmpty) {
+        used_++;
+    }
+    slots_[slot] = record;
+    size_++;
+    return true;
+}
+
+bool LockTable::Erase(PathId path, LockRecord* record) {
+    if (size_ == 0) {
+        return false;
+    }
+
+    bool found;
+    const size_t slot = Probe(path, &found);
+    if (!found) {
+        return false;
+    }
+
+    if (record != nullptr) {
+        *record = slots_[slot];
+    }
+    slots_[slot].path = kTombstone;
+    size_--;
+    return true;
+}
+
+void LockTable::Clear() {
+    slots_.clear();
+    size_ = 0;
+    used_ = 0;
+}
+
+void LockTable::Rehash(size_t capacity) {
+    // capacity must be a power of two for our masking.
+    size_t n = 16;
+    while (n < capacity) {
+        n *= 2;
+    }
+
+    std::vector<LockRecord> old(n, LockRecord{kEmpty, MLocker::Mapping()});
+    old.swap(slots_);
+    size_ = 0;
+    used_ = 0;
+
+    for (const auto& record : old) {
+        if (record.path != kEmpty && record.path != kTombstone) {
+            Insert(record);
+        }
+    }
+}
+
+size_t LockTable::MemoryUsage() const {
+    return sizeof(*this) + slots_.capacity() * sizeof(LockRecord);
+}
+
+}  // namespace file_binder
@@ -0,0 +1,94 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__LOCK_TABLE_H__
+#define __FILE_BINDER__LOCK_TABLE_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "mlocker.h"
+#include "path_table.h"
+
+namespace file_binder {
+
+// A LockRecord is a plain description of a locked file.  It does not own the
+// mapping, which must be released with MLocker::Unlock.
+struct LockRecord {
+    PathId path;
+    MLocker::Mapping mapping;
+};
+
+// LockTable is a flat, open-addressed table of LockRecords keyed by PathId.
+class LockTable {
+public:
+    LockTable();
+    ~LockTable();
+
+    LockTable(LockTable&&);
+    LockTable& operator=(LockTable&&);
+
+    // Returns the record for path, or nullptr if there is none.
+    LockRecord* Find(PathId path);
+    const LockRecord* Find(PathId path) const;
+
+    // Inserts record, unless a record for the same path exists.  It returns
+    // false in that case.
+    bool Insert(const LockRecord& record);
+
+    // Removes the record for path, copying it to record if found.
+    bool Erase(PathId path, LockRecord* record);
+
+    // Calls f for each record, in unspecified order.
+    template<typename F>
+    void ForEach(F f) const {
+        for (const auto& slot : slots_) {
+            if (slot.path != kEmpty && slot.path != kTombstone) {
+                f(slot);
+            }
+        }
+    }
+
+    void Clear();
+
+    size_t size() const { return size_; }
+
+    // Bytes used by the table.
+    size_t MemoryUsage() const;
+private:
+    LockTable(const LockTable&) = delete;
+    LockTable& operator=(const LockTable&) = delete;
+
+    static constexpr PathId kEmpty = PathTable::kInvalid;
+    static constexpr PathId kTombstone = PathTable::kInvalid - 1;
+
+    // Returns the slot holding path, or the first free slot it could be
+    // inserted at when absent.
+    size_t Probe(PathId path, bool* found) const;
+
+    void Rehash(size_t capacity);
+
+    std::vector<LockRecord> slots_;
+    size_t size_;
+    // Occupied slots, including tombstones.
+    size_t used_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__LOCK_TABLE_H__
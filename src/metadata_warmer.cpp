@@ -0,0 +1,301 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata_warmer.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include "resource_counters.h"
+
+namespace file_binder {
+namespace {
+
+// A lookup served from the dentry, inode and page caches takes a few
+// microseconds.  Slower ones are checked for reads from storage.
+const std::chrono::microseconds kSlowLookup(50);
+
+// The percentage of time stalled on memory ("some avg10") above which
+// passes are brought forward.
+const double kPressureThreshold = 1.0;
+
+// The directories to list, each with the names to look up within it, in
+// order so that parents are warmed before their children.
+typedef std::map<std::string, std::vector<std::string>> Tree;
+
+// Adds the components of path to names:  Each name under its parent, and,
+// if directory, path itself for listing.
+void AddPath(const std::string& path, bool directory,
+        std::map<std::string, std::set<std::string>>* names) {
+    if (path.empty() || path[0] != '/') {
+        return;
+    }
+
+    std::string parent = "/";
+    size_t start = 1;
+    while (start < path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            const std::string name = path.substr(start, end - start);
+            (*names)[parent].insert(name);
+            if (parent.size() > 1) {
+                parent += '/';
+            }
+            parent += name;
+        }
+        start = end + 1;
+    }
+    if (directory) {
+        (*names)[parent];
+    }
+}
+
+}  // namespace
+
+struct MetadataWarmer::State {
+    State(Clock::duration min_interval_, Clock::duration max_interval_,
+            std::string pressure_) :
+        min_interval(min_interval_), max_interval(max_interval_),
+        pressure(std::move(pressure_)), stopped(false),
+        interval(min_interval_), components(0) {}
+
+    const Clock::duration min_interval;
+    const Clock::duration max_interval;
+    const std::string pressure;
+
+    mutable std::mutex mu;
+    std::condition_variable cv;
+    bool stopped;
+    Clock::duration interval;
+    // The files and directories tracked, by key.
+    std::unordered_map<size_t, std::pair<std::vector<std::string>,
+        std::vector<std::string>>> paths;
+    // Rebuilt from paths by each Set, and shared with a pass in progress.
+    std::shared_ptr<const Tree> tree;
+    size_t components;
+    Stats stats;
+};
+
+MetadataWarmer::MetadataWarmer(Clock::duration min_interval,
+        Clock::duration max_interval, std::string pressure) :
+    state_(std::make_shared<State>(
+        min_interval, max_interval, std::move(pressure))) {}
+
+MetadataWarmer::~MetadataWarmer() {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    state_->stopped = true;
+    state_->cv.notify_all();
+}
+
+void MetadataWarmer::Set(size_t key, const std::vector<std::string>& files,
+        const std::vector<std::string>& directories) {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    if (files.empty() && directories.empty()) {
+        state_->paths.erase(key);
+    } else {
+        state_->paths[key] = std::make_pair(files, directories);
+    }
+
+    std::map<std::string, std::set<std::string>> names;
+    for (const auto& paths : state_->paths) {
+        for (const auto& file : paths.second.first) {
+            AddPath(file, false, &names);
+        }
+        for (const auto& directory : paths.second.second) {
+            AddPath(directory, true, &names);
+        }
+    }
+
+    std::shared_ptr<Tree> tree = std::make_shared<Tree>();
+    size_t components = 0;
+    for (const auto& directory : names) {
+        (*tree)[directory.first].assign(
+            directory.second.begin(), directory.second.end());
+        components += directory.second.size();
+    }
+    state_->tree = std::move(tree);
+    state_->components = components;
+}
+
+bool MetadataWarmer::Start() {
+    try {
+        std::thread(Run, state_).detach();
+    } catch (std::system_error& ex) {
+        return false;
+    }
+    return true;
+}
+
+uint64_t MetadataWarmer::Warm() {
+    return Warm(state_.get());
+}
+
+size_t MetadataWarmer::directories() const {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    return state_->tree ? state_->tree->size() : 0;
+}
+
+size_t MetadataWarmer::components() const {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    return state_->components;
+}
+
+MetadataWarmer::Stats MetadataWarmer::stats() const {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    return state_->stats;
+}
+
+MetadataWarmer::Clock::duration MetadataWarmer::interval() const {
+    std::lock_guard<std::mutex> lock(state_->mu);
+    return state_->interval;
+}
+
+MetadataWarmer::Clock::duration MetadataWarmer::NextInterval(
+        Clock::duration interval, Clock::duration min_interval,
+        Clock::duration max_interval, double pressure, uint64_t misses) {
+    if (pressure >= kPressureThreshold || misses > 0) {
+        return std::max(interval / 2, min_interval);
+    }
+    return std::min(interval * 2, max_interval);
+}
+
+double MetadataWarmer::ReadPressure(const std::string& path) {
+    int fd;
+    do {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return 0;
+    }
+
+    char buf[256];
+    ssize_t ret;
+    do {
+        ret = read(fd, buf, sizeof(buf) - 1);
+    } while (ret < 0 && errno == EINTR);
+    close(fd);
+    if (ret <= 0) {
+        return 0;
+    }
+    buf[ret] = '\0';
+
+    static const char kSome[] = "some avg10=";
+    const char* some = strstr(buf, kSome);
+    return some == nullptr ? 0 : strtod(some + sizeof(kSome) - 1, nullptr);
+}
+
+uint64_t MetadataWarmer::Warm(State* state) {
+    std::shared_ptr<const Tree> tree;
+    {
+        std::lock_guard<std::mutex> lock(state->mu);
+        tree = state->tree;
+    }
+    if (!tree) {
+        tree = std::make_shared<Tree>();
+    }
+
+    Stats pass;
+    const Clock::time_point start = Clock::now();
+    uint64_t read_bytes = 0;
+    const bool accounting = ResourceCounters::ReadBytes(&read_bytes);
+    // Returns true if the call begun at begin missed the cache.  Without
+    // I/O accounting, every slow call is assumed to have.
+    auto missed = [&](Clock::time_point begin) {
+        if (Clock::now() - begin < kSlowLookup) {
+            return false;
+        }
+        if (!accounting) {
+            return true;
+        }
+        uint64_t bytes;
+        ResourceCounters::ReadBytes(&bytes);
+        const bool read = bytes > read_bytes;
+        read_bytes = bytes;
+        return read;
+    };
+
+    for (const auto& directory : *tree) {
+        Clock::time_point begin = Clock::now();
+        DIR* dir = opendir(directory.first.c_str());
+        if (dir == nullptr) {
+            // Removed since it was tracked, until the next Set.
+            continue;
+        }
+        while (readdir(dir) != nullptr) {}
+        pass.listings++;
+        pass.listing_misses += missed(begin);
+
+        for (const auto& name : directory.second) {
+            struct stat buf;
+            begin = Clock::now();
+            fstatat(dirfd(dir), name.c_str(), &buf, AT_SYMLINK_NOFOLLOW);
+            pass.lookups++;
+            pass.lookup_misses += missed(begin);
+        }
+        closedir(dir);
+    }
+
+    std::lock_guard<std::mutex> lock(state->mu);
+    Stats& stats = state->stats;
+    stats.passes++;
+    stats.listings += pass.listings;
+    stats.listing_misses += pass.listing_misses;
+    stats.lookups += pass.lookups;
+    stats.lookup_misses += pass.lookup_misses;
+    stats.last_pass = Clock::now() - start;
+    return pass.listing_misses + pass.lookup_misses;
+}
+
+void MetadataWarmer::Run(std::shared_ptr<State> state) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(state->mu);
+            state->cv.wait_for(lock, state->interval,
+                [&state] { return state->stopped; });
+            if (state->stopped) {
+                return;
+            }
+        }
+
+        const uint64_t misses = Warm(state.get());
+        const double pressure = ReadPressure(state->pressure);
+
+        std::lock_guard<std::mutex> lock(state->mu);
+        state->interval = NextInterval(state->interval, state->min_interval,
+            state->max_interval, pressure, misses);
+    }
+}
+
+}  // namespace file_binder
@@ -0,0 +1,107 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__METADATA_WARMER_H__
+#define __FILE_BINDER__METADATA_WARMER_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// MetadataWarmer keeps the path to each locked file resolvable without the
+// disk.  Locking a file's pages does not keep the dentries and inodes of the
+// directories leading to it, nor the blocks of those directories, which are
+// reclaimed like any other cache.  A thread of our own periodically lists
+// each directory on the way to a tracked path with getdents and stats each
+// component with fstatat, so that reclaim finds them recently used, and
+// counts the lookups which had to read from storage.
+//
+// Passes are spaced between min_interval and max_interval apart:  The
+// interval halves while memory is under pressure or a pass misses the cache,
+// and doubles otherwise.  A pass stuck on a failing disk only holds up the
+// warming thread.
+class MetadataWarmer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats {
+        uint64_t passes = 0;
+        // Directories listed and path components looked up, and those which
+        // read from storage.
+        uint64_t listings = 0;
+        uint64_t listing_misses = 0;
+        uint64_t lookups = 0;
+        uint64_t lookup_misses = 0;
+        Clock::duration last_pass = Clock::duration::zero();
+    };
+
+    // pressure is the PSI file of memory, whose "some avg10" is read after
+    // each pass.
+    MetadataWarmer(Clock::duration min_interval, Clock::duration max_interval,
+        std::string pressure = "/proc/pressure/memory");
+    ~MetadataWarmer();
+
+    // Tracks files and directories, given as absolute paths, on behalf of
+    // key (e.g. a group), in place of those tracked for key before.
+    void Set(size_t key, const std::vector<std::string>& files,
+        const std::vector<std::string>& directories);
+
+    // Starts the warming thread, returning false on failure.
+    bool Start();
+
+    // Warms everything tracked once, on the calling thread.  It returns the
+    // number of listings and lookups which missed the cache.
+    uint64_t Warm();
+
+    // The directories listed and components looked up by each pass.
+    size_t directories() const;
+    size_t components() const;
+
+    Stats stats() const;
+    Clock::duration interval() const;
+
+    // Returns the interval to follow one of interval, given the memory
+    // pressure (the percentage of time stalled) and the misses of the latest
+    // pass.
+    static Clock::duration NextInterval(Clock::duration interval,
+        Clock::duration min_interval, Clock::duration max_interval,
+        double pressure, uint64_t misses);
+
+    // Returns the "some avg10" of the PSI file at path, or 0 if it is
+    // unavailable.
+    static double ReadPressure(const std::string& path);
+private:
+    MetadataWarmer(const MetadataWarmer&) = delete;
+    MetadataWarmer& operator=(const MetadataWarmer&) = delete;
+
+    struct State;
+
+    static uint64_t Warm(State* state);
+    static void Run(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> state_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__METADATA_WARMER_H__
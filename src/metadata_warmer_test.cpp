@@ -0,0 +1,142 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata_warmer.h"
+#include "temp_tree.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+namespace file_binder {
+namespace {
+
+typedef MetadataWarmer::Clock Clock;
+
+// Builds root/a/b/file and root/c below a temporary directory.
+class MetadataWarmerTest : public ::testing::Test {
+protected:
+    MetadataWarmerTest() : tree_("metadata_warmer_test"), root_(tree_.root()) {}
+
+    void SetUp() override {
+        ASSERT_FALSE(root_.empty());
+        ASSERT_TRUE(tree_.MakeDirectory("a"));
+        ASSERT_TRUE(tree_.MakeDirectory("a/b"));
+        ASSERT_TRUE(tree_.MakeDirectory("c"));
+        ASSERT_TRUE(tree_.Write("a/b/file", "file"));
+    }
+
+    TempTree tree_;
+    const std::string root_;
+};
+
+TEST_F(MetadataWarmerTest, WarmsEachComponent) {
+    MetadataWarmer warmer(std::chrono::seconds(1), std::chrono::seconds(60));
+    // Duplicate slashes are ignored.
+    warmer.Set(0, {root_ + "/a//b/file"}, {root_ + "/c"});
+
+    // "/", "/tmp", root, a, b and c are listed.  tmp, the root's entry in
+    // /tmp, a, c, b and file are looked up.
+    EXPECT_EQ(6u, warmer.directories());
+    EXPECT_EQ(6u, warmer.components());
+
+    warmer.Warm();
+    MetadataWarmer::Stats stats = warmer.stats();
+    EXPECT_EQ(1u, stats.passes);
+    EXPECT_EQ(6u, stats.listings);
+    EXPECT_EQ(6u, stats.lookups);
+
+    // Everything was just brought into the cache.
+    EXPECT_EQ(0u, warmer.Warm());
+    stats = warmer.stats();
+    EXPECT_EQ(2u, stats.passes);
+    EXPECT_EQ(12u, stats.lookups);
+}
+
+TEST_F(MetadataWarmerTest, SetReplacesKey) {
+    MetadataWarmer warmer(std::chrono::seconds(1), std::chrono::seconds(60));
+    warmer.Set(0, {root_ + "/a/b/file"}, {});
+    warmer.Set(1, {}, {root_ + "/c"});
+    EXPECT_EQ(6u, warmer.directories());
+
+    warmer.Set(0, {}, {});
+    // "/", "/tmp", root and c.
+    EXPECT_EQ(4u, warmer.directories());
+    EXPECT_EQ(3u, warmer.components());
+
+    warmer.Set(1, {}, {});
+    EXPECT_EQ(0u, warmer.directories());
+    warmer.Warm();
+    EXPECT_EQ(0u, warmer.stats().listings);
+}
+
+TEST_F(MetadataWarmerTest, SkipsRemovedDirectories) {
+    MetadataWarmer warmer(std::chrono::seconds(1), std::chrono::seconds(60));
+    warmer.Set(0, {}, {root_ + "/c"});
+    ASSERT_EQ(0, rmdir((root_ + "/c").c_str()));
+
+    warmer.Warm();
+    // c can no longer be listed, but its lookup still happens.
+    const MetadataWarmer::Stats stats = warmer.stats();
+    EXPECT_EQ(3u, stats.listings);
+    EXPECT_EQ(3u, stats.lookups);
+}
+
+TEST_F(MetadataWarmerTest, ReadPressure) {
+    const std::string path = root_ + "/pressure";
+    ASSERT_TRUE(WriteFile(path,
+        "some avg10=2.50 avg60=1.00 avg300=0.10 total=12345\n"
+        "full avg10=0.50 avg60=0.00 avg300=0.00 total=123\n"));
+    EXPECT_DOUBLE_EQ(2.5, MetadataWarmer::ReadPressure(path));
+    EXPECT_DOUBLE_EQ(0, MetadataWarmer::ReadPressure(root_ + "/missing"));
+}
+
+TEST(MetadataWarmerIntervalTest, AdaptsToPressureAndMisses) {
+    const Clock::duration min = std::chrono::seconds(1);
+    const Clock::duration max = std::chrono::seconds(60);
+    const Clock::duration interval = std::chrono::seconds(8);
+
+    EXPECT_EQ(std::chrono::seconds(16),
+        MetadataWarmer::NextInterval(interval, min, max, 0, 0));
+    EXPECT_EQ(std::chrono::seconds(4),
+        MetadataWarmer::NextInterval(interval, min, max, 5.0, 0));
+    EXPECT_EQ(std::chrono::seconds(4),
+        MetadataWarmer::NextInterval(interval, min, max, 0, 1));
+
+    EXPECT_EQ(max, MetadataWarmer::NextInterval(max, min, max, 0, 0));
+    EXPECT_EQ(min, MetadataWarmer::NextInterval(min, min, max, 5.0, 0));
+}
+
+TEST_F(MetadataWarmerTest, WarmsPeriodically) {
+    MetadataWarmer warmer(std::chrono::milliseconds(1),
+        std::chrono::milliseconds(10), root_ + "/missing");
+    warmer.Set(0, {root_ + "/a/b/file"}, {});
+    ASSERT_TRUE(warmer.Start());
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::seconds(10);
+    while (warmer.stats().passes < 3 && Clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GE(warmer.stats().passes, 3u);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -18,17 +18,33 @@
 
 #include "mlocker.h"
 
+#include <cerrno>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "kernel_features.h"
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
 
 namespace file_binder {
 
-MLocker::Token::Token(const std::string& path) : addr_(nullptr), size_(0) {
+namespace {
+
+// Closes fd and throws error, as a std::system_error.
+[[noreturn]] void CloseAndThrow(int fd, int error, const std::string& what) {
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+MLocker::Mapping MapAndLock(const std::string& path) {
     // TODO:  Use RAII for this file descriptor.
     int fd;
     do {
@@ -36,8 +52,8 @@ MLocker::Token::Token(const std::string& path) : addr_(nullptr), size_(0) {
     } while (fd < 0 && errno == EINTR);
 
     if (fd < 0) {
-        // TODO: Catch this.
-        throw std::invalid_argument("Error opening: " + path);
+        throw std::system_error(
+            errno, std::generic_category(), "Error opening: " + path);
     }
 
     struct stat buf;
@@ -45,27 +61,65 @@ MLocker::Token::Token(const std::string& path) : addr_(nullptr), size_(0) {
     do {
         ret = fstat(fd, &buf);
     } while (ret != 0 && errno == EINTR);
+    if (ret != 0) {
+        CloseAndThrow(fd, errno, "Unable to stat: " + path);
+    }
 
-    // TODO:  Handle ret < 0
+    MLocker::Mapping mapping;
+    if (buf.st_size == 0) {
+        // Empty files cannot be mapped, and there is nothing to lock.
+        ::close(fd);
+        return mapping;
+    }
 
-    size_ = buf.st_size;
-    addr_ = ::mmap(nullptr, size_, PROT_READ,
-        MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
-    if (addr_ == MAP_FAILED) {
+    mapping.size = buf.st_size;
+    if (HasKernelFeature(KernelFeature::kPopulateRead)) {
+        // Unlike MAP_POPULATE, MADV_POPULATE_READ reports pages it could not
+        // read.
+        mapping.addr = ::mmap(
+            nullptr, mapping.size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping.addr == MAP_FAILED) {
+            CloseAndThrow(fd, errno, "Unable to mmap: " + path);
+        }
         ::close(fd);
 
-        throw std::runtime_error("Unable to mmap");
+        if (::madvise(mapping.addr, mapping.size, MADV_POPULATE_READ) != 0 ||
+                ::mlock(mapping.addr, mapping.size) != 0) {
+            const int error = errno;
+            ::munmap(mapping.addr, mapping.size);
+
+            throw std::system_error(
+                error, std::generic_category(), "Unable to populate: " + path);
+        }
+        return mapping;
+    }
+
+    mapping.addr = ::mmap(nullptr, mapping.size, PROT_READ,
+        MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+    if (mapping.addr == MAP_FAILED) {
+        CloseAndThrow(fd, errno, "Unable to mmap: " + path);
     }
 
     ::close(fd);
 
     // MAP_LOCKED is not as strong as mlock.
     // TODO: Check this return value.
-    ::mlock(addr_, size_);
+    ::mlock(mapping.addr, mapping.size);
+    return mapping;
+}
+
+}  // namespace
+
+MLocker::Token::Token(const std::string& path) : addr_(nullptr), size_(0) {
+    const Mapping mapping = MapAndLock(path);
+    addr_ = mapping.addr;
+    size_ = mapping.size;
 }
 
 MLocker::Token::~Token() {
-    ::munmap(addr_, size_);
+    if (addr_ != nullptr) {
+        ::munmap(addr_, size_);
+    }
 }
 
 MLocker::Token::Token(Token&& rhs) :
@@ -90,4 +144,32 @@ std::unique_ptr<MLocker::Token> MLocker::Lock(const std::string& path) const {
     return std::unique_ptr<Token>(new Token(path));
 }
 
+MLocker::Mapping MLocker::LockMapping(const std::string& path) const {
+    return MapAndLock(path);
+}
+
+void MLocker::Unlock(const Mapping& mapping) const {
+    if (mapping.addr != nullptr) {
+        ::munmap(mapping.addr, mapping.size);
+    }
+}
+
+void MLocker::Prefetch(const std::string& path) const {
+    PrefetchFile(path);
+}
+
+void PrefetchFile(const std::string& path) {
+    int fd;
+    do {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0) {
+        return;
+    }
+
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+}
+
 }   // namespace file_binder
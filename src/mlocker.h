@@ -19,6 +19,8 @@
 #ifndef __FILE_BINDER__MLOCKER_H__
 #define __FILE_BINDER__MLOCKER_H__
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -26,6 +28,20 @@ namespace file_binder {
 
 class MLocker {
 public:
+    // A Mapping is a plain record of a locked file mapping.  Unlike a Token,
+    // it does not release the mapping when destroyed; it must be passed to
+    // Unlock.
+    struct Mapping {
+        Mapping() : addr(nullptr), size(0), shard(0) {}
+
+        void* addr;
+        size_t size;
+        // The process holding the mapping:  0 for this process, otherwise
+        // the helper it was delegated to (see ShardSupervisor).  For helpers,
+        // addr is an address in the helper's address space.
+        uint32_t shard;
+    };
+
     class Token {
     public:
         Token(Token&&);
@@ -48,8 +64,24 @@ public:
     virtual ~MLocker();
 
     virtual std::unique_ptr<Token> Lock(const std::string& path) const;
+
+    // LockMapping locks path into memory, as with Lock, but returns the
+    // mapping as a plain record for compact storage.  It throws a
+    // std::system_error, carrying the errno, on failure.
+    virtual Mapping LockMapping(const std::string& path) const;
+
+    // Releases a mapping returned by LockMapping.
+    virtual void Unlock(const Mapping& mapping) const;
+
+    // Prefetch asks the kernel to readahead the contents of path into the page
+    // cache, without locking it.  It is best effort and errors are ignored.
+    virtual void Prefetch(const std::string& path) const;
 };
 
+// PrefetchFile implements MLocker::Prefetch, for callers not holding an
+// MLocker.
+void PrefetchFile(const std::string& path);
+
 }  // namespace file_binder
 
 #endif  // __FILE_BINDER__MLOCKER_H__
@@ -27,6 +27,8 @@
 #include <regex>
 #include <stdexcept>
 
+#include "kernel_features.h"
+
 namespace file_binder {
 namespace {
 
@@ -76,9 +78,10 @@ public:
 
         std::regex prop_re(
             // Property
-            "^([a-zA-Z_]+): *"
+            "^([a-zA-Z_]+):(.*)$");
+        std::regex size_re(
             // Size
-            "([0-9]+) kB$");
+            " *([0-9]+) kB$");
 
         std::ifstream smaps("/proc/self/smaps");
 
@@ -90,6 +93,7 @@ public:
 
         // Our outer parsing loop maintains the invariant that line is always
         // the beginning of another entry, or blank.
+        bool more;
         do {
             if (line.empty()) {
                 break;
@@ -114,17 +118,25 @@ public:
             entry.filename = match[7].str();
 
             // Iterate over contents.
+            more = false;
             while (std::getline(smaps, line)) {
                 std::smatch prop_match;
                 if (!std::regex_match(line, prop_match, prop_re)) {
                     // Assume we are done with matching properties and are back
                     // to entries.
+                    more = true;
                     break;
                 }
                 ASSERT_EQ(3, prop_match.size());
 
+                // Skip properties other than sizes, such as VmFlags.
                 const std::string prop = prop_match[1];
-                const uint64_t val = Dec(prop_match[2]);
+                const std::string value = prop_match[2];
+                std::smatch size_match;
+                if (!std::regex_match(value, size_match, size_re)) {
+                    continue;
+                }
+                const uint64_t val = Dec(size_match[1]);
 
                 if (prop == "Size") {
                     entry.Size = val;
@@ -136,7 +148,7 @@ public:
             }
 
             new_entries.push_back(entry);
-        } while(std::getline(smaps, line));
+        } while (more);
 
         using std::swap;
         swap(entries, new_entries);
@@ -160,7 +172,7 @@ public:
     std::vector<Entry> entries;
 };
 
-TEST(MLocker, Locked) {
+void ExpectLocked() {
     // Construct a temporary file, fill with some data.
     char name[] = "/tmp/mlocker.XXXXXXX";
     int fd = mkstemp(name);
@@ -230,5 +242,14 @@ TEST(MLocker, Locked) {
     ::close(fd);
 }
 
+TEST(MLocker, Locked) {
+    ExpectLocked();
+}
+
+TEST(MLocker, LockedWithMapPopulate) {
+    DisableKernelFeature(KernelFeature::kPopulateRead);
+    ExpectLocked();
+}
+
 }  // namespace
 }  // namespace file_binder
@@ -0,0 +1,333 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "numa.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+namespace file_binder {
+namespace {
+
+// From include/uapi/linux/mempolicy.h.  We use the raw system calls, rather
+// than libnuma, to avoid the dependency.
+const int kMpolDefault = 0;
+const int kMpolPreferred = 1;
+const int kMpolBind = 2;
+const int kMpolInterleave = 3;
+const int kMpolMfMove = 1 << 1;
+
+// The largest node id we support.
+const int kMaxNodes = 1024;
+const size_t kBitsPerLong = 8 * sizeof(unsigned long);
+
+// The number of pages queried per move_pages call.
+const size_t kPagesPerCall = 4096;
+
+// Parses a list such as "0,2-3".
+bool ParseList(const std::string& list, std::vector<int>* values) {
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        char* end;
+        const long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        if (end == range.c_str() || *end != '\0' || first < 0 ||
+                last < first || last >= kMaxNodes) {
+            return false;
+        }
+
+        for (long i = first; i <= last; i++) {
+            values->push_back(static_cast<int>(i));
+        }
+    }
+    return true;
+}
+
+std::vector<int> ReadList(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::vector<int> values;
+    if (std::getline(in, line)) {
+        ParseList(line, &values);
+    }
+    return values;
+}
+
+std::vector<unsigned long> Mask(const std::vector<int>& bits, size_t size) {
+    std::vector<unsigned long> mask((size + kBitsPerLong - 1) / kBitsPerLong);
+    for (int bit : bits) {
+        if (bit >= 0 && static_cast<size_t>(bit) < size) {
+            mask[bit / kBitsPerLong] |= 1UL << (bit % kBitsPerLong);
+        }
+    }
+    return mask;
+}
+
+}  // namespace
+
+bool ParseNumaPolicy(const std::string& spec, NumaPolicy* policy) {
+    const size_t colon = spec.find(':');
+    const std::string mode = spec.substr(0, colon);
+
+    NumaPolicy parsed;
+    if (mode == "default") {
+        parsed.mode = NumaPolicy::Mode::kDefault;
+    } else if (mode == "interleave") {
+        parsed.mode = NumaPolicy::Mode::kInterleave;
+    } else if (mode == "bind") {
+        parsed.mode = NumaPolicy::Mode::kBind;
+    } else if (mode == "cpu") {
+        parsed.mode = NumaPolicy::Mode::kCpu;
+    } else {
+        return false;
+    }
+
+    if (colon != std::string::npos &&
+            !ParseList(spec.substr(colon + 1), &parsed.nodes)) {
+        return false;
+    }
+
+    // Binding or pinning to every node is surely a mistake.
+    if (parsed.nodes.empty() && (parsed.mode == NumaPolicy::Mode::kBind ||
+            parsed.mode == NumaPolicy::Mode::kCpu)) {
+        return false;
+    }
+
+    *policy = std::move(parsed);
+    return true;
+}
+
+std::vector<int> OnlineNumaNodes() {
+    std::vector<int> nodes = ReadList("/sys/devices/system/node/online");
+    if (nodes.empty()) {
+        // Kernels without CONFIG_NUMA have a single node.
+        nodes.push_back(0);
+    }
+    return nodes;
+}
+
+ScopedNumaPolicy::ScopedNumaPolicy(const NumaPolicy& policy) :
+        ok_(true), restore_policy_(false), restore_affinity_(false),
+        old_mode_(kMpolDefault) {
+    if (policy.mode == NumaPolicy::Mode::kDefault) {
+        return;
+    }
+
+    const std::vector<int> nodes =
+        policy.nodes.empty() ? OnlineNumaNodes() : policy.nodes;
+
+    old_nodemask_.resize(kMaxNodes / kBitsPerLong);
+    if (syscall(SYS_get_mempolicy, &old_mode_, old_nodemask_.data(),
+            kMaxNodes, nullptr, 0) == 0) {
+        restore_policy_ = true;
+    }
+
+    int mode = kMpolDefault;
+    switch (policy.mode) {
+        case NumaPolicy::Mode::kDefault:
+            break;
+        case NumaPolicy::Mode::kInterleave:
+            mode = kMpolInterleave;
+            break;
+        case NumaPolicy::Mode::kBind:
+            mode = kMpolBind;
+            break;
+        case NumaPolicy::Mode::kCpu: {
+            mode = kMpolPreferred;
+
+            cpu_set_t old_cpus;
+            if (sched_getaffinity(0, sizeof(old_cpus), &old_cpus) == 0) {
+                old_cpus_.assign(
+                    reinterpret_cast<unsigned long*>(&old_cpus),
+                    reinterpret_cast<unsigned long*>(&old_cpus + 1));
+                restore_affinity_ = true;
+            }
+
+            std::vector<int> cpus;
+            for (int node : nodes) {
+                std::vector<int> node_cpus = ReadList(
+                    "/sys/devices/system/node/node" + std::to_string(node) +
+                    "/cpulist");
+                cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+            }
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                if (cpu < CPU_SETSIZE) {
+                    CPU_SET(cpu, &set);
+                }
+            }
+            if (cpus.empty() || sched_setaffinity(0, sizeof(set), &set) != 0) {
+                ok_ = false;
+            }
+            break;
+        }
+    }
+
+    // MPOL_PREFERRED takes a single node.
+    const std::vector<int> policy_nodes = mode == kMpolPreferred ?
+        std::vector<int>(1, nodes[0]) : nodes;
+    const std::vector<unsigned long> mask = Mask(policy_nodes, kMaxNodes);
+    if (syscall(SYS_set_mempolicy, mode, mask.data(), kMaxNodes) != 0) {
+        ok_ = false;
+    }
+}
+
+ScopedNumaPolicy::~ScopedNumaPolicy() {
+    if (restore_policy_) {
+        syscall(SYS_set_mempolicy, old_mode_,
+            old_mode_ == kMpolDefault ? nullptr : old_nodemask_.data(),
+            kMaxNodes);
+    }
+    if (restore_affinity_) {
+        sched_setaffinity(0, old_cpus_.size() * sizeof(unsigned long),
+            reinterpret_cast<cpu_set_t*>(old_cpus_.data()));
+    }
+}
+
+ThreadPlacement GetThreadPlacement() {
+    ThreadPlacement placement;
+    std::vector<unsigned long> nodemask(kMaxNodes / kBitsPerLong);
+    int mode;
+    if (syscall(SYS_get_mempolicy, &mode, nodemask.data(), kMaxNodes,
+            nullptr, 0) == 0) {
+        placement.mode = mode;
+        if (mode != kMpolDefault) {
+            placement.nodemask = std::move(nodemask);
+        }
+    }
+
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        placement.cpus.assign(
+            reinterpret_cast<unsigned long*>(&cpus),
+            reinterpret_cast<unsigned long*>(&cpus + 1));
+    }
+    return placement;
+}
+
+bool SetThreadPlacement(const ThreadPlacement& placement) {
+    bool ok = true;
+    if (placement.mode >= 0 && syscall(SYS_set_mempolicy, placement.mode,
+            placement.nodemask.empty() ? nullptr : placement.nodemask.data(),
+            kMaxNodes) != 0) {
+        ok = false;
+    }
+    if (!placement.cpus.empty() && sched_setaffinity(0,
+            placement.cpus.size() * sizeof(unsigned long),
+            reinterpret_cast<const cpu_set_t*>(placement.cpus.data())) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+void CountNodeBytes(
+        const void* addr, size_t size, std::vector<uint64_t>* bytes) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    const size_t pages = (size + page - 1) / page;
+
+    std::vector<void*> addrs;
+    std::vector<int> status;
+    for (size_t first = 0; first < pages; first += kPagesPerCall) {
+        const size_t count = std::min(kPagesPerCall, pages - first);
+        addrs.resize(count);
+        status.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            addrs[i] = reinterpret_cast<void*>(begin + (first + i) * page);
+        }
+
+        // With no target nodes, move_pages reports where each page is.
+        if (syscall(SYS_move_pages, 0, count, addrs.data(), nullptr,
+                status.data(), 0) != 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const int node = status[i];
+            if (node < 0) {
+                // Not resident, or otherwise unavailable.
+                continue;
+            }
+            if (static_cast<size_t>(node) >= bytes->size()) {
+                bytes->resize(node + 1);
+            }
+
+            const size_t offset = (first + i) * page;
+            (*bytes)[node] += std::min(page, size - offset);
+        }
+    }
+}
+
+void MigrateToNodes(
+        const void* addr, size_t size, const std::vector<int>& nodes) {
+    if (nodes.empty()) {
+        return;
+    }
+
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    const size_t pages = (size + page - 1) / page;
+
+    std::vector<void*> addrs;
+    std::vector<int> status;
+    std::vector<void*> moves;
+    for (size_t first = 0; first < pages; first += kPagesPerCall) {
+        const size_t count = std::min(kPagesPerCall, pages - first);
+        addrs.resize(count);
+        status.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            addrs[i] = reinterpret_cast<void*>(begin + (first + i) * page);
+        }
+        if (syscall(SYS_move_pages, 0, count, addrs.data(), nullptr,
+                status.data(), 0) != 0) {
+            return;
+        }
+
+        moves.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (status[i] >= 0 && std::find(nodes.begin(), nodes.end(),
+                    status[i]) == nodes.end()) {
+                moves.push_back(addrs[i]);
+            }
+        }
+        if (moves.empty()) {
+            continue;
+        }
+
+        const std::vector<int> targets(moves.size(), nodes[0]);
+        status.resize(moves.size());
+        syscall(SYS_move_pages, 0, moves.size(), moves.data(),
+            targets.data(), status.data(), kMpolMfMove);
+    }
+}
+
+}  // namespace file_binder
@@ -0,0 +1,113 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__NUMA_H__
+#define __FILE_BINDER__NUMA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// Page cache is allocated according to the memory policy of the thread which
+// faults it in, not of the mapping, so a NumaPolicy is applied to the thread
+// populating a group rather than with mbind.
+struct NumaPolicy {
+    enum class Mode {
+        // Allocate wherever the populating thread runs.
+        kDefault,
+        // Spread pages across nodes.
+        kInterleave,
+        // Allocate only from nodes.
+        kBind,
+        // Run the populating thread on the CPUs of nodes, preferring their
+        // memory, as a consumer pinned there would.
+        kCpu,
+    };
+
+    Mode mode = Mode::kDefault;
+    // The nodes to use, or every online node if empty.
+    std::vector<int> nodes;
+};
+
+// Parses "default", "interleave[:<nodes>]", "bind:<nodes>" or "cpu:<nodes>",
+// where nodes is a list such as "0,2-3".
+bool ParseNumaPolicy(const std::string& spec, NumaPolicy* policy);
+
+// Returns the online NUMA nodes.
+std::vector<int> OnlineNumaNodes();
+
+// Applies a NumaPolicy to the calling thread for the lifetime of this object.
+class ScopedNumaPolicy {
+public:
+    explicit ScopedNumaPolicy(const NumaPolicy& policy);
+    ~ScopedNumaPolicy();
+
+    // Returns false if the policy could not be applied.
+    bool ok() const { return ok_; }
+private:
+    ScopedNumaPolicy(const ScopedNumaPolicy&) = delete;
+    ScopedNumaPolicy& operator=(const ScopedNumaPolicy&) = delete;
+
+    bool ok_;
+    bool restore_policy_;
+    bool restore_affinity_;
+    int old_mode_;
+    std::vector<unsigned long> old_nodemask_;
+    std::vector<unsigned long> old_cpus_;
+};
+
+// The memory policy and CPU affinity of a thread, so that another thread can
+// take them on.  Either is left empty if it could not be read.
+struct ThreadPlacement {
+    int mode = -1;
+    std::vector<unsigned long> nodemask;
+    std::vector<unsigned long> cpus;
+
+    bool operator==(const ThreadPlacement& rhs) const {
+        return mode == rhs.mode && nodemask == rhs.nodemask &&
+            cpus == rhs.cpus;
+    }
+    bool operator!=(const ThreadPlacement& rhs) const {
+        return !(*this == rhs);
+    }
+};
+
+// Returns the placement of the calling thread.
+ThreadPlacement GetThreadPlacement();
+
+// Applies placement to the calling thread, returning false on failure.
+bool SetThreadPlacement(const ThreadPlacement& placement);
+
+// Adds the bytes of [addr, addr + size) resident on each node to
+// (*bytes)[node], growing bytes as needed.  Pages which are not resident are
+// not counted.
+void CountNodeBytes(
+    const void* addr, size_t size, std::vector<uint64_t>* bytes);
+
+// Moves the resident pages of [addr, addr + size) which are not on one of
+// nodes to nodes[0].  It is best effort; pages shared with other processes
+// are only moved with CAP_SYS_NICE.
+void MigrateToNodes(
+    const void* addr, size_t size, const std::vector<int>& nodes);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__NUMA_H__
@@ -0,0 +1,106 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "numa.h"
+
+#include <cstdlib>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "mlocker.h"
+
+namespace file_binder {
+namespace {
+
+int CurrentMode() {
+    int mode = -1;
+    std::vector<unsigned long> mask(1024 / (8 * sizeof(unsigned long)));
+    syscall(SYS_get_mempolicy, &mode, mask.data(), 1024, nullptr, 0);
+    return mode;
+}
+
+TEST(Numa, ParsePolicy) {
+    NumaPolicy policy;
+    ASSERT_TRUE(ParseNumaPolicy("interleave", &policy));
+    EXPECT_EQ(NumaPolicy::Mode::kInterleave, policy.mode);
+    EXPECT_TRUE(policy.nodes.empty());
+
+    ASSERT_TRUE(ParseNumaPolicy("bind:0,2-3", &policy));
+    EXPECT_EQ(NumaPolicy::Mode::kBind, policy.mode);
+    EXPECT_EQ((std::vector<int>{0, 2, 3}), policy.nodes);
+
+    ASSERT_TRUE(ParseNumaPolicy("cpu:1", &policy));
+    EXPECT_EQ(NumaPolicy::Mode::kCpu, policy.mode);
+    EXPECT_EQ(std::vector<int>{1}, policy.nodes);
+
+    EXPECT_FALSE(ParseNumaPolicy("bind", &policy));
+    EXPECT_FALSE(ParseNumaPolicy("bind:3-1", &policy));
+    EXPECT_FALSE(ParseNumaPolicy("bind:x", &policy));
+    EXPECT_FALSE(ParseNumaPolicy("spread", &policy));
+}
+
+TEST(Numa, ScopedPolicy) {
+    const int before = CurrentMode();
+    const int node = OnlineNumaNodes()[0];
+
+    NumaPolicy policy;
+    policy.mode = NumaPolicy::Mode::kBind;
+    policy.nodes.push_back(node);
+    {
+        ScopedNumaPolicy scoped(policy);
+        ASSERT_TRUE(scoped.ok());
+        // MPOL_BIND
+        EXPECT_EQ(2, CurrentMode());
+    }
+    EXPECT_EQ(before, CurrentMode());
+}
+
+TEST(Numa, CountNodeBytes) {
+    char name[] = "/tmp/numa_test.XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    const std::string contents(100000, 'x');
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+        write(fd, contents.data(), contents.size()));
+    close(fd);
+
+    MLocker mlocker;
+    const MLocker::Mapping mapping = mlocker.LockMapping(name);
+
+    std::vector<uint64_t> bytes;
+    CountNodeBytes(mapping.addr, mapping.size, &bytes);
+    uint64_t total = 0;
+    for (uint64_t b : bytes) {
+        total += b;
+    }
+    // Every page is locked, and so resident.
+    EXPECT_EQ(contents.size(), total);
+
+    // Migrating to the node the pages are already on is a no-op.
+    MigrateToNodes(mapping.addr, mapping.size, OnlineNumaNodes());
+
+    mlocker.Unlock(mapping);
+    unlink(name);
+}
+
+}  // namespace
+}  // namespace file_binder
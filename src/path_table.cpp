@@ -0,0 +1,173 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "path_table.h"
+
+#include <cstring>
+
+namespace file_binder {
+namespace {
+
+// The roots of absolute and relative paths.
+const PathId kAbsoluteRoot = 0;
+const PathId kRelativeRoot = 1;
+
+uint64_t Hash(PathId parent, const char* name, size_t length) {
+    // FNV-1a, seeded with the parent.
+    uint64_t h = 14695981039346656037ULL ^ parent;
+    for (size_t i = 0; i < length; i++) {
+        h ^= static_cast<uint8_t>(name[i]);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+}  // namespace
+
+constexpr PathId PathTable::kInvalid;
+
+PathTable::PathTable() : index_(64, kInvalid) {
+    nodes_.push_back(Node{"", kInvalid, 0});
+    nodes_.push_back(Node{"", kInvalid, 0});
+}
+
+PathTable::~PathTable() {}
+
+PathId PathTable::Intern(const std::string& path) {
+    return Walk(path, true);
+}
+
+PathId PathTable::Find(const std::string& path) const {
+    return const_cast<PathTable*>(this)->Walk(path, false);
+}
+
+PathId PathTable::Walk(const std::string& path, bool insert) {
+    PathId id = !path.empty() && path[0] == '/' ? kAbsoluteRoot : kRelativeRoot;
+
+    size_t pos = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '/') {
+            pos++;
+            continue;
+        }
+
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+
+        id = Child(id, path.data() + pos, end - pos, insert);
+        if (id == kInvalid) {
+            return kInvalid;
+        }
+        pos = end;
+    }
+
+    return id;
+}
+
+PathId PathTable::Child(
+        PathId parent, const char* name, size_t length, bool insert) {
+    const size_t mask = index_.size() - 1;
+    size_t slot = Hash(parent, name, length) & mask;
+    while (index_[slot] != kInvalid) {
+        const Node& node = nodes_[index_[slot]];
+        if (node.parent == parent && node.length == length &&
+                memcmp(node.name, name, length) == 0) {
+            return index_[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!insert) {
+        return kInvalid;
+    }
+
+    const PathId id = static_cast<PathId>(nodes_.size());
+    nodes_.push_back(Node{arena_.Copy(name, length), parent,
+        static_cast<uint32_t>(length)});
+    index_[slot] = id;
+
+    // Keep the load factor below 1/2.
+    if (nodes_.size() * 2 > index_.size()) {
+        Grow();
+    }
+    return id;
+}
+
+void PathTable::Grow() {
+    std::vector<PathId> index(index_.size() * 2, kInvalid);
+    const size_t mask = index.size() - 1;
+    for (PathId id = kRelativeRoot + 1; id < nodes_.size(); id++) {
+        const Node& node = nodes_[id];
+        size_t slot = Hash(node.parent, node.name, node.length) & mask;
+        while (index[slot] != kInvalid) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot] = id;
+    }
+    index_.swap(index);
+}
+
+std::string PathTable::Get(PathId id) const {
+    if (id >= nodes_.size()) {
+        return std::string();
+    }
+
+    size_t length = 0;
+    PathId root = id;
+    for (PathId p = id; p != kInvalid; p = nodes_[p].parent) {
+        length += nodes_[p].length + 1;
+        root = p;
+    }
+
+    if (id == kAbsoluteRoot) {
+        return "/";
+    } else if (id == kRelativeRoot) {
+        return ".";
+    }
+
+    // Fill in components from the end.  Each component is preceded by a
+    // slash, which we drop for relative paths.
+    std::string ret(length, '/');
+    size_t end = length;
+    for (PathId p = id; p != root; p = nodes_[p].parent) {
+        const Node& node = nodes_[p];
+        end -= node.length;
+        memcpy(&ret[end], node.name, node.length);
+        end--;
+    }
+    // The root contributes a leading slash of its own.
+    ret.erase(0, root == kRelativeRoot ? 2 : 1);
+    return ret;
+}
+
+PathId PathTable::Parent(PathId id) const {
+    if (id >= nodes_.size()) {
+        return kInvalid;
+    }
+    return nodes_[id].parent;
+}
+
+size_t PathTable::MemoryUsage() const {
+    return sizeof(*this) + arena_.MemoryUsage() +
+        nodes_.capacity() * sizeof(Node) +
+        index_.capacity() * sizeof(PathId);
+}
+
+}  // namespace file_binder
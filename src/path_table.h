@@ -0,0 +1,86 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__PATH_TABLE_H__
+#define __FILE_BINDER__PATH_TABLE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+
+namespace file_binder {
+
+typedef uint32_t PathId;
+
+// PathTable interns paths as a tree of components, so that files in the same
+// directory share the storage of their parent's path.  Component names are
+// stored in an Arena.  Ids are dense and stable for the lifetime of the table.
+class PathTable {
+public:
+    static constexpr PathId kInvalid = static_cast<PathId>(-1);
+
+    PathTable();
+    ~PathTable();
+
+    // Interns path, returning its id.  Repeated and trailing slashes are
+    // ignored, but "." and ".." are treated as ordinary components.
+    PathId Intern(const std::string& path);
+
+    // Returns the id of path, or kInvalid if it has not been interned.
+    PathId Find(const std::string& path) const;
+
+    // Reconstructs the path for id.
+    std::string Get(PathId id) const;
+
+    // Returns the directory containing id, or kInvalid for the roots.
+    PathId Parent(PathId id) const;
+
+    // The number of ids allocated, including intermediate directories.
+    size_t size() const { return nodes_.size(); }
+
+    // Bytes used by the table and its arena.
+    size_t MemoryUsage() const;
+private:
+    PathTable(const PathTable&) = delete;
+    PathTable& operator=(const PathTable&) = delete;
+
+    struct Node {
+        const char* name;
+        PathId parent;
+        uint32_t length;
+    };
+
+    // Looks up the child of parent named name, inserting it if requested.
+    PathId Child(PathId parent, const char* name, size_t length, bool insert);
+
+    PathId Walk(const std::string& path, bool insert);
+
+    void Grow();
+
+    Arena arena_;
+    std::vector<Node> nodes_;
+    // Open-addressed index of (parent, name) to node, using linear probing.
+    std::vector<PathId> index_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__PATH_TABLE_H__
@@ -0,0 +1,116 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the time to lock a tree of files in discovery order against
+// physical-layout order.  Page cache is dropped for the files before each
+// run, so this is most meaningful on a dedicated (e.g. loop-device backed)
+// filesystem:
+//
+//   truncate -s 2G /tmp/disk.img
+//   mkfs.ext4 -q /tmp/disk.img
+//   mount -o loop /tmp/disk.img /mnt/test
+//   cp -a /usr/lib /mnt/test/
+//   population_benchmark /mnt/test [iterations]
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "filesystem.h"
+#include "mlocker.h"
+#include "population_scheduler.h"
+
+namespace {
+
+void Evict(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+double LockAll(const std::vector<std::string>& paths, bool scheduled) {
+    file_binder::MLocker mlocker;
+    std::vector<file_binder::MLocker::Mapping> mappings;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> order;
+    if (scheduled) {
+        const auto reads = file_binder::PopulationScheduler::Plan(paths);
+        order = file_binder::PopulationScheduler::Populate(paths, reads);
+    } else {
+        for (uint32_t i = 0; i < paths.size(); i++) {
+            order.push_back(i);
+        }
+    }
+
+    for (uint32_t i : order) {
+        try {
+            mappings.push_back(mlocker.LockMapping(paths[i]));
+        } catch (std::exception& ex) {
+            // Skip unreadable files.
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& mapping : mappings) {
+        mlocker.Unlock(mapping);
+    }
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [iterations]\n", argv[0]);
+        return 1;
+    }
+    const int iterations = argc > 2 ? atoi(argv[2]) : 3;
+
+    std::vector<std::string> paths;
+    size_t bytes = 0;
+    file_binder::Filesystem filesystem;
+    filesystem.Walk(argv[1],
+        [&paths, &bytes](const std::string& path, const struct stat& buf) {
+            if (S_ISREG(buf.st_mode)) {
+                paths.push_back(path);
+                bytes += buf.st_size;
+            }
+        });
+    printf("%zu files, %zu bytes\n", paths.size(), bytes);
+
+    for (int i = 0; i < iterations; i++) {
+        Evict(paths);
+        const double discovery = LockAll(paths, false);
+        Evict(paths);
+        const double physical = LockAll(paths, true);
+        printf("discovery order: %8.3fs  physical order: %8.3fs  "
+            "speedup %.2fx\n", discovery, physical, discovery / physical);
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "population_scheduler.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace file_binder {
+namespace {
+
+// The number of extents fetched per FS_IOC_FIEMAP call.
+const size_t kExtentsPerCall = 64;
+
+// Extents which do not have a meaningful physical address.
+const uint32_t kUnmappedFlags = FIEMAP_EXTENT_UNKNOWN |
+    FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE |
+    FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_UNWRITTEN;
+
+int Open(const std::string& path) {
+    int fd;
+    do {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+// Appends the extents of the file open at fd to reads.  It returns false if
+// FIEMAP is unsupported or the file's layout is unknown.
+bool Fiemap(int fd, uint32_t file, dev_t device, uint64_t size,
+        std::vector<PopulationScheduler::Read>* reads) {
+    const size_t bytes =
+        sizeof(struct fiemap) + kExtentsPerCall * sizeof(struct fiemap_extent);
+    std::unique_ptr<uint64_t[]> storage(new uint64_t[(bytes + 7) / 8]);
+    struct fiemap* fm = reinterpret_cast<struct fiemap*>(storage.get());
+
+    const size_t start = reads->size();
+    uint64_t offset = 0;
+    bool last = false;
+    while (!last && offset < size) {
+        memset(fm, 0, sizeof(*fm));
+        fm->fm_start = offset;
+        fm->fm_length = FIEMAP_MAX_OFFSET - offset;
+        fm->fm_extent_count = kExtentsPerCall;
+
+        if (::ioctl(fd, FS_IOC_FIEMAP, fm) < 0 || fm->fm_mapped_extents == 0) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < fm->fm_mapped_extents; i++) {
+            const struct fiemap_extent& extent = fm->fm_extents[i];
+            last = (extent.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+            offset = extent.fe_logical + extent.fe_length;
+
+            if (extent.fe_flags & kUnmappedFlags) {
+                reads->resize(start);
+                return false;
+            }
+
+            PopulationScheduler::Read read;
+            read.file = file;
+            read.offset = extent.fe_logical;
+            read.length = std::min<uint64_t>(
+                extent.fe_length, size > extent.fe_logical ?
+                    size - extent.fe_logical : 0);
+            read.device = device;
+            read.physical = extent.fe_physical;
+            if (read.length > 0) {
+                reads->push_back(read);
+            }
+        }
+    }
+
+    return reads->size() > start;
+}
+
+// Returns the physical address of the first block of the file open at fd, or
+// kUnknownPhysical.  FIBMAP requires CAP_SYS_RAWIO.
+uint64_t Fibmap(int fd, const struct stat& buf) {
+    int block = 0;
+    if (::ioctl(fd, FIBMAP, &block) < 0 || block == 0) {
+        return PopulationScheduler::kUnknownPhysical;
+    }
+    return static_cast<uint64_t>(block) * buf.st_blksize;
+}
+
+}  // namespace
+
+constexpr uint64_t PopulationScheduler::kUnknownPhysical;
+
+std::vector<PopulationScheduler::Read> PopulationScheduler::Plan(
+        const std::vector<std::string>& paths) {
+    std::vector<Read> reads;
+    for (uint32_t i = 0; i < paths.size(); i++) {
+        int fd = Open(paths[i]);
+        if (fd < 0) {
+            continue;
+        }
+
+        struct stat buf;
+        if (::fstat(fd, &buf) < 0 || buf.st_size == 0) {
+            ::close(fd);
+            continue;
+        }
+
+        if (!Fiemap(fd, i, buf.st_dev, buf.st_size, &reads)) {
+            Read read;
+            read.file = i;
+            read.offset = 0;
+            read.length = buf.st_size;
+            read.device = buf.st_dev;
+            read.physical = Fibmap(fd, buf);
+            reads.push_back(read);
+        }
+
+        ::close(fd);
+    }
+
+    // Unknown addresses sort last on their device.  The sort is stable, so
+    // those files otherwise keep their discovery order.
+    std::stable_sort(reads.begin(), reads.end(),
+        [](const Read& a, const Read& b) {
+            if (a.device != b.device) {
+                return a.device < b.device;
+            }
+            return a.physical < b.physical;
+        });
+
+    // Merge physically and logically contiguous extents of the same file.
+    std::vector<Read> merged;
+    for (const auto& read : reads) {
+        if (!merged.empty()) {
+            Read& prev = merged.back();
+            if (prev.file == read.file &&
+                    prev.physical != kUnknownPhysical &&
+                    prev.offset + prev.length == read.offset &&
+                    prev.physical + prev.length == read.physical) {
+                prev.length += read.length;
+                continue;
+            }
+        }
+        merged.push_back(read);
+    }
+
+    return merged;
+}
+
+std::vector<uint32_t> PopulationScheduler::Populate(
+        const std::vector<std::string>& paths,
+        const std::vector<Read>& reads,
+        IoThrottle* throttle) {
+    std::vector<uint32_t> order;
+    std::vector<bool> seen(paths.size());
+
+    int fd = -1;
+    uint32_t fd_file = 0;
+    for (const auto& read : reads) {
+        if (fd < 0 || fd_file != read.file) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = Open(paths[read.file]);
+            fd_file = read.file;
+            if (fd < 0) {
+                continue;
+            }
+        }
+
+        if (!seen[read.file]) {
+            seen[read.file] = true;
+            order.push_back(read.file);
+        }
+
+        if (throttle != nullptr) {
+            throttle->Read(read.device, read.length);
+        }
+
+        // readahead queues the I/O without copying it to us, so the block
+        // layer sees our requests in physical order.
+        ::readahead(fd, read.offset, read.length);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    // Files which could not be planned are locked last, in discovery order.
+    for (uint32_t i = 0; i < paths.size(); i++) {
+        if (!seen[i]) {
+            order.push_back(i);
+        }
+    }
+    return order;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,68 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__POPULATION_SCHEDULER_H__
+#define __FILE_BINDER__POPULATION_SCHEDULER_H__
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "io_throttle.h"
+
+namespace file_binder {
+
+// PopulationScheduler orders the reads needed to bring a set of files into
+// the page cache by their physical location on disk, so that populating a
+// lock set is dominated by sequential rather than random I/O.
+class PopulationScheduler {
+public:
+    struct Read {
+        // Index of the file within the paths passed to Plan.
+        uint32_t file;
+        // The byte range of the file to read.
+        uint64_t offset;
+        uint64_t length;
+        // The device and physical byte address of offset.  For files whose
+        // layout is unknown, physical is kUnknownPhysical.
+        dev_t device;
+        uint64_t physical;
+    };
+
+    static constexpr uint64_t kUnknownPhysical = static_cast<uint64_t>(-1);
+
+    // Returns reads covering each of paths, sorted by device and physical
+    // address, with physically adjacent extents of a file merged.  Layouts
+    // are queried with FIEMAP, falling back to FIBMAP for the first block.
+    // Files whose layout is unavailable are read whole, after the others.
+    static std::vector<Read> Plan(const std::vector<std::string>& paths);
+
+    // Issues readahead for each of reads, in order, admitting each through
+    // throttle if one is given.  It returns the order in which files were
+    // first read, which is a good order to lock them in.
+    static std::vector<uint32_t> Populate(
+        const std::vector<std::string>& paths,
+        const std::vector<Read>& reads,
+        IoThrottle* throttle = nullptr);
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__POPULATION_SCHEDULER_H__
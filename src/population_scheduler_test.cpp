@@ -0,0 +1,90 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "population_scheduler.h"
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+typedef PopulationScheduler::Read Read;
+
+TEST(PopulationScheduler, PlanCoversFiles) {
+    std::vector<std::string> paths;
+    std::vector<size_t> sizes;
+    for (int i = 0; i < 4; i++) {
+        char name[] = "/tmp/population_scheduler.XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+
+        const std::string contents((i + 1) * 10000, 'a' + i);
+        ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+            write(fd, contents.data(), contents.size()));
+        fsync(fd);
+        close(fd);
+
+        paths.push_back(name);
+        sizes.push_back(contents.size());
+    }
+    // Missing files are skipped by the plan, but still returned in the lock
+    // order.
+    paths.push_back("/nonexistent/file");
+
+    const std::vector<Read> reads = PopulationScheduler::Plan(paths);
+
+    std::vector<uint64_t> covered(paths.size());
+    for (const auto& read : reads) {
+        ASSERT_LT(read.file, paths.size());
+        covered[read.file] += read.length;
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+        EXPECT_EQ(sizes[i], covered[i]) << paths[i];
+    }
+    EXPECT_EQ(0, covered.back());
+
+    // Reads are ordered by physical location, unknown locations last.
+    EXPECT_TRUE(std::is_sorted(reads.begin(), reads.end(),
+        [](const Read& a, const Read& b) {
+            if (a.device != b.device) {
+                return a.device < b.device;
+            }
+            return a.physical < b.physical;
+        }));
+
+    std::vector<uint32_t> order = PopulationScheduler::Populate(paths, reads);
+    ASSERT_EQ(paths.size(), order.size());
+    EXPECT_EQ(paths.size() - 1, order.back());
+    std::sort(order.begin(), order.end());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        EXPECT_EQ(i, order[i]);
+    }
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+        ::unlink(paths[i].c_str());
+    }
+}
+
+}  // namespace
+}  // namespace file_binder
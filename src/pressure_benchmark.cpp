@@ -0,0 +1,530 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the latency of running commands while memory is scarce, with and
+// without binder holding their files.  Usage:
+//
+//   pressure_benchmark [--binder=<path>] [--memory-max=<bytes>]
+//       [--hog=<bytes>] [--io-max=<major>:<minor>=<bytes/s>]
+//       [--lock-set=<path>] [--iterations=<n>] [--interval-ms=<n>]
+//
+// With a writable cgroup v2 hierarchy offering the memory controller, binder,
+// the commands and a memory hog (by default, 90% of --memory-max) run in a
+// cgroup of their own, so the commands' pages are reclaimed by the kernel and
+// binder's locked pages count against the same limit.
+// --io-max throttles reads from a device; for a reproducible slow disk, put
+// the commands on a loop device:
+//
+//   truncate -s 4G /tmp/disk.img
+//   mkfs.ext4 -q /tmp/disk.img
+//   mount -o loop /tmp/disk.img /mnt/slow     # e.g. loop0, 7:0
+//   cp -a /usr /mnt/slow/
+//   pressure_benchmark --io-max=7:0=4194304 --lock-set=/mnt/slow/usr/lib
+//
+// Otherwise, reclaim is simulated by evicting the commands' files from the
+// page cache before each run; locked pages are not evicted.
+//
+// Each command is run with binder off, with binder locking the commands
+// (pinned, pinned with --runtime-modules, and warm), and pinned with each
+// --lock-set added, to show the cost of larger lock sets.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "elf_parser.h"
+#include "library_resolver.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char kCgroupName[] = "file-binder-benchmark";
+
+struct Command {
+    std::string name;
+    std::vector<std::string> argv;
+};
+
+struct Config {
+    std::string name;
+    // Empty when binder is not running.
+    std::vector<std::string> binder_args;
+};
+
+bool WriteFile(const std::string& path, const std::string& contents) {
+    int fd;
+    do {
+        fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return false;
+    }
+
+    ssize_t ret;
+    do {
+        ret = write(fd, contents.data(), contents.size());
+    } while (ret < 0 && errno == EINTR);
+    close(fd);
+    return ret == static_cast<ssize_t>(contents.size());
+}
+
+// Returns the mount point of the cgroup v2 hierarchy, or an empty string.
+std::string FindCgroup2() {
+    std::ifstream in("/proc/self/mountinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        // ... <mount point> <options> [optional fields] - <fstype> ...
+        const size_t dash = line.find(" - ");
+        if (dash == std::string::npos ||
+                line.compare(dash + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string id, parent, device, root, mount_point;
+        fields >> id >> parent >> device >> root >> mount_point;
+        return mount_point;
+    }
+    return std::string();
+}
+
+// Creates our cgroup with the given limits.  It returns the cgroup's path,
+// or an empty string if the memory controller is unavailable to us.
+std::string CreateCgroup(uint64_t memory_max, const std::string& io_max) {
+    const std::string root = FindCgroup2();
+    if (root.empty()) {
+        return std::string();
+    }
+
+    WriteFile(root + "/cgroup.subtree_control", "+memory +io");
+    const std::string cgroup = root + "/" + kCgroupName;
+    if (mkdir(cgroup.c_str(), 0755) < 0 && errno != EEXIST) {
+        return std::string();
+    }
+    if (!WriteFile(cgroup + "/memory.max", std::to_string(memory_max))) {
+        rmdir(cgroup.c_str());
+        return std::string();
+    }
+    // Without swap, the hog's memory cannot be reclaimed, leaving only the
+    // page cache to give.
+    WriteFile(cgroup + "/memory.swap.max", "0");
+
+    if (!io_max.empty()) {
+        // "<major>:<minor>=<bytes>" becomes "<major>:<minor> rbps=<bytes>".
+        const size_t equals = io_max.find('=');
+        if (equals == std::string::npos ||
+                !WriteFile(cgroup + "/io.max", io_max.substr(0, equals) +
+                    " rbps=" + io_max.substr(equals + 1))) {
+            fprintf(stderr, "Unable to set io.max to %s\n", io_max.c_str());
+        }
+    }
+    return cgroup;
+}
+
+void JoinCgroup(const std::string& cgroup) {
+    if (!cgroup.empty()) {
+        WriteFile(cgroup + "/cgroup.procs", "0");
+    }
+}
+
+// Returns the absolute path of name, searching PATH if needed.
+std::string Which(const std::string& name) {
+    if (name.find('/') != std::string::npos) {
+        return name;
+    }
+
+    const char* path = getenv("PATH");
+    std::istringstream dirs(path != nullptr ? path : "/usr/bin:/bin");
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+        const std::string candidate = dir + "/" + name;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+    }
+    return std::string();
+}
+
+// Adds path and, transitively, the libraries it depends on to files.
+void AddWithDependencies(
+        const std::string& path, file_binder::LibraryResolver* resolver,
+        std::unordered_set<std::string>* files) {
+    if (path.empty() || !files->insert(path).second) {
+        return;
+    }
+
+    int fd;
+    do {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return;
+    }
+
+    std::vector<std::string> deps;
+    bool x64 = true;
+    try {
+        file_binder::ElfParser elf(fd);
+        std::string interpreter;
+        if (elf.GetInterpreter(&interpreter)) {
+            deps.push_back(interpreter);
+        }
+        x64 = elf.Is64Bit();
+        for (const auto& dep : elf.GetLibraryDependencies()) {
+            std::string resolved;
+            if (resolver->Resolve(dep, x64, &resolved)) {
+                deps.push_back(resolved);
+            }
+        }
+    } catch (file_binder::ElfError& ex) {
+        // Not an ELF file.
+    }
+    close(fd);
+
+    for (const auto& dep : deps) {
+        AddWithDependencies(dep, resolver, files);
+    }
+}
+
+void Evict(const std::vector<std::string>& files) {
+    for (const auto& file : files) {
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+// Starts a process which keeps hog bytes of anonymous memory in use.
+pid_t StartHog(const std::string& cgroup, uint64_t hog) {
+    const pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    JoinCgroup(cgroup);
+    char* memory = static_cast<char*>(mmap(nullptr, hog,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (memory == MAP_FAILED) {
+        _exit(1);
+    }
+    while (true) {
+        for (uint64_t i = 0; i < hog; i += 4096) {
+            memory[i]++;
+        }
+    }
+}
+
+// Starts binder with args in cgroup, returning once it has locked its initial
+// set.  Its locked pages are charged to the cgroup, as they would be if it
+// shared one with the commands.  binder's output remains readable from
+// *report, to be closed by Stop.
+pid_t StartBinder(
+        const std::string& binder, const std::string& cgroup,
+        std::vector<std::string> args, FILE** report) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return -1;
+    }
+
+    args.insert(args.begin(), binder);
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        JoinCgroup(cgroup);
+        dup2(fds[1], STDERR_FILENO);
+        execv(binder.c_str(), argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+
+    // binder reports once its pinned groups are locked.  It writes little
+    // after that, so leaving the rest of its output unread never blocks it.
+    *report = fdopen(fds[0], "r");
+    char line[4096];
+    while (fgets(line, sizeof(line), *report) != nullptr) {
+        if (strncmp(line, "Total:", 6) == 0) {
+            fprintf(stderr, "  binder: %s", line);
+            break;
+        }
+    }
+    return pid;
+}
+
+void Stop(pid_t pid, FILE* report = nullptr) {
+    if (report != nullptr) {
+        fclose(report);
+    }
+    if (pid <= 0) {
+        return;
+    }
+    kill(pid, SIGTERM);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+}
+
+// Runs command to completion, returning its latency.
+double Run(const Command& command, const std::string& cgroup) {
+    std::vector<std::string> args = command.argv;
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    const auto start = Clock::now();
+    const pid_t pid = fork();
+    if (pid == 0) {
+        JoinCgroup(cgroup);
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
+
+double Percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const size_t index = std::min(samples.size() - 1,
+        static_cast<size_t>(p * samples.size()));
+    return samples[index];
+}
+
+bool ParseSize(const char* s, uint64_t* value) {
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) {
+        return false;
+    }
+
+    static const char kSuffixes[] = "KMG";
+    const char* suffix = *end != '\0' ? strchr(kSuffixes, *end) : nullptr;
+    if (suffix != nullptr) {
+        v <<= 10 * (suffix - kSuffixes + 1);
+        end++;
+    }
+    *value = v;
+    return *end == '\0';
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    // Measures a library load, in a child run as a command.
+    static const char kDlopen[] = "--dlopen=";
+    if (argc == 2 && strncmp(argv[1], kDlopen, sizeof(kDlopen) - 1) == 0) {
+        return dlopen(argv[1] + sizeof(kDlopen) - 1, RTLD_NOW) != nullptr ?
+            0 : 1;
+    }
+
+    static const char kBinder[] = "--binder=";
+    static const char kMemoryMax[] = "--memory-max=";
+    static const char kHog[] = "--hog=";
+    static const char kIoMax[] = "--io-max=";
+    static const char kLockSet[] = "--lock-set=";
+    static const char kIterations[] = "--iterations=";
+    static const char kIntervalMs[] = "--interval-ms=";
+
+    char self[PATH_MAX];
+    const ssize_t self_length = readlink("/proc/self/exe", self, sizeof(self));
+    if (self_length < 0 || self_length == sizeof(self)) {
+        perror("readlink");
+        return 1;
+    }
+    const std::string self_path(self, self_length);
+
+    // By default, use the binder built alongside us.
+    std::string binder =
+        self_path.substr(0, self_path.rfind('/') + 1) + "binder";
+    uint64_t memory_max = 256 << 20;
+    uint64_t hog = 0;
+    std::string io_max;
+    std::vector<std::string> lock_sets;
+    int iterations = 50;
+    int interval_ms = 20;
+    for (int i = 1; i < argc; i++) {
+        bool valid = true;
+        if (strncmp(argv[i], kBinder, sizeof(kBinder) - 1) == 0) {
+            binder = argv[i] + sizeof(kBinder) - 1;
+        } else if (strncmp(argv[i], kMemoryMax, sizeof(kMemoryMax) - 1) == 0) {
+            valid = ParseSize(argv[i] + sizeof(kMemoryMax) - 1, &memory_max);
+        } else if (strncmp(argv[i], kHog, sizeof(kHog) - 1) == 0) {
+            valid = ParseSize(argv[i] + sizeof(kHog) - 1, &hog);
+        } else if (strncmp(argv[i], kIoMax, sizeof(kIoMax) - 1) == 0) {
+            io_max = argv[i] + sizeof(kIoMax) - 1;
+        } else if (strncmp(argv[i], kLockSet, sizeof(kLockSet) - 1) == 0) {
+            lock_sets.emplace_back(argv[i] + sizeof(kLockSet) - 1);
+        } else if (strncmp(argv[i], kIterations,
+                sizeof(kIterations) - 1) == 0) {
+            iterations = atoi(argv[i] + sizeof(kIterations) - 1);
+        } else if (strncmp(argv[i], kIntervalMs,
+                sizeof(kIntervalMs) - 1) == 0) {
+            interval_ms = atoi(argv[i] + sizeof(kIntervalMs) - 1);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Unknown or malformed argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (hog == 0) {
+        hog = memory_max / 10 * 9;
+    }
+
+    // Commands standing in for an operator's shell, a login and a library
+    // load.
+    const std::string sh = Which("sh");
+    std::vector<Command> commands = {
+        {"exec", {Which("true")}},
+        {"shell", {sh, "-c", "ls / > /dev/null"}},
+        {"login", {sh, "-l", "-c", "id > /dev/null"}},
+        {"getent", {Which("getent"), "passwd", "root"}},
+        {"dlopen", {self_path, std::string(kDlopen) + "libresolv.so.2"}},
+    };
+    commands.erase(std::remove_if(commands.begin(), commands.end(),
+        [](const Command& command) { return command.argv[0].empty(); }),
+        commands.end());
+
+    file_binder::LibraryResolver resolver;
+    std::unordered_set<std::string> file_set;
+    std::vector<std::string> binaries;
+    for (const auto& command : commands) {
+        // We are not what the dlopen command measures, so we are neither
+        // locked nor evicted.
+        if (command.name != "dlopen") {
+            binaries.push_back(command.argv[0]);
+            AddWithDependencies(command.argv[0], &resolver, &file_set);
+        }
+    }
+    for (const char* name : {"ls", "id"}) {
+        const std::string path = Which(name);
+        if (!path.empty()) {
+            binaries.push_back(path);
+            AddWithDependencies(path, &resolver, &file_set);
+        }
+    }
+    std::string resolved;
+    if (resolver.Resolve("libresolv.so.2", sizeof(void*) == 8, &resolved)) {
+        binaries.push_back(resolved);
+        AddWithDependencies(resolved, &resolver, &file_set);
+    }
+    const std::vector<std::string> files(file_set.begin(), file_set.end());
+
+    std::vector<Config> configs = {
+        {"off", {}},
+        {"pinned", binaries},
+        {"pinned+modules", binaries},
+        {"warm", {}},
+    };
+    configs[2].binder_args.push_back("--runtime-modules");
+    for (const auto& binary : binaries) {
+        configs[3].binder_args.push_back("--warm=" + binary);
+    }
+    for (const auto& lock_set : lock_sets) {
+        Config config;
+        config.name = "pinned+" + lock_set;
+        config.binder_args = binaries;
+        config.binder_args.push_back(lock_set);
+        configs.push_back(std::move(config));
+    }
+
+    const std::string cgroup = CreateCgroup(memory_max, io_max);
+    if (cgroup.empty()) {
+        fprintf(stderr, "The cgroup v2 memory controller is unavailable; "
+            "simulating reclaim by evicting %zu files before each run.\n",
+            files.size());
+    } else {
+        fprintf(stderr, "Running in %s with memory.max=%llu, hog=%llu.\n",
+            cgroup.c_str(), static_cast<unsigned long long>(memory_max),
+            static_cast<unsigned long long>(hog));
+    }
+
+    printf("%-24s %-8s %10s %10s %10s\n", "config", "command", "p50 (ms)",
+        "p99 (ms)", "max (ms)");
+    fflush(stdout);
+    for (const auto& config : configs) {
+        fprintf(stderr, "%s\n", config.name.c_str());
+
+        // Start from a cold cache, so binder does its own reads.
+        Evict(files);
+        FILE* report = nullptr;
+        const pid_t binder_pid = config.binder_args.empty() ? -1 :
+            StartBinder(binder, cgroup, config.binder_args, &report);
+        const pid_t hog_pid = cgroup.empty() ? -1 : StartHog(cgroup, hog);
+
+        for (const auto& command : commands) {
+            std::vector<double> samples;
+            for (int i = 0; i < iterations; i++) {
+                if (cgroup.empty()) {
+                    Evict(files);
+                }
+                usleep(interval_ms * 1000);
+                samples.push_back(Run(command, cgroup));
+            }
+
+            printf("%-24s %-8s %10.3f %10.3f %10.3f\n", config.name.c_str(),
+                command.name.c_str(), Percentile(samples, 0.5),
+                Percentile(samples, 0.99), Percentile(samples, 1.0));
+            fflush(stdout);
+        }
+
+        Stop(hog_pid);
+        Stop(binder_pid, report);
+    }
+
+    if (!cgroup.empty()) {
+        rmdir(cgroup.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pressure_monitor.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace file_binder {
+
+std::vector<PressureMonitor::Trigger> PressureMonitor::DefaultTriggers() {
+    // Unprivileged users may only register windows which are a multiple of
+    // 2s, so we use that throughout.
+    return {
+        {"memory", "some", 150000, 2000000, Level::kPrefetch},
+        {"io",     "some", 150000, 2000000, Level::kPrefetch},
+        {"memory", "full", 100000, 2000000, Level::kLock},
+        {"io",     "full", 100000, 2000000, Level::kLock},
+    };
+}
+
+PressureMonitor::PressureMonitor(
+        std::vector<Trigger> triggers, Clock::duration hold) :
+    triggers_(std::move(triggers)), hold_(hold), level_(Level::kNone) {}
+
+PressureMonitor::~PressureMonitor() {
+    for (int fd : fds_) {
+        ::close(fd);
+    }
+}
+
+bool PressureMonitor::Start() {
+    std::vector<int> fds;
+    bool ok = true;
+    for (const auto& trigger : triggers_) {
+        const std::string path = "/proc/pressure/" + trigger.resource;
+
+        int fd;
+        do {
+            fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+
+        if (fd < 0) {
+            ok = false;
+            break;
+        }
+        fds.push_back(fd);
+
+        // The trigger is registered by writing it, including its terminating
+        // null, to the pressure file.  It remains active until fd is closed.
+        const std::string spec = trigger.kind + " " +
+            std::to_string(trigger.stall_us) + " " +
+            std::to_string(trigger.window_us);
+        ssize_t ret;
+        do {
+            ret = ::write(fd, spec.c_str(), spec.size() + 1);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok) {
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        return false;
+    }
+
+    fds_.swap(fds);
+    return true;
+}
+
+void PressureMonitor::Notify(size_t index, Clock::time_point now) {
+    if (index >= triggers_.size()) {
+        return;
+    }
+
+    Raise(triggers_[index].level, now);
+}
+
+void PressureMonitor::Raise(Level level, Clock::time_point now) {
+    if (level >= level_) {
+        level_ = level;
+        last_fired_ = now;
+    }
+}
+
+PressureMonitor::Level PressureMonitor::Tick(Clock::time_point now) {
+    // Step down a single level at a time, so warm groups are demoted from
+    // locked to prefetched before they are released entirely.
+    if (level_ != Level::kNone && now - last_fired_ >= hold_) {
+        level_ = static_cast<Level>(static_cast<int>(level_) - 1);
+        last_fired_ = now;
+    }
+
+    return level_;
+}
+
+PressureMonitor::Clock::duration PressureMonitor::TimeToNextTick(
+        Clock::time_point now) const {
+    if (level_ == Level::kNone) {
+        return Clock::duration::zero();
+    }
+
+    const Clock::duration elapsed = now - last_fired_;
+    if (elapsed >= hold_) {
+        return Clock::duration::zero();
+    }
+    return hold_ - elapsed;
+}
+
+}  // namespace file_binder
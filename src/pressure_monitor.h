@@ -0,0 +1,109 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__PRESSURE_MONITOR_H__
+#define __FILE_BINDER__PRESSURE_MONITOR_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// PressureMonitor watches the kernel's pressure stall information (PSI) for
+// memory and I/O.  Rather than polling /proc/pressure, it registers PSI
+// triggers and relies on the kernel to wake us (POLLPRI) once a stall
+// threshold is exceeded.
+class PressureMonitor {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Escalating levels of protection.  Levels are ordered, so callers may
+    // compare them.
+    enum class Level {
+        kNone = 0,
+        // Readahead the contents of warm groups.
+        kPrefetch = 1,
+        // Lock warm groups into memory.
+        kLock = 2,
+    };
+
+    struct Trigger {
+        // Resource name under /proc/pressure, e.g. "memory" or "io".
+        std::string resource;
+        // "some" or "full", see Documentation/accounting/psi.rst.
+        std::string kind;
+        // Stall threshold within each window.
+        uint64_t stall_us;
+        uint64_t window_us;
+        // The level to escalate to when this trigger fires.
+        Level level;
+    };
+
+    // Returns the default set of triggers:  Prefetching is started on partial
+    // stalls, locking on complete stalls, for both memory and I/O.
+    static std::vector<Trigger> DefaultTriggers();
+
+    // hold is the period which a level is retained for after its last trigger
+    // fired before we step down to the next lower level.
+    PressureMonitor(std::vector<Trigger> triggers, Clock::duration hold);
+    virtual ~PressureMonitor();
+
+    // Registers our triggers with the kernel.  It returns false if PSI is
+    // unavailable (older kernels or CONFIG_PSI=n), in which case no file
+    // descriptors are returned by fds().
+    bool Start();
+
+    // File descriptors to poll for POLLPRI.  The index of each descriptor
+    // matches the index of the trigger that it was registered for.
+    const std::vector<int>& fds() const { return fds_; }
+
+    // Notifies the monitor that trigger index fired at now.
+    void Notify(size_t index, Clock::time_point now);
+
+    // Raises the level to at least level, as if a trigger for it fired at
+    // now.
+    void Raise(Level level, Clock::time_point now);
+
+    // Steps the level down if no trigger has fired recently.  It returns the
+    // current level.
+    Level Tick(Clock::time_point now);
+
+    Level level() const { return level_; }
+
+    // Returns the time remaining until the current level may step down, or
+    // zero when we are at Level::kNone.
+    Clock::duration TimeToNextTick(Clock::time_point now) const;
+private:
+    PressureMonitor(const PressureMonitor&) = delete;
+    PressureMonitor& operator=(const PressureMonitor&) = delete;
+
+    std::vector<Trigger> triggers_;
+    const Clock::duration hold_;
+
+    std::vector<int> fds_;
+
+    Level level_;
+    // Time at which level_ was last raised or reaffirmed by a trigger.
+    Clock::time_point last_fired_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__PRESSURE_MONITOR_H__
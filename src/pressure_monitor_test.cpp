@@ -0,0 +1,91 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pressure_monitor.h"
+
+#include <gtest/gtest.h>
+
+namespace file_binder {
+namespace {
+
+typedef PressureMonitor::Clock Clock;
+typedef PressureMonitor::Level Level;
+
+TEST(PressureMonitor, EscalatesAndStepsDown) {
+    const std::chrono::seconds hold(10);
+    PressureMonitor monitor(PressureMonitor::DefaultTriggers(), hold);
+    ASSERT_EQ(4, PressureMonitor::DefaultTriggers().size());
+
+    const Clock::time_point t0 = Clock::now();
+    EXPECT_EQ(Level::kNone, monitor.Tick(t0));
+    EXPECT_EQ(Clock::duration::zero(), monitor.TimeToNextTick(t0));
+
+    // A partial memory stall starts prefetching.
+    monitor.Notify(0, t0);
+    EXPECT_EQ(Level::kPrefetch, monitor.Tick(t0));
+
+    // A complete I/O stall escalates to locking.
+    monitor.Notify(3, t0 + std::chrono::seconds(1));
+    EXPECT_EQ(Level::kLock, monitor.Tick(t0 + std::chrono::seconds(2)));
+    EXPECT_EQ(std::chrono::seconds(9),
+        monitor.TimeToNextTick(t0 + std::chrono::seconds(2)));
+
+    // Partial stalls do not extend how long we hold the lock level.
+    monitor.Notify(1, t0 + std::chrono::seconds(5));
+    EXPECT_EQ(Level::kLock, monitor.Tick(t0 + std::chrono::seconds(10)));
+
+    // Once pressure subsides, we step down one level per hold period.
+    const Clock::time_point t1 = t0 + std::chrono::seconds(11);
+    EXPECT_EQ(Level::kPrefetch, monitor.Tick(t1));
+    EXPECT_EQ(Level::kPrefetch, monitor.Tick(t1 + std::chrono::seconds(5)));
+    EXPECT_EQ(Level::kNone, monitor.Tick(t1 + hold));
+}
+
+TEST(PressureMonitor, Raise) {
+    const std::chrono::seconds hold(10);
+    PressureMonitor monitor(PressureMonitor::DefaultTriggers(), hold);
+
+    const Clock::time_point t0 = Clock::now();
+    monitor.Raise(Level::kLock, t0);
+    EXPECT_EQ(Level::kLock, monitor.Tick(t0 + std::chrono::seconds(9)));
+    // Lower levels do not extend the hold.
+    monitor.Raise(Level::kPrefetch, t0 + std::chrono::seconds(9));
+    EXPECT_EQ(Level::kPrefetch, monitor.Tick(t0 + hold));
+}
+
+TEST(PressureMonitor, IgnoresUnknownTriggers) {
+    PressureMonitor monitor(
+        PressureMonitor::DefaultTriggers(), std::chrono::seconds(1));
+    monitor.Notify(100, Clock::now());
+    EXPECT_EQ(Level::kNone, monitor.level());
+}
+
+TEST(PressureMonitor, Start) {
+    PressureMonitor monitor(
+        PressureMonitor::DefaultTriggers(), std::chrono::seconds(1));
+    if (!monitor.Start()) {
+        // PSI is not available on this kernel.
+        EXPECT_TRUE(monitor.fds().empty());
+        return;
+    }
+
+    EXPECT_EQ(4, monitor.fds().size());
+}
+
+}  // namespace
+}  // namespace file_binder
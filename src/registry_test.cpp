@@ -0,0 +1,133 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+#include "lock_table.h"
+#include "path_table.h"
+
+#include <cstdint>
+
+#include <gtest/gtest.h>
+#include <string>
+
+namespace file_binder {
+namespace {
+
+TEST(Arena, Allocate) {
+    Arena arena(64);
+
+    const char* a = arena.Copy("hello", 5);
+    EXPECT_EQ("hello", std::string(a, 5));
+    EXPECT_EQ(64, arena.MemoryUsage());
+
+    void* aligned = arena.Allocate(8, 8);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(aligned) % 8);
+
+    // Oversized allocations receive their own chunk.
+    arena.Allocate(1000);
+    EXPECT_LE(64 + 1000, arena.MemoryUsage());
+}
+
+TEST(PathTable, Intern) {
+    PathTable table;
+
+    const PathId libc = table.Intern("/usr/lib/libc.so.6");
+    const PathId libm = table.Intern("/usr/lib/libm.so.6");
+    EXPECT_NE(libc, libm);
+    EXPECT_EQ(libc, table.Intern("/usr/lib/libc.so.6"));
+    EXPECT_EQ(libc, table.Intern("//usr//lib/libc.so.6/"));
+    EXPECT_EQ(libc, table.Find("/usr/lib/libc.so.6"));
+    EXPECT_EQ(PathTable::kInvalid, table.Find("/usr/lib/libz.so.1"));
+
+    EXPECT_EQ("/usr/lib/libc.so.6", table.Get(libc));
+    EXPECT_EQ("/usr/lib/libm.so.6", table.Get(libm));
+
+    // The parent directory is shared.
+    EXPECT_EQ(table.Parent(libc), table.Parent(libm));
+    EXPECT_EQ("/usr/lib", table.Get(table.Parent(libc)));
+    EXPECT_EQ("/", table.Get(table.Find("/")));
+
+    // Relative paths are distinct from absolute ones.
+    const PathId relative = table.Intern("usr/lib/libc.so.6");
+    EXPECT_NE(libc, relative);
+    EXPECT_EQ("usr/lib/libc.so.6", table.Get(relative));
+}
+
+TEST(PathTable, Grow) {
+    PathTable table;
+
+    std::vector<PathId> ids;
+    for (int i = 0; i < 10000; i++) {
+        ids.push_back(table.Intern("/dir" + std::to_string(i % 10) +
+            "/file" + std::to_string(i)));
+    }
+
+    for (int i = 0; i < 10000; i++) {
+        const std::string path = "/dir" + std::to_string(i % 10) + "/file" +
+            std::to_string(i);
+        EXPECT_EQ(ids[i], table.Find(path));
+        EXPECT_EQ(path, table.Get(ids[i]));
+    }
+}
+
+TEST(LockTable, InsertFindErase) {
+    LockTable table;
+    EXPECT_EQ(nullptr, table.Find(1));
+
+    for (PathId i = 0; i < 1000; i++) {
+        LockRecord record;
+        record.path = i;
+        record.mapping.size = i * 10;
+        EXPECT_TRUE(table.Insert(record));
+    }
+    EXPECT_EQ(1000, table.size());
+
+    LockRecord duplicate;
+    duplicate.path = 5;
+    EXPECT_FALSE(table.Insert(duplicate));
+
+    for (PathId i = 0; i < 1000; i += 2) {
+        LockRecord record;
+        EXPECT_TRUE(table.Erase(i, &record));
+        EXPECT_EQ(i * 10, record.mapping.size);
+    }
+    EXPECT_FALSE(table.Erase(0, nullptr));
+    EXPECT_EQ(500, table.size());
+
+    for (PathId i = 0; i < 1000; i++) {
+        const LockRecord* record = table.Find(i);
+        if (i % 2 == 0) {
+            EXPECT_EQ(nullptr, record);
+        } else {
+            ASSERT_NE(nullptr, record);
+            EXPECT_EQ(i * 10, record->mapping.size);
+        }
+    }
+
+    size_t count = 0;
+    table.ForEach([&count](const LockRecord&) { count++; });
+    EXPECT_EQ(500, count);
+
+    LockTable moved(std::move(table));
+    EXPECT_EQ(0, table.size());
+    EXPECT_EQ(500, moved.size());
+    EXPECT_NE(nullptr, moved.Find(1));
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,208 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resource_counters.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace file_binder {
+namespace {
+
+// The perf_event software counters we read, in the order they are opened.
+const uint64_t kEvents[] = {
+    PERF_COUNT_SW_PAGE_FAULTS_MAJ,
+    PERF_COUNT_SW_PAGE_FAULTS_MIN,
+    PERF_COUNT_SW_CONTEXT_SWITCHES,
+    PERF_COUNT_SW_TASK_CLOCK,
+};
+const size_t kNumEvents = sizeof(kEvents) / sizeof(kEvents[0]);
+
+uint64_t Saturate(uint64_t a, uint64_t b) {
+    return a > b ? a - b : 0;
+}
+
+// The counters of one thread, opened the first time it samples them.
+class ThreadCounters {
+public:
+    ThreadCounters() : io_fd_(-1) {
+        for (size_t i = 0; i < kNumEvents; i++) {
+            fds_[i] = -1;
+        }
+        if (!OpenEvents()) {
+            CloseEvents();
+        }
+
+        do {
+            io_fd_ = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+        } while (io_fd_ < 0 && errno == EINTR);
+    }
+
+    ~ThreadCounters() {
+        CloseEvents();
+        if (io_fd_ >= 0) {
+            close(io_fd_);
+        }
+    }
+
+    bool perf_event() const { return fds_[0] >= 0; }
+    bool io_accounting() const { return io_fd_ >= 0; }
+
+    ResourceUsage Sample() const {
+        ResourceUsage usage;
+        if (!perf_event() || !ReadEvents(&usage)) {
+            struct rusage ru;
+            if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+                usage.major_faults = ru.ru_majflt;
+                usage.minor_faults = ru.ru_minflt;
+                usage.context_switches = ru.ru_nvcsw + ru.ru_nivcsw;
+                usage.cpu_ns =
+                    (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+                    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+            }
+        }
+        usage.read_bytes = ReadBytes();
+        return usage;
+    }
+
+    uint64_t ReadBytes() const {
+        if (io_fd_ < 0) {
+            return 0;
+        }
+
+        char buf[512];
+        ssize_t ret;
+        do {
+            ret = pread(io_fd_, buf, sizeof(buf) - 1, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret <= 0) {
+            return 0;
+        }
+        buf[ret] = '\0';
+
+        static const char kReadBytes[] = "\nread_bytes: ";
+        const char* line = strstr(buf, kReadBytes);
+        return line == nullptr ? 0 :
+            strtoull(line + sizeof(kReadBytes) - 1, nullptr, 10);
+    }
+private:
+    bool OpenEvents() {
+        for (size_t i = 0; i < kNumEvents; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = kEvents[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_hv = 1;
+            // Only this thread, on any CPU.
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr,
+                0, -1, i == 0 ? -1 : fds_[0], PERF_FLAG_FD_CLOEXEC));
+            if (fds_[i] < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CloseEvents() {
+        for (size_t i = 0; i < kNumEvents; i++) {
+            if (fds_[i] >= 0) {
+                close(fds_[i]);
+                fds_[i] = -1;
+            }
+        }
+    }
+
+    // Reads the whole group at once.
+    bool ReadEvents(ResourceUsage* usage) const {
+        uint64_t values[1 + kNumEvents];
+        ssize_t ret;
+        do {
+            ret = read(fds_[0], values, sizeof(values));
+        } while (ret < 0 && errno == EINTR);
+        if (ret != static_cast<ssize_t>(sizeof(values)) ||
+                values[0] != kNumEvents) {
+            return false;
+        }
+
+        usage->major_faults = values[1];
+        usage->minor_faults = values[2];
+        usage->context_switches = values[3];
+        usage->cpu_ns = values[4];
+        return true;
+    }
+
+    int fds_[kNumEvents];
+    int io_fd_;
+};
+
+const ThreadCounters& Counters() {
+    static thread_local ThreadCounters counters;
+    return counters;
+}
+
+}  // namespace
+
+std::atomic<bool> ResourceCounters::enabled_{false};
+
+ResourceUsage& ResourceUsage::operator+=(const ResourceUsage& other) {
+    major_faults += other.major_faults;
+    minor_faults += other.minor_faults;
+    context_switches += other.context_switches;
+    cpu_ns += other.cpu_ns;
+    read_bytes += other.read_bytes;
+    return *this;
+}
+
+ResourceUsage ResourceUsage::operator-(const ResourceUsage& other) const {
+    ResourceUsage usage;
+    usage.major_faults = Saturate(major_faults, other.major_faults);
+    usage.minor_faults = Saturate(minor_faults, other.minor_faults);
+    usage.context_switches =
+        Saturate(context_switches, other.context_switches);
+    usage.cpu_ns = Saturate(cpu_ns, other.cpu_ns);
+    usage.read_bytes = Saturate(read_bytes, other.read_bytes);
+    return usage;
+}
+
+void ResourceCounters::Enable() {
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+ResourceUsage ResourceCounters::Sample() {
+    return Counters().Sample();
+}
+
+bool ResourceCounters::ReadBytes(uint64_t* bytes) {
+    const ThreadCounters& counters = Counters();
+    *bytes = counters.ReadBytes();
+    return counters.io_accounting();
+}
+
+const char* ResourceCounters::Source() {
+    return Counters().perf_event() ? "perf_event" : "getrusage";
+}
+
+}  // namespace file_binder
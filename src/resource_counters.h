@@ -0,0 +1,102 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__RESOURCE_COUNTERS_H__
+#define __FILE_BINDER__RESOURCE_COUNTERS_H__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+namespace file_binder {
+
+// The resources a thread consumed, e.g. while working on one stage of a
+// scan for one file.
+struct ResourceUsage {
+    uint64_t major_faults = 0;
+    uint64_t minor_faults = 0;
+    uint64_t context_switches = 0;
+    uint64_t cpu_ns = 0;
+    // Bytes the thread caused to be read from storage, from
+    // /proc/thread-self/io.
+    uint64_t read_bytes = 0;
+
+    ResourceUsage& operator+=(const ResourceUsage& other);
+    // Saturates at 0, as counters from different sources may disagree.
+    ResourceUsage operator-(const ResourceUsage& other) const;
+};
+
+// ResourceCounters samples the resource usage of the calling thread from
+// perf_event software counters (major and minor faults, context switches
+// and task clock), falling back to getrusage(RUSAGE_THREAD) where
+// perf_event_open is not permitted.  Counters are opened per thread, the
+// first time it samples them.  While counting is disabled, a UsageSpan
+// costs a single relaxed load and branch.
+class ResourceCounters {
+public:
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void Enable();
+
+    // Returns the usage of the calling thread so far.
+    static ResourceUsage Sample();
+
+    // Sets *bytes to the bytes the calling thread has caused to be read
+    // from storage, returning false if I/O accounting is unavailable.  It
+    // does not depend on counting being enabled.
+    static bool ReadBytes(uint64_t* bytes);
+
+    // Returns "perf_event" if the calling thread's counters come from
+    // perf_event_open, or "getrusage".
+    static const char* Source();
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// UsageSpan adds the calling thread's usage over its lifetime to *total, if
+// counting is enabled.
+class UsageSpan {
+public:
+    explicit UsageSpan(ResourceUsage* total) : total_(nullptr) {
+        if (ResourceCounters::enabled()) {
+            total_ = total;
+            begin_ = ResourceCounters::Sample();
+        }
+    }
+
+    // errno is preserved, so spans may cover failing calls.
+    ~UsageSpan() {
+        if (total_ != nullptr) {
+            const int error = errno;
+            *total_ += ResourceCounters::Sample() - begin_;
+            errno = error;
+        }
+    }
+private:
+    UsageSpan(const UsageSpan&) = delete;
+    UsageSpan& operator=(const UsageSpan&) = delete;
+
+    ResourceUsage* total_;
+    ResourceUsage begin_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__RESOURCE_COUNTERS_H__
@@ -0,0 +1,96 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resource_counters.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+namespace file_binder {
+namespace {
+
+// Faults in pages of fresh anonymous memory.
+void Touch(size_t pages) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* addr = mmap(nullptr, pages * page, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, addr);
+    for (size_t i = 0; i < pages; i++) {
+        static_cast<char*>(addr)[i * page] = 1;
+    }
+    munmap(addr, pages * page);
+}
+
+TEST(ResourceCounters, Arithmetic) {
+    ResourceUsage a;
+    a.major_faults = 2;
+    a.read_bytes = 4096;
+    ResourceUsage b;
+    b.major_faults = 3;
+    b.cpu_ns = 10;
+
+    const ResourceUsage difference = a - b;
+    EXPECT_EQ(0, difference.major_faults);
+    EXPECT_EQ(4096, difference.read_bytes);
+    EXPECT_EQ(0, difference.cpu_ns);
+
+    a += b;
+    EXPECT_EQ(5, a.major_faults);
+    EXPECT_EQ(10, a.cpu_ns);
+    EXPECT_EQ(4096, a.read_bytes);
+}
+
+TEST(ResourceCounters, Spans) {
+    ResourceUsage usage;
+    ASSERT_FALSE(ResourceCounters::enabled());
+    {
+        UsageSpan span(&usage);
+        Touch(64);
+    }
+    EXPECT_EQ(0, usage.minor_faults);
+
+    ResourceCounters::Enable();
+    const std::string source = ResourceCounters::Source();
+    EXPECT_TRUE(source == "perf_event" || source == "getrusage") << source;
+    {
+        UsageSpan span(&usage);
+        Touch(64);
+        const auto end = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(20);
+        while (std::chrono::steady_clock::now() < end) {}
+    }
+    EXPECT_GE(usage.minor_faults, 64);
+    EXPECT_GT(usage.cpu_ns, 0);
+
+    // Each thread counts only its own usage.
+    ResourceUsage other;
+    std::thread([&other] {
+        UsageSpan span(&other);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }).join();
+    EXPECT_LT(other.minor_faults, 64);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,185 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "retry_scheduler.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace file_binder {
+
+constexpr uint64_t RetryScheduler::kUnscheduled;
+
+RetryScheduler::RetryScheduler(
+        Clock::duration tick, size_t slots, Clock::duration initial_backoff,
+        Clock::duration max_backoff, uint32_t max_attempts) :
+        tick_(tick), initial_backoff_(initial_backoff),
+        max_backoff_(max_backoff), max_attempts_(max_attempts),
+        epoch_(Clock::now()), given_up_(0), wheel_(std::max<size_t>(slots, 1)),
+        cursor_(0), timers_(0) {}
+
+bool RetryScheduler::Fail(PathId path, uint32_t group, Stage stage,
+        int error, Clock::time_point now) {
+    const uint64_t key = Key(path, group);
+    auto inserted = failures_.emplace(key, Entry());
+    Entry& entry = inserted.first->second;
+    Failure& failure = entry.failure;
+    if (inserted.second) {
+        failure.path = path;
+        failure.group = group;
+        failure.attempts = 0;
+        failure.given_up = false;
+        entry.due = kUnscheduled;
+    }
+    failure.stage = stage;
+    failure.error = error;
+    failure.attempts++;
+
+    if (failure.given_up) {
+        return false;
+    } else if (failure.attempts >= max_attempts_) {
+        failure.given_up = true;
+        given_up_++;
+        entry.due = kUnscheduled;
+        return false;
+    }
+
+    Clock::duration backoff = initial_backoff_;
+    for (uint32_t i = 1; i < failure.attempts && backoff < max_backoff_; i++) {
+        backoff *= 2;
+    }
+    backoff = std::min(backoff, max_backoff_);
+
+    // Any earlier timer for the entry is left to expire as stale.
+    failure.retry = now + backoff;
+    entry.due = std::max(TickOf(failure.retry, true), cursor_ + 1);
+    wheel_[entry.due % wheel_.size()].push_back({key, entry.due});
+    timers_++;
+    return true;
+}
+
+void RetryScheduler::Succeed(PathId path, uint32_t group) {
+    if (failures_.empty()) {
+        return;
+    }
+
+    auto it = failures_.find(Key(path, group));
+    if (it != failures_.end()) {
+        Erase(it);
+    }
+}
+
+void RetryScheduler::Forget(uint32_t group) {
+    for (auto it = failures_.begin(); it != failures_.end(); ) {
+        auto next = std::next(it);
+        if (it->second.failure.group == group) {
+            Erase(it);
+        }
+        it = next;
+    }
+}
+
+const RetryScheduler::Failure* RetryScheduler::Find(
+        PathId path, uint32_t group) const {
+    auto it = failures_.find(Key(path, group));
+    return it == failures_.end() ? nullptr : &it->second.failure;
+}
+
+std::vector<RetryScheduler::Failure> RetryScheduler::Due(
+        Clock::time_point now) {
+    std::vector<Failure> due;
+    const uint64_t target = TickOf(now, false);
+    if (target <= cursor_) {
+        return due;
+    }
+
+    // Each slot holds the timers of every round of the wheel, so a slot is
+    // visited at most once however long it has been since the last call.
+    const uint64_t span = std::min<uint64_t>(target - cursor_, wheel_.size());
+    for (uint64_t i = 1; i <= span; i++) {
+        std::vector<Timer>& slot = wheel_[(cursor_ + i) % wheel_.size()];
+        for (size_t j = 0; j < slot.size(); ) {
+            if (slot[j].due > target) {
+                // Due in a later round.
+                j++;
+                continue;
+            }
+
+            const Timer timer = slot[j];
+            slot[j] = slot.back();
+            slot.pop_back();
+            timers_--;
+
+            auto it = failures_.find(timer.key);
+            if (it != failures_.end() && it->second.due == timer.due) {
+                it->second.due = kUnscheduled;
+                due.push_back(it->second.failure);
+            }
+        }
+    }
+    cursor_ = target;
+    return due;
+}
+
+RetryScheduler::Clock::time_point RetryScheduler::next_retry() const {
+    if (timers_ == 0) {
+        return Clock::time_point::max();
+    }
+
+    // The first occupied slot may only hold timers of later rounds, in which
+    // case we wake early.
+    for (uint64_t i = 1; i <= wheel_.size(); i++) {
+        if (!wheel_[(cursor_ + i) % wheel_.size()].empty()) {
+            return epoch_ + static_cast<Clock::rep>(cursor_ + i) * tick_;
+        }
+    }
+    return Clock::time_point::max();
+}
+
+const char* RetryScheduler::StageName(Stage stage) {
+    switch (stage) {
+        case Stage::kOpen:
+            return "open";
+        case Stage::kParse:
+            return "parse";
+        case Stage::kPopulate:
+            return "populate";
+        case Stage::kLock:
+            return "lock";
+    }
+    return "unknown";
+}
+
+uint64_t RetryScheduler::TickOf(Clock::time_point time, bool round_up) const {
+    if (time <= epoch_) {
+        return 0;
+    }
+    const Clock::rep elapsed = (time - epoch_).count();
+    const Clock::rep tick = tick_.count();
+    return static_cast<uint64_t>(
+        round_up ? (elapsed + tick - 1) / tick : elapsed / tick);
+}
+
+void RetryScheduler::Erase(std::unordered_map<uint64_t, Entry>::iterator it) {
+    if (it->second.failure.given_up) {
+        given_up_--;
+    }
+    failures_.erase(it);
+}
+
+}  // namespace file_binder
@@ -0,0 +1,149 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__RETRY_SCHEDULER_H__
+#define __FILE_BINDER__RETRY_SCHEDULER_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "path_table.h"
+
+namespace file_binder {
+
+// RetryScheduler tracks the files which failed to open, parse, populate or
+// lock on behalf of a group, and schedules retries with exponential backoff.
+// Transient failures, such as ENOENT or EACCES midway through a package
+// upgrade or ENOMEM near the lock budget, are retried cheaply; files which
+// fail max_attempts times are given up on, and stay in the failure table for
+// reporting until they succeed.
+//
+// Retries are kept on a hashed timer wheel of tick-sized slots, so
+// scheduling and expiring a retry are O(1) however many are pending.
+class RetryScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Stage {
+        kOpen,
+        kParse,
+        kPopulate,
+        kLock,
+    };
+
+    struct Failure {
+        PathId path;
+        uint32_t group;
+        Stage stage;
+        // The errno of the latest failure, or 0 if unknown.
+        int error;
+        uint32_t attempts;
+        // When the next retry is due, unless given up on.
+        Clock::time_point retry;
+        bool given_up;
+    };
+
+    RetryScheduler(
+        Clock::duration tick = std::chrono::milliseconds(100),
+        size_t slots = 512,
+        Clock::duration initial_backoff = std::chrono::seconds(1),
+        Clock::duration max_backoff = std::chrono::minutes(10),
+        uint32_t max_attempts = 10);
+
+    // Records that path failed on behalf of group at now, scheduling a retry
+    // after twice the previous backoff.  It returns false if path has now
+    // been given up on.
+    bool Fail(PathId path, uint32_t group, Stage stage, int error,
+        Clock::time_point now);
+
+    // Forgets the failure of path on behalf of group, as it succeeded or is
+    // no longer needed.
+    void Succeed(PathId path, uint32_t group);
+
+    // Forgets every failure on behalf of group.
+    void Forget(uint32_t group);
+
+    // Returns the failure of path on behalf of group, or nullptr.
+    const Failure* Find(PathId path, uint32_t group) const;
+
+    // Returns the failures whose retries are due by now.  They remain in the
+    // table until they Succeed or Fail again.
+    std::vector<Failure> Due(Clock::time_point now);
+
+    // When the next retry may be due, or Clock::time_point::max() if none
+    // are scheduled.
+    Clock::time_point next_retry() const;
+
+    // The number of failures recorded, and of those given up on.
+    size_t size() const { return failures_.size(); }
+    size_t given_up() const { return given_up_; }
+
+    // Calls f(failure) for each failure, in unspecified order.
+    template<typename F>
+    void ForEach(F f) const {
+        for (const auto& entry : failures_) {
+            f(entry.second.failure);
+        }
+    }
+
+    static const char* StageName(Stage stage);
+private:
+    struct Entry {
+        Failure failure;
+        // The tick of the timer for the next retry, or kUnscheduled.
+        uint64_t due;
+    };
+
+    struct Timer {
+        uint64_t key;
+        // The tick the retry is due, which identifies the timer as current.
+        uint64_t due;
+    };
+
+    static uint64_t Key(PathId path, uint32_t group) {
+        return (static_cast<uint64_t>(group) << 32) | path;
+    }
+
+    static constexpr uint64_t kUnscheduled = static_cast<uint64_t>(-1);
+
+    // The tick of time, rounded down or up.
+    uint64_t TickOf(Clock::time_point time, bool round_up) const;
+    void Erase(std::unordered_map<uint64_t, Entry>::iterator it);
+
+    const Clock::duration tick_;
+    const Clock::duration initial_backoff_;
+    const Clock::duration max_backoff_;
+    const uint32_t max_attempts_;
+    const Clock::time_point epoch_;
+
+    std::unordered_map<uint64_t, Entry> failures_;
+    size_t given_up_;
+
+    std::vector<std::vector<Timer>> wheel_;
+    // The last tick expired by Due.
+    uint64_t cursor_;
+    // The timers on the wheel, including those made stale by Succeed.
+    size_t timers_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__RETRY_SCHEDULER_H__
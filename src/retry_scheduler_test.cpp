@@ -0,0 +1,119 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "retry_scheduler.h"
+
+#include <cerrno>
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+typedef RetryScheduler::Clock Clock;
+typedef RetryScheduler::Stage Stage;
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+TEST(RetryScheduler, Backoff) {
+    // 10ms ticks on a wheel of 8 slots, backing off from 100ms to 400ms.
+    RetryScheduler retries(milliseconds(10), 8, milliseconds(100),
+        milliseconds(400), 5);
+    const Clock::time_point start = Clock::now();
+
+    EXPECT_EQ(Clock::time_point::max(), retries.next_retry());
+    EXPECT_TRUE(retries.Fail(7, 1, Stage::kOpen, ENOENT, start));
+    EXPECT_LE(retries.next_retry(), start + milliseconds(110));
+
+    EXPECT_TRUE(retries.Due(start + milliseconds(50)).empty());
+    std::vector<RetryScheduler::Failure> due =
+        retries.Due(start + milliseconds(120));
+    ASSERT_EQ(1u, due.size());
+    EXPECT_EQ(7u, due[0].path);
+    EXPECT_EQ(1u, due[0].group);
+    EXPECT_EQ(ENOENT, due[0].error);
+    EXPECT_EQ(1u, due[0].attempts);
+    // It is only returned once.
+    EXPECT_TRUE(retries.Due(start + milliseconds(130)).empty());
+
+    // The backoff doubles, up to its maximum, across rounds of the wheel.
+    Clock::time_point now = start + milliseconds(130);
+    const int backoffs[] = {200, 400, 400};
+    for (int backoff : backoffs) {
+        EXPECT_TRUE(retries.Fail(7, 1, Stage::kLock, ENOMEM, now));
+        EXPECT_TRUE(retries.Due(now + milliseconds(backoff - 20)).empty());
+        now += milliseconds(backoff + 20);
+        due = retries.Due(now);
+        ASSERT_EQ(1u, due.size()) << backoff;
+        EXPECT_EQ(Stage::kLock, due[0].stage);
+    }
+
+    // The fifth failure gives up.
+    EXPECT_FALSE(retries.Fail(7, 1, Stage::kLock, ENOMEM, now));
+    EXPECT_EQ(1u, retries.given_up());
+    EXPECT_TRUE(retries.Due(now + seconds(10)).empty());
+    ASSERT_NE(nullptr, retries.Find(7, 1));
+    EXPECT_TRUE(retries.Find(7, 1)->given_up);
+    EXPECT_EQ(5u, retries.Find(7, 1)->attempts);
+
+    retries.Succeed(7, 1);
+    EXPECT_EQ(nullptr, retries.Find(7, 1));
+    EXPECT_EQ(0u, retries.size());
+    EXPECT_EQ(0u, retries.given_up());
+}
+
+TEST(RetryScheduler, Cancel) {
+    RetryScheduler retries(milliseconds(10), 8, milliseconds(100),
+        milliseconds(400), 5);
+    const Clock::time_point start = Clock::now();
+
+    EXPECT_TRUE(retries.Fail(1, 0, Stage::kOpen, EACCES, start));
+    EXPECT_TRUE(retries.Fail(2, 0, Stage::kOpen, EACCES, start));
+    EXPECT_TRUE(retries.Fail(2, 1, Stage::kOpen, EACCES, start));
+    EXPECT_TRUE(retries.Fail(3, 1, Stage::kOpen, EACCES, start));
+    EXPECT_EQ(4u, retries.size());
+
+    retries.Succeed(1, 0);
+    retries.Forget(1);
+    EXPECT_EQ(1u, retries.size());
+
+    const std::vector<RetryScheduler::Failure> due =
+        retries.Due(start + seconds(1));
+    ASSERT_EQ(1u, due.size());
+    EXPECT_EQ(2u, due[0].path);
+    EXPECT_EQ(0u, due[0].group);
+}
+
+TEST(RetryScheduler, Reschedule) {
+    RetryScheduler retries(milliseconds(10), 8, milliseconds(100),
+        milliseconds(400), 5);
+    const Clock::time_point start = Clock::now();
+
+    // Failing again before the retry supersedes the earlier timer.
+    EXPECT_TRUE(retries.Fail(1, 0, Stage::kOpen, ENOENT, start));
+    EXPECT_TRUE(retries.Fail(1, 0, Stage::kOpen, ENOENT, start));
+    EXPECT_TRUE(retries.Due(start + milliseconds(150)).empty());
+    EXPECT_EQ(1u, retries.Due(start + milliseconds(250)).size());
+    EXPECT_EQ(Clock::time_point::max(), retries.next_retry());
+}
+
+}  // namespace
+}  // namespace file_binder
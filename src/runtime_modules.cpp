@@ -0,0 +1,283 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "runtime_modules.h"
+
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+namespace file_binder {
+namespace {
+
+bool Exists(const std::string& path) {
+    struct stat buf;
+    return ::stat(path.c_str(), &buf) == 0;
+}
+
+// Returns the paths of the entries in directory, sorted, or an empty vector
+// if it cannot be read.
+std::vector<std::string> ListDirectory(const std::string& directory) {
+    std::vector<std::string> ret;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return ret;
+    }
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        ret.push_back(directory + "/" + entry->d_name);
+    }
+    closedir(dir);
+
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+void StripComment(std::string* line) {
+    const size_t comment = line->find('#');
+    if (comment != std::string::npos) {
+        line->resize(comment);
+    }
+}
+
+// Appends value to out unless it has been seen before.
+void AppendUnique(
+        std::string value, std::unordered_set<std::string>* seen,
+        std::vector<std::string>* out) {
+    if (seen->insert(value).second) {
+        out->push_back(std::move(value));
+    }
+}
+
+}  // namespace
+
+RuntimeModulePlugin::~RuntimeModulePlugin() {}
+
+std::vector<std::string> ParseNsswitch(std::istream& in) {
+    std::vector<std::string> ret;
+    std::unordered_set<std::string> seen;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        StripComment(&line);
+
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+
+        // Each database is followed by a list of services, interspersed with
+        // bracketed actions, e.g. "hosts: files [NOTFOUND=return] dns".
+        std::istringstream words(line.substr(colon + 1));
+        std::string word;
+        bool in_action = false;
+        while (words >> word) {
+            if (in_action || word[0] == '[') {
+                in_action = word.back() != ']';
+                continue;
+            }
+
+            AppendUnique("libnss_" + word + ".so.2", &seen, &ret);
+        }
+    }
+
+    return ret;
+}
+
+std::vector<std::string> ParsePamConfig(std::istream& in) {
+    std::vector<std::string> ret;
+    std::unordered_set<std::string> seen;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        StripComment(&line);
+
+        std::istringstream words(line);
+        std::string type;
+        if (!(words >> type) || type[0] == '@') {
+            // Blank, or an "@include" directive.
+            continue;
+        }
+
+        std::string control;
+        if (!(words >> control)) {
+            continue;
+        }
+        if (control[0] == '[') {
+            // Bracketed controls may contain whitespace.
+            while (control.back() != ']' && words >> control) {}
+        } else if (control == "include" || control == "substack") {
+            // These name another service, not a module.
+            continue;
+        }
+
+        std::string module;
+        if (words >> module) {
+            AppendUnique(module, &seen, &ret);
+        }
+    }
+
+    return ret;
+}
+
+std::vector<std::string> ParseGconvModules(std::istream& in) {
+    std::vector<std::string> ret;
+    std::unordered_set<std::string> seen;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        StripComment(&line);
+
+        // module  FROM  TO  FILE  [COST]
+        std::istringstream words(line);
+        std::string keyword, from, to, file;
+        if (!(words >> keyword >> from >> to >> file) || keyword != "module") {
+            continue;
+        }
+
+        AppendUnique(file, &seen, &ret);
+    }
+
+    return ret;
+}
+
+NssPlugin::NssPlugin(const std::string& config) : config_(config) {}
+
+std::vector<std::string> NssPlugin::ConfigPaths() const {
+    return {config_};
+}
+
+std::vector<std::string> NssPlugin::Modules() const {
+    std::ifstream in(config_);
+    return ParseNsswitch(in);
+}
+
+PamPlugin::PamPlugin(
+        std::vector<std::string> library_directories,
+        const std::string& config_directory) :
+    library_directories_(std::move(library_directories)),
+    config_directory_(config_directory) {}
+
+std::vector<std::string> PamPlugin::ConfigPaths() const {
+    return {config_directory_};
+}
+
+std::vector<std::string> PamPlugin::Modules() const {
+    std::vector<std::string> ret;
+    std::unordered_set<std::string> seen;
+
+    for (const auto& service : ListDirectory(config_directory_)) {
+        std::ifstream in(service);
+        for (const auto& module : ParsePamConfig(in)) {
+            if (module[0] == '/') {
+                AppendUnique(module, &seen, &ret);
+                continue;
+            }
+
+            for (const auto& dir : library_directories_) {
+                std::string candidate = dir + "/security/" + module;
+                if (Exists(candidate)) {
+                    AppendUnique(std::move(candidate), &seen, &ret);
+                    break;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+GconvPlugin::GconvPlugin(std::vector<std::string> library_directories) {
+    const char* gconv_path = getenv("GCONV_PATH");
+    if (gconv_path != nullptr) {
+        std::istringstream dirs(gconv_path);
+        std::string dir;
+        while (std::getline(dirs, dir, ':')) {
+            if (!dir.empty()) {
+                directories_.push_back(dir);
+            }
+        }
+    }
+
+    for (const auto& dir : library_directories) {
+        std::string candidate = dir + "/gconv";
+        if (Exists(candidate + "/gconv-modules") ||
+                Exists(candidate + "/gconv-modules.d")) {
+            directories_.push_back(std::move(candidate));
+        }
+    }
+}
+
+std::vector<std::string> GconvPlugin::ConfigPaths() const {
+    std::vector<std::string> ret;
+    for (const auto& dir : directories_) {
+        ret.push_back(dir);
+        ret.push_back(dir + "/gconv-modules.d");
+    }
+    return ret;
+}
+
+std::vector<std::string> GconvPlugin::Modules() const {
+    std::vector<std::string> ret;
+    std::unordered_set<std::string> seen;
+
+    for (const auto& dir : directories_) {
+        std::vector<std::string> configs = {dir + "/gconv-modules"};
+        for (auto& config : ListDirectory(dir + "/gconv-modules.d")) {
+            configs.push_back(std::move(config));
+        }
+
+        for (const auto& config : configs) {
+            std::ifstream in(config);
+            for (const auto& file : ParseGconvModules(in)) {
+                std::string module =
+                    (file[0] == '/' ? file : dir + "/" + file) + ".so";
+                AppendUnique(std::move(module), &seen, &ret);
+            }
+        }
+
+        // glibc prefers the precompiled cache over gconv-modules.
+        const std::string cache = dir + "/gconv-modules.cache";
+        if (Exists(cache)) {
+            AppendUnique(cache, &seen, &ret);
+        }
+    }
+
+    return ret;
+}
+
+std::vector<std::unique_ptr<RuntimeModulePlugin>> DefaultRuntimeModulePlugins(
+        const std::vector<std::string>& library_directories) {
+    std::vector<std::unique_ptr<RuntimeModulePlugin>> ret;
+    ret.emplace_back(new NssPlugin());
+    ret.emplace_back(new PamPlugin(library_directories));
+    ret.emplace_back(new GconvPlugin(library_directories));
+    return ret;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,108 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__RUNTIME_MODULES_H__
+#define __FILE_BINDER__RUNTIME_MODULES_H__
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// A RuntimeModulePlugin discovers libraries which are loaded with dlopen(3)
+// according to some system configuration.  These never appear in DT_NEEDED,
+// so they are invisible to ElfParser.
+class RuntimeModulePlugin {
+public:
+    virtual ~RuntimeModulePlugin();
+
+    virtual const char* name() const = 0;
+
+    // The configuration files and directories which determine our modules.
+    // Modules are rediscovered when any of these change.
+    virtual std::vector<std::string> ConfigPaths() const = 0;
+
+    // Returns the modules to lock.  Entries are either paths or sonames to be
+    // resolved through the library search path.
+    virtual std::vector<std::string> Modules() const = 0;
+};
+
+// Name Service Switch modules (libnss_*.so.2) named by /etc/nsswitch.conf.
+class NssPlugin : public RuntimeModulePlugin {
+public:
+    explicit NssPlugin(const std::string& config = "/etc/nsswitch.conf");
+
+    const char* name() const override { return "nss"; }
+    std::vector<std::string> ConfigPaths() const override;
+    std::vector<std::string> Modules() const override;
+private:
+    const std::string config_;
+};
+
+// PAM modules named by the service configurations in /etc/pam.d.
+class PamPlugin : public RuntimeModulePlugin {
+public:
+    // Relative module names are searched for in the "security" subdirectory
+    // of each of library_directories.
+    explicit PamPlugin(
+        std::vector<std::string> library_directories,
+        const std::string& config_directory = "/etc/pam.d");
+
+    const char* name() const override { return "pam"; }
+    std::vector<std::string> ConfigPaths() const override;
+    std::vector<std::string> Modules() const override;
+private:
+    const std::vector<std::string> library_directories_;
+    const std::string config_directory_;
+};
+
+// iconv(3) converters named by the gconv-modules configuration of glibc.
+class GconvPlugin : public RuntimeModulePlugin {
+public:
+    // As by glibc, the directories in GCONV_PATH, if set, are searched first,
+    // followed by the "gconv" subdirectory of each of library_directories.
+    explicit GconvPlugin(std::vector<std::string> library_directories);
+
+    const char* name() const override { return "gconv"; }
+    std::vector<std::string> ConfigPaths() const override;
+    std::vector<std::string> Modules() const override;
+private:
+    std::vector<std::string> directories_;
+};
+
+// Returns the plugins for NSS, PAM and gconv.
+std::vector<std::unique_ptr<RuntimeModulePlugin>> DefaultRuntimeModulePlugins(
+    const std::vector<std::string>& library_directories);
+
+// Returns the sonames of the NSS modules referenced by an nsswitch.conf.
+std::vector<std::string> ParseNsswitch(std::istream& in);
+
+// Returns the module names (paths or bare filenames) referenced by a PAM
+// service configuration.  Included services are not followed, as every file
+// in /etc/pam.d is parsed independently.
+std::vector<std::string> ParsePamConfig(std::istream& in);
+
+// Returns the module filenames, without their ".so" suffix, referenced by a
+// gconv-modules configuration.
+std::vector<std::string> ParseGconvModules(std::istream& in);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__RUNTIME_MODULES_H__
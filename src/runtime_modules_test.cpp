@@ -0,0 +1,82 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "runtime_modules.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+typedef std::vector<std::string> Strings;
+
+TEST(RuntimeModules, Nsswitch) {
+    std::istringstream in(
+        "# /etc/nsswitch.conf\n"
+        "\n"
+        "passwd:         files systemd\n"
+        "group:          files [SUCCESS=merge] systemd\n"
+        "hosts:          files mdns4_minimal [NOTFOUND = return] dns\n"
+        "netgroup:       nis # trailing comment\n");
+
+    EXPECT_EQ(Strings({
+            "libnss_files.so.2",
+            "libnss_systemd.so.2",
+            "libnss_mdns4_minimal.so.2",
+            "libnss_dns.so.2",
+            "libnss_nis.so.2",
+        }), ParseNsswitch(in));
+}
+
+TEST(RuntimeModules, Pam) {
+    std::istringstream in(
+        "#%PAM-1.0\n"
+        "@include common-auth\n"
+        "auth       required     pam_env.so readenv=1\n"
+        "account    include      system-login\n"
+        "session    substack     system-auth\n"
+        "-session   optional     pam_systemd.so\n"
+        "session [success=ok ignore=ignore default=bad] pam_selinux.so open\n"
+        "password   requisite    /opt/lib/pam_custom.so\n"
+        "auth       required     pam_env.so\n");
+
+    EXPECT_EQ(Strings({
+            "pam_env.so",
+            "pam_systemd.so",
+            "pam_selinux.so",
+            "/opt/lib/pam_custom.so",
+        }), ParsePamConfig(in));
+}
+
+TEST(RuntimeModules, Gconv) {
+    std::istringstream in(
+        "# from         to              module          cost\n"
+        "alias   ISO-IR-100//   ISO-8859-1//\n"
+        "module  ISO-8859-1//   INTERNAL        ISO8859-1       1\n"
+        "module  INTERNAL       ISO-8859-1//    ISO8859-1       1\n"
+        "module  UTF-16//       INTERNAL        UTF-16\n"
+        "module  broken\n");
+
+    EXPECT_EQ(Strings({"ISO8859-1", "UTF-16"}), ParseGconvModules(in));
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -19,92 +19,2316 @@
 #include "scanner.h"
 
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <system_error>
+
+#include "content_hash.h"
 #include "elf_parser.h"
+#include "kernel_features.h"
+#include "population_scheduler.h"
+#include "self_protection.h"
+#include "shebang.h"
+#include "tracer.h"
 
 namespace file_binder {
+namespace {
+
+// The search path used to resolve "#!/usr/bin/env foo" scripts when we do not
+// have a PATH of our own.
+const char kDefaultSearchPath[] =
+    "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin";
+
+// Sentinel for an absent group index.
+const size_t kNoGroup = static_cast<size_t>(-1);
+
+// Directory polling bounds, see DirectoryPoller.
+const std::chrono::seconds kMinPollInterval(1);
+const std::chrono::seconds kMaxPollInterval(60);
+// Metadata is warmed between every second and every minute.
+const std::chrono::seconds kMinWarmInterval(1);
+const std::chrono::seconds kMaxWarmInterval(60);
+
+// Changes are acted upon once none have been seen for kChangeSettle, or
+// kMaxChangeDelay after the first, whichever is sooner.
+const std::chrono::milliseconds kChangeSettle(500);
+const std::chrono::seconds kMaxChangeDelay(5);
+
+// Returns true for filesystems whose changes may be made elsewhere, which
+// inotify does not report.
+bool IsRemoteFilesystem(const std::string& path) {
+    struct statfs buf;
+    if (statfs(path.c_str(), &buf) != 0) {
+        return false;
+    }
+
+    switch (static_cast<uint32_t>(buf.f_type)) {
+        case 0x6969:        // NFS
+        case 0x517B:        // SMB
+        case 0xFF534D42:    // CIFS
+        case 0xFE534D42:    // SMB2
+        case 0x65735546:    // FUSE
+        case 0x01021997:    // 9P
+        case 0x00C36400:    // Ceph
+        case 0x5346414F:    // AFS
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Reads which take longer than Scanner::Deadline allows are given up on.
+const std::chrono::seconds kDefaultIoDeadline(10);
+const size_t kDefaultQuarantineAfter = 3;
+// The slowest throughput and open rate we expect from a working device.
+const uint64_t kMinBytesPerSecond = 1 << 20;
+const std::chrono::milliseconds kMaxOpenTime(10);
+// The files listed in the report as reading the most from storage.
+const size_t kTopUsageFiles = 10;
+// The bytes filled before they are locked, bounding how long pages sit in the
+// page cache, where they may be reclaimed, before we lock them.
+const uint64_t kFillBatchBytes = 256 << 20;
+
+std::string SearchPath() {
+    const char* path = getenv("PATH");
+    return path != nullptr ? path : kDefaultSearchPath;
+}
+
+// Sends state to the service manager, if we were started by one which
+// supports sd_notify.
+void NotifyServiceManager(const std::string& state) {
+    const char* socket_path = getenv("NOTIFY_SOCKET");
+    if (socket_path == nullptr || (socket_path[0] != '/' &&
+            socket_path[0] != '@')) {
+        return;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const size_t length = strlen(socket_path);
+    if (length >= sizeof(address.sun_path)) {
+        return;
+    }
+    memcpy(address.sun_path, socket_path, length);
+    if (address.sun_path[0] == '@') {
+        // An abstract socket.
+        address.sun_path[0] = '\0';
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t ret;
+    do {
+        ret = sendto(fd, state.data(), state.size(), MSG_NOSIGNAL,
+            reinterpret_cast<const struct sockaddr*>(&address),
+            offsetof(struct sockaddr_un, sun_path) + length);
+    } while (ret < 0 && errno == EINTR);
+    close(fd);
+}
+
+// The runtime dependencies of a file, as read by ReadDependencies.
+struct Dependencies {
+    bool script = false;
+    Shebang shebang;
+
+    bool elf = false;
+    ElfDependencies libraries;
+};
+
+// Reads the dependencies of the file open at fd.  It only touches its
+// arguments, so it may be abandoned on a DeadlineExecutor.
+void ReadDependencies(int fd, const struct stat& buf, Dependencies* deps) {
+    // A single read classifies the file and serves as both the shebang line
+    // and the ELF header, so other files cost no further reads.
+    uint8_t prefix[kShebangMaxLength];
+    ssize_t size;
+    do {
+        size = pread(fd, prefix, sizeof(prefix), 0);
+    } while (size < 0 && errno == EINTR);
+    if (size <= 0) {
+        return;
+    }
+
+    switch (ClassifyFile(prefix, size)) {
+        case FileKind::kScript:
+            deps->script = (buf.st_mode & 0111) != 0 && ParseShebang(
+                reinterpret_cast<const char*>(prefix), size, &deps->shebang);
+            break;
+        case FileKind::kElf: {
+            ElfResult<ElfDependencies> result =
+                ParseElfDependencies(fd, prefix, size);
+            if (result.ok()) {
+                deps->elf = true;
+                deps->libraries = std::move(result.value());
+            }
+            break;
+        }
+        case FileKind::kOther:
+            break;
+    }
+}
+
+// Reads ranges of the file at path into the page cache, returning once they
+// are resident.  It returns false if the file cannot be read, e.g. due to a
+// bad sector.
+bool Fill(const std::string& path,
+        const std::vector<PopulationScheduler::Read>& ranges) {
+    int fd;
+    do {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Queue the whole file before waiting on any of it.
+    for (const auto& range : ranges) {
+        readahead(fd, range.offset, range.length);
+    }
+
+    std::unique_ptr<char[]> buf(new char[1 << 17]);
+    bool ok = true;
+    for (const auto& range : ranges) {
+        uint64_t offset = range.offset;
+        const uint64_t end = range.offset + range.length;
+        while (ok && offset < end) {
+            const ssize_t ret = pread(fd, buf.get(),
+                std::min<uint64_t>(1 << 17, end - offset), offset);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret <= 0) {
+                // EOF if the file has since been truncated.
+                ok = ret == 0;
+                break;
+            }
+            offset += ret;
+        }
+    }
+
+    close(fd);
+    return ok;
+}
+
+}  // namespace
+
+constexpr size_t Scanner::kMaxGroups;
+
+Scanner::Scanner() :
+    filesystem_(new Filesystem()),
+    mlocker_(new ShardSupervisor("/proc/self/exe")),
+    pressure_(new PressureMonitor(
+        PressureMonitor::DefaultTriggers(), std::chrono::seconds(60))),
+    resolver_(new LibraryResolver()),
+    watcher_(new Watcher()),
+    poller_(new DirectoryPoller(kMinPollInterval, kMaxPollInterval)),
+    throttle_(new IoThrottle()),
+    executor_(new DeadlineExecutor(kDefaultQuarantineAfter)),
+    reported_metadata_misses_(0),
+    io_deadline_(kDefaultIoDeadline),
+    io_priority_{IoClass::kNone, 0},
+    applied_level_(PressureMonitor::Level::kNone),
+    runtime_modules_group_(kNoGroup),
+    inotify_directories_(0),
+    changed_groups_(0),
+    config_changed_(false),
+    changes_pending_(false),
+    changes_lost_(false),
+    trace_started_(false),
+    upgrade_requested_(false),
+    stop_requested_(false),
+    search_path_(SearchPath()),
+    pending_sequence_(0),
+    walk_depth_(0) {
+    if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        wake_fds_[0] = wake_fds_[1] = -1;
+    }
+    handoff_.fd = -1;
+    handoff_.holder = -1;
 
-Scanner::Scanner() : filesystem_(new Filesystem()), mlocker_(new MLocker()) {}
-Scanner::~Scanner() {}
+    // Walks, polls and library lookups may block on a failing disk.
+    auto run = [this](dev_t device, std::function<void()> task) {
+        return RunIo(device, std::move(task));
+    };
+    filesystem_->SetRunner(run);
+    poller_->SetRunner(run);
+    resolver_->SetRunner([this](std::function<void()> task) {
+        return RunIo(DeadlineExecutor::kNoDevice, std::move(task));
+    });
+}
+
+Scanner::~Scanner() {
+    for (auto& group : groups_) {
+        Release(&group.locks);
+    }
+    ReleaseHandoff(&handoff_);
+
+    if (wake_fds_[0] >= 0) {
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+    }
+}
 
 void Scanner::SetPaths(std::vector<std::string> paths) {
-    pending_paths_ = std::move(paths);
+    AddGroup("default", Mode::kPinned, std::move(paths));
+}
+
+void Scanner::AddGroup(
+        const std::string& name, Mode mode, std::vector<std::string> paths) {
+    assert(groups_.size() < kMaxGroups);
+
+    Group group;
+    group.name = name;
+    group.mode = mode;
+    group.paths = std::move(paths);
+    group.priority = 0;
+    groups_.push_back(std::move(group));
+}
+
+void Scanner::EnableRuntimeModules() {
+    if (runtime_modules_group_ != kNoGroup) {
+        return;
+    }
+
+    // The plugins are created by Run, once our deadlines are set.
+    runtime_modules_group_ = groups_.size();
+    AddGroup("runtime-modules", Mode::kPinned, {});
+}
+
+void Scanner::SetIoPolicy(
+        const IoThrottle::Limits& limits, const IoPriority& priority) {
+    throttle_->SetLimits(limits);
+    io_priority_ = priority;
+}
+
+void Scanner::SetIoLimitsFile(std::string path) {
+    io_limits_file_ = std::move(path);
+}
+
+void Scanner::SetDeadlines(
+        std::chrono::milliseconds deadline, size_t quarantine_after) {
+    io_deadline_ = deadline;
+    executor_.reset(new DeadlineExecutor(quarantine_after));
+}
+
+void Scanner::SetTraceOutput(std::string path) {
+    trace_output_ = std::move(path);
+    Tracer::Enable();
+}
+
+void Scanner::EnableResourceCounters() {
+    ResourceCounters::Enable();
+}
+
+void Scanner::EnableMetadataWarming() {
+    warmer_.reset(new MetadataWarmer(kMinWarmInterval, kMaxWarmInterval));
+    if (!warmer_->Start()) {
+        fprintf(stderr, "Unable to start warming metadata.\n");
+        warmer_.reset();
+    }
+}
+
+void Scanner::SetUpgradeArguments(std::vector<std::string> args) {
+    upgrade_args_ = std::move(args);
+}
+
+void Scanner::RequestUpgrade() {
+    upgrade_requested_.store(true, std::memory_order_relaxed);
+    if (wake_fds_[1] >= 0) {
+        const char c = 0;
+        ssize_t ret = write(wake_fds_[1], &c, 1);
+        (void) ret;
+    }
+}
+
+void Scanner::RequestStop() {
+    stop_requested_.store(true, std::memory_order_relaxed);
+    if (wake_fds_[1] >= 0) {
+        const char c = 0;
+        ssize_t ret = write(wake_fds_[1], &c, 1);
+        (void) ret;
+    }
+}
+
+void Scanner::SetHandoff(int fd, pid_t holder) {
+    handoff_.fd = fd;
+    handoff_.holder = holder;
+}
+
+bool Scanner::SetPriority(const std::string& group, int priority) {
+    for (auto& g : groups_) {
+        if (g.name == group) {
+            g.priority = priority;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scanner::SetNumaPolicy(
+        const std::string& group, const NumaPolicy& policy) {
+    for (auto& g : groups_) {
+        if (g.name == group) {
+            g.numa = policy;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scanner::SetShadow(const std::string& group, const std::string& root,
+        bool bind, std::string* error) {
+    for (auto& g : groups_) {
+        if (g.name != group) {
+            continue;
+        }
+
+        std::unique_ptr<ShadowTree> shadow(new ShadowTree(root));
+        if (!shadow->Init(error)) {
+            return false;
+        }
+        if (bind) {
+            shadow->EnableBind();
+        }
+        g.shadow = std::move(shadow);
+        return true;
+    }
+    *error = "unknown group " + group;
+    return false;
 }
 
 void Scanner::Run() {
-    using std::placeholders::_1;
-    using std::placeholders::_2;
-    const auto& callback = std::bind(&Scanner::Walk, this, _1, _2);
+    run_start_ = std::chrono::steady_clock::now();
+    if (handoff_.fd >= 0 &&
+            !ReceiveHandoff(handoff_.fd, handoff_.holder, &handoff_)) {
+        fprintf(stderr, "Unable to receive the inventory of the previous "
+            "binary.\n");
+    }
+    if (handoff_.fd >= 0) {
+        // The previous binary's files are resident, so there is little I/O
+        // to limit, and the holder should be released promptly.
+        throttle_->Unthrottle();
+    }
+
+    const IoPriority original_priority = GetIoPriority();
+    if (io_priority_.io_class != IoClass::kNone &&
+            !SetIoPriority(io_priority_)) {
+        perror("ioprio_set");
+    }
+
+    if (runtime_modules_group_ != kNoGroup) {
+        LoadRuntimeModulePlugins();
+        WatchConfig();
+    }
+
+    // Pinned groups are locked in tiers of descending priority, so that the
+    // closure of the most important ones is resident before anything else
+    // is read.
+    bool has_warm = false;
+    std::vector<size_t> pinned;
+    for (size_t i = 0; i < groups_.size(); i++) {
+        if (groups_[i].mode == Mode::kPinned) {
+            pinned.push_back(i);
+        } else {
+            has_warm = true;
+        }
+    }
+    std::stable_sort(pinned.begin(), pinned.end(), [this](size_t a, size_t b) {
+        return groups_[a].priority > groups_[b].priority;
+    });
+
+    for (size_t i = 0; i < pinned.size(); i++) {
+        Group& group = groups_[pinned[i]];
+        if (pinned[i] == runtime_modules_group_) {
+            RefreshRuntimeModules();
+        } else {
+            Scan(&group, Action::kLock);
+        }
+
+        if (i + 1 == pinned.size() ||
+                groups_[pinned[i + 1]].priority != group.priority) {
+            TierReady(group.priority);
+        }
+    }
+
+    // Warm groups the previous binary had locked under pressure are relocked
+    // too, before its locks go, and held as if the pressure had just been
+    // reported to us.
+    const PressureMonitor::Level inherited =
+        static_cast<PressureMonitor::Level>(handoff_.pressure_level);
+    if (has_warm && handoff_.fd >= 0 &&
+            inherited > PressureMonitor::Level::kNone &&
+            inherited <= PressureMonitor::Level::kLock) {
+        pressure_->Raise(inherited, PressureMonitor::Clock::now());
+        ApplyPressure(inherited);
+    }
+
+    // Our own locks are in place, so the previous binary's may go.
+    CompleteHandoff();
+
+    // The pinned groups are resident.  Anything we populate from here on is
+    // in response to pressure or configuration changes, so it runs at full
+    // speed.
+    throttle_->Unthrottle();
+    if (io_priority_.io_class != IoClass::kNone) {
+        SetIoPriority(original_priority);
+    }
+
+    PrintReport(stderr);
+    WriteTrace();
+    NotifyServiceManager("READY=1");
+
+    if (has_warm && !pressure_->Start()) {
+        fprintf(stderr, "Pressure stall information is unavailable, "
+            "locking warm groups unconditionally.\n");
+        ApplyPressure(PressureMonitor::Level::kLock);
+        has_warm = false;
+    }
+
+    typedef PressureMonitor::Clock Clock;
+    std::vector<struct pollfd> fds;
+    if (has_warm) {
+        for (int fd : pressure_->fds()) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLPRI;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+        }
+    }
+    const size_t pressure_fds = fds.size();
+
+    const size_t wake_fd = fds.size();
+    {
+        struct pollfd pfd;
+        pfd.fd = wake_fds_[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+    }
+
+    if (watcher_->fd() >= 0) {
+        struct pollfd pfd;
+        pfd.fd = watcher_->fd();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+    }
 
-    // We allow our Walk function to build up additional paths for us to scan.
-    // To avoid iterator invalidation issues, we move the contents of the
-    // member variable into a stack variable and build up additional work items
-    // in pending_paths_.
-    std::vector<std::string> paths;
     while (true) {
-        while (!pending_paths_.empty()) {
-            paths.swap(pending_paths_);
+        // Sleep until a trigger fires or we may step down a level.
+        const Clock::duration wait = pressure_->TimeToNextTick(Clock::now());
+        int timeout = -1;
+        if (pressure_->level() != PressureMonitor::Level::kNone) {
+            timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    wait).count()) + 1;
+        }
+        // ... or directories are due to be polled.
+        if (poller_->size() > 0) {
+            const int poll_timeout = std::max(0, static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    poller_->next_poll() - Clock::now()).count()) + 1);
+            timeout = timeout < 0 ? poll_timeout :
+                std::min(timeout, poll_timeout);
+        }
+        // ... or failed files are due to be retried.
+        if (retries_.next_retry() != RetryScheduler::Clock::time_point::max()) {
+            const int retry_timeout = std::max(0, static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    retries_.next_retry() - Clock::now()).count()) + 1);
+            timeout = timeout < 0 ? retry_timeout :
+                std::min(timeout, retry_timeout);
+        }
+        // ... or the metadata warmer may have missed the cache.
+        if (warmer_) {
+            const int warm_timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    warmer_->interval()).count());
+            timeout = timeout < 0 ? warm_timeout :
+                std::min(timeout, warm_timeout);
+        }
+        // ... or pending changes have settled.
+        if (changes_pending_) {
+            const Clock::time_point due = std::min(
+                last_change_ + kChangeSettle, first_change_ + kMaxChangeDelay);
+            const int change_timeout = std::max(0, static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    due - Clock::now()).count()) + 1);
+            timeout = timeout < 0 ? change_timeout :
+                std::min(timeout, change_timeout);
+        }
+
+        int ret = poll(fds.data(), fds.size(), timeout);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+
+        const Clock::time_point now = Clock::now();
+        for (size_t i = 0; ret > 0 && i < pressure_fds; i++) {
+            if (fds[i].revents & POLLERR) {
+                // The monitored resource has gone away.  Stop polling it.
+                fds[i].fd = -1;
+            } else if (fds[i].revents & POLLPRI) {
+                pressure_->Notify(i, now);
+            }
+        }
+
+        if (ret > 0 && (fds[wake_fd].revents & POLLIN)) {
+            char buf[64];
+            while (read(wake_fds_[0], buf, sizeof(buf)) > 0) {}
+        }
+        if (stop_requested_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (upgrade_requested_.exchange(false)) {
+            Upgrade();
+        }
+        ReloadIoLimits();
 
-            for (const auto& path : paths) {
-                filesystem_->Walk(path, callback);
+        if (ret > 0 && fds.size() > wake_fd + 1 &&
+                (fds[wake_fd + 1].revents & POLLIN)) {
+            HandleWatchEvents();
+        }
+        if (poller_->size() > 0 && now >= poller_->next_poll()) {
+            for (const auto& directory : poller_->Poll(now)) {
+                DirectoryChanged(directory);
             }
+        }
+        bool scanned = false;
+        if (changes_pending_ && (now - last_change_ >= kChangeSettle ||
+                now - first_change_ >= kMaxChangeDelay)) {
+            RescanChanged();
+            scanned = true;
+        }
+        if (now >= retries_.next_retry()) {
+            RetryFailed(now);
+            scanned = true;
+        }
+        if (warmer_) {
+            ReportMetadataMisses();
+        }
 
-            paths.clear();
+        const PressureMonitor::Level applied = applied_level_;
+        ApplyPressure(pressure_->Tick(now));
+        if (scanned || applied != applied_level_) {
+            WriteTrace();
         }
+    }
+}
+
+void Scanner::Scan(Group* group, Action action) {
+    TraceSpan span(action == Action::kLock ? "scan" : "prefetch scan",
+        group->name);
 
-        paths.clear();
+    // Everything we read while scanning lands in the page cache, so the
+    // group's policy covers the whole scan rather than just LockPending.
+    ScopedNumaPolicy numa(group->numa);
+    if (!numa.ok()) {
+        fprintf(stderr, "Unable to apply the NUMA policy of group %s.\n",
+            group->name.c_str());
     }
 
-    // TODO:  Configure inotify
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    const auto& callback =
+        std::bind(&Scanner::Walk, this, group, action, _1, _2);
+
+    // We allow our Walk function to build up additional paths for us to scan
+    // in pending_paths_.  The group's own paths are walked first, then their
+    // dependencies, level by level.
+    for (const auto& path : group->paths) {
+        Enqueue(path, 0);
+    }
+    visited_.clear();
+    walked_directories_.clear();
+    if (action == Action::kLock) {
+        group->unavailable.clear();
+        group->roots.clear();
+    }
 
-    while (true) {
-        sleep(3600);
+    while (!pending_paths_.empty()) {
+        const PendingPath next = pending_paths_.top();
+        pending_paths_.pop();
+
+        walk_depth_ = next.depth;
+        TraceSpan walk("walk", next.path);
+        filesystem_->Walk(next.path, callback,
+            [](const std::string& directory, int error) {
+                fprintf(stderr, "Unable to walk %s: %s, skipping it.\n",
+                    directory.c_str(), strerror(error));
+            });
+    }
+
+    if (action == Action::kLock) {
+        // Files no longer found are released along with those replaced.
+        group->locks.ForEach([this](const LockRecord& record) {
+            if (record.path >= visited_.size() || !visited_[record.path]) {
+                superseded_.push_back(record);
+            }
+        });
+        for (const auto& record : superseded_) {
+            group->locks.Erase(record.path, nullptr);
+        }
+    }
+    visited_.clear();
+
+    if (action == Action::kLock) {
+        group->directories.clear();
+        group->directories.insert(
+            walked_directories_.begin(), walked_directories_.end());
+        LockPending(group);
+        for (const auto& record : superseded_) {
+            mlocker_->Unlock(record.mapping);
+        }
+        superseded_.clear();
+        SyncShadow(group);
+        WatchGroup(group - groups_.data());
+        WarmMetadata(group - groups_.data());
     }
 }
 
-void Scanner::Walk(const std::string& path, const struct stat& buf) {
+void Scanner::Walk(
+        Group* group,
+        Action action,
+        const std::string& path,
+        const struct stat& buf) {
+    if (S_ISDIR(buf.st_mode) && action == Action::kLock) {
+        // New files in the directory may need to be locked.
+        walked_directories_.push_back(path);
+        return;
+    }
     if (!S_ISREG(buf.st_mode)) {
         // Ignore non-files.
         return;
     }
 
-    // Scan ELF-type files for their runtime dependencies.
-    {
+    const PathId id = path_table_.Intern(path);
+    if (id >= visited_.size()) {
+        visited_.resize(path_table_.size());
+    }
+    if (visited_[id]) {
+        // Already handled by this scan.
+        return;
+    }
+    visited_[id] = true;
+
+    if (action == Action::kLock && group->mode != Mode::kPinned &&
+            IsPinned(id)) {
+        // There is no need to lock a second mapping of this file.
+        return;
+    }
+
+    if (executor_->IsQuarantined(buf.st_dev)) {
+        if (action == Action::kLock) {
+            group->unavailable.push_back(id);
+        }
+        return;
+    }
+    if (action == Action::kLock && walk_depth_ == 0) {
+        group->roots.push_back(id);
+    }
+
+    // Files unchanged since we last parsed them keep their dependencies.
+    const DependencyGraph::Identity identity =
+        DependencyGraph::Identity::Of(buf);
+    bool current = graph_.Contains(id) && graph_.identity(id) == identity;
+    if (!current && ContentUnchanged(id, identity)) {
+        graph_.SetIdentity(id, identity);
+        current = true;
+    }
+
+    if (current) {
+        for (const auto& edge : graph_.edges(id)) {
+            if (edge.target != PathTable::kInvalid) {
+                Enqueue(path_table_.Get(edge.target), walk_depth_ + 1);
+            }
+        }
+    } else {
+        // Scan ELF-type files and scripts for their runtime dependencies.
+        ReloadIoLimits();
+        throttle_->Open();
+
+        ResourceUsage usage;
         int fd;
-        do {
-            fd = open(path.c_str(), O_RDONLY);
-        } while (fd < 0 && errno != EINTR);
+        {
+            UsageSpan span(&usage);
+            fd = OpenFile(path, buf.st_dev);
+        }
+
+        if (fd < 0) {
+            if (action == Action::kLock) {
+                const int error = errno;
+                if (error == ETIMEDOUT) {
+                    group->unavailable.push_back(id);
+                }
+                if (!executor_->IsQuarantined(buf.st_dev)) {
+                    RecordFailure(
+                        group, id, RetryScheduler::Stage::kOpen, error);
+                }
+            }
+            return;
+        }
+
+        TraceSpan parse("parse", path);
+        const bool parsed = ScanDependencies(id, fd, buf, &usage);
+        AccountUsage(group, id, kParseUsage, usage);
+        if (!parsed) {
+            if (action == Action::kLock) {
+                group->unavailable.push_back(id);
+                if (!executor_->IsQuarantined(buf.st_dev)) {
+                    RecordFailure(
+                        group, id, RetryScheduler::Stage::kParse, ETIMEDOUT);
+                }
+            }
+            return;
+        }
+
+        // Any lock we hold maps its previous contents.
+        LockRecord record;
+        if (action == Action::kLock && group->locks.Erase(id, &record)) {
+            superseded_.push_back(record);
+        }
+    }
+    if (action == Action::kPrefetch) {
+        TraceSpan prefetch("prefetch", path);
+        // Best effort; a stall quarantines the device as for any other I/O.
+        RunIo(buf.st_dev, [path] { PrefetchFile(path); });
+        return;
+    }
+
+    // Lock file into memory once the scan is complete, see LockPending.
+    if (group->locks.Find(id) == nullptr) {
+        PendingLock pending;
+        pending.path = id;
+        pending.device = buf.st_dev;
+        pending.size = static_cast<uint64_t>(buf.st_size);
+        to_lock_.push_back(pending);
+    }
+}
+
+void Scanner::LockPending(Group* group) {
+    typedef PopulationScheduler::Read Read;
+
+    std::shared_ptr<std::vector<std::string>> paths(
+        new std::vector<std::string>());
+    paths->reserve(to_lock_.size());
+    for (const auto& pending : to_lock_) {
+        paths->push_back(path_table_.Get(pending.path));
+    }
+
+    // Bring the files into the page cache in the order they are laid out on
+    // disk, then lock them in the same order, so that MAP_POPULATE finds
+    // their pages already resident.  Each step that may touch the disk runs
+    // against a deadline.
+    std::shared_ptr<std::vector<Read>> reads(new std::vector<Read>());
+    {
+        TraceSpan plan("plan");
+        if (executor_->Run(DeadlineExecutor::kNoDevice,
+                Deadline(0, paths->size()), [paths, reads] {
+                    *reads = PopulationScheduler::Plan(*paths);
+                }) != DeadlineExecutor::Status::kOk) {
+            // Read each file whole, in discovery order.
+            reads.reset(new std::vector<Read>());
+            for (uint32_t i = 0; i < to_lock_.size(); i++) {
+                reads->push_back({i, 0, to_lock_[i].size, to_lock_[i].device,
+                    PopulationScheduler::kUnknownPhysical});
+            }
+        }
+    }
+
+    const bool throttled = throttle_->throttled();
+    if (!throttled) {
+        // Queue everything at once, so the block layer sees our requests in
+        // physical order.  Each disk is swept by its own worker, so disks
+        // are read in parallel.  Throttled scans are instead admitted file
+        // by file below.
+        TraceSpan populate("populate");
+        std::unordered_map<dev_t, size_t> disks;
+        std::vector<std::shared_ptr<std::vector<Read>>> disk_reads;
+        std::vector<uint64_t> disk_bytes;
+        for (const auto& read : *reads) {
+            const dev_t disk = Device(read.device).disk;
+            auto inserted = disks.emplace(disk, disk_reads.size());
+            if (inserted.second) {
+                disk_reads.emplace_back(new std::vector<Read>());
+                disk_bytes.push_back(0);
+            }
+            disk_reads[inserted.first->second]->push_back(read);
+            disk_bytes[inserted.first->second] += read.length;
+        }
+
+        std::vector<DeadlineExecutor::Task> tasks;
+        std::vector<std::shared_ptr<ResourceUsage>> usages;
+        for (const auto& disk : disks) {
+            std::shared_ptr<std::vector<Read>> sweep =
+                disk_reads[disk.second];
+            std::shared_ptr<ResourceUsage> usage(new ResourceUsage());
+            tasks.push_back({DeadlineExecutor::kNoDevice, disk.first,
+                Deadline(disk_bytes[disk.second], sweep->size()),
+                [paths, sweep, usage] {
+                    UsageSpan span(usage.get());
+                    PopulationScheduler::Populate(*paths, *sweep);
+                }});
+            usages.push_back(usage);
+        }
+        const std::vector<DeadlineExecutor::Status> statuses =
+            executor_->RunQueues(std::move(tasks), [](dev_t) -> size_t {
+                return 1;
+            });
+        for (size_t j = 0; j < statuses.size(); j++) {
+            // Abandoned sweeps may still be counting.
+            if (statuses[j] == DeadlineExecutor::Status::kOk) {
+                AccountUsage(group, PathTable::kInvalid, kPopulateUsage,
+                    *usages[j]);
+            }
+        }
+    }
+
+    std::vector<std::vector<Read>> file_reads(to_lock_.size());
+    std::vector<uint32_t> order;
+    for (const auto& read : *reads) {
+        if (file_reads[read.file].empty()) {
+            order.push_back(read.file);
+        }
+        file_reads[read.file].push_back(read);
+    }
+    for (uint32_t i = 0; i < to_lock_.size(); i++) {
+        if (file_reads[i].empty()) {
+            order.push_back(i);
+            file_reads[i].push_back({i, 0, to_lock_[i].size,
+                to_lock_[i].device, PopulationScheduler::kUnknownPhysical});
+        }
+    }
 
-        if (fd >= 0) {
-            try {
-                ElfParser elf(fd);
+    // Files are filled a batch at a time, each disk from its own queue, so
+    // that disks are read in parallel with each other, and then locked in
+    // order before their pages can be reclaimed.  Throttled scans are
+    // admitted a file at a time.
+    size_t next = 0;
+    while (next < order.size()) {
+        std::vector<uint32_t> batch;
+        std::vector<DeadlineExecutor::Task> tasks;
+        std::vector<uint32_t> task_files;
+        std::vector<std::shared_ptr<bool>> filled;
+        std::vector<std::shared_ptr<ResourceUsage>> usages;
+        std::unordered_map<dev_t, size_t> depths;
+        uint64_t batch_bytes = 0;
+        for (; next < order.size() && batch_bytes < kFillBatchBytes &&
+                !(throttled && !tasks.empty()); next++) {
+            const uint32_t i = order[next];
+            const PendingLock& pending = to_lock_[i];
+            const std::string& path = (*paths)[i];
+            batch.push_back(i);
 
-                std::string interpreter;
-                bool has_interpreter = elf.GetInterpreter(&interpreter);
-                if (has_interpreter) {
-                    pending_paths_.emplace_back(std::move(interpreter));
+            // Wait for the file to be resident before mapping it, as a
+            // thread stuck in MAP_POPULATE cannot be abandoned.
+            bool resident = false;
+            const int fd = OpenFile(path, pending.device);
+            if (fd >= 0) {
+                resident = IsCached(fd, 0, pending.size);
+                close(fd);
+            }
+            if (resident) {
+                continue;
+            }
+
+            if (throttled) {
+                ReloadIoLimits();
+                for (const auto& read : file_reads[i]) {
+                    throttle_->Read(read.device, read.length);
                 }
+            }
 
-                std::vector<std::string> deps = elf.GetLibraryDependencies();
-                pending_paths_.insert(
-                    pending_paths_.begin(), deps.begin(), deps.end());
-            } catch (ElfError& ex) {
-                // Ignore.
+            const BlockDevice& device = Device(pending.device);
+            depths[device.disk] = device.depth;
+            std::shared_ptr<bool> ok(new bool(false));
+            std::shared_ptr<ResourceUsage> usage(new ResourceUsage());
+            std::shared_ptr<std::vector<Read>> ranges(
+                new std::vector<Read>(std::move(file_reads[i])));
+            const std::string task_path = path;
+            tasks.push_back({pending.device, device.disk,
+                Deadline(pending.size), [task_path, ranges, ok, usage] {
+                    TraceSpan fill("fill", task_path);
+                    UsageSpan span(usage.get());
+                    *ok = Fill(task_path, *ranges);
+                }});
+            task_files.push_back(i);
+            filled.push_back(ok);
+            usages.push_back(usage);
+            batch_bytes += pending.size;
+        }
+
+        const std::vector<DeadlineExecutor::Status> statuses =
+            executor_->RunQueues(std::move(tasks), [&depths](dev_t disk) {
+                return depths[disk];
+            });
+        std::unordered_set<uint32_t> failed;
+        for (size_t j = 0; j < statuses.size(); j++) {
+            if (statuses[j] == DeadlineExecutor::Status::kOk) {
+                AccountUsage(group, to_lock_[task_files[j]].path,
+                    kFillUsage, *usages[j]);
+            }
+            if (statuses[j] == DeadlineExecutor::Status::kOk && *filled[j]) {
+                continue;
+            }
+            const PendingLock& pending = to_lock_[task_files[j]];
+            failed.insert(task_files[j]);
+            group->unavailable.push_back(pending.path);
+            if (statuses[j] != DeadlineExecutor::Status::kQuarantined) {
+                RecordFailure(group, pending.path,
+                    RetryScheduler::Stage::kPopulate,
+                    statuses[j] == DeadlineExecutor::Status::kOk ?
+                        EIO : ETIMEDOUT);
             }
+        }
 
-            close(fd);
+        for (uint32_t i : batch) {
+            if (failed.count(i) > 0) {
+                continue;
+            }
+            LockFilled(group, to_lock_[i], (*paths)[i]);
         }
     }
 
-    // TODO:  Insert dependencies into inotify watch.
+    to_lock_.clear();
+}
+
+void Scanner::SyncShadow(Group* group) {
+    if (!group->shadow) {
+        return;
+    }
+
+    // The locked files are resident, so copying them costs no disk reads.
+    TraceSpan sync("shadow", group->name);
+    std::vector<std::string> files;
+    files.reserve(group->locks.size());
+    group->locks.ForEach([this, &files](const LockRecord& record) {
+        files.push_back(path_table_.Get(record.path));
+    });
+    group->shadow->Sync(files);
+    for (const auto& file : group->shadow->failed()) {
+        fprintf(stderr, "Unable to shadow %s in %s.\n", file.c_str(),
+            group->shadow->root().c_str());
+    }
+}
 
-    // Lock file into memory, hold a reference to it.
-    locks_.emplace(path, mlocker_->Lock(path));
+void Scanner::WarmMetadata(size_t index) {
+    if (!warmer_) {
+        return;
+    }
+
+    const Group& group = groups_[index];
+    std::vector<std::string> files;
+    std::vector<std::string> directories;
+    if (group.locks.size() > 0) {
+        files.reserve(group.locks.size());
+        group.locks.ForEach([this, &files](const LockRecord& record) {
+            files.push_back(path_table_.Get(record.path));
+        });
+        directories.assign(
+            group.directories.begin(), group.directories.end());
+    }
+    warmer_->Set(index, files, directories);
+}
+
+void Scanner::ReportMetadataMisses() {
+    const MetadataWarmer::Stats stats = warmer_->stats();
+    const uint64_t misses = stats.listing_misses + stats.lookup_misses;
+    if (misses == reported_metadata_misses_) {
+        return;
+    }
+
+    fprintf(stderr, "Metadata warming missed the cache %llu times since "
+        "last reported (%llu in total), warming every %llds.\n",
+        static_cast<unsigned long long>(misses - reported_metadata_misses_),
+        static_cast<unsigned long long>(misses),
+        static_cast<long long>(std::chrono::duration_cast<
+            std::chrono::seconds>(warmer_->interval()).count()));
+    reported_metadata_misses_ = misses;
+}
+
+void Scanner::LockFilled(
+        Group* group, const PendingLock& pending, const std::string& path) {
+    TraceSpan lock("lock", path);
+
+    // Lock file into memory, hold a reference to it.
+    LockRecord record;
+    record.path = pending.path;
+    ResourceUsage usage;
+    // A helper holding a shard gets as long as a read of the file would.
+    mlocker_->set_reply_timeout(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            Deadline(pending.size)));
+    try {
+        UsageSpan span(&usage);
+        record.mapping = mlocker_->LockMapping(path);
+    } catch (const std::system_error& ex) {
+        // Typically ENOENT or EACCES as the file is replaced, ENOMEM or
+        // EAGAIN near RLIMIT_MEMLOCK, or ETIMEDOUT from a stuck helper.
+        const int error = ex.code().value();
+        AccountUsage(group, pending.path, kLockUsage, usage);
+        RecordFailure(
+            group, pending.path, RetryScheduler::Stage::kLock, error);
+        return;
+    }
+    AccountUsage(group, pending.path, kLockUsage, usage);
+    group->locks.Insert(record);
+    retries_.Succeed(pending.path, group - groups_.data());
+
+    // The pages are resident, so hashing them costs little I/O.  A file
+    // which changed under us is left unhashed, and so is rescanned in full
+    // when it is next touched.
+    uint64_t hash;
+    if (graph_.Contains(pending.path) &&
+            HashFile(pending.path, graph_.identity(pending.path), &hash)) {
+        graph_.SetHash(pending.path, hash);
+    }
+
+    // Pages which were already resident were placed by whoever read
+    // them first.
+    if (record.mapping.shard == 0 &&
+            (group->numa.mode == NumaPolicy::Mode::kBind ||
+             group->numa.mode == NumaPolicy::Mode::kCpu)) {
+        MigrateToNodes(
+            record.mapping.addr, record.mapping.size, group->numa.nodes);
+    }
+}
+
+bool Scanner::ScanDependencies(PathId id, int fd, const struct stat& buf,
+        ResourceUsage* usage) {
+    std::shared_ptr<Dependencies> deps(new Dependencies());
+    if (IsCached(fd, 0, buf.st_size)) {
+        // Parsing cannot block, so skip the round trip to a worker.
+        UsageSpan span(usage);
+        ReadDependencies(fd, buf, deps.get());
+        close(fd);
+    } else {
+        // The worker owns fd from here on, as it may outlive the call.
+        std::shared_ptr<ResourceUsage> worker_usage(new ResourceUsage());
+        const DeadlineExecutor::Status status = executor_->Run(buf.st_dev,
+            Deadline(0), [fd, buf, deps, worker_usage] {
+                UsageSpan span(worker_usage.get());
+                ReadDependencies(fd, buf, deps.get());
+                close(fd);
+            });
+        if (status == DeadlineExecutor::Status::kQuarantined) {
+            close(fd);
+        }
+        if (status != DeadlineExecutor::Status::kOk) {
+            return false;
+        }
+        *usage += *worker_usage;
+    }
+
+    // Each dependency is recorded in graph_ as well as being fed back into
+    // pending_paths_, so its own dependencies are discovered.
+    std::vector<DependencyGraph::Edge> edges;
+    auto depend = [this, &edges](const std::string& soname, bool is_64bit,
+            std::string path) {
+        DependencyGraph::Edge edge;
+        edge.soname = soname;
+        edge.is_64bit = is_64bit;
+        edge.target = PathTable::kInvalid;
+        if (!path.empty()) {
+            edge.target = path_table_.Intern(path);
+            Enqueue(std::move(path), walk_depth_ + 1);
+        }
+        edges.push_back(std::move(edge));
+    };
+
+    if (deps->script) {
+        // "#!/usr/bin/env foo" searches PATH for foo.
+        typedef std::vector<std::string> Paths;
+        std::shared_ptr<Paths> interpreters(new Paths());
+        const std::string search_path = search_path_;
+        if (!RunIo(DeadlineExecutor::kNoDevice,
+                [interpreters, deps, search_path] {
+                    *interpreters = ResolveShebang(deps->shebang, search_path);
+                })) {
+            return false;
+        }
+        for (auto& dep : *interpreters) {
+            depend("", false, std::move(dep));
+        }
+    } else if (deps->elf) {
+        ElfDependencies& elf = deps->libraries;
+        if (elf.has_interpreter) {
+            depend("", elf.is_64bit, std::move(elf.interpreter));
+        }
+
+        for (const auto& dep : elf.libraries) {
+            TraceSpan resolve("resolve", dep);
+            std::string resolved;
+            if (!resolver_->Resolve(dep, elf.is_64bit, &resolved)) {
+                resolved.clear();
+            }
+            depend(dep, elf.is_64bit, std::move(resolved));
+        }
+    }
+
+    graph_.Set(id, DependencyGraph::Identity::Of(buf), std::move(edges),
+        path_table_.Parent(id));
+    return true;
+}
+
+void Scanner::AccountUsage(Group* group, PathId id, UsageStage stage,
+        const ResourceUsage& usage) {
+    if (!ResourceCounters::enabled()) {
+        return;
+    }
+    if (group != nullptr) {
+        group->usage[stage] += usage;
+    }
+    if (id != PathTable::kInvalid) {
+        file_usage_[id] += usage;
+    }
+}
+
+void Scanner::PrintUsage(FILE* out) const {
+    static const char* const kStageNames[kUsageStages] = {
+        "parse", "populate", "fill", "lock",
+    };
+    auto print = [out](const ResourceUsage& usage) {
+        fprintf(out, "%llu bytes read, %llu major faults, %llu minor "
+            "faults, %llu context switches, %.3fs CPU",
+            static_cast<unsigned long long>(usage.read_bytes),
+            static_cast<unsigned long long>(usage.major_faults),
+            static_cast<unsigned long long>(usage.minor_faults),
+            static_cast<unsigned long long>(usage.context_switches),
+            usage.cpu_ns / 1e9);
+    };
+
+    fprintf(out, "Resource usage (%s):\n", ResourceCounters::Source());
+    for (const auto& group : groups_) {
+        fprintf(out, "  Group %s:\n", group.name.c_str());
+        for (int stage = 0; stage < kUsageStages; stage++) {
+            fprintf(out, "    %s: ", kStageNames[stage]);
+            print(group.usage[stage]);
+            fprintf(out, "\n");
+        }
+    }
+
+    // The files which caused the most I/O.
+    std::vector<std::pair<PathId, const ResourceUsage*>> files;
+    for (const auto& file : file_usage_) {
+        if (file.second.read_bytes > 0 || file.second.major_faults > 0) {
+            files.emplace_back(file.first, &file.second);
+        }
+    }
+    const size_t top = std::min<size_t>(files.size(), kTopUsageFiles);
+    std::partial_sort(files.begin(), files.begin() + top, files.end(),
+        [](const std::pair<PathId, const ResourceUsage*>& a,
+                const std::pair<PathId, const ResourceUsage*>& b) {
+            return a.second->read_bytes != b.second->read_bytes ?
+                a.second->read_bytes > b.second->read_bytes :
+                a.second->major_faults > b.second->major_faults;
+        });
+    if (top > 0) {
+        fprintf(out, "  Files reading the most (of %zu):\n", files.size());
+    }
+    for (size_t i = 0; i < top; i++) {
+        fprintf(out, "    %s: ", path_table_.Get(files[i].first).c_str());
+        print(*files[i].second);
+        fprintf(out, "\n");
+    }
+}
+
+const BlockDevice& Scanner::Device(dev_t device) {
+    auto it = devices_.find(device);
+    if (it == devices_.end()) {
+        it = devices_.emplace(device, DescribeBlockDevice(device)).first;
+    }
+    return it->second;
+}
+
+DeadlineExecutor::Clock::duration Scanner::Deadline(
+        uint64_t bytes, size_t files) const {
+    return io_deadline_ + files * kMaxOpenTime +
+        std::chrono::duration_cast<DeadlineExecutor::Clock::duration>(
+            std::chrono::duration<double>(
+                static_cast<double>(bytes) / kMinBytesPerSecond));
+}
+
+bool Scanner::RunIo(dev_t device, std::function<void()> task) {
+    return executor_->Run(device, Deadline(0), std::move(task)) ==
+        DeadlineExecutor::Status::kOk;
+}
+
+int Scanner::OpenFile(const std::string& path, dev_t device) {
+    struct Open {
+        int fd = -1;
+        int error = 0;
+        // Set by whichever of the opener and the caller is done first, so
+        // that the other closes fd if the caller gave up on it.
+        std::atomic<bool> done{false};
+    };
+    std::shared_ptr<Open> open_file(new Open());
+    const bool ok = RunIo(device, [open_file, path] {
+        int fd;
+        do {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        open_file->fd = fd;
+        open_file->error = errno;
+        if (open_file->done.exchange(true) && fd >= 0) {
+            close(fd);
+        }
+    });
+    if (!ok) {
+        if (open_file->done.exchange(true) && open_file->fd >= 0) {
+            close(open_file->fd);
+        }
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    if (open_file->fd < 0) {
+        errno = open_file->error;
+    }
+    return open_file->fd;
+}
+
+bool Scanner::StatFile(const std::string& path, struct stat* buf) {
+    struct Stat {
+        struct stat buf;
+        int error = 0;
+    };
+    std::shared_ptr<Stat> result(new Stat());
+    if (!RunIo(DeadlineExecutor::kNoDevice, [result, path] {
+                if (lstat(path.c_str(), &result->buf) != 0) {
+                    result->error = errno;
+                }
+            })) {
+        errno = ETIMEDOUT;
+        return false;
+    } else if (result->error != 0) {
+        errno = result->error;
+        return false;
+    }
+    *buf = result->buf;
+    return true;
+}
+
+void Scanner::RecordFailure(const Group* group, PathId id,
+        RetryScheduler::Stage stage, int error) {
+    const uint32_t index = static_cast<uint32_t>(group - groups_.data());
+    const RetryScheduler::Failure* previous = retries_.Find(id, index);
+    const bool given_up = previous != nullptr && previous->given_up;
+    if (!retries_.Fail(id, index, stage, error,
+            RetryScheduler::Clock::now()) && !given_up) {
+        const RetryScheduler::Failure* failure = retries_.Find(id, index);
+        fprintf(stderr, "Giving up on %s after %u attempts:  %s: %s\n",
+            path_table_.Get(id).c_str(), failure->attempts,
+            RetryScheduler::StageName(stage), strerror(error));
+    }
+}
+
+void Scanner::RetryFailed(RetryScheduler::Clock::time_point now) {
+    typedef DependencyGraph::Identity Identity;
+
+    const std::vector<RetryScheduler::Failure> due = retries_.Due(now);
+    uint64_t groups = 0;
+    std::unordered_set<PathId> replaced;
+    for (const auto& failure : due) {
+        const Group& group = groups_[failure.group];
+        if (group.mode == Mode::kWarm &&
+                applied_level_ != PressureMonitor::Level::kLock) {
+            continue;
+        }
+        groups |= static_cast<uint64_t>(1) << failure.group;
+
+        // Reparse the file if it has changed since we recorded it.
+        const std::string path = path_table_.Get(failure.path);
+        struct stat buf;
+        if (!graph_.Contains(failure.path)) {
+            Enqueue(path, 0);
+        } else if (StatFile(path, &buf) &&
+                graph_.identity(failure.path) != Identity::Of(buf)) {
+            replaced.insert(failure.path);
+            Enqueue(path, 0);
+        }
+    }
+    if (groups != 0) {
+        TraceSpan retry("retry");
+        ReconcileClosures(groups, replaced);
+    }
+
+    // Failures which did not recur have succeeded, or are no longer needed.
+    for (const auto& failure : due) {
+        const RetryScheduler::Failure* current =
+            retries_.Find(failure.path, failure.group);
+        if (current != nullptr && current->attempts == failure.attempts) {
+            retries_.Succeed(failure.path, failure.group);
+        }
+    }
+}
+
+bool Scanner::ContentUnchanged(
+        PathId id, const DependencyGraph::Identity& identity) {
+    if (!graph_.Contains(id) || graph_.hash(id) == 0) {
+        return false;
+    }
+    const DependencyGraph::Identity& previous = graph_.identity(id);
+    if (previous.device != identity.device ||
+            previous.inode != identity.inode ||
+            previous.size != identity.size) {
+        return false;
+    }
+
+    bool locked = false;
+    for (const auto& group : groups_) {
+        if (group.locks.Find(id) != nullptr) {
+            locked = true;
+            break;
+        }
+    }
+    if (!locked) {
+        return false;
+    }
+
+    // Pages dropped by rewriting the file in place would also be faulted back
+    // in on this thread, were it hashed through our mapping.
+    uint64_t hash;
+    return HashFile(id, identity, &hash) && hash == graph_.hash(id);
+}
+
+bool Scanner::HashFile(PathId id, const DependencyGraph::Identity& identity,
+        uint64_t* hash) {
+    struct Hashed {
+        bool ok = false;
+        uint64_t hash = 0;
+    };
+    std::shared_ptr<Hashed> hashed(new Hashed());
+    const std::string path = path_table_.Get(id);
+    TraceSpan span("hash", path);
+    const DeadlineExecutor::Status status = executor_->Run(identity.device,
+        Deadline(static_cast<uint64_t>(identity.size)),
+        [hashed, path, identity] {
+            int fd;
+            do {
+                fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            } while (fd < 0 && errno == EINTR);
+            if (fd < 0) {
+                return;
+            }
+            struct stat buf;
+            if (fstat(fd, &buf) == 0 && buf.st_dev == identity.device &&
+                    buf.st_ino == identity.inode &&
+                    buf.st_size == identity.size) {
+                hashed->ok = ContentHashFile(fd,
+                    static_cast<uint64_t>(identity.size), &hashed->hash);
+            }
+            close(fd);
+        });
+    if (status != DeadlineExecutor::Status::kOk || !hashed->ok) {
+        return false;
+    }
+    *hash = hashed->hash;
+    return true;
+}
+
+void Scanner::Enqueue(std::string path, uint32_t depth) {
+    PendingPath pending;
+    pending.path = std::move(path);
+    pending.depth = depth;
+    pending.sequence = pending_sequence_++;
+    pending_paths_.push(std::move(pending));
+}
+
+void Scanner::TierReady(int priority) const {
+    size_t files = 0;
+    for (const auto& group : groups_) {
+        if (group.mode == Mode::kPinned && group.priority == priority) {
+            files += group.locks.size();
+        }
+    }
+
+    const double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - run_start_).count();
+    fprintf(stderr, "Priority %d resident after %.2fs: %zu files\n",
+        priority, elapsed, files);
+    NotifyServiceManager("STATUS=Priority " + std::to_string(priority) +
+        " resident");
+}
+
+bool Scanner::IsPinned(PathId path) const {
+    for (const auto& group : groups_) {
+        if (group.mode == Mode::kPinned && group.locks.Find(path) != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scanner::Release(LockTable* locks) {
+    locks->ForEach([this](const LockRecord& record) {
+        mlocker_->Unlock(record.mapping);
+    });
+    locks->Clear();
+}
+
+void Scanner::PrintReport(FILE* out) const {
+    size_t files = 0;
+    size_t bytes = 0;
+    size_t overhead = path_table_.MemoryUsage();
+    const bool numa = OnlineNumaNodes().size() > 1;
+    for (const auto& group : groups_) {
+        size_t group_bytes = 0;
+        group.locks.ForEach([&group_bytes](const LockRecord& record) {
+            group_bytes += record.mapping.size;
+        });
+
+        fprintf(out, "Group %s: %zu files, %zu bytes locked\n",
+            group.name.c_str(), group.locks.size(), group_bytes);
+        if (!group.unavailable.empty()) {
+            fprintf(out, "  %zu files unavailable, their devices failed or "
+                "timed out\n", group.unavailable.size());
+        }
+        if (group.shadow) {
+            fprintf(out, "  Shadowed in %s: %zu files, %llu bytes, %zu bound; "
+                "rescue environment in %s\n", group.shadow->root().c_str(),
+                group.shadow->size(),
+                static_cast<unsigned long long>(group.shadow->bytes()),
+                group.shadow->bound(),
+                group.shadow->RescueEnvironment().c_str());
+            for (const auto& file : group.shadow->privileged()) {
+                fprintf(out, "    %s not bound, as it is setuid, setgid or "
+                    "has file capabilities\n", file.c_str());
+            }
+        }
+
+        if (numa || group.numa.mode != NumaPolicy::Mode::kDefault) {
+            // The placement of helpers' mappings is not visible to us.
+            std::vector<uint64_t> node_bytes;
+            size_t helper_bytes = 0;
+            group.locks.ForEach([&](const LockRecord& record) {
+                if (record.mapping.shard == 0) {
+                    CountNodeBytes(record.mapping.addr, record.mapping.size,
+                        &node_bytes);
+                } else {
+                    helper_bytes += record.mapping.size;
+                }
+            });
+
+            fprintf(out, "  By node:");
+            for (size_t node = 0; node < node_bytes.size(); node++) {
+                if (node_bytes[node] > 0) {
+                    fprintf(out, " %zu: %llu bytes;", node,
+                        static_cast<unsigned long long>(node_bytes[node]));
+                }
+            }
+            fprintf(out, " in helpers: %zu bytes\n", helper_bytes);
+        }
+        files += group.locks.size();
+        bytes += group_bytes;
+        overhead += group.locks.MemoryUsage();
+    }
+
+    fprintf(out, "Total: %zu files, %zu bytes locked; %zu paths interned, "
+        "%zu bytes of tracking overhead (%.1f bytes/file)\n",
+        files, bytes, path_table_.size(), overhead,
+        files > 0 ? static_cast<double>(overhead) / files : 0.);
+    fprintf(out, "Dependency graph: %zu files, %zu bytes\n", graph_.size(),
+        graph_.MemoryUsage());
+    fprintf(out, "Watching %zu directories: %zu with inotify, %zu by polling "
+        "(%zu bytes of snapshot)\n", watched_directories_.size(),
+        inotify_directories_, poller_->size(), poller_->MemoryUsage());
+    if (retries_.size() > 0) {
+        fprintf(out, "Failed files: %zu awaiting retry, %zu given up\n",
+            retries_.size() - retries_.given_up(), retries_.given_up());
+        retries_.ForEach([this, out](const RetryScheduler::Failure& failure) {
+            if (failure.given_up) {
+                fprintf(out, "  %s (group %s): %s: %s, %u attempts\n",
+                    path_table_.Get(failure.path).c_str(),
+                    groups_[failure.group].name.c_str(),
+                    RetryScheduler::StageName(failure.stage),
+                    strerror(failure.error), failure.attempts);
+            }
+        });
+    }
+    if (executor_->timeouts() > 0) {
+        fprintf(out, "I/O deadlines missed: %zu; quarantined devices:",
+            executor_->timeouts());
+        for (dev_t device : executor_->quarantined()) {
+            fprintf(out, " %u:%u", major(device), minor(device));
+        }
+        fprintf(out, "%s\n", executor_->quarantined().empty() ? " none" : "");
+    }
+    if (!devices_.empty()) {
+        // Partitions sharing a disk share its queue.
+        std::unordered_set<dev_t> disks;
+        fprintf(out, "Device queues:");
+        for (const auto& device : devices_) {
+            const BlockDevice& block = device.second;
+            if (!disks.insert(block.disk).second) {
+                continue;
+            }
+            fprintf(out, "%s %s%s%u:%u%s depth %zu%s", disks.size() > 1 ?
+                ";" : "", block.name.c_str(), block.name.empty() ? "" : " (",
+                major(block.disk), minor(block.disk),
+                block.name.empty() ? "" : ")", block.depth,
+                block.rotational ? ", rotational" : "");
+        }
+        fprintf(out, "\n");
+    }
+    if (warmer_) {
+        const MetadataWarmer::Stats stats = warmer_->stats();
+        fprintf(out, "Metadata warming: %zu directories, %zu components, "
+            "every %llds; %llu passes, %llu/%llu listings and %llu/%llu "
+            "lookups missed the cache, latest pass %lldms\n",
+            warmer_->directories(), warmer_->components(),
+            static_cast<long long>(std::chrono::duration_cast<
+                std::chrono::seconds>(warmer_->interval()).count()),
+            static_cast<unsigned long long>(stats.passes),
+            static_cast<unsigned long long>(stats.listing_misses),
+            static_cast<unsigned long long>(stats.listings),
+            static_cast<unsigned long long>(stats.lookup_misses),
+            static_cast<unsigned long long>(stats.lookups),
+            static_cast<long long>(std::chrono::duration_cast<
+                std::chrono::milliseconds>(stats.last_pass).count()));
+    }
+    if (ResourceCounters::enabled()) {
+        PrintUsage(out);
+    }
+    PrintKernelFeatures(out);
+    PrintSelfProtection(out);
+    mlocker_->PrintReport(out);
+}
+
+void Scanner::ApplyPressure(PressureMonitor::Level level) {
+    if (level == applied_level_) {
+        return;
+    }
+
+    for (auto& group : groups_) {
+        if (group.mode != Mode::kWarm) {
+            continue;
+        }
+
+        switch (level) {
+            case PressureMonitor::Level::kNone:
+                Release(&group.locks);
+                retries_.Forget(&group - groups_.data());
+                WarmMetadata(&group - groups_.data());
+                break;
+            case PressureMonitor::Level::kPrefetch:
+                // When stepping down from kLock, the contents are already
+                // resident, so releasing our locks is sufficient.
+                Release(&group.locks);
+                retries_.Forget(&group - groups_.data());
+                WarmMetadata(&group - groups_.data());
+                if (applied_level_ == PressureMonitor::Level::kNone) {
+                    Scan(&group, Action::kPrefetch);
+                }
+                break;
+            case PressureMonitor::Level::kLock:
+                Scan(&group, Action::kLock);
+                break;
+        }
+    }
+
+    applied_level_ = level;
+}
+
+void Scanner::RefreshRuntimeModules() {
+    const bool x64 = sizeof(void*) == 8;
+
+    if (plugins_.empty()) {
+        // Run could not create them in time.
+        if (!LoadRuntimeModulePlugins()) {
+            return;
+        }
+        WatchConfig();
+    }
+
+    // The plugins read their configuration, from /etc and the library
+    // directories.
+    typedef std::vector<std::string> Modules;
+    std::shared_ptr<Modules> found(new Modules());
+    const auto plugins = plugins_;
+    if (!RunIo(DeadlineExecutor::kNoDevice, [found, plugins] {
+                for (const auto& plugin : plugins) {
+                    for (auto& module : plugin->Modules()) {
+                        found->push_back(std::move(module));
+                    }
+                }
+            })) {
+        fprintf(stderr, "Timed out reading the runtime modules' "
+            "configuration, keeping those locked.\n");
+        return;
+    }
+
+    std::vector<std::string> modules;
+    for (auto& module : *found) {
+        if (module.find('/') == std::string::npos) {
+            // A soname, as used by NSS.
+            std::string resolved;
+            if (!resolver_->Resolve(module, x64, &resolved)) {
+                continue;
+            }
+            module = std::move(resolved);
+        }
+        modules.push_back(std::move(module));
+    }
+
+    Group& group = groups_[runtime_modules_group_];
+    group.paths = std::move(modules);
+    Rescan(&group);
+}
+
+bool Scanner::LoadRuntimeModulePlugins() {
+    // The gconv plugin probes the library directories for its configuration.
+    typedef std::vector<std::unique_ptr<RuntimeModulePlugin>> Plugins;
+    std::shared_ptr<Plugins> plugins(new Plugins());
+    const std::vector<std::string> directories = resolver_->directories();
+    if (!RunIo(DeadlineExecutor::kNoDevice, [plugins, directories] {
+                *plugins = DefaultRuntimeModulePlugins(directories);
+            })) {
+        fprintf(stderr, "Timed out probing for runtime module "
+            "configuration, trying again on the next change.\n");
+        return false;
+    }
+
+    for (auto& plugin : *plugins) {
+        plugins_.emplace_back(std::move(plugin));
+    }
+    return true;
+}
+
+void Scanner::Rescan(Group* group) {
+    Scan(group, Action::kLock);
+}
+
+void Scanner::WatchGroup(size_t index) {
+    std::unordered_set<PathId> parents;
+    groups_[index].locks.ForEach([&](const LockRecord& record) {
+        parents.insert(path_table_.Parent(record.path));
+    });
+    for (PathId parent : parents) {
+        if (parent != PathTable::kInvalid) {
+            Watch(path_table_.Get(parent), index);
+        }
+    }
+
+    for (const auto& directory : walked_directories_) {
+        Watch(directory, index);
+    }
+    walked_directories_.clear();
+}
+
+void Scanner::Watch(const std::string& directory, size_t index) {
+    uint64_t& groups = watched_directories_[directory];
+    const bool added = groups == 0;
+    groups |= static_cast<uint64_t>(1) << index;
+    if (!added) {
+        return;
+    }
+
+    // Watches fail once fs.inotify.max_user_watches is exhausted.  A
+    // filesystem too slow to say what it is gets polled.
+    std::shared_ptr<bool> remote(new bool(true));
+    const bool probed = RunIo(DeadlineExecutor::kNoDevice,
+        [remote, directory] { *remote = IsRemoteFilesystem(directory); });
+    if (probed && !*remote && watcher_->Add(directory)) {
+        inotify_directories_++;
+    } else if (!poller_->Add(directory)) {
+        // Try again on the next rescan.
+        watched_directories_.erase(directory);
+    }
+}
+
+void Scanner::DirectoryChanged(const std::string& directory) {
+    if (config_directories_.count(directory) > 0) {
+        MarkChanged();
+        config_changed_ = true;
+    }
+
+    WatchedDirectoryChanged(directory);
+}
+
+void Scanner::WatchedDirectoryChanged(const std::string& directory) {
+    auto it = watched_directories_.find(directory);
+    if (it != watched_directories_.end()) {
+        MarkChanged();
+        changed_groups_ |= it->second;
+        changed_directories_.insert(directory);
+    }
+}
+
+void Scanner::MarkChanged() {
+    const auto now = std::chrono::steady_clock::now();
+    if (!changes_pending_) {
+        changes_pending_ = true;
+        first_change_ = now;
+    }
+    last_change_ = now;
+}
+
+void Scanner::RescanChanged() {
+    // A change to the search path or its directories may resolve sonames
+    // differently, in any group.
+    bool libraries_changed = config_changed_ || changes_lost_;
+    for (const auto& directory : resolver_->directories()) {
+        libraries_changed |= changed_directories_.count(directory) > 0;
+    }
+    if (libraries_changed) {
+        resolver_->Reload();
+        ResolveSonames();
+    }
+
+    if (config_changed_ && runtime_modules_group_ != kNoGroup) {
+        changed_groups_ |= static_cast<uint64_t>(1) << runtime_modules_group_;
+    }
+
+    uint64_t incremental = 0;
+    for (size_t i = 0; i < groups_.size(); i++) {
+        const uint64_t bit = static_cast<uint64_t>(1) << i;
+        Group& group = groups_[i];
+        if (i == runtime_modules_group_) {
+            if (changed_groups_ & bit) {
+                RefreshRuntimeModules();
+            }
+            continue;
+        } else if (group.mode != Mode::kPinned) {
+            // Warm groups are only rescanned while they are locked.
+            if ((changed_groups_ & bit) &&
+                    applied_level_ == PressureMonitor::Level::kLock) {
+                Rescan(&group);
+            }
+            continue;
+        }
+
+        // Entries added to or removed from the trees we walked call for a
+        // rescan.  Otherwise, the dependency graph tells us what changed.
+        bool tree_changed = changes_lost_;
+        for (const auto& directory : changed_directories_) {
+            tree_changed |= group.directories.count(directory) > 0;
+        }
+
+        if ((changed_groups_ & bit) && tree_changed) {
+            Rescan(&group);
+        } else if ((changed_groups_ & bit) || libraries_changed) {
+            incremental |= bit;
+        }
+    }
+    if (incremental != 0) {
+        UpdateClosures(incremental);
+    }
+
+    changed_groups_ = 0;
+    config_changed_ = false;
+    changes_lost_ = false;
+    changed_directories_.clear();
+    changes_pending_ = false;
+}
+
+void Scanner::UpdateClosures(uint64_t groups) {
+    typedef DependencyGraph::Identity Identity;
+
+    // Only the files in changed directories can have been replaced.  A
+    // directory never interned holds nothing we know of.
+    std::unordered_set<PathId> changed;
+    std::unordered_set<PathId> candidates;
+    for (const auto& directory : changed_directories_) {
+        const PathId id = path_table_.Find(directory);
+        if (id != PathTable::kInvalid) {
+            changed.insert(id);
+            graph_.ForEachFileIn(id, [&candidates](PathId file) {
+                candidates.insert(file);
+            });
+        }
+    }
+    auto in_changed_directory = [this, &changed](PathId file) {
+        return changed.count(path_table_.Parent(file)) > 0;
+    };
+    for (size_t i = 0; i < groups_.size(); i++) {
+        if ((groups & (static_cast<uint64_t>(1) << i)) == 0) {
+            continue;
+        }
+        for (PathId root : groups_[i].roots) {
+            if (!graph_.Contains(root) && in_changed_directory(root)) {
+                candidates.insert(root);
+            }
+        }
+    }
+
+    std::unordered_set<PathId> replaced;
+    for (PathId file : candidates) {
+        const std::string path = path_table_.Get(file);
+        struct stat buf;
+        if (!StatFile(path, &buf) || !S_ISREG(buf.st_mode)) {
+            // Any group still needing it records the failure.
+            graph_.Remove(file);
+            Enqueue(path, 0);
+            continue;
+        }
+
+        const Identity identity = Identity::Of(buf);
+        if (graph_.Contains(file) && graph_.identity(file) == identity) {
+            continue;
+        } else if (ContentUnchanged(file, identity)) {
+            // Touched, but not modified.
+            graph_.SetIdentity(file, identity);
+            continue;
+        }
+        replaced.insert(file);
+        Enqueue(path, 0);
+    }
+
+    // Pick up libraries which are new, or have reappeared.
+    graph_.ForEachSoname([this](const std::string&, bool, PathId target) {
+        if (target != PathTable::kInvalid && !graph_.Contains(target)) {
+            Enqueue(path_table_.Get(target), 0);
+        }
+    });
+
+    ReconcileClosures(groups, replaced);
+}
+
+void Scanner::ReconcileClosures(
+        uint64_t groups, const std::unordered_set<PathId>& replaced) {
+    typedef DependencyGraph::Identity Identity;
+
+    // Parse the replaced files and any dependencies new to the graph,
+    // noting those which fail for the groups needing them.
+    struct Failure {
+        RetryScheduler::Stage stage;
+        int error;
+    };
+    std::unordered_map<PathId, Failure> failed;
+    std::unordered_set<PathId> parsed;
+    // The parses' resource usage is accounted to each group needing them.
+    std::unordered_map<PathId, ResourceUsage> parse_usage;
+    walk_depth_ = 0;
+    while (!pending_paths_.empty()) {
+        const std::string path = pending_paths_.top().path;
+        pending_paths_.pop();
+
+        const PathId id = path_table_.Intern(path);
+        if ((graph_.Contains(id) && replaced.count(id) == 0) ||
+                !parsed.insert(id).second) {
+            continue;
+        }
+
+        struct stat buf;
+        if (!StatFile(path, &buf)) {
+            graph_.Remove(id);
+            failed[id] = {RetryScheduler::Stage::kOpen, errno};
+            continue;
+        } else if (!S_ISREG(buf.st_mode) ||
+                executor_->IsQuarantined(buf.st_dev)) {
+            graph_.Remove(id);
+            continue;
+        }
+
+        ReloadIoLimits();
+        throttle_->Open();
+
+        const int fd = OpenFile(path, buf.st_dev);
+        if (fd < 0) {
+            graph_.Remove(id);
+            if (!executor_->IsQuarantined(buf.st_dev)) {
+                failed[id] = {RetryScheduler::Stage::kOpen, errno};
+            }
+            continue;
+        }
+        TraceSpan parse("parse", path);
+        ResourceUsage usage;
+        const bool ok = ScanDependencies(id, fd, buf, &usage);
+        AccountUsage(nullptr, id, kParseUsage, usage);
+        if (ResourceCounters::enabled()) {
+            parse_usage[id] = usage;
+        }
+        if (!ok) {
+            graph_.Remove(id);
+            if (!executor_->IsQuarantined(buf.st_dev)) {
+                failed[id] = {RetryScheduler::Stage::kParse, ETIMEDOUT};
+            }
+        }
+    }
+
+    // Lock or unlock the difference in each group's closure.
+    for (size_t i = 0; i < groups_.size(); i++) {
+        if ((groups & (static_cast<uint64_t>(1) << i)) == 0) {
+            continue;
+        }
+
+        Group& group = groups_[i];
+        const std::vector<PathId> closure = graph_.Closure(group.roots);
+        const std::unordered_set<PathId> members(
+            closure.begin(), closure.end());
+        for (const auto& usage : parse_usage) {
+            if (members.count(usage.first) > 0) {
+                group.usage[kParseUsage] += usage.second;
+            }
+        }
+
+        if (!failed.empty()) {
+            auto needed = [&](PathId file) {
+                auto it = failed.find(file);
+                if (it != failed.end()) {
+                    RecordFailure(
+                        &group, file, it->second.stage, it->second.error);
+                }
+            };
+            for (PathId root : group.roots) {
+                needed(root);
+            }
+            for (PathId file : closure) {
+                for (const auto& edge : graph_.edges(file)) {
+                    needed(edge.target);
+                }
+            }
+        }
+
+        // Replaced files are relocked before their old mappings go.
+        std::vector<LockRecord> stale;
+        group.locks.ForEach([&](const LockRecord& record) {
+            if (members.count(record.path) == 0 ||
+                    replaced.count(record.path) > 0) {
+                stale.push_back(record);
+            }
+        });
+        for (const auto& record : stale) {
+            group.locks.Erase(record.path, nullptr);
+        }
+
+        group.unavailable.clear();
+        for (PathId file : closure) {
+            if (group.locks.Find(file) != nullptr) {
+                continue;
+            }
+
+            const Identity& identity = graph_.identity(file);
+            if (executor_->IsQuarantined(identity.device)) {
+                group.unavailable.push_back(file);
+                continue;
+            }
+
+            PendingLock pending;
+            pending.path = file;
+            pending.device = identity.device;
+            pending.size = static_cast<uint64_t>(identity.size);
+            to_lock_.push_back(pending);
+        }
+
+        LockPending(&group);
+        for (const auto& record : stale) {
+            mlocker_->Unlock(record.mapping);
+        }
+        SyncShadow(&group);
+        WatchGroup(i);
+        WarmMetadata(i);
+    }
+}
+
+void Scanner::ResolveSonames() {
+    // Each soname is resolved once, rather than once per file needing it.
+    std::vector<std::pair<std::string, bool>> sonames;
+    graph_.ForEachSoname([&sonames](const std::string& soname,
+            bool is_64bit, PathId) {
+        sonames.emplace_back(soname, is_64bit);
+    });
+    for (const auto& soname : sonames) {
+        TraceSpan resolve("resolve", soname.first);
+        std::string resolved;
+        PathId target = PathTable::kInvalid;
+        if (resolver_->Resolve(soname.first, soname.second, &resolved)) {
+            target = path_table_.Intern(resolved);
+        }
+        graph_.Retarget(soname.first, soname.second, target);
+    }
+}
+
+void Scanner::WatchConfig() {
+    std::vector<std::string> paths = resolver_->ConfigPaths();
+    for (const auto& plugin : plugins_) {
+        for (auto& path : plugin->ConfigPaths()) {
+            paths.push_back(std::move(path));
+        }
+    }
+
+    // A path we cannot stat in time is taken to be a file.
+    std::shared_ptr<std::vector<bool>> probed(
+        new std::vector<bool>(paths.size(), false));
+    std::vector<bool> is_directory(paths.size(), false);
+    if (RunIo(DeadlineExecutor::kNoDevice, [probed, paths] {
+                for (size_t i = 0; i < paths.size(); i++) {
+                    struct stat buf;
+                    (*probed)[i] = stat(paths[i].c_str(), &buf) == 0 &&
+                        S_ISDIR(buf.st_mode);
+                }
+            })) {
+        is_directory = *probed;
+    }
+
+    std::unordered_set<std::string> directories;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::string& path = paths[i];
+        if (is_directory[i]) {
+            // Changes to any entry of a configuration directory count.
+            directories.insert(path);
+        } else {
+            // Watch the parent, as files are often replaced by renaming.
+            const size_t slash = path.rfind('/');
+            if (slash == std::string::npos || slash == 0) {
+                directories.insert("/");
+            } else {
+                directories.insert(path.substr(0, slash));
+            }
+        }
+        config_paths_.insert(std::move(path));
+    }
+
+    for (const auto& directory : directories) {
+        if (!watcher_->Add(directory) && !poller_->Add(directory)) {
+            fprintf(stderr, "Unable to watch %s, changes to it will not be "
+                "noticed.\n", directory.c_str());
+        }
+        config_directories_.insert(directory);
+    }
+}
+
+void Scanner::Upgrade() {
+    // Once the binary has been replaced on disk, our link reads
+    // "<path> (deleted)", but path names the new binary.
+    char link[PATH_MAX];
+    const ssize_t length = readlink("/proc/self/exe", link, sizeof(link));
+    if (length < 0 || length == sizeof(link)) {
+        perror("Unable to find our binary");
+        return;
+    }
+    std::string binary(link, length);
+    static const char kDeleted[] = " (deleted)";
+    const size_t suffix = sizeof(kDeleted) - 1;
+    if (binary.size() > suffix &&
+            binary.compare(binary.size() - suffix, suffix, kDeleted) == 0) {
+        binary.resize(binary.size() - suffix);
+    }
+
+    // Record the identity of each locked file, preferring that of the
+    // mapping itself, as the path may have been replaced since.
+    const std::vector<MappedFile> files = ReadMappedFiles();
+    std::vector<LockedRegion> regions;
+    std::vector<HandoffRecord> records;
+    for (const auto& group : groups_) {
+        group.locks.ForEach([&](const LockRecord& lock) {
+            HandoffRecord record;
+            record.group = group.name;
+            record.path = path_table_.Get(lock.path);
+            record.size = lock.mapping.size;
+
+            bool identified = false;
+            if (lock.mapping.shard == 0 && lock.mapping.addr != nullptr) {
+                LockedRegion region;
+                region.addr = lock.mapping.addr;
+                region.size = lock.mapping.size;
+                regions.push_back(region);
+
+                const uintptr_t addr =
+                    reinterpret_cast<uintptr_t>(lock.mapping.addr);
+                auto it = std::lower_bound(files.begin(), files.end(), addr,
+                    [](const MappedFile& file, uintptr_t a) {
+                        return file.start < a;
+                    });
+                if (it != files.end() && it->start == addr) {
+                    record.device = it->device;
+                    record.inode = it->inode;
+                    identified = true;
+                }
+            }
+
+            if (!identified) {
+                struct stat buf;
+                if (stat(record.path.c_str(), &buf) != 0) {
+                    return;
+                }
+                record.device = buf.st_dev;
+                record.inode = buf.st_ino;
+            }
+            records.push_back(std::move(record));
+        });
+    }
+
+    int fd;
+    pid_t holder;
+    if (!StartHandoffHolder(regions, mlocker_->helpers(), records,
+            static_cast<int>(applied_level_), &fd, &holder)) {
+        fprintf(stderr, "Unable to start a holder, not upgrading.\n");
+        return;
+    }
+
+    fprintf(stderr, "Upgrading to %s, %zu files held by pid %d.\n",
+        binary.c_str(), records.size(), static_cast<int>(holder));
+    WriteTrace();
+    fflush(stderr);
+
+    std::vector<std::string> args;
+    args.push_back(binary);
+    args.insert(args.end(), upgrade_args_.begin(), upgrade_args_.end());
+    args.push_back("--handoff=" + std::to_string(fd) + "," +
+        std::to_string(holder));
+
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    execv(binary.c_str(), argv.data());
+
+    // We still hold our locks, so the holder may simply be released.  Our
+    // helpers remain ours.
+    perror("Unable to execute the new binary");
+    Handoff handoff;
+    handoff.fd = fd;
+    handoff.holder = holder;
+    ReleaseHandoff(&handoff);
+}
+
+void Scanner::CompleteHandoff() {
+    if (handoff_.fd < 0) {
+        return;
+    }
+
+    size_t relocked = 0;
+    size_t changed = 0;
+    size_t dropped = 0;
+    for (const auto& record : handoff_.records) {
+        const PathId id = path_table_.Find(record.path);
+        bool locked = false;
+        for (const auto& group : groups_) {
+            if (id != PathTable::kInvalid &&
+                    group.locks.Find(id) != nullptr) {
+                locked = true;
+                break;
+            }
+        }
+
+        struct stat buf;
+        if (!locked) {
+            // No longer in any group we lock, e.g. as our configuration
+            // changed.
+            dropped++;
+        } else if (stat(record.path.c_str(), &buf) == 0 &&
+                buf.st_dev == record.device && buf.st_ino == record.inode) {
+            relocked++;
+        } else {
+            changed++;
+        }
+    }
+
+    fprintf(stderr, "Handoff: %zu files inherited, %zu relocked, %zu "
+        "replaced on disk, %zu no longer locked\n",
+        handoff_.records.size(), relocked, changed, dropped);
+    ReleaseHandoff(&handoff_);
+    handoff_.records.clear();
+}
+
+void Scanner::ReloadIoLimits() {
+    if (!throttle_->TakeReloadRequest() || io_limits_file_.empty()) {
+        return;
+    }
+
+    struct Read {
+        IoThrottle::Limits limits;
+        std::string error;
+        bool ok = false;
+    };
+    std::shared_ptr<Read> read(new Read());
+    const std::string path = io_limits_file_;
+    if (!RunIo(DeadlineExecutor::kNoDevice, [read, path] {
+                read->ok = ReadIoLimits(path, &read->limits, &read->error);
+            })) {
+        fprintf(stderr, "Timed out reading %s, keeping the current I/O "
+            "limits.\n", path.c_str());
+        return;
+    } else if (!read->ok) {
+        fprintf(stderr, "%s, keeping the current I/O limits.\n",
+            read->error.c_str());
+        return;
+    }
+
+    const IoThrottle::Limits& limits = read->limits;
+    throttle_->SetLimits(limits);
+    fprintf(stderr, "I/O limits reloaded:  %llu bytes/s, %llu bytes/s per "
+        "device, %llu files/s (0 is unlimited).\n",
+        static_cast<unsigned long long>(limits.bytes),
+        static_cast<unsigned long long>(limits.device_bytes),
+        static_cast<unsigned long long>(limits.files));
+}
+
+void Scanner::WriteTrace() {
+    if (trace_output_.empty()) {
+        return;
+    }
+
+    FILE* out = fopen(trace_output_.c_str(), trace_started_ ? "ae" : "we");
+    if (out == nullptr) {
+        perror("Unable to open trace output");
+        return;
+    }
+    if (!Tracer::AppendChromeTrace(out, &trace_started_)) {
+        fprintf(stderr, "Unable to write trace to %s\n",
+            trace_output_.c_str());
+    }
+    fclose(out);
+}
+
+void Scanner::HandleWatchEvents() {
+    for (const auto& event : watcher_->Read()) {
+        if (event.directory.empty()) {
+            // Events were lost, so anything may have changed.
+            MarkChanged();
+            changed_groups_ = ~static_cast<uint64_t>(0);
+            config_changed_ = true;
+            changes_lost_ = true;
+            continue;
+        }
+
+        if (config_paths_.count(event.directory) > 0 ||
+                config_paths_.count(event.directory + "/" + event.name) > 0) {
+            MarkChanged();
+            config_changed_ = true;
+        }
+
+        WatchedDirectoryChanged(event.directory);
+
+        if (event.mask & IN_IGNORED) {
+            // The watch is gone, e.g. with the directory.  Forget it, so the
+            // rescan that follows watches it afresh.
+            if (watched_directories_.erase(event.directory) > 0 &&
+                    inotify_directories_ > 0) {
+                inotify_directories_--;
+            }
+            if (config_directories_.count(event.directory) > 0 &&
+                    !watcher_->Add(event.directory)) {
+                poller_->Add(event.directory);
+            }
+        }
+    }
 }
 
 }  // namespace file_binder
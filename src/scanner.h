@@ -19,35 +19,470 @@
 #ifndef __FILE_BINDER__SCANNER_H__
 #define __FILE_BINDER__SCANNER_H__
 
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
 #include <memory>
+#include <queue>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "block_device.h"
+#include "deadline_executor.h"
+#include "dependency_graph.h"
+#include "directory_poller.h"
 #include "filesystem.h"
+#include "handoff.h"
+#include "io_throttle.h"
+#include "library_resolver.h"
+#include "lock_table.h"
+#include "metadata_warmer.h"
 #include "mlocker.h"
+#include "numa.h"
+#include "path_table.h"
+#include "pressure_monitor.h"
+#include "resource_counters.h"
+#include "retry_scheduler.h"
+#include "runtime_modules.h"
+#include "shadow_tree.h"
+#include "shard_supervisor.h"
+#include "watcher.h"
 
 namespace file_binder {
 
 class Scanner {
 public:
+    // Locking policy for a group of paths.
+    enum class Mode {
+        // Paths are locked at startup and held for the lifetime of the
+        // scanner.
+        kPinned,
+        // Paths are prefetched, then locked, as memory or I/O pressure rises.
+        // They are released once the pressure subsides.
+        kWarm,
+    };
+
+    // Groups are tracked in 64-bit masks, so at most this many may be added,
+    // including those added by SetPaths and EnableRuntimeModules.
+    static constexpr size_t kMaxGroups = 64;
+
     Scanner();
     ~Scanner();
 
+    // Adds a pinned group consisting of paths.
     void SetPaths(std::vector<std::string> paths);
 
+    void AddGroup(
+        const std::string& name, Mode mode, std::vector<std::string> paths);
+
+    // Adds a pinned group of the modules loaded at runtime by NSS, PAM and
+    // gconv, along with their dependencies.  The group is rediscovered when
+    // their configuration changes.
+    void EnableRuntimeModules();
+
+    // Sets the priority of the named group.  Pinned groups are locked in
+    // tiers of descending priority, each tier's closure becoming resident
+    // before the next is scanned.  It returns false if there is no such
+    // group.
+    bool SetPriority(const std::string& group, int priority);
+
+    // Sets the NUMA policy used to populate the named group.  It returns
+    // false if there is no such group.
+    bool SetNumaPolicy(const std::string& group, const NumaPolicy& policy);
+
+    // Keeps copies of the named group's locked files in a tmpfs at root,
+    // bind mounted over the originals if bind is set.  It returns false,
+    // with a description in *error, if there is no such group or root
+    // cannot be held in memory.
+    bool SetShadow(const std::string& group, const std::string& root,
+        bool bind, std::string* error);
+
+    // Limits the I/O of the initial scan of pinned groups, and runs it at
+    // priority.  Both are lifted once the pinned groups are resident.
+    void SetIoPolicy(
+        const IoThrottle::Limits& limits, const IoPriority& priority);
+
+    // Gives up on reading a file once deadline, plus time for its size at
+    // a crawl, has passed, so a failing disk cannot stall us.  Devices are
+    // skipped once quarantine_after reads from them have timed out.
+    void SetDeadlines(
+        std::chrono::milliseconds deadline, size_t quarantine_after);
+
+    // Rereads the limits from path, as written for ReadIoLimits, whenever
+    // IoThrottle::RequestReload is called.  New limits re-arm the throttle,
+    // including for scans after the initial one.
+    void SetIoLimitsFile(std::string path);
+
+    // The throttle applied to our scans.  It may be lifted early, or asked to
+    // reload its limits, from a signal handler.
+    IoThrottle* throttle() { return throttle_.get(); }
+
+    // Enables tracing, writing the trace to path as Chrome trace event JSON
+    // once the pinned groups are locked, and again after each later scan.
+    void SetTraceOutput(std::string path);
+
+    // Counts the faults, context switches, CPU time and bytes read of each
+    // stage of each scan, by file and by group, for the report.
+    void EnableResourceCounters();
+
+    // Keeps the directories and path components leading to locked files in
+    // the kernel's caches, from a thread of our own.
+    void EnableMetadataWarming();
+
+    // The arguments, excluding argv[0], to start the new binary with on a
+    // live upgrade.
+    void SetUpgradeArguments(std::vector<std::string> args);
+
+    // Requests a live upgrade:  Our locks are handed to a holder process and
+    // the binary at /proc/self/exe, as since replaced on disk, is executed in
+    // our place.  It is async-signal-safe.
+    void RequestUpgrade();
+
+    // Requests that Run return, so that we are destroyed and release our
+    // bind mounts.  It is async-signal-safe.
+    void RequestStop();
+
+    // Takes over the locks of the previous binary from the holder at fd.
+    // They are released once our own pinned groups are locked.
+    void SetHandoff(int fd, pid_t holder);
+
     void Run();
 private:
+    // The stages of a scan whose resource usage is counted.
+    enum UsageStage {
+        kParseUsage,
+        kPopulateUsage,
+        kFillUsage,
+        kLockUsage,
+        kUsageStages,
+    };
+
+    struct Group {
+        std::string name;
+        Mode mode;
+        std::vector<std::string> paths;
+        NumaPolicy numa;
+        int priority;
+
+        // The files locked on behalf of this group.
+        LockTable locks;
+        // Files left unlocked by the latest lock scan as their device timed
+        // out or failed to read them.
+        std::vector<PathId> unavailable;
+        // The files found by walking paths, as opposed to dependencies, and
+        // the directories walked, in the latest lock scan.
+        std::vector<PathId> roots;
+        std::unordered_set<std::string> directories;
+        // The resources used on the group's behalf, by UsageStage, if
+        // counting is enabled.
+        ResourceUsage usage[kUsageStages];
+        // Copies of the locked files, if the group is shadowed.
+        std::unique_ptr<ShadowTree> shadow;
+    };
+
+    // A path awaiting a walk, at its depth in the dependency graph of its
+    // group's paths.
+    struct PendingPath {
+        std::string path;
+        uint32_t depth;
+        // Orders paths of the same depth by when they were queued.
+        uint64_t sequence;
+    };
+
+    struct LaterPath {
+        bool operator()(const PendingPath& a, const PendingPath& b) const {
+            return a.depth != b.depth ? a.depth > b.depth :
+                a.sequence > b.sequence;
+        }
+    };
+
+    // A file found by Walk, to be locked by LockPending.
+    struct PendingLock {
+        PathId path;
+        dev_t device;
+        uint64_t size;
+    };
+
+    enum class Action {
+        kPrefetch,
+        kLock,
+    };
+
+    // Scans the paths of group and their dependencies, applying action to
+    // each file found.
+    void Scan(Group* group, Action action);
+
     void Walk(
+        Group* group,
+        Action action,
         const std::string& path,
         const struct stat& buf);
 
+    // Populates and locks the files collected in to_lock_ by Walk.
+    void LockPending(Group* group);
+
+    // Brings the shadow copies of group, if any, in line with its locks.
+    void SyncShadow(Group* group);
+
+    // Tracks the paths of the files locked by group index, and the
+    // directories it walked, for metadata warming if enabled.
+    void WarmMetadata(size_t index);
+
+    // Reports the misses of metadata warming since last reported.
+    void ReportMetadataMisses();
+
+    // Locks pending, at path, once LockPending has brought it into the page
+    // cache.
+    void LockFilled(
+        Group* group, const PendingLock& pending, const std::string& path);
+
+    // Adds the runtime dependencies of file id, open at fd, to
+    // pending_paths_ and graph_:  The interpreter and libraries of ELF files,
+    // and the interpreter of scripts.  fd is closed, and the resources used
+    // are added to usage.  It returns false if the file could not be read in
+    // time.
+    bool ScanDependencies(PathId id, int fd, const struct stat& buf,
+        ResourceUsage* usage);
+
+    // Adds usage, spent on stage of file id for group, to the totals.  id
+    // may be PathTable::kInvalid for work spanning files, and group may be
+    // null for work not yet attributed to a group.
+    void AccountUsage(Group* group, PathId id, UsageStage stage,
+        const ResourceUsage& usage);
+
+    // Prints the resource usage of each group, and of the files which read
+    // the most from storage.
+    void PrintUsage(FILE* out) const;
+
+    // Returns the block device behind device, described once.
+    const BlockDevice& Device(dev_t device);
+
+    // The time allowed to read bytes across files.
+    DeadlineExecutor::Clock::duration Deadline(
+        uint64_t bytes, size_t files = 1) const;
+
+    // Runs task, which may block on device, on executor_ against the default
+    // deadline, returning true if it completed.  As for DeadlineExecutor::Run,
+    // task must own the state it touches.
+    bool RunIo(dev_t device, std::function<void()> task);
+
+    // Opens path, on device, for reading through RunIo.  It returns -1 with
+    // errno set on failure, which is ETIMEDOUT if the open did not complete.
+    int OpenFile(const std::string& path, dev_t device);
+
+    // lstats path through RunIo.  It returns false with errno set on
+    // failure, which is ETIMEDOUT if the lstat did not complete.
+    bool StatFile(const std::string& path, struct stat* buf);
+
+    // Returns true if file id, recorded in graph_, still has the contents
+    // hashed when it was locked, despite its identity changing to identity
+    // (as by touch, chmod or rewriting the same bytes in place).  A file
+    // replaced by another inode never qualifies, as its lock must be taken
+    // afresh.  The file is read on executor_, and is taken to have changed
+    // if that misses its deadline.
+    bool ContentUnchanged(
+        PathId id, const DependencyGraph::Identity& identity);
+
+    // Hashes file id with read on executor_, rather than through a locked
+    // mapping, which a truncation would turn into SIGBUS.  It returns false
+    // if the file is no longer identity or its deadline is missed.
+    bool HashFile(PathId id, const DependencyGraph::Identity& identity,
+        uint64_t* hash);
+
+    // Queues path to be walked by the current Scan.
+    void Enqueue(std::string path, uint32_t depth);
+
+    // Reports that the pinned groups of priority are resident.
+    void TierReady(int priority) const;
+
+    // Returns true if path is held by a pinned group.
+    bool IsPinned(PathId path) const;
+
+    // Unlocks and removes every record of locks.
+    void Release(LockTable* locks);
+
+    // Reports the files and bytes locked by each group, and the memory used
+    // to track them.
+    void PrintReport(FILE* out) const;
+
+    // Prefetches, locks or releases warm groups to match level.
+    void ApplyPressure(PressureMonitor::Level level);
+
+    // Rescans group.  Files which are unchanged keep their locks; changed
+    // files are locked afresh before their previous locks are released, so
+    // files which remain in the group stay locked throughout.
+    void Rescan(Group* group);
+
+    // Rediscovers the runtime modules group and relocks it.
+    void RefreshRuntimeModules();
+
+    // Creates plugins_, which probes for their configuration, on executor_.
+    // It returns false if that missed its deadline.
+    bool LoadRuntimeModulePlugins();
+
+    // Watches the directories walked by the latest lock scan of group index,
+    // and those holding its files.
+    void WatchGroup(size_t index);
+
+    // Watches directory on behalf of group index, with inotify where
+    // possible, otherwise by polling.
+    void Watch(const std::string& directory, size_t index);
+
+    // Notes a change to the entries of directory, as found by polling.
+    void DirectoryChanged(const std::string& directory);
+
+    // Notes a change to the entries of a watched directory.
+    void WatchedDirectoryChanged(const std::string& directory);
+
+    // Notes that a change is pending, for batching.
+    void MarkChanged();
+
+    // Rescans the groups noted as changed, once changes have settled.
+    void RescanChanged();
+
+    // Brings groups, a bitmask of pinned groups, up to date with the changes
+    // to changed_directories_ without rescanning them:  Only files whose
+    // contents changed are reparsed, then the difference in each group's
+    // closure is locked or unlocked.
+    void UpdateClosures(uint64_t groups);
+
+    // Parses the files queued in pending_paths_ which are new to graph_ or
+    // in replaced, then locks or unlocks the difference in the closure of
+    // each of groups, a bitmask, relocking the files in replaced.
+    void ReconcileClosures(
+        uint64_t groups, const std::unordered_set<PathId>& replaced);
+
+    // Records that file id failed at stage on behalf of group, scheduling a
+    // retry.
+    void RecordFailure(const Group* group, PathId id,
+        RetryScheduler::Stage stage, int error);
+
+    // Retries the failed files which are due by now.
+    void RetryFailed(RetryScheduler::Clock::time_point now);
+
+    // Re-resolves each soname in graph_, after the search path changed.
+    void ResolveSonames();
+
+    // Watches the configuration of our plugins and library resolver.
+    void WatchConfig();
+
+    // Handles pending inotify events.
+    void HandleWatchEvents();
+
+    // Hands our locks to a holder and executes the new binary.  It only
+    // returns on failure.
+    void Upgrade();
+
+    // Reports on the files inherited from the previous binary and releases
+    // its holder.
+    void CompleteHandoff();
+
+    // Applies the limits in io_limits_file_, if a reload was requested.
+    void ReloadIoLimits();
+
+    // Appends the spans recorded since the last write to trace_output_, if
+    // set.
+    void WriteTrace();
+
     std::unique_ptr<Filesystem> filesystem_;
-    std::unique_ptr<MLocker> mlocker_;
+    std::unique_ptr<ShardSupervisor> mlocker_;
+    std::unique_ptr<PressureMonitor> pressure_;
+    std::unique_ptr<LibraryResolver> resolver_;
+    std::unique_ptr<Watcher> watcher_;
+    std::unique_ptr<DirectoryPoller> poller_;
+    std::unique_ptr<IoThrottle> throttle_;
+    std::unique_ptr<DeadlineExecutor> executor_;
+    // Null unless metadata warming is enabled.
+    std::unique_ptr<MetadataWarmer> warmer_;
+    uint64_t reported_metadata_misses_;
+    // The block devices behind the filesystems we have read from, by
+    // st_dev.
+    std::unordered_map<dev_t, BlockDevice> devices_;
+    std::chrono::milliseconds io_deadline_;
+    // The I/O priority of the initial scan, or IoClass::kNone to leave ours
+    // unchanged.
+    IoPriority io_priority_;
+    // The file the limits are reloaded from, if any.
+    std::string io_limits_file_;
+
+    std::vector<Group> groups_;
+    PressureMonitor::Level applied_level_;
+
+    // Shared with the tasks reading their configuration, which may outlive
+    // us if abandoned.
+    std::vector<std::shared_ptr<RuntimeModulePlugin>> plugins_;
+    // Index of the runtime modules group in groups_, if enabled.
+    size_t runtime_modules_group_;
+    // Configuration files and directories that we are watching.
+    std::unordered_set<std::string> config_paths_;
+    // The directories watched for changes to config_paths_.
+    std::unordered_set<std::string> config_directories_;
+
+    // The groups with files in each watched directory, as a bitmask of
+    // indices into groups_.
+    std::unordered_map<std::string, uint64_t> watched_directories_;
+    size_t inotify_directories_;
+    // Groups with changes pending a rescan, as a bitmask.
+    uint64_t changed_groups_;
+    bool config_changed_;
+    // The directories changed since the last rescan, and when the first and
+    // latest of those changes were seen.  Changes are batched until they
+    // settle, as a package upgrade touches many files at once.
+    std::unordered_set<std::string> changed_directories_;
+    bool changes_pending_;
+    std::chrono::steady_clock::time_point first_change_;
+    std::chrono::steady_clock::time_point last_change_;
+    // Set when watch events were lost, so anything may have changed.
+    bool changes_lost_;
+
+    // The dependencies between every file we have scanned.
+    DependencyGraph graph_;
+    // Files which failed to open, parse, populate or lock, by group.
+    RetryScheduler retries_;
+    // The resources used on each file, across stages and groups, if
+    // counting is enabled.
+    std::unordered_map<PathId, ResourceUsage> file_usage_;
+
+    std::string trace_output_;
+    // Whether trace_output_ has been written to, and so is appended to.
+    bool trace_started_;
+    // When Run started, for reporting the readiness of each tier.
+    std::chrono::steady_clock::time_point run_start_;
+
+    std::vector<std::string> upgrade_args_;
+    std::atomic<bool> upgrade_requested_;
+    std::atomic<bool> stop_requested_;
+    // A self-pipe which wakes Run when an upgrade or stop is requested.
+    int wake_fds_[2];
+    // The handoff from the previous binary, while in progress.
+    Handoff handoff_;
+
+    // The PATH used to resolve "#!/usr/bin/env foo" interpreters.
+    const std::string search_path_;
+
+    // Interned storage for the path of every file we have visited.
+    PathTable path_table_;
 
-    std::vector<std::string> pending_paths_;
-    // Mapping of paths to mlock tokens.
-    std::unordered_map<std::string, std::unique_ptr<MLocker::Token>> locks_;
+    std::priority_queue<PendingPath, std::vector<PendingPath>, LaterPath>
+        pending_paths_;
+    uint64_t pending_sequence_;
+    // The depth of the path being walked.
+    uint32_t walk_depth_;
+    // Files already visited by the current Scan, indexed by PathId.
+    std::vector<bool> visited_;
+    // Files to be locked at the end of the current Scan, in discovery order.
+    std::vector<PendingLock> to_lock_;
+    // Directories walked by the current Scan.
+    std::vector<std::string> walked_directories_;
+    // Locks of files which the current Scan found changed or gone, released
+    // once it has locked their replacements.
+    std::vector<LockRecord> superseded_;
 };
 
 }  // namespace file_binder
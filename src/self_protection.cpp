@@ -0,0 +1,116 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "self_protection.h"
+
+#include <alloca.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4
+#endif
+
+namespace file_binder {
+namespace {
+
+bool enabled = false;
+SelfProtection reserved;
+// The break once the heap was grown.
+uintptr_t heap_end = 0;
+
+// Touches bytes of stack below our caller's frame.
+__attribute__((noinline)) void TouchStack(size_t bytes) {
+    char* stack = static_cast<char*>(alloca(bytes));
+    memset(stack, 0, bytes);
+    // Keep the stores from being elided.
+    asm volatile("" : : "r"(stack) : "memory");
+}
+
+}  // namespace
+
+bool ProtectSelf(const SelfProtection& protection, std::string* error) {
+    // mallopt returns 0 on failure.  A trim threshold of -1 is the largest
+    // possible, so free memory is never trimmed.
+    if (mallopt(M_ARENA_MAX, 1) == 0 || mallopt(M_MMAP_MAX, 0) == 0 ||
+            mallopt(M_TRIM_THRESHOLD, -1) == 0) {
+        *error = "unable to configure malloc";
+        return false;
+    }
+
+    if (protection.heap_bytes > 0) {
+        // Freed, the reservation stays in the heap for later allocations.
+        void* reservation = malloc(protection.heap_bytes);
+        if (reservation == nullptr) {
+            *error = "unable to reserve " +
+                std::to_string(protection.heap_bytes) + " bytes of heap";
+            return false;
+        }
+        free(reservation);
+    }
+    heap_end = reinterpret_cast<uintptr_t>(sbrk(0));
+    if (protection.stack_bytes > 0) {
+        TouchStack(protection.stack_bytes);
+    }
+
+    // Populates and locks everything mapped so far, including the heap and
+    // stack.
+    if (mlockall(MCL_CURRENT) != 0) {
+        *error = std::string("mlockall: ") + strerror(errno);
+        return false;
+    }
+    // Without MCL_ONFAULT, later mappings would be populated in full as they
+    // are made:  The files we lock would be read on the thread mapping them
+    // rather than as LockPending schedules, and each residency check would
+    // read the window it maps.
+    if (mlockall(MCL_FUTURE | MCL_ONFAULT) != 0) {
+        *error = errno == EINVAL ?
+            "the kernel lacks MCL_ONFAULT (4.4), without which later "
+            "mappings would be populated as they are made" :
+            std::string("mlockall: ") + strerror(errno);
+        munlockall();
+        return false;
+    }
+
+    enabled = true;
+    reserved = protection;
+    return true;
+}
+
+void PrintSelfProtection(FILE* out) {
+    if (!enabled) {
+        return;
+    }
+
+    const uintptr_t brk = reinterpret_cast<uintptr_t>(sbrk(0));
+    const size_t grown = brk > heap_end ? brk - heap_end : 0;
+    fprintf(out, "Self protection: memory locked (later mappings on fault); "
+        "%zu bytes of heap reserved", reserved.heap_bytes);
+    if (grown > 0) {
+        fprintf(out, ", outgrown by %zu bytes", grown);
+    }
+    fprintf(out, "; %zu bytes of stack touched\n", reserved.stack_bytes);
+}
+
+}  // namespace file_binder
@@ -0,0 +1,57 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__SELF_PROTECTION_H__
+#define __FILE_BINDER__SELF_PROTECTION_H__
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace file_binder {
+
+// The memory reserved by ProtectSelf.
+struct SelfProtection {
+    // Bytes the heap is grown by in advance.
+    size_t heap_bytes;
+    // Bytes of the calling thread's stack touched in advance.
+    size_t stack_bytes;
+};
+
+// ProtectSelf keeps us from stalling on our own memory, whether on reclaim
+// or on the disk we are protecting.  malloc is confined to a single heap,
+// shared by all threads, which is grown by heap_bytes up front and never
+// returned to the kernel, and no allocation is served by a fresh mapping.
+// The calling thread's stack is touched stack_bytes deep.  Everything
+// mapped is then locked with mlockall(MCL_CURRENT), and later mappings
+// (thread stacks, the files we lock) are locked as they fault
+// (MCL_FUTURE | MCL_ONFAULT, 4.4).  Thereafter, allocations fitting in the
+// heap make no system calls and take no faults.
+//
+// It should be called before any threads are started.  It returns false,
+// with a description in *error, if the heap cannot be reserved or memory
+// cannot be locked (e.g. under RLIMIT_MEMLOCK, or without MCL_ONFAULT).
+bool ProtectSelf(const SelfProtection& protection, std::string* error);
+
+// Reports the memory reserved, and whether the heap has outgrown it, if
+// ProtectSelf succeeded.
+void PrintSelfProtection(FILE* out);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__SELF_PROTECTION_H__
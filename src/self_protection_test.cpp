@@ -0,0 +1,172 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "self_protection.h"
+
+#include <alloca.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "kernel_features.h"
+#include "scanner.h"
+#include "temp_tree.h"
+
+namespace file_binder {
+namespace {
+
+// Faults taken by the calling thread so far.
+uint64_t Faults() {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+// Allocates as the event loop does:  Paths, hash table nodes, a buffer large
+// enough to be mapped rather than taken from the heap by default, and an
+// exception.
+void Churn() {
+    std::unordered_map<std::string, std::vector<uint32_t>> files;
+    for (uint32_t i = 0; i < 1000; i++) {
+        files["/usr/lib/libfile.so." + std::to_string(i)].assign(16, i);
+    }
+    std::vector<char> buffer(4 << 20, 1);
+    try {
+        throw std::runtime_error("unable to lock " + files.begin()->first);
+    } catch (const std::exception&) {}
+}
+
+// The bytes of path we have locked, from our mappings of it.
+uint64_t LockedBytes(const std::string& path) {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool mapping = false;
+    uint64_t locked = 0;
+    while (std::getline(smaps, line)) {
+        if (line.find('-') < line.find(' ')) {
+            // A mapping, "<start>-<end> <perms> ... <path>".
+            mapping = line.size() > path.size() &&
+                line.compare(line.size() - path.size(), path.size(),
+                    path) == 0 &&
+                line[line.size() - path.size() - 1] == ' ';
+        } else if (mapping && line.compare(0, 7, "Locked:") == 0) {
+            locked += strtoull(line.c_str() + 7, nullptr, 10) << 10;
+        }
+    }
+    return locked;
+}
+
+// Waits up to 10s for done.
+bool WaitFor(std::function<bool()> done) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+__attribute__((noinline)) void UseStack(size_t bytes) {
+    char* stack = static_cast<char*>(alloca(bytes));
+    memset(stack, 1, bytes);
+    asm volatile("" : : "r"(stack) : "memory");
+}
+
+TEST(SelfProtection, UnreservableHeap) {
+    std::string error;
+    EXPECT_FALSE(ProtectSelf({static_cast<size_t>(1) << 62, 0}, &error));
+    EXPECT_FALSE(error.empty());
+}
+
+TEST(SelfProtection, SteadyStateIsFaultFree) {
+    std::string error;
+    ASSERT_TRUE(ProtectSelf({32 << 20, 1 << 20}, &error)) << error;
+
+    // The first pass warms malloc's bins and the unwinder.
+    Churn();
+    const void* brk = sbrk(0);
+    const uint64_t faults = Faults();
+    for (int i = 0; i < 10; i++) {
+        Churn();
+    }
+    UseStack(512 << 10);
+    EXPECT_EQ(faults, Faults());
+    EXPECT_EQ(brk, sbrk(0));
+
+    char* report;
+    size_t size;
+    FILE* out = open_memstream(&report, &size);
+    ASSERT_NE(nullptr, out);
+    PrintSelfProtection(out);
+    fclose(out);
+    EXPECT_NE(nullptr, strstr(report, "Self protection: memory locked"));
+    EXPECT_EQ(nullptr, strstr(report, "outgrown")) << report;
+    free(report);
+}
+
+TEST(SelfProtection, RescansWhileProtected) {
+    TempTree tree("self_protection_test");
+    ASSERT_FALSE(tree.root().empty());
+    ASSERT_TRUE(tree.Write("before", std::string(1 << 20, 'b')));
+
+    std::string error;
+    ASSERT_TRUE(ProtectSelf({32 << 20, 1 << 20}, &error)) << error;
+
+    // Later mappings, such as those locking files and, without cachestat,
+    // checking their residency, are locked as they fault.  The poll loop
+    // must still rescan the tree when it changes, and lock what it finds.
+    DisableKernelFeature(KernelFeature::kCachestat);
+    Scanner scanner;
+    scanner.SetPaths({tree.root()});
+    bool locked_before = false;
+    bool locked_after = false;
+    std::thread changes([&]() {
+        locked_before = WaitFor([&]() {
+            return LockedBytes(tree.Path("before")) > 0;
+        });
+        if (locked_before && tree.Write("after", std::string(1 << 20, 'a'))) {
+            locked_after = WaitFor([&]() {
+                return LockedBytes(tree.Path("after")) > 0;
+            });
+        }
+        scanner.RequestStop();
+    });
+    scanner.Run();
+    changes.join();
+
+    EXPECT_TRUE(locked_before);
+    EXPECT_TRUE(locked_after);
+}
+
+}  // namespace
+}  // namespace file_binder
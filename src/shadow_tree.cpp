@@ -0,0 +1,398 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shadow_tree.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <set>
+#include <unordered_set>
+
+#ifndef __NR_copy_file_range
+#define __NR_copy_file_range 326
+#endif
+
+namespace file_binder {
+namespace {
+
+const long kTmpfsMagic = 0x01021994;
+const long kRamfsMagic = 0x858458f6;
+
+const char kTemporarySuffix[] = ".file-binder.tmp";
+const char kCapabilityXattr[] = "security.capability";
+const char kRescueEnvironment[] = "/rescue.env";
+
+// Copies size bytes from in to out, with copy_file_range where the kernel
+// supports it between the two filesystems (5.3), else sendfile.
+bool CopyContents(int in, int out, uint64_t size) {
+    loff_t in_offset = 0;
+    loff_t out_offset = 0;
+    bool fallback = false;
+    while (static_cast<uint64_t>(in_offset) < size && !fallback) {
+        const ssize_t ret = syscall(__NR_copy_file_range, in, &in_offset,
+            out, &out_offset, size - in_offset, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0 && in_offset == 0 && (errno == ENOSYS ||
+                errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+            fallback = true;
+        } else if (ret <= 0) {
+            // EOF if the file has since been truncated.
+            return ret == 0;
+        } else {
+            in_offset += ret;
+        }
+    }
+
+    off_t offset = static_cast<off_t>(in_offset);
+    while (static_cast<uint64_t>(offset) < size) {
+        const ssize_t ret = sendfile(out, in, &offset, size - offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return ret == 0;
+        }
+    }
+    return true;
+}
+
+bool IsExecutable(const std::string& file, mode_t mode) {
+    return (mode & 0111) != 0 &&
+        file.find(".so", file.rfind('/')) == std::string::npos;
+}
+
+bool IsLibrary(const std::string& file) {
+    return file.find(".so", file.rfind('/')) != std::string::npos;
+}
+
+std::string Join(const std::set<std::string>& directories) {
+    std::string joined;
+    for (const auto& directory : directories) {
+        if (!joined.empty()) {
+            joined += ':';
+        }
+        joined += directory;
+    }
+    return joined;
+}
+
+}  // namespace
+
+ShadowTree::ShadowTree(std::string root) :
+    root_(std::move(root)), mounted_(false), bind_(false), bytes_(0) {}
+
+ShadowTree::~ShadowTree() {
+    for (auto& file : files_) {
+        Unbind(file.first, &file.second);
+    }
+    if (mounted_) {
+        umount2(root_.c_str(), MNT_DETACH);
+    }
+}
+
+bool ShadowTree::Init(std::string* error) {
+    if (root_.empty() || root_[0] != '/') {
+        *error = "the shadow root must be an absolute path";
+        return false;
+    }
+    if (!MakeParents(std::string()) ||
+            (mkdir(root_.c_str(), 0755) != 0 && errno != EEXIST)) {
+        *error = "unable to create " + root_ + ": " + strerror(errno);
+        return false;
+    }
+
+    struct statfs fs;
+    if (statfs(root_.c_str(), &fs) != 0) {
+        *error = "unable to stat " + root_ + ": " + strerror(errno);
+        return false;
+    }
+    if (fs.f_type == kTmpfsMagic || fs.f_type == kRamfsMagic) {
+        return true;
+    }
+
+    // Copies are never setuid, but nosuid guards against any which are.
+    if (mount("tmpfs", root_.c_str(), "tmpfs", MS_NOSUID | MS_NODEV,
+            "mode=0755") != 0) {
+        *error = root_ + " is not a tmpfs, and mounting one failed: " +
+            strerror(errno);
+        return false;
+    }
+    mounted_ = true;
+    return true;
+}
+
+size_t ShadowTree::Sync(const std::vector<std::string>& files) {
+    failed_.clear();
+    privileged_.clear();
+    size_t copied = 0;
+    std::unordered_set<std::string> listed;
+    for (const auto& file : files) {
+        if (!listed.insert(file).second) {
+            continue;
+        }
+
+        auto it = files_.find(file);
+        if (it != files_.end() && it->second.bound) {
+            // The original is hidden behind our read-only copy, so it can
+            // no longer be replaced or written through its path, but it may
+            // still be written in place through another link or mount
+            // namespace.  We check it through the descriptor held since
+            // binding, and recopy and rebind it if it changed.
+            struct stat original;
+            if (fstat(it->second.original, &original) == 0 &&
+                    it->second.Matches(original)) {
+                continue;
+            }
+            Unbind(file, &it->second);
+        }
+
+        struct stat original;
+        if (stat(file.c_str(), &original) != 0) {
+            failed_.push_back(file);
+            continue;
+        }
+        struct stat shadow;
+        if (it == files_.end() &&
+                stat((root_ + file).c_str(), &shadow) == 0 &&
+                shadow.st_dev == original.st_dev &&
+                shadow.st_ino == original.st_ino) {
+            // Bound by a previous binary, before a live upgrade.  We unbind
+            // it to reach the original, and bind our own copy.
+            umount2(file.c_str(), MNT_DETACH);
+            if (stat(file.c_str(), &original) != 0) {
+                failed_.push_back(file);
+                continue;
+            }
+        }
+        if (it != files_.end() && it->second.Matches(original)) {
+            continue;
+        }
+
+        Copy copy;
+        if (!CopyFile(file, &copy)) {
+            failed_.push_back(file);
+            continue;
+        }
+        copied++;
+
+        if (it != files_.end()) {
+            bytes_ -= it->second.size;
+            Unbind(file, &it->second);
+        }
+        bytes_ += copy.size;
+        files_[file] = copy;
+    }
+
+    for (auto it = files_.begin(); it != files_.end();) {
+        if (listed.count(it->first) > 0) {
+            ++it;
+            continue;
+        }
+        Unbind(it->first, &it->second);
+        unlink((root_ + it->first).c_str());
+        bytes_ -= it->second.size;
+        it = files_.erase(it);
+    }
+
+    if (bind_) {
+        for (auto& file : files_) {
+            if (file.second.bound) {
+                continue;
+            } else if (file.second.privileged) {
+                // Our copy could not be run with the original's privileges.
+                privileged_.push_back(file.first);
+            } else if (!Bind(file.first, &file.second)) {
+                failed_.push_back(file.first);
+            }
+        }
+    }
+
+    WriteRescueEnvironment();
+    return copied;
+}
+
+size_t ShadowTree::bound() const {
+    size_t count = 0;
+    for (const auto& file : files_) {
+        count += file.second.bound;
+    }
+    return count;
+}
+
+std::string ShadowTree::RescueEnvironment() const {
+    return root_ + kRescueEnvironment;
+}
+
+bool ShadowTree::CopyFile(const std::string& file, Copy* copy) {
+    int in;
+    do {
+        in = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (in < 0 && errno == EINTR);
+    if (in < 0) {
+        return false;
+    }
+
+    struct stat buf;
+    if (fstat(in, &buf) != 0 || !S_ISREG(buf.st_mode) ||
+            !MakeParents(file)) {
+        close(in);
+        return false;
+    }
+
+    // Copies replace their predecessors atomically, as they may be running.
+    const std::string path = root_ + file;
+    const std::string temporary = path + kTemporarySuffix;
+    int out;
+    do {
+        out = open(temporary.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    } while (out < 0 && errno == EINTR);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    // Copies never carry the original's setuid, setgid or file
+    // capabilities.
+    const bool privileged = (buf.st_mode & (S_ISUID | S_ISGID)) != 0 ||
+        fgetxattr(in, kCapabilityXattr, nullptr, 0) >= 0;
+    bool ok = CopyContents(in, out, static_cast<uint64_t>(buf.st_size));
+    close(in);
+    if (ok) {
+        fchmod(out, buf.st_mode & 0777);
+        if (fchown(out, buf.st_uid, buf.st_gid) != 0) {
+            // Unprivileged, the copies are ours.
+        }
+        const struct timespec times[2] = {buf.st_atim, buf.st_mtim};
+        futimens(out, times);
+    }
+    ok &= close(out) == 0;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    copy->device = buf.st_dev;
+    copy->inode = buf.st_ino;
+    copy->size = buf.st_size;
+    copy->mtime = buf.st_mtim;
+    copy->mode = buf.st_mode;
+    copy->privileged = privileged;
+    copy->bound = false;
+    copy->original = -1;
+    return true;
+}
+
+bool ShadowTree::MakeParents(const std::string& path) {
+    // For path, its parents below root_; for root_ itself, its own parents.
+    const std::string full = root_ + path;
+    const size_t begin = path.empty() ? 1 : root_.size() + 1;
+    for (size_t slash = full.find('/', begin); slash != std::string::npos;
+            slash = full.find('/', slash + 1)) {
+        if (mkdir(full.substr(0, slash).c_str(), 0755) != 0 &&
+                errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShadowTree::Copy::Matches(const struct stat& buf) const {
+    return device == buf.st_dev && inode == buf.st_ino &&
+        size == buf.st_size && mtime.tv_sec == buf.st_mtim.tv_sec &&
+        mtime.tv_nsec == buf.st_mtim.tv_nsec;
+}
+
+bool ShadowTree::Bind(const std::string& file, Copy* copy) {
+    int original;
+    do {
+        original = open(file.c_str(), O_PATH | O_CLOEXEC);
+    } while (original < 0 && errno == EINTR);
+    if (original < 0) {
+        return false;
+    }
+
+    const std::string path = root_ + file;
+    if (mount(path.c_str(), file.c_str(), nullptr, MS_BIND, nullptr) != 0) {
+        close(original);
+        return false;
+    }
+    // Bind mounts only become read-only once remounted.  Writable, writes
+    // meant for the original would land in our copy.
+    if (mount(nullptr, file.c_str(), nullptr,
+            MS_REMOUNT | MS_BIND | MS_RDONLY, nullptr) != 0) {
+        umount2(file.c_str(), MNT_DETACH);
+        close(original);
+        return false;
+    }
+    copy->bound = true;
+    copy->original = original;
+    return true;
+}
+
+void ShadowTree::Unbind(const std::string& file, Copy* copy) {
+    if (copy->bound) {
+        umount2(file.c_str(), MNT_DETACH);
+        close(copy->original);
+        copy->bound = false;
+        copy->original = -1;
+    }
+}
+
+void ShadowTree::WriteRescueEnvironment() {
+    std::set<std::string> executables;
+    std::set<std::string> libraries;
+    for (const auto& file : files_) {
+        const std::string directory =
+            root_ + file.first.substr(0, file.first.rfind('/'));
+        if (IsExecutable(file.first, file.second.mode)) {
+            executables.insert(directory);
+        } else if (IsLibrary(file.first)) {
+            libraries.insert(directory);
+        }
+    }
+
+    const std::string path = RescueEnvironment();
+    const std::string temporary = path + kTemporarySuffix;
+    FILE* out = fopen(temporary.c_str(), "we");
+    if (out == nullptr) {
+        return;
+    }
+    fprintf(out,
+        "# Sourced to run the tools shadowed by File Binder from memory.\n"
+        "# Programs still find their interpreter by its absolute path;\n"
+        "# run them with chroot %s to avoid the disk entirely.\n"
+        "export PATH=%s\n"
+        "export LD_LIBRARY_PATH=%s\n",
+        root_.c_str(), Join(executables).c_str(), Join(libraries).c_str());
+    if (fclose(out) != 0 || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+    }
+}
+
+}  // namespace file_binder
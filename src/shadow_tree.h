@@ -0,0 +1,112 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__SHADOW_TREE_H__
+#define __FILE_BINDER__SHADOW_TREE_H__
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace file_binder {
+
+// ShadowTree keeps copies of a set of files in RAM-backed storage, mirroring
+// their absolute paths below root, so that they stay usable (by chroot, a
+// rescue PATH or bind mounts over the originals) even if path lookups on the
+// disk holding them hang.
+class ShadowTree {
+public:
+    explicit ShadowTree(std::string root);
+    ~ShadowTree();
+
+    // Prepares root, mounting a tmpfs on it unless it is one already.  It
+    // returns false, with a description in *error, if root cannot be held in
+    // memory.
+    bool Init(std::string* error);
+
+    // Makes the tree hold exactly files, given as absolute paths, copying
+    // those which are new or have changed since the last Sync and removing
+    // those no longer listed.  It returns the number of files copied.
+    size_t Sync(const std::vector<std::string>& files);
+
+    // Bind mounts each copy, read-only, over its original from now on.
+    // While bound, the originals cannot be renamed over or unlinked.  Copies
+    // of setuid, setgid or capability-bearing files are never bound, as
+    // they would not run with the original's privileges.
+    void EnableBind() { bind_ = true; }
+
+    const std::string& root() const { return root_; }
+    size_t size() const { return files_.size(); }
+    uint64_t bytes() const { return bytes_; }
+    // The files which could not be copied or bound in the latest Sync.
+    const std::vector<std::string>& failed() const { return failed_; }
+    // The files left unbound in the latest Sync, as they are privileged.
+    const std::vector<std::string>& privileged() const {
+        return privileged_;
+    }
+    size_t bound() const;
+
+    // The path of a shell snippet setting PATH and LD_LIBRARY_PATH to the
+    // tree's executables and libraries, rewritten by each Sync.
+    std::string RescueEnvironment() const;
+private:
+    struct Copy {
+        // The original's identity when it was copied.
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+        mode_t mode;
+        // Whether the original is setuid, setgid or has file capabilities.
+        bool privileged;
+        bool bound;
+        // While bound, the original, which our copy hides.
+        int original;
+
+        // Returns true if buf still describes the original when copied.
+        bool Matches(const struct stat& buf) const;
+    };
+
+    // Copies file, returning false on failure.
+    bool CopyFile(const std::string& file, Copy* copy);
+    // Creates the parents of path below root_.
+    bool MakeParents(const std::string& path);
+    // Bind mounts the copy of file over it, returning false on failure.
+    bool Bind(const std::string& file, Copy* copy);
+    void Unbind(const std::string& file, Copy* copy);
+    void WriteRescueEnvironment();
+
+    const std::string root_;
+    // Whether we mounted the tmpfs at root_.
+    bool mounted_;
+    bool bind_;
+    std::unordered_map<std::string, Copy> files_;
+    uint64_t bytes_;
+    std::vector<std::string> failed_;
+    std::vector<std::string> privileged_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__SHADOW_TREE_H__
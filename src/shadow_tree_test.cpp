@@ -0,0 +1,146 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shadow_tree.h"
+#include "temp_tree.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+// Originals live in a temporary directory and are shadowed below a
+// directory in /dev/shm, which is a tmpfs.
+class ShadowTreeTest : public ::testing::Test {
+protected:
+    ShadowTreeTest()
+        : source_tree_("shadow_tree_test"),
+          shadow_tree_("shadow_tree_test", "/dev/shm"),
+          source_(source_tree_.root()), shadow_(shadow_tree_.root()) {}
+
+    void SetUp() override {
+        ASSERT_FALSE(source_.empty());
+        ASSERT_FALSE(shadow_.empty());
+        ASSERT_TRUE(source_tree_.MakeDirectory("bin"));
+        ASSERT_TRUE(source_tree_.MakeDirectory("lib"));
+        ASSERT_TRUE(source_tree_.Write("bin/tool", "tool", 04755));
+        ASSERT_TRUE(source_tree_.Write("lib/libtool.so.1", "library"));
+    }
+
+    TempTree source_tree_;
+    TempTree shadow_tree_;
+    const std::string source_;
+    const std::string shadow_;
+};
+
+TEST_F(ShadowTreeTest, CopiesAndSyncs) {
+    ShadowTree tree(shadow_);
+    std::string error;
+    ASSERT_TRUE(tree.Init(&error)) << error;
+
+    const std::string tool = source_ + "/bin/tool";
+    const std::string library = source_ + "/lib/libtool.so.1";
+    EXPECT_EQ(2, tree.Sync({tool, library}));
+    EXPECT_EQ(2, tree.size());
+    EXPECT_EQ(11, tree.bytes());
+    EXPECT_TRUE(tree.failed().empty());
+    EXPECT_EQ("tool", ReadFile(shadow_ + tool));
+    EXPECT_EQ("library", ReadFile(shadow_ + library));
+
+    // Copies keep their permissions, except for setuid.
+    struct stat buf;
+    ASSERT_EQ(0, stat((shadow_ + tool).c_str(), &buf));
+    EXPECT_EQ(0755, buf.st_mode & 07777);
+
+    const std::string environment = ReadFile(tree.RescueEnvironment());
+    EXPECT_NE(std::string::npos, environment.find(
+        "export PATH=" + shadow_ + source_ + "/bin\n"));
+    EXPECT_NE(std::string::npos, environment.find(
+        "export LD_LIBRARY_PATH=" + shadow_ + source_ + "/lib\n"));
+
+    // Unchanged files are not copied again.
+    EXPECT_EQ(0, tree.Sync({tool, library}));
+
+    // Replaced files are.
+    const std::string replacement = source_ + "/bin/tool.new";
+    ASSERT_TRUE(WriteFile(replacement, "new tool", 0755));
+    ASSERT_EQ(0, rename(replacement.c_str(), tool.c_str()));
+    EXPECT_EQ(1, tree.Sync({tool, library}));
+    EXPECT_EQ("new tool", ReadFile(shadow_ + tool));
+    EXPECT_EQ(15, tree.bytes());
+
+    // Files no longer listed are removed, and missing ones reported.
+    EXPECT_EQ(0, tree.Sync({tool, source_ + "/bin/missing"}));
+    EXPECT_EQ(1, tree.size());
+    EXPECT_EQ(std::vector<std::string>{source_ + "/bin/missing"},
+        tree.failed());
+    EXPECT_NE(0, access((shadow_ + library).c_str(), F_OK));
+}
+
+TEST_F(ShadowTreeTest, BindsUnprivilegedCopies) {
+    if (geteuid() != 0) {
+        // Bind mounts need CAP_SYS_ADMIN.
+        return;
+    }
+
+    const std::string tool = source_ + "/bin/tool";
+    const std::string library = source_ + "/lib/libtool.so.1";
+    const std::string link = source_ + "/lib/libtool.link";
+    ASSERT_EQ(0, ::link(library.c_str(), link.c_str()));
+    {
+        ShadowTree tree(shadow_);
+        std::string error;
+        ASSERT_TRUE(tree.Init(&error)) << error;
+        tree.EnableBind();
+        EXPECT_EQ(2, tree.Sync({tool, library}));
+
+        // The setuid tool is left unbound.
+        EXPECT_EQ(1, tree.bound());
+        EXPECT_EQ(std::vector<std::string>{tool}, tree.privileged());
+        EXPECT_TRUE(tree.failed().empty());
+
+        // The bound copy is read-only.
+        EXPECT_EQ(-1, access(library.c_str(), W_OK));
+        EXPECT_EQ(EROFS, errno);
+
+        // Writes in place through another link are noticed.
+        ASSERT_TRUE(WriteFile(link, "changed"));
+        EXPECT_EQ(1, tree.Sync({tool, library}));
+        EXPECT_EQ(1, tree.bound());
+        EXPECT_EQ("changed", ReadFile(library));
+    }
+    EXPECT_EQ("changed", ReadFile(library));
+    unlink(link.c_str());
+}
+
+TEST_F(ShadowTreeTest, RequiresAbsoluteRoot) {
+    ShadowTree tree("relative");
+    std::string error;
+    EXPECT_FALSE(tree.Init(&error));
+    EXPECT_FALSE(error.empty());
+}
+
+}  // namespace
+}  // namespace file_binder
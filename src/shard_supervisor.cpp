@@ -0,0 +1,411 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shard_supervisor.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <system_error>
+
+namespace file_binder {
+namespace {
+
+enum Op : uint32_t {
+    kLock = 1,
+    kUnlock = 2,
+};
+
+enum Status : int32_t {
+    kOk = 0,
+    // 1 was kOpenFailed, before replies carried the error.
+    kFailed = 2,
+};
+
+struct Request {
+    uint32_t op;
+    uint32_t path_length;
+    uint64_t addr;
+    uint64_t size;
+    // Followed by path_length bytes of path for kLock.
+};
+
+struct Reply {
+    int32_t status;
+    // The errno of a failure.
+    int32_t error;
+    uint64_t addr;
+    uint64_t size;
+};
+
+size_t ReadMaxMapCount() {
+    std::ifstream in("/proc/sys/vm/max_map_count");
+    size_t count = 0;
+    if (!(in >> count)) {
+        // The kernel's default.
+        count = 65530;
+    }
+    return count;
+}
+
+size_t CountMappings() {
+    std::ifstream in("/proc/self/maps");
+    size_t count = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        count++;
+    }
+    return count;
+}
+
+bool Send(int fd, const void* buf, size_t size) {
+    ssize_t ret;
+    do {
+        ret = ::send(fd, buf, size, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    return ret == static_cast<ssize_t>(size);
+}
+
+ssize_t Receive(int fd, void* buf, size_t size) {
+    ssize_t ret;
+    do {
+        ret = ::recv(fd, buf, size, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+// As Receive, but fails with ETIMEDOUT if nothing arrives within timeout.  A
+// zero timeout waits indefinitely.
+ssize_t Receive(
+        int fd, void* buf, size_t size, std::chrono::milliseconds timeout) {
+    if (timeout.count() > 0) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        int ret;
+        do {
+            const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+            ret = ::poll(&pfd, 1, static_cast<int>(
+                std::max<std::chrono::milliseconds::rep>(
+                    remaining.count(), 0)));
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        } else if (ret < 0) {
+            return -1;
+        }
+    }
+
+    return Receive(fd, buf, size);
+}
+
+}  // namespace
+
+ShardSupervisor::ShardSupervisor(
+        std::string helper_binary, size_t vma_limit, size_t headroom) :
+        helper_binary_(std::move(helper_binary)), reply_timeout_(0),
+        local_mappings_(0) {
+    if (vma_limit == 0) {
+        vma_limit = ReadMaxMapCount();
+    }
+
+    const size_t reserved = headroom + CountMappings();
+    budget_ = vma_limit > reserved ? vma_limit - reserved : 0;
+}
+
+ShardSupervisor::~ShardSupervisor() {
+    // Closing the socket instructs the helper to release its shard and exit.
+    for (auto& shard : shards_) {
+        int status;
+        if (shard.fd < 0) {
+            // Abandoned helpers may never exit, so reap only those that
+            // have.
+            ::waitpid(shard.pid, &status, WNOHANG);
+            continue;
+        }
+
+        ::close(shard.fd);
+        while (::waitpid(shard.pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+}
+
+MLocker::Mapping ShardSupervisor::LockMapping(const std::string& path) const {
+    if (local_mappings_ < budget_) {
+        Mapping mapping = MLocker::LockMapping(path);
+        if (mapping.addr != nullptr) {
+            local_mappings_++;
+        }
+        return mapping;
+    }
+
+    for (uint32_t i = 0; i < shards_.size(); i++) {
+        if (shards_[i].alive && shards_[i].mappings < budget_) {
+            return Delegate(i + 1, path);
+        }
+    }
+
+    if (budget_ == 0 || !Spawn()) {
+        throw std::system_error(ENOMEM, std::generic_category(),
+            "Unable to mmap:  Out of VMAs and unable to start a helper");
+    }
+    return Delegate(shards_.size(), path);
+}
+
+void ShardSupervisor::Unlock(const Mapping& mapping) const {
+    if (mapping.addr == nullptr) {
+        return;
+    }
+
+    if (mapping.shard == 0) {
+        MLocker::Unlock(mapping);
+        local_mappings_--;
+        return;
+    }
+
+    if (mapping.shard > shards_.size()) {
+        return;
+    }
+
+    Shard& shard = shards_[mapping.shard - 1];
+    if (!shard.alive) {
+        return;
+    }
+
+    Request request;
+    request.op = kUnlock;
+    request.path_length = 0;
+    request.addr = reinterpret_cast<uintptr_t>(mapping.addr);
+    request.size = mapping.size;
+
+    Reply reply;
+    if (!Send(shard.fd, &request, sizeof(request)) ||
+            Receive(shard.fd, &reply, sizeof(reply), reply_timeout_) !=
+                sizeof(reply)) {
+        Abandon(&shard);
+        return;
+    }
+    shard.mappings--;
+}
+
+std::vector<pid_t> ShardSupervisor::helpers() const {
+    std::vector<pid_t> pids;
+    for (const auto& shard : shards_) {
+        if (shard.alive) {
+            pids.push_back(shard.pid);
+        }
+    }
+    return pids;
+}
+
+size_t ShardSupervisor::mappings(uint32_t shard) const {
+    if (shard == 0) {
+        return local_mappings_;
+    } else if (shard > shards_.size()) {
+        return 0;
+    }
+    return shards_[shard - 1].mappings;
+}
+
+void ShardSupervisor::PrintReport(FILE* out) const {
+    fprintf(out, "Mappings: %zu local, budget %zu per process\n",
+        local_mappings_, budget_);
+    for (size_t i = 0; i < shards_.size(); i++) {
+        const Shard& shard = shards_[i];
+        fprintf(out, "Shard %zu (pid %d): %zu mappings%s\n", i + 1,
+            static_cast<int>(shard.pid), shard.mappings,
+            shard.alive ? "" : ", lost");
+    }
+}
+
+bool ShardSupervisor::Spawn() const {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        return false;
+    }
+
+    const pid_t parent = ::getpid();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        ::close(fds[0]);
+        // Other helpers watch for their sockets to close, so we must not
+        // hold a copy of them.
+        for (const auto& shard : shards_) {
+            if (shard.fd >= 0) {
+                ::close(shard.fd);
+            }
+        }
+
+        // Exit along with the supervisor, even if the socket is somehow
+        // kept open.
+        ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (::getppid() != parent) {
+            _exit(0);
+        }
+
+        if (helper_binary_.empty()) {
+            _exit(RunShardHelper(fds[1]));
+        }
+
+        // Exec for a fresh address space, free of our mappings.
+        ::fcntl(fds[1], F_SETFD, 0);
+        const std::string arg = "--shard-helper=" + std::to_string(fds[1]);
+        ::execl(helper_binary_.c_str(), helper_binary_.c_str(), arg.c_str(),
+            static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    ::close(fds[1]);
+
+    Shard shard;
+    shard.pid = pid;
+    shard.fd = fds[0];
+    shard.mappings = 0;
+    shard.alive = true;
+    shards_.push_back(shard);
+    return true;
+}
+
+MLocker::Mapping ShardSupervisor::Delegate(
+        uint32_t index, const std::string& path) const {
+    Shard& shard = shards_[index - 1];
+
+    std::string buf(sizeof(Request), '\0');
+    Request request;
+    request.op = kLock;
+    request.path_length = static_cast<uint32_t>(path.size());
+    request.addr = 0;
+    request.size = 0;
+    memcpy(&buf[0], &request, sizeof(request));
+    buf += path;
+
+    Reply reply;
+    ssize_t received = -1;
+    if (Send(shard.fd, buf.data(), buf.size())) {
+        received = Receive(shard.fd, &reply, sizeof(reply), reply_timeout_);
+    }
+    if (received != sizeof(reply)) {
+        const bool timed_out = received < 0 && errno == ETIMEDOUT;
+        Abandon(&shard);
+        if (timed_out) {
+            throw std::system_error(ETIMEDOUT, std::generic_category(),
+                "Unable to mmap:  Helper " + std::to_string(index) +
+                " timed out locking " + path);
+        }
+        throw std::system_error(EPIPE, std::generic_category(),
+            "Unable to mmap:  Helper " + std::to_string(index) +
+            " is not responding");
+    }
+
+    if (reply.status != kOk) {
+        // Failures in a helper are reported as they would be locally.
+        throw std::system_error(reply.error, std::generic_category(),
+            "Unable to lock " + path + " in helper " +
+            std::to_string(index));
+    }
+
+    Mapping mapping;
+    mapping.addr = reinterpret_cast<void*>(reply.addr);
+    mapping.size = reply.size;
+    mapping.shard = index;
+    if (mapping.addr != nullptr) {
+        shard.mappings++;
+    }
+    return mapping;
+}
+
+void ShardSupervisor::Abandon(Shard* shard) const {
+    // A helper blocked on a hung device may not exit until its I/O
+    // completes, so we don't wait for it here; see ~ShardSupervisor.
+    ::kill(shard->pid, SIGKILL);
+    ::close(shard->fd);
+    shard->fd = -1;
+    shard->alive = false;
+}
+
+int RunShardHelper(int fd) {
+    MLocker mlocker;
+
+    std::vector<char> buf(sizeof(Request) + PATH_MAX);
+    while (true) {
+        const ssize_t size = Receive(fd, buf.data(), buf.size());
+        if (size < static_cast<ssize_t>(sizeof(Request))) {
+            // The supervisor has gone away (or misbehaved).  Exiting releases
+            // our shard.
+            return size == 0 ? 0 : 1;
+        }
+
+        Request request;
+        memcpy(&request, buf.data(), sizeof(request));
+
+        Reply reply;
+        reply.status = kOk;
+        reply.error = 0;
+        reply.addr = 0;
+        reply.size = 0;
+
+        if (request.op == kLock) {
+            const size_t length = std::min<size_t>(
+                request.path_length, size - sizeof(Request));
+            const std::string path(buf.data() + sizeof(Request), length);
+            try {
+                const MLocker::Mapping mapping = mlocker.LockMapping(path);
+                reply.addr = reinterpret_cast<uintptr_t>(mapping.addr);
+                reply.size = mapping.size;
+            } catch (std::system_error& ex) {
+                reply.status = kFailed;
+                reply.error = ex.code().value();
+            }
+        } else if (request.op == kUnlock) {
+            MLocker::Mapping mapping;
+            mapping.addr = reinterpret_cast<void*>(request.addr);
+            mapping.size = request.size;
+            mlocker.Unlock(mapping);
+        }
+
+        if (!Send(fd, &reply, sizeof(reply))) {
+            return 1;
+        }
+    }
+}
+
+}  // namespace file_binder
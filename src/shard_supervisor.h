@@ -0,0 +1,112 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__SHARD_SUPERVISOR_H__
+#define __FILE_BINDER__SHARD_SUPERVISOR_H__
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mlocker.h"
+
+namespace file_binder {
+
+// ShardSupervisor locks files while staying within vm.max_map_count.  Each
+// locked file costs a VMA, so once this process nears the limit, further
+// mappings are delegated to helper processes, each of which holds a shard of
+// the lock set in its own address space.  Helpers exit, releasing their
+// shard, when the supervisor goes away.
+class ShardSupervisor : public MLocker {
+public:
+    // Helpers are started by executing helper_binary with
+    // "--shard-helper=<fd>", which must call RunShardHelper.  If helper_binary
+    // is empty, helpers are forked without exec, inheriting our mappings; this
+    // is only suitable for tests.
+    //
+    // vma_limit is the number of VMAs available to each process, or 0 to use
+    // vm.max_map_count.  headroom VMAs are left unused in each process for
+    // its heap, stacks and libraries.
+    ShardSupervisor(
+        std::string helper_binary, size_t vma_limit = 0,
+        size_t headroom = 1024);
+    ~ShardSupervisor() override;
+
+    // Locks path in this process or, if we are out of VMAs, in a helper.
+    Mapping LockMapping(const std::string& path) const override;
+
+    void Unlock(const Mapping& mapping) const override;
+
+    // How long to wait for a helper to reply to each request from here on,
+    // or zero (the default) to wait indefinitely.  A helper which misses it
+    // is presumed stuck on a hung device and killed, losing its shard, and
+    // the request fails with ETIMEDOUT.
+    void set_reply_timeout(std::chrono::milliseconds timeout) {
+        reply_timeout_ = timeout;
+    }
+
+    // The number of helpers started.
+    size_t shards() const { return shards_.size(); }
+
+    // The pids of the helpers which are still running.
+    std::vector<pid_t> helpers() const;
+
+    // The number of locked mappings held by shard, where 0 is this process.
+    size_t mappings(uint32_t shard) const;
+
+    void PrintReport(FILE* out) const;
+private:
+    struct Shard {
+        pid_t pid;
+        // -1 once the helper is abandoned.
+        int fd;
+        size_t mappings;
+        // False once the helper has exited or stopped responding.
+        bool alive;
+    };
+
+    // Starts a new helper, returning false on failure.
+    bool Spawn() const;
+
+    // Sends a request to shard and waits for its reply.
+    Mapping Delegate(uint32_t shard, const std::string& path) const;
+
+    // Kills the helper of shard and stops using it.
+    void Abandon(Shard* shard) const;
+
+    const std::string helper_binary_;
+    // The number of mappings each process may hold.
+    size_t budget_;
+    std::chrono::milliseconds reply_timeout_;
+
+    // These are updated from our const MLocker interface.
+    mutable size_t local_mappings_;
+    mutable std::vector<Shard> shards_;
+};
+
+// Services lock requests from a ShardSupervisor on fd until it is closed.
+int RunShardHelper(int fd);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__SHARD_SUPERVISOR_H__
@@ -0,0 +1,143 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shard_supervisor.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <system_error>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+size_t CountMappings() {
+    std::ifstream in("/proc/self/maps");
+    size_t count = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        count++;
+    }
+    return count;
+}
+
+TEST(ShardSupervisor, Shards) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 5; i++) {
+        char name[] = "/tmp/shard_supervisor.XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(5, write(fd, "hello", 5));
+        close(fd);
+        names.push_back(name);
+    }
+
+    {
+        // Allow each process two mappings beyond those it already has.
+        ShardSupervisor supervisor("", CountMappings() + 2, 0);
+
+        std::vector<MLocker::Mapping> mappings;
+        for (const auto& name : names) {
+            mappings.push_back(supervisor.LockMapping(name));
+            EXPECT_NE(nullptr, mappings.back().addr);
+            EXPECT_EQ(5, mappings.back().size);
+        }
+
+        EXPECT_EQ(0, mappings[0].shard);
+        EXPECT_EQ(0, mappings[1].shard);
+        EXPECT_EQ(1, mappings[2].shard);
+        EXPECT_EQ(1, mappings[3].shard);
+        EXPECT_EQ(2, mappings[4].shard);
+
+        EXPECT_EQ(2, supervisor.shards());
+        EXPECT_EQ(2, supervisor.mappings(0));
+        EXPECT_EQ(2, supervisor.mappings(1));
+        EXPECT_EQ(1, supervisor.mappings(2));
+
+        // Failures in a helper are reported as they would be locally.
+        try {
+            supervisor.LockMapping("/nonexistent/file");
+            ADD_FAILURE() << "Locked a nonexistent file";
+        } catch (const std::system_error& ex) {
+            EXPECT_EQ(ENOENT, ex.code().value());
+        }
+
+        for (const auto& mapping : mappings) {
+            supervisor.Unlock(mapping);
+        }
+        EXPECT_EQ(0, supervisor.mappings(0));
+        EXPECT_EQ(0, supervisor.mappings(1));
+        EXPECT_EQ(0, supervisor.mappings(2));
+    }
+
+    for (const auto& name : names) {
+        ::unlink(name.c_str());
+    }
+}
+
+TEST(ShardSupervisor, ReplyTimeout) {
+    char name[] = "/tmp/shard_supervisor.XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(5, write(fd, "hello", 5));
+    close(fd);
+
+    // Opening a FIFO blocks until a writer arrives, standing in for a hung
+    // device.
+    const std::string fifo = std::string(name) + ".fifo";
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+
+    {
+        // Allow this process one mapping, so that the rest are delegated.
+        ShardSupervisor supervisor("", CountMappings() + 1, 0);
+        supervisor.set_reply_timeout(std::chrono::milliseconds(100));
+
+        const MLocker::Mapping local = supervisor.LockMapping(name);
+        EXPECT_EQ(0, local.shard);
+
+        try {
+            supervisor.LockMapping(fifo);
+            ADD_FAILURE() << "Locked a FIFO";
+        } catch (const std::system_error& ex) {
+            EXPECT_EQ(ETIMEDOUT, ex.code().value());
+        }
+        EXPECT_EQ(1, supervisor.shards());
+        EXPECT_TRUE(supervisor.helpers().empty());
+
+        // The stuck helper is replaced.
+        const MLocker::Mapping delegated = supervisor.LockMapping(name);
+        EXPECT_EQ(2, delegated.shard);
+        EXPECT_EQ(1, supervisor.helpers().size());
+
+        supervisor.Unlock(delegated);
+        supervisor.Unlock(local);
+    }
+
+    ::unlink(fifo.c_str());
+    ::unlink(name);
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,171 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shebang.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace file_binder {
+namespace {
+
+bool IsBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+std::vector<std::string> SplitWords(const std::string& s) {
+    std::vector<std::string> words;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        while (pos < s.size() && IsBlank(s[pos])) {
+            pos++;
+        }
+
+        size_t end = pos;
+        while (end < s.size() && !IsBlank(s[end])) {
+            end++;
+        }
+
+        if (end > pos) {
+            words.emplace_back(s, pos, end - pos);
+        }
+        pos = end;
+    }
+    return words;
+}
+
+bool IsEnv(const std::string& interpreter) {
+    const size_t slash = interpreter.rfind('/');
+    const std::string base = slash == std::string::npos ?
+        interpreter : interpreter.substr(slash + 1);
+    return base == "env";
+}
+
+}  // namespace
+
+bool ParseShebang(const char* data, size_t size, Shebang* shebang) {
+    size = std::min(size, kShebangMaxLength);
+    if (size < 2 || data[0] != '#' || data[1] != '!') {
+        return false;
+    }
+
+    const char* end = std::find(data + 2, data + size, '\n');
+    if (end == data + size && size == kShebangMaxLength) {
+        // The line was truncated.  Newer kernels refuse to exec these rather
+        // than silently using a truncated interpreter path.
+        return false;
+    }
+
+    const char* p = data + 2;
+    while (p < end && IsBlank(*p)) {
+        p++;
+    }
+    const char* interpreter_end = p;
+    while (interpreter_end < end && !IsBlank(*interpreter_end) &&
+            *interpreter_end != '\r' && *interpreter_end != '\0') {
+        interpreter_end++;
+    }
+    if (interpreter_end == p) {
+        return false;
+    }
+
+    const char* arg = interpreter_end;
+    while (arg < end && IsBlank(*arg)) {
+        arg++;
+    }
+    const char* arg_end = end;
+    while (arg_end > arg && (IsBlank(arg_end[-1]) || arg_end[-1] == '\r')) {
+        arg_end--;
+    }
+
+    shebang->interpreter.assign(p, interpreter_end);
+    shebang->argument.assign(arg, arg_end);
+    return true;
+}
+
+std::vector<std::string> ResolveShebang(
+        const Shebang& shebang, const std::string& search_path) {
+    std::vector<std::string> ret;
+    ret.push_back(shebang.interpreter);
+
+    if (!IsEnv(shebang.interpreter)) {
+        return ret;
+    }
+
+    // Skip over env's options and environment assignments to find the
+    // command.  -S splits the argument on whitespace for us, which we already
+    // do unconditionally.
+    const std::vector<std::string> words = SplitWords(shebang.argument);
+    for (size_t i = 0; i < words.size(); i++) {
+        const std::string& word = words[i];
+        if (word == "-u" || word == "-C" || word == "--unset" ||
+                word == "--chdir") {
+            // Skip the option's value.
+            i++;
+            continue;
+        } else if (word[0] == '-' || word.find('=') != std::string::npos) {
+            continue;
+        }
+
+        std::string resolved;
+        if (word.find('/') != std::string::npos) {
+            ret.push_back(word);
+        } else if (FindInPath(word, search_path, &resolved)) {
+            ret.push_back(std::move(resolved));
+        }
+        break;
+    }
+
+    return ret;
+}
+
+bool FindInPath(
+        const std::string& name, const std::string& search_path,
+        std::string* resolved) {
+    size_t pos = 0;
+    while (pos <= search_path.size()) {
+        size_t end = search_path.find(':', pos);
+        if (end == std::string::npos) {
+            end = search_path.size();
+        }
+
+        // An empty entry refers to the current directory, which is not
+        // meaningful for a daemon.
+        if (end > pos) {
+            std::string candidate = search_path.substr(pos, end - pos);
+            candidate += "/";
+            candidate += name;
+
+            struct stat buf;
+            if (::stat(candidate.c_str(), &buf) == 0 &&
+                    S_ISREG(buf.st_mode) && (buf.st_mode & 0111) != 0) {
+                *resolved = std::move(candidate);
+                return true;
+            }
+        }
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,58 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__SHEBANG_H__
+#define __FILE_BINDER__SHEBANG_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+
+// The kernel only examines this many bytes of a script for its "#!" line
+// (BINPRM_BUF_SIZE).
+constexpr size_t kShebangMaxLength = 256;
+
+struct Shebang {
+    // The interpreter named by the script, e.g. "/bin/sh" or "/usr/bin/env".
+    std::string interpreter;
+    // The optional argument following the interpreter.  As with the kernel,
+    // this is not split on whitespace.
+    std::string argument;
+};
+
+// Parses the "#!" line found in the first size bytes of a file.  It returns
+// false if data does not start with a well-formed interpreter line.
+bool ParseShebang(const char* data, size_t size, Shebang* shebang);
+
+// Returns the executables a script depends on:  The interpreter, and for
+// "/usr/bin/env foo"-style scripts, foo as resolved through search_path (a
+// colon-separated list of directories, as in PATH).
+std::vector<std::string> ResolveShebang(
+    const Shebang& shebang, const std::string& search_path);
+
+// Searches the colon-separated directories of search_path for an executable
+// named name.  It returns false if none was found.
+bool FindInPath(
+    const std::string& name, const std::string& search_path,
+    std::string* resolved);
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__SHEBANG_H__
@@ -0,0 +1,98 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shebang.h"
+#include "temp_tree.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+bool Parse(const std::string& s, Shebang* shebang) {
+    return ParseShebang(s.data(), s.size(), shebang);
+}
+
+TEST(Shebang, Parse) {
+    Shebang shebang;
+
+    ASSERT_TRUE(Parse("#!/bin/sh\necho hello\n", &shebang));
+    EXPECT_EQ("/bin/sh", shebang.interpreter);
+    EXPECT_EQ("", shebang.argument);
+
+    ASSERT_TRUE(Parse("#! /usr/bin/python3 -u  \r\nimport os\n", &shebang));
+    EXPECT_EQ("/usr/bin/python3", shebang.interpreter);
+    EXPECT_EQ("-u", shebang.argument);
+
+    // The argument is not split.
+    ASSERT_TRUE(Parse("#!/usr/bin/env -S python3 -u", &shebang));
+    EXPECT_EQ("/usr/bin/env", shebang.interpreter);
+    EXPECT_EQ("-S python3 -u", shebang.argument);
+
+    EXPECT_FALSE(Parse("", &shebang));
+    EXPECT_FALSE(Parse("#", &shebang));
+    EXPECT_FALSE(Parse("#!\n", &shebang));
+    EXPECT_FALSE(Parse("\x7f" "ELF", &shebang));
+    EXPECT_FALSE(Parse("#!/" + std::string(kShebangMaxLength, 'a'), &shebang));
+}
+
+TEST(Shebang, Resolve) {
+    TempTree tree("shebang");
+    ASSERT_FALSE(tree.root().empty());
+    const std::string dir = tree.root();
+
+    const std::string python = tree.Path("python3");
+    const std::string data = tree.Path("data");
+    ASSERT_TRUE(WriteFile(python, "", 0755));
+    ASSERT_TRUE(WriteFile(data, ""));
+
+    const std::string search_path = std::string("/nonexistent::") + dir;
+
+    std::string resolved;
+    EXPECT_TRUE(FindInPath("python3", search_path, &resolved));
+    EXPECT_EQ(python, resolved);
+    // Non-executable files are skipped.
+    EXPECT_FALSE(FindInPath("data", search_path, &resolved));
+
+    Shebang shebang;
+    shebang.interpreter = "/bin/sh";
+    EXPECT_EQ(std::vector<std::string>({"/bin/sh"}),
+        ResolveShebang(shebang, search_path));
+
+    shebang.interpreter = "/usr/bin/env";
+    shebang.argument = "python3";
+    EXPECT_EQ(std::vector<std::string>({"/usr/bin/env", python}),
+        ResolveShebang(shebang, search_path));
+
+    shebang.argument = "-S -u HOME LANG=C python3 -u";
+    EXPECT_EQ(std::vector<std::string>({"/usr/bin/env", python}),
+        ResolveShebang(shebang, search_path));
+
+    shebang.argument = "/opt/bin/tool";
+    EXPECT_EQ(std::vector<std::string>({"/usr/bin/env", "/opt/bin/tool"}),
+        ResolveShebang(shebang, search_path));
+
+    shebang.argument = "missing";
+    EXPECT_EQ(std::vector<std::string>({"/usr/bin/env"}),
+        ResolveShebang(shebang, search_path));
+}
+
+}  // namespace
+}  // namespace file_binder
@@ -0,0 +1,100 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "temp_tree.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+int RemoveEntry(const char* path, const struct stat* buf, int type,
+        struct FTW* ftw) {
+    (void) buf;
+    (void) type;
+    (void) ftw;
+
+    // Keep going, so one stubborn entry does not leave the rest behind.
+    ::remove(path);
+    return 0;
+}
+
+}  // namespace
+
+bool RemoveTree(const std::string& path) {
+    nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+    return access(path.c_str(), F_OK) != 0;
+}
+
+bool WriteFile(const std::string& path, const std::string& contents,
+        mode_t mode) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    const bool written =
+        fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+    if (fclose(f) != 0 || !written) {
+        return false;
+    }
+    return chmod(path.c_str(), mode) == 0;
+}
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+TempTree::TempTree(const std::string& prefix, const std::string& parent) {
+    std::string pattern = parent + "/" + prefix + ".XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (mkdtemp(name.data())) {
+        root_ = name.data();
+    }
+}
+
+TempTree::~TempTree() {
+    if (!root_.empty()) {
+        RemoveTree(root_);
+    }
+}
+
+std::string TempTree::Path(const std::string& relative) const {
+    return root_ + "/" + relative;
+}
+
+bool TempTree::MakeDirectory(const std::string& relative) const {
+    return mkdir(Path(relative).c_str(), 0755) == 0;
+}
+
+bool TempTree::Write(const std::string& relative, const std::string& contents,
+        mode_t mode) const {
+    return WriteFile(Path(relative), contents, mode);
+}
+
+}  // namespace file_binder
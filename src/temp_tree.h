@@ -0,0 +1,58 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __FILE_BINDER__TEMP_TREE_H__
+#define __FILE_BINDER__TEMP_TREE_H__
+
+#include <sys/types.h>
+
+#include <string>
+
+namespace file_binder {
+
+// Removes path and everything below it, without following symlinks.
+bool RemoveTree(const std::string& path);
+
+bool WriteFile(const std::string& path, const std::string& contents,
+    mode_t mode = 0644);
+
+std::string ReadFile(const std::string& path);
+
+// A temporary directory for tests, removed with its contents on
+// destruction.  root() is empty if it could not be created.
+class TempTree {
+public:
+    explicit TempTree(const std::string& prefix,
+        const std::string& parent = "/tmp");
+    ~TempTree();
+
+    const std::string& root() const { return root_; }
+    std::string Path(const std::string& relative) const;
+
+    bool MakeDirectory(const std::string& relative) const;
+    bool Write(const std::string& relative, const std::string& contents,
+        mode_t mode = 0644) const;
+private:
+    TempTree(const TempTree&) = delete;
+    TempTree& operator=(const TempTree&) = delete;
+
+    std::string root_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__TEMP_TREE_H__
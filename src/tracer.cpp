@@ -0,0 +1,208 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracer.h"
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+
+namespace file_binder {
+namespace {
+
+const size_t kEventsPerChunk = 4096;
+const size_t kMaxChunks = Tracer::kMaxEvents / kEventsPerChunk;
+
+struct Chunk {
+    Tracer::Event events[kEventsPerChunk];
+};
+
+// Events are appended to a ring of chunks, allocated as the ring first
+// reaches them.  The owner publishes each event by incrementing head, and
+// the writer frees its slot by advancing tail past it.
+struct Buffer {
+    Buffer() {
+        for (auto& chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<Chunk*> chunks[kMaxChunks];
+    // The number of events appended and written (or discarded), and dropped,
+    // so far.
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    pid_t tid;
+    Buffer* next = nullptr;
+};
+
+// The buffers of every thread which has recorded an event.  Buffers are never
+// freed, as readers may be walking them, and a thread's buffer is kept when it
+// exits so that its events are still exported.
+std::atomic<Buffer*> buffers{nullptr};
+
+// Serializes the writers, which are each buffer's only consumer.
+std::mutex writer_mutex;
+
+const Tracer::Event& EventAt(const Buffer& buffer, uint64_t index) {
+    const Chunk* chunk = buffer.chunks[
+        (index / kEventsPerChunk) % kMaxChunks].load(
+            std::memory_order_relaxed);
+    return chunk->events[index % kEventsPerChunk];
+}
+
+Buffer* ThreadBuffer() {
+    static thread_local Buffer* buffer = nullptr;
+    if (buffer == nullptr) {
+        buffer = new Buffer();
+        buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+
+        Buffer* head = buffers.load(std::memory_order_relaxed);
+        do {
+            buffer->next = head;
+        } while (!buffers.compare_exchange_weak(
+            head, buffer, std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+    return buffer;
+}
+
+void WriteString(FILE* out, const std::string& s) {
+    fputc('"', out);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+}  // namespace
+
+constexpr size_t Tracer::kMaxEvents;
+
+std::atomic<bool> Tracer::enabled_(false);
+
+void Tracer::Enable() {
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::Disable() {
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void Tracer::Record(
+        const char* name, const std::string& detail, uint64_t begin,
+        uint64_t end) {
+    Buffer* buffer = ThreadBuffer();
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    if (head - buffer->tail.load(std::memory_order_acquire) == kMaxEvents) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // The chunk is published to the writer along with head.
+    std::atomic<Chunk*>& slot =
+        buffer->chunks[(head / kEventsPerChunk) % kMaxChunks];
+    Chunk* chunk = slot.load(std::memory_order_relaxed);
+    if (chunk == nullptr) {
+        chunk = new Chunk();
+        slot.store(chunk, std::memory_order_relaxed);
+    }
+
+    Event& event = chunk->events[head % kEventsPerChunk];
+    event.name = name;
+    event.detail = detail;
+    event.begin = begin;
+    event.duration = end - begin;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Tracer::AppendChromeTrace(FILE* out, bool* started) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const int pid = static_cast<int>(getpid());
+
+    if (!*started) {
+        fprintf(out, "[\n{\"name\":\"process_name\",\"ph\":\"M\","
+            "\"pid\":%d,\"args\":{\"name\":\"binder\"}}", pid);
+        *started = true;
+    }
+
+    for (Buffer* buffer = buffers.load(std::memory_order_acquire);
+            buffer != nullptr; buffer = buffer->next) {
+        const int tid = static_cast<int>(buffer->tid);
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        for (uint64_t i = buffer->tail.load(std::memory_order_relaxed);
+                i < head; i++) {
+            const Event& event = EventAt(*buffer, i);
+
+            // Timestamps are in microseconds.
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"binder\","
+                "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":%d",
+                event.name, event.begin / 1000., event.duration / 1000.,
+                pid, tid);
+            if (!event.detail.empty()) {
+                fputs(",\"args\":{\"detail\":", out);
+                WriteString(out, event.detail);
+                fputc('}', out);
+            }
+            fputc('}', out);
+        }
+        buffer->tail.store(head, std::memory_order_release);
+
+        const uint64_t dropped =
+            buffer->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            fprintf(out, ",\n{\"name\":\"dropped\",\"cat\":\"binder\","
+                "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":{\"events\":%llu}}",
+                Now() / 1000., pid, tid,
+                static_cast<unsigned long long>(dropped));
+        }
+    }
+
+    return fflush(out) == 0 && !ferror(out);
+}
+
+void Tracer::Clear() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    for (Buffer* buffer = buffers.load(std::memory_order_acquire);
+            buffer != nullptr; buffer = buffer->next) {
+        buffer->tail.store(
+            buffer->head.load(std::memory_order_acquire),
+            std::memory_order_release);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace file_binder
@@ -0,0 +1,117 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__TRACER_H__
+#define __FILE_BINDER__TRACER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace file_binder {
+
+// Tracer records timestamped spans of work, such as walking, parsing or
+// locking a file, and exports them as Chrome trace event JSON (viewable in
+// Perfetto or chrome://tracing).
+//
+// Each thread records into its own bounded ring without locking.  While
+// tracing is disabled, a span costs a single relaxed load and branch.
+class Tracer {
+public:
+    // Each thread holds at most this many events not yet written.  Events
+    // recorded while its ring is full are dropped, and counted.
+    static constexpr size_t kMaxEvents = 65536;
+
+    struct Event {
+        // The stage, which must be a string literal.
+        const char* name;
+        // Typically the file being worked on.
+        std::string detail;
+        // Start time and duration in nanoseconds.
+        uint64_t begin;
+        uint64_t duration;
+    };
+
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void Enable();
+    static void Disable();
+
+    // Returns a monotonic timestamp in nanoseconds.
+    static uint64_t Now();
+
+    // Appends an event to the calling thread's buffer.
+    static void Record(
+        const char* name, const std::string& detail, uint64_t begin,
+        uint64_t end);
+
+    // Appends every event recorded since the last write, from all threads,
+    // to a Chrome trace in the JSON array format, and discards them.  The
+    // array is opened by the first write (with *started false) and left
+    // unterminated, as trace viewers allow, so later writes can append to
+    // it.  It may run concurrently with Record, in which case events
+    // recorded during the write are left for the next one.  It returns
+    // false on I/O errors.
+    static bool AppendChromeTrace(FILE* out, bool* started);
+
+    // Discards every event recorded so far.
+    static void Clear();
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// TraceSpan records a span covering its own lifetime, if tracing is enabled.
+class TraceSpan {
+public:
+    // name must be a string literal.  detail is only copied if tracing is
+    // enabled.
+    explicit TraceSpan(const char* name) : name_(name), begin_(0) {
+        if (Tracer::enabled()) {
+            begin_ = Tracer::Now();
+        }
+    }
+
+    TraceSpan(const char* name, const std::string& detail) :
+            name_(name), begin_(0) {
+        if (Tracer::enabled()) {
+            detail_ = detail;
+            begin_ = Tracer::Now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (begin_ != 0) {
+            Tracer::Record(name_, detail_, begin_, Tracer::Now());
+        }
+    }
+private:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    const char* name_;
+    std::string detail_;
+    uint64_t begin_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__TRACER_H__
@@ -0,0 +1,158 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace file_binder {
+namespace {
+
+std::string Export() {
+    char* data = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&data, &size);
+    bool started = false;
+    EXPECT_TRUE(Tracer::AppendChromeTrace(out, &started));
+    EXPECT_TRUE(started);
+    fclose(out);
+
+    std::string ret(data, size);
+    free(data);
+    return ret;
+}
+
+size_t Count(const std::string& haystack, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos;
+            pos = haystack.find(needle, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST(Tracer, Disabled) {
+    Tracer::Clear();
+    Tracer::Disable();
+    {
+        TraceSpan span("walk", "/bin");
+    }
+    EXPECT_EQ(0, Count(Export(), "\"ph\":\"X\""));
+}
+
+TEST(Tracer, Spans) {
+    Tracer::Clear();
+    Tracer::Enable();
+    {
+        TraceSpan outer("walk", "/bin");
+        TraceSpan inner("parse", "/bin/\"quoted\"\n");
+    }
+    Tracer::Disable();
+
+    const std::string trace = Export();
+    EXPECT_EQ(0, trace.find("[\n{\"name\":\"process_name\""));
+    EXPECT_EQ(2, Count(trace, "\"ph\":\"X\""));
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"walk\""));
+    EXPECT_NE(std::string::npos,
+        trace.find("\"detail\":\"/bin/\\\"quoted\\\"\\u000a\""));
+}
+
+TEST(Tracer, Threads) {
+    Tracer::Clear();
+    Tracer::Enable();
+
+    // Enough events to span several chunks in each thread.
+    const int kEvents = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([]() {
+            for (int j = 0; j < kEvents; j++) {
+                TraceSpan span("lock");
+            }
+        });
+    }
+    // Exporting concurrently with recording is safe.
+    size_t exported = Count(Export(), "\"name\":\"lock\"");
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    Tracer::Disable();
+
+    exported += Count(Export(), "\"name\":\"lock\"");
+    EXPECT_EQ(4 * kEvents, exported);
+}
+
+TEST(Tracer, WritesOnce) {
+    Tracer::Clear();
+    Tracer::Enable();
+    {
+        TraceSpan span("walk", "/bin");
+    }
+    EXPECT_EQ(1, Count(Export(), "\"ph\":\"X\""));
+    EXPECT_EQ(0, Count(Export(), "\"ph\":\"X\""));
+
+    // Later writes append to the array.
+    char* data = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&data, &size);
+    bool started = true;
+    {
+        TraceSpan span("parse", "/bin/sh");
+    }
+    Tracer::Disable();
+    EXPECT_TRUE(Tracer::AppendChromeTrace(out, &started));
+    fclose(out);
+    EXPECT_EQ(0, std::string(data, size).find(",\n{\"name\":\"parse\""));
+    free(data);
+}
+
+TEST(Tracer, Bounded) {
+    Tracer::Clear();
+    Tracer::Enable();
+
+    // A fresh thread, so that its ring starts out empty.
+    std::thread thread([]() {
+        for (size_t i = 0; i < Tracer::kMaxEvents + 5; i++) {
+            TraceSpan span("lock");
+        }
+
+        const std::string trace = Export();
+        EXPECT_EQ(Tracer::kMaxEvents, Count(trace, "\"name\":\"lock\""));
+        EXPECT_NE(std::string::npos,
+            trace.find("\"name\":\"dropped\""));
+        EXPECT_NE(std::string::npos,
+            trace.find("\"args\":{\"events\":5}"));
+
+        // Writing the events made room for more.
+        {
+            TraceSpan span("lock");
+        }
+        EXPECT_EQ(1, Count(Export(), "\"name\":\"lock\""));
+    });
+    thread.join();
+    Tracer::Disable();
+}
+
+}  // namespace
+}  // namespace file_binder
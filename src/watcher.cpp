@@ -0,0 +1,111 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "watcher.h"
+
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace file_binder {
+namespace {
+
+// Changes which may replace the contents of a file within a directory.
+// Package managers and editors typically write a temporary file and rename it
+// into place, so watching the files themselves is insufficient.
+const uint32_t kMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+}  // namespace
+
+Watcher::Watcher() : fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+
+Watcher::~Watcher() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool Watcher::Add(const std::string& directory) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    int wd = inotify_add_watch(fd_, directory.c_str(), kMask);
+    if (wd < 0) {
+        return false;
+    }
+
+    directories_[wd] = directory;
+    return true;
+}
+
+std::vector<Watcher::Event> Watcher::Read() {
+    std::vector<Event> events;
+    if (fd_ < 0) {
+        return events;
+    }
+
+    alignas(struct inotify_event) char buf[4096];
+    while (true) {
+        ssize_t size = ::read(fd_, buf, sizeof(buf));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size <= 0) {
+            // EAGAIN:  We have drained the queue.
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < size; ) {
+            const struct inotify_event* ev =
+                reinterpret_cast<const struct inotify_event*>(buf + offset);
+            offset += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost.  Report it, with no directory.
+                Event event;
+                event.mask = ev->mask;
+                events.push_back(std::move(event));
+                continue;
+            }
+
+            auto it = directories_.find(ev->wd);
+            if (it == directories_.end()) {
+                continue;
+            }
+
+            Event event;
+            event.directory = it->second;
+            // name is padded with nulls to an alignment boundary.
+            if (ev->len > 0) {
+                event.name = ev->name;
+            }
+            event.mask = ev->mask;
+            events.push_back(std::move(event));
+
+            if (ev->mask & IN_IGNORED) {
+                // The watch was removed, e.g. because the directory was.
+                directories_.erase(it);
+            }
+        }
+    }
+
+    return events;
+}
+
+}  // namespace file_binder
@@ -0,0 +1,67 @@
+/**
+ * File Binder - A File Loading Utility
+ * (c) 2016-2017 Chris Kennelly <chris@ckennelly.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BINDER__WATCHER_H__
+#define __FILE_BINDER__WATCHER_H__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace file_binder {
+
+// Watcher wraps an inotify instance, watching directories for entries which
+// are created, replaced, modified or removed.
+class Watcher {
+public:
+    struct Event {
+        // The watched directory, or empty if the event queue overflowed
+        // (IN_Q_OVERFLOW) and events may have been lost.
+        std::string directory;
+        // The name of the affected entry within directory.  It is empty for
+        // events on the directory itself.
+        std::string name;
+        uint32_t mask;
+    };
+
+    Watcher();
+    virtual ~Watcher();
+
+    // Returns the inotify descriptor to poll for POLLIN, or -1 if inotify is
+    // unavailable.
+    int fd() const { return fd_; }
+
+    // Watches the directory at path.  It returns false on failure, for
+    // example when fs.inotify.max_user_watches is exhausted.
+    virtual bool Add(const std::string& directory);
+
+    // Reads all pending events without blocking.
+    virtual std::vector<Event> Read();
+private:
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    int fd_;
+    // Mapping of watch descriptors to the directories they watch.
+    std::unordered_map<int, std::string> directories_;
+};
+
+}  // namespace file_binder
+
+#endif  // __FILE_BINDER__WATCHER_H__